@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "Allocator.h"
+#include "Arithmetic.h"
+#include "Multiplication.h"
+#include "ThreadPool.h"
+
+static void benchmark(
+    const char * name,
+    unsigned int iterations,
+    const std::function<void ()>& body)
+{
+  kcalc::AllocationStatistics before = 
+    kcalc::GmpAllocator::statistics();
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned int i = 0; i < iterations; ++i)
+    body();
+  auto end = std::chrono::steady_clock::now();
+  kcalc::AllocationStatistics after = 
+    kcalc::GmpAllocator::statistics(); 
+  double nanos = std::chrono::duration<double, std::nano>(
+      end - start).count() / iterations;
+  std::cout << std::left << std::setw(32) << name 
+            << std::right << std::setw(14) << std::fixed 
+            << std::setprecision(1) << nanos << " ns/op" 
+            << std::setw(10) << std::setprecision(1)
+            << double(after.allocations - before.allocations) / iterations
+            << " allocs/op" << std::endl;
+}
+
+static std::string digits(unsigned int count, char first)
+{
+  std::string result(1, first);
+  for (unsigned int i = 1; i < count; ++i)
+    result.push_back('0' + (i * 7 + 3) % 10);
+  return result;
+}
+
+int main(int argc, char * argv[])
+{
+  kcalc::GmpAllocator::install();
+  unsigned int iterations = argc > 1 ? std::stoul(argv[1]) : 20000;
+  for (unsigned int size : { 20u, 200u, 2000u })
+  {
+    kcalc::ComplexNumber a(digits(size, '7') + ".25");
+    a += kcalc::ComplexNumber(digits(size, '3') + ".5i");
+    kcalc::ComplexNumber b(digits(size / 2, '9') + ".125");
+    b += kcalc::ComplexNumber(digits(size / 2, '4') + "i");
+    kcalc::ComplexNumber gaussian(digits(size, '5'));
+    gaussian += kcalc::ComplexNumber(digits(size, '6') + "i"); 
+    kcalc::ComplexNumber divisor(digits(size / 2, '8'));
+    divisor += kcalc::ComplexNumber(digits(size / 2, '2') + "i");  
+    kcalc::ComplexNumber real(digits(size / 2, '9') + ".125");
+
+    std::cout << "-- " << size << " digits" << std::endl;
+    benchmark("divide (rational)", iterations, [&]() {
+        kcalc::ComplexNumber copy(a);
+        copy /= b; });
+    benchmark("divide (gaussian integer)", iterations, [&]() {
+        kcalc::ComplexNumber copy(gaussian);
+        copy /= divisor; });
+    benchmark("divide (real divisor)", iterations, [&]() {
+        kcalc::ComplexNumber copy(a);
+        copy /= real; }); 
+    benchmark("inverse", iterations, [&]() {
+        kcalc::ComplexNumber copy(a);
+        copy.inverse(); });
+    benchmark("modulo", iterations, [&]() {
+        kcalc::ComplexNumber copy(a);
+        copy %= real; }); 
+    benchmark("floor", iterations, [&]() {
+        kcalc::ComplexNumber copy(a);
+        copy.floor(); });
+    benchmark("a * b + c * d (gaussian integer)", iterations, [&]() {
+        kcalc::ComplexNumber result = gaussian * divisor + divisor * divisor; });
+    benchmark("a * b + c * d (rational)", iterations, [&]() {
+        kcalc::ComplexNumber result = a * b + b * real; });
+    benchmark("copy (baseline)", iterations, [&]() {
+        kcalc::ComplexNumber copy(a); });
+  }
+  for (unsigned int size : { 1000u, 100000u, 1000000u })
+  {
+    std::string literal = digits(size, '1') + "." + digits(size / 4, '2');
+    std::cout << "-- literal of " << size << " digits" << std::endl;
+    benchmark("parse literal", 
+        std::max(1u, iterations / (size / 50)), [&]() {
+        kcalc::ComplexNumber number(literal); });
+  }
+  benchmark("parse 1e1000000 (scaled)", iterations, [&]() {
+      kcalc::ComplexNumber number("1e1000000"); });
+  kcalc::ComplexNumber power = kcalc::ComplexNumber(3) ^ 
+    kcalc::ComplexNumber(2000000);
+  std::cout << "-- 3^2000000, " 
+            << kcalc::ThreadPool::instance().concurrency() 
+            << " threads" << std::endl;
+  benchmark("to_string", 3, [&]() { power.to_string(); });
+  mpz_class factor;
+  mpz_ui_pow_ui(factor.get_mpz_t(), 7, 10000000);
+  for (unsigned int threads : { 1u, 2u, 4u })
+  {
+    kcalc::Multiplication::setThreads(threads);
+    std::string name = "multiply 8.4M digits, " + 
+      std::to_string(threads) + " tasks";
+    benchmark(name.c_str(), 3, [&]() {
+        mpz_class product;
+        kcalc::Multiplication::multiply(product.get_mpz_t(),
+            factor.get_mpz_t(), factor.get_mpz_t()); });
+  }
+  kcalc::Multiplication::setThreads(0);
+  return 0;
+}
@@ -0,0 +1,72 @@
+#include <chrono>
+#include <complex>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Allocator.h"
+#include "ColumnEvaluator.h"
+#include "ColumnKernels.h"
+#include "PreparedExpression.h"
+
+// Compares evaluating an expression row by row with the column
+// evaluator in exact and in double precision.
+//
+//   column_bench [rows] [expression]
+
+static void benchmark(const char * name, std::size_t rows,
+    const std::function<void ()>& body)
+{
+  auto start = std::chrono::steady_clock::now();
+  body();
+  double nanos = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / rows;
+  std::cout << std::left << std::setw(32) << name
+            << std::right << std::setw(14) << std::fixed
+            << std::setprecision(1) << nanos << " ns/row" << std::endl;
+}
+
+int main(int argc, char * argv[])
+{
+  kcalc::GmpAllocator::install();
+  std::size_t rows = argc > 1 ? std::stoul(argv[1]) : 200000;
+  std::string text = argc > 2 ? argv[2] : "x^3 - 2*x*y + y/3";
+  kcalc::ColumnEvaluator evaluator(text);
+  kcalc::PreparedExpression prepared =
+    kcalc::PreparedExpression::prepare(text);
+  const std::vector<std::string>& variables = evaluator.variables();
+
+  std::vector<std::vector<kcalc::ComplexNumber>> exact(variables.size());
+  std::vector<std::vector<double>> real(variables.size());
+  std::vector<const kcalc::ComplexNumber *> exactColumns;
+  std::vector<const double *> realColumns;
+  for (std::size_t column = 0; column < variables.size(); ++column)
+  {
+    for (std::size_t i = 0; i < rows; ++i)
+    {
+      long value = (i * (2 * column + 3) + column) % 1999 + 1;
+      exact[column].emplace_back(value);
+      real[column].push_back(value);
+    }
+    exactColumns.push_back(exact[column].data());
+    realColumns.push_back(real[column].data());
+  }
+
+  std::cout << "-- " << rows << " rows of " << text << ", "
+            << kcalc::ColumnKernels::best().name << " kernels"
+            << std::endl;
+  benchmark("row by row", rows, [&]() {
+      for (std::size_t i = 0; i < rows; ++i)
+      {
+        for (std::size_t column = 0; column < variables.size(); ++column)
+          prepared.bind(variables[column], exact[column][i]);
+        prepared.execute();
+      } });
+  benchmark("exact columns", rows, [&]() {
+      evaluator.evaluate(exactColumns, rows); });
+  benchmark("double columns", rows, [&]() {
+      evaluator.approximate(realColumns, rows); });
+  return 0;
+}
@@ -0,0 +1,128 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Server.h"
+
+// Load generator for kcalc --serve: every connection runs on its own
+// thread and keeps up to depth requests in flight.
+//
+//   server_load socket [connections] [requests] [depth] [statement]
+
+using Clock = std::chrono::steady_clock;
+
+static int connectTo(const char * path)
+{
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+  if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&address),
+        sizeof(address)) < 0)
+  {
+    std::perror(path);
+    std::exit(1);
+  }
+  return fd;
+}
+
+static void runConnection(
+    const char * path,
+    unsigned int requests,
+    unsigned int depth,
+    const std::string& statement,
+    kcalc::LatencyHistogram& latency,
+    unsigned long& errors)
+{
+  int fd = connectTo(path);
+  std::string request = statement + "\n";
+  std::deque<Clock::time_point> sent;
+  std::string input;
+  char buffer[1 << 16];
+  unsigned int issued = 0;
+  unsigned int answered = 0;
+  while (answered < requests)
+  {
+    std::string batch;
+    while (issued < requests && sent.size() < depth)
+    {
+      batch += request;
+      sent.push_back(Clock::now());
+      ++issued;
+    }
+    if (!batch.empty() &&
+        ::send(fd, batch.data(), batch.size(), MSG_NOSIGNAL) < 0)
+      break;
+    ssize_t count = ::recv(fd, buffer, sizeof(buffer), 0);
+    if (count <= 0)
+      break;
+    input.append(buffer, count);
+    Clock::time_point now = Clock::now();
+    std::size_t begin = 0, end;
+    while ((end = input.find('\n', begin)) != std::string::npos)
+    {
+      if (input.compare(begin, 2, "ok") != 0)
+        ++errors;
+      latency.record(std::chrono::duration<double, std::micro>(
+            now - sent.front()).count());
+      sent.pop_front();
+      ++answered;
+      begin = end + 1;
+    }
+    input.erase(0, begin);
+  }
+  ::close(fd);
+}
+
+int main(int argc, char ** argv)
+{
+  if (argc < 2)
+  {
+    std::cerr << "usage: server_load socket [connections] [requests] "
+      "[depth] [statement]" << std::endl;
+    return 2;
+  }
+  unsigned int connections = argc > 2 ? std::atoi(argv[2]) : 4;
+  unsigned int requests = argc > 3 ? std::atoi(argv[3]) : 10000;
+  unsigned int depth = argc > 4 ? std::atoi(argv[4]) : 16;
+  std::string statement = argc > 5 ? argv[5] : "3^1000 % 1000000007";
+  std::vector<kcalc::LatencyHistogram> latencies(connections);
+  std::vector<unsigned long> errors(connections);
+  std::vector<std::thread> threads;
+  auto start = Clock::now();
+  for (unsigned int i = 0; i < connections; ++i)
+    threads.emplace_back(runConnection, argv[1], requests,
+        std::max(1u, depth), std::cref(statement),
+        std::ref(latencies[i]), std::ref(errors[i]));
+  for (std::thread& thread : threads)
+    thread.join();
+  double seconds = std::chrono::duration<double>(
+      Clock::now() - start).count();
+  kcalc::LatencyHistogram total;
+  unsigned long failed = 0;
+  for (unsigned int i = 0; i < connections; ++i)
+  {
+    total.merge(latencies[i]);
+    failed += errors[i];
+  }
+  std::cout << std::fixed << std::setprecision(1)
+    << total.count() << " requests in " << seconds << " s, "
+    << total.count() / seconds << " requests/s, "
+    << failed << " errors\n"
+    << "latency mean " << total.mean() << " us, p50 "
+    << total.percentile(0.5) << " us, p99 "
+    << total.percentile(0.99) << " us, max " << total.max() << " us"
+    << std::endl;
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+#ifndef KCALC_ALLOCATOR_H
+#define KCALC_ALLOCATOR_H 
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace kcalc 
+{
+
+struct AllocationStatistics
+{
+  unsigned long allocations = 0;
+  unsigned long bytes = 0;
+  long long liveBytes = 0;
+  long long peakBytes = 0;
+};
+
+// Memory functions handed to GMP via mp_set_memory_functions. Small 
+// limb buffers are recycled through thread-local size-class pools; 
+// while a StatementArena is active on a thread, new buffers are 
+// carved out of the arena instead. install() must run before the
+// first GMP allocation, as GMP cannot free memory across allocators.
+class GmpAllocator
+{
+public:
+  static void install();
+  static bool installed();
+
+  // statistics of the calling thread
+  static AllocationStatistics statistics();
+  static void resetStatistics();
+
+  // allocations and bytes of all threads
+  static unsigned long totalAllocations();
+  static unsigned long totalBytes();
+};
+
+// Bump allocator for the GMP temporaries of a single statement. Frees
+// of arena blocks are no-ops, the whole arena is released at once by 
+// the destructor. Nothing allocated while the arena is active may 
+// outlive it, use an ArenaSuspension for allocations that do.
+class StatementArena
+{
+public:
+  StatementArena();
+  ~StatementArena();
+  StatementArena(const StatementArena&) = delete;
+  StatementArena& operator=(const StatementArena&) = delete;
+
+  void * allocate(std::size_t size);
+  bool owns(const void * ptr) const;
+  void release(std::size_t size);
+  std::size_t capacity() const;
+
+  StatementArena * previous() const
+  { return m_previous; }
+
+private:
+  struct Chunk
+  {
+    char * begin;
+    std::size_t size;
+  };
+
+  std::vector<Chunk> m_chunks;
+  char * m_current;
+  char * m_end;
+  std::size_t m_nextChunkSize;
+  std::size_t m_liveBytes;
+  StatementArena * m_previous;
+  StatementArena * m_previousAllocation;
+};
+
+class ArenaSuspension
+{
+public:
+  ArenaSuspension();
+  ~ArenaSuspension();
+  ArenaSuspension(const ArenaSuspension&) = delete;
+  ArenaSuspension& operator=(const ArenaSuspension&) = delete;
+
+private:
+  StatementArena * m_suspended;
+};
+
+// Limits of a single statement, zero for none.
+struct Budget
+{
+  // wall time
+  double seconds = 0;
+  // GMP memory allocated and not yet freed; arena blocks count until
+  // the arena is released
+  std::size_t bytes = 0;
+  // decimal digits of a power or product
+  unsigned long digits = 0;
+  // cancelled by StatementBudget::interrupt()
+  bool interruptible = false;
+  // cancels the statement once set, from any thread
+  const std::atomic<bool> * cancelled = nullptr;
+};
+
+// Enforces a Budget on the statement evaluated by the constructing 
+// thread and the pool tasks it forks (see TaskGroup). Powers and 
+// products whose estimated size exceeds the digits or the memory throw
+// a BudgetExceededException before they are computed. Evaluation loops
+// call checkpoint(), which throws once the memory or the time is 
+// exceeded and a CancelledException after an interrupt. The GMP 
+// memory functions only count: throwing through GMP leaves its 
+// objects in an undefined state, so a single GMP call may overrun the
+// memory. Memory allocated before the budget is not counted, neither 
+// when it is allocated nor when it is freed, only its growth. Without
+// a memory limit, the memory functions keep no account at all.
+class StatementBudget
+{
+public:
+  explicit StatementBudget(const Budget& budget);
+  ~StatementBudget();
+  StatementBudget(const StatementBudget&) = delete;
+  StatementBudget& operator=(const StatementBudget&) = delete;
+
+  // the budget of the calling thread, null if there is none
+  static StatementBudget * current();
+
+  // throws if a value of that many bits exceeds the current budget
+  static void checkSize(double bits);
+  // throws if the current statement is cancelled, over its memory
+  // or, every so many calls and after large allocations, out of time
+  static void checkpoint();
+
+  // cancels all interruptible statements, async-signal-safe
+  static void interrupt();
+  // called before an interruptible statement starts
+  static void clearInterrupt();
+  static bool interrupted();
+
+  // accounting of the GMP memory functions, which must not throw; 
+  // arena blocks count until the arena is released
+  void allocate(std::size_t size);
+  void release(std::size_t size);
+  // non-zero if the budget limits memory; its blocks outside arenas
+  // carry it, so that only they are released from the budget
+  std::uint64_t blockTag() const;
+
+  // makes budget the current one of the calling thread for its 
+  // lifetime
+  class Scope
+  {
+  public:
+    explicit Scope(StatementBudget * budget);
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    StatementBudget * m_previous;
+  };
+
+private:
+  void check(bool clock);
+
+  Budget m_budget;
+  std::chrono::steady_clock::time_point m_deadline;
+  std::atomic<long long> m_liveBytes;
+  std::uint64_t m_blockTag;
+  StatementBudget * m_previous;
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_ALLOCATOR_H  
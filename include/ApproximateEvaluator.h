@@ -0,0 +1,82 @@
+#ifndef KCALC_APPROXIMATE_EVALUATOR_H
+#define KCALC_APPROXIMATE_EVALUATOR_H
+
+#include <string>
+
+#include "Ast.h"
+#include "Ball.h"
+#include "FixedPoint.h"
+#include "Residue.h"
+#include "SymbolTable.h"
+
+namespace kcalc
+{
+
+enum class Precision : unsigned short
+{
+  Exact = 0u,
+  Double = 1u,
+  LongDouble = 2u,
+  // GMP floats with a chosen number of bits
+  Float = 3u,
+  // balls with midpoints of a chosen number of bits, see Ball
+  Ball = 4u,
+  // decimals with a chosen number of places, see FixedPoint
+  Decimal = 5u,
+  // residues modulo a prime, see Residue
+  Modular = 6u
+};
+
+struct Approximation
+{
+  Precision precision = Precision::Exact;
+  unsigned long bits = 256;
+  // ball results with fewer correct digits throw a
+  // PrecisionLossException, to be evaluated exactly instead; 0 prints
+  // any result
+  unsigned int minimumDigits = 0;
+  // places of decimal results
+  unsigned int places = 2;
+  // the prime of modular results
+  mpz_class modulus = 0;
+};
+
+// Evaluates expressions in floating point instead of exact rationals,
+// variables take the value of their expression in the same precision.
+// Unlike in exact arithmetic, double and long double allow rational
+// and complex exponents, overflowing values become inf. Division by
+// zero and the modulo of a complex divisor are errors as in exact
+// arithmetic.
+//
+// Balls print only digits that are correct; operations they cannot
+// decide, like floor for a modulo close to an integer quotient, throw
+// a PrecisionLossException.
+//
+// Decimals print all their places in positional notation; their
+// exponents have to be integers as in exact arithmetic.
+//
+// Residues are reduced on entry and after every operation, so their
+// size stays bounded. Complex residues are pairs of residues, divisors
+// with a norm of zero are a division by zero. Exponents are evaluated
+// exactly, remainders of residues throw a ModuloResidueException.
+class ApproximateEvaluator
+{
+public:
+  explicit ApproximateEvaluator(const Approximation& approximation);
+
+  // the value in scientific notation with the significant digits of
+  // the precision; throws an UnboundVariableException for variables
+  // without a value
+  std::string evaluate(const Expression& expression,
+      const SymbolTable& symbolTable) const;
+
+  // significant digits of the results, the places for decimals
+  unsigned int digits() const;
+
+private:
+  Approximation m_approximation;
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_APPROXIMATE_EVALUATOR_H
@@ -3,11 +3,35 @@
 
 #include <gmpxx.h>
 
+#include <cassert>
+#include <complex>
+#include <optional>
+#include <ostream>
+#include <vector>
+
 #include "Exceptions.h"
 
 namespace kcalc 
 {
 
+class ComplexNumber;
+
+enum class DisplayMode : unsigned short
+{
+  Full = 0u,
+  Truncated = 1u,
+  Scientific = 2u
+};
+
+// Truncated shows the leading and trailing `digits` digits of longer
+// integers plus their digit count, Scientific `digits` significant 
+// digits computed from the top limbs only.
+struct DisplayFormat
+{
+  DisplayMode mode = DisplayMode::Full;
+  unsigned int digits = 20;
+};
+
 class ComplexNumber
 {
 public:
@@ -16,18 +40,86 @@ public:
   ComplexNumber(
       const long real,
       const long imag = 0) :
-    m_real{real}, m_imaginary{imag}
+    m_real{real}, m_imaginary{imag}, m_scale{0}
+  { }
+  ComplexNumber(
+      const mpq_class& real,
+      const mpq_class& imag) :
+    m_real{real}, m_imaginary{imag}, m_scale{0}
   { }
   ComplexNumber(
       const ComplexNumber&) = default;
   ComplexNumber(
       ComplexNumber&&) = default; 
+  ComplexNumber& operator=(
+      const ComplexNumber&) = default;
+  ComplexNumber& operator=(
+      ComplexNumber&&) = default;
 
   bool isPure() const
   { return m_real == 0 || m_imaginary == 0; }   
 
+  bool isInteger() const
+  { 
+    if (m_imaginary != 0)
+      return false;
+    // a positive scale can still cancel a denominator
+    if (m_scale < 0 || (m_scale > 0 && m_real.get_den() != 1))
+      return ComplexNumber(*this).normalize().isInteger();
+    return m_real.get_den() == 1; 
+  }
+
+  bool isGaussianInteger() const
+  { 
+    if (m_scale < 0 || (m_scale > 0 && !hasIntegerParts()))
+      return ComplexNumber(*this).normalize().isGaussianInteger();
+    return hasIntegerParts();
+  }
+
+  // approximate size of the digits of both parts, in bits
+  double bitSize() const;
+
+  // both parts rounded to double precision
+  std::complex<double> approximate() const;
+
+  // both parts rounded to the precision of real and imaginary
+  void approximate(mpf_class& real, mpf_class& imaginary) const;
+
+  // the value if it is an integer in the range of long
+  std::optional<long> toLong() const;
+
+  bool isScaled() const
+  { return m_scale != 0; }
+
+  // the pending power of ten of the parts
+  long scale() const
+  { return m_scale; }
+
+  // the parts of a number without a pending scale, see normalize()
+  const mpq_class& real() const
+  { 
+    assert(!isScaled());
+    return m_real; 
+  }
+
+  const mpq_class& imaginary() const
+  { 
+    assert(!isScaled());
+    return m_imaginary; 
+  }
+
+  // the parts before the pending scale is applied
+  const mpq_class& realMantissa() const
+  { return m_real; }
+
+  const mpq_class& imaginaryMantissa() const
+  { return m_imaginary; }
+
   bool operator==(const ComplexNumber& number) const
   { 
+    if (m_scale != number.m_scale)
+      return ComplexNumber(*this).normalize() == 
+        ComplexNumber(number).normalize();
     return m_real == number.m_real && 
         m_imaginary == number.m_imaginary; 
   }
@@ -35,124 +127,199 @@ public:
   ComplexNumber& operator+=(
       const ComplexNumber& other)
   {
+    if (m_scale != other.m_scale)
+      return normalize() += ComplexNumber(other).normalize();
     m_real += other.m_real;
     m_imaginary += other.m_imaginary;
     return *this;
   }
 
   ComplexNumber operator+(
-      const ComplexNumber& other) const
+      const ComplexNumber& other) const &
   {
     ComplexNumber copy(*this);
     copy += other;
     return copy;
   }
 
+  ComplexNumber operator+(
+      const ComplexNumber& other) &&
+  {
+    *this += other;
+    return std::move(*this);
+  }
+
   ComplexNumber& operator-=(
       const ComplexNumber& other)
   {
+    if (m_scale != other.m_scale)
+      return normalize() -= ComplexNumber(other).normalize();
     m_real -= other.m_real;
     m_imaginary -= other.m_imaginary;
     return *this;
   } 
 
   ComplexNumber operator-(
-      const ComplexNumber& other) const
+      const ComplexNumber& other) const &
   {
     ComplexNumber copy(*this);
     copy -= other;
     return copy;
   } 
 
-  ComplexNumber& operator*=(
-      const ComplexNumber& other)
+  ComplexNumber operator-(
+      const ComplexNumber& other) &&
   {
-    mpq_class real = m_real * other.m_real
-      - m_imaginary * other.m_imaginary;
-    mpq_class imag = m_real * other.m_imaginary 
-      + m_imaginary * other.m_real;
-    m_real.swap(real);
-    m_imaginary.swap(imag);
-    return *this;
-  }
+    *this -= other;
+    return std::move(*this);
+  } 
+
+  ComplexNumber& operator*=(
+      const ComplexNumber& other);
 
   ComplexNumber operator*(
-      const ComplexNumber& other) const
+      const ComplexNumber& other) const &
   {
     ComplexNumber copy(*this);
     copy *= other;
     return copy;
   } 
 
-  ComplexNumber& operator/=(
-      const ComplexNumber& other)
+  ComplexNumber operator*(
+      const ComplexNumber& other) &&
   {
-    ComplexNumber copy(other);
-    *this *= copy.inverse();
-    return *this;
-  }
+    *this *= other;
+    return std::move(*this);
+  } 
+
+  ComplexNumber& operator/=(
+      const ComplexNumber& other);
 
   ComplexNumber operator/(
-      const ComplexNumber& other) const
+      const ComplexNumber& other) const &
   {
     ComplexNumber copy(*this);
     copy /= other;
     return copy;
   } 
 
-  ComplexNumber& operator%=(
-      const ComplexNumber& other)
+  ComplexNumber operator/(
+      const ComplexNumber& other) &&
   {
-    if (other.m_imaginary != 0)
-      throw ModuloComplexNumberException(__FILE__, __LINE__,
-          to_string(), other.to_string());
-    ComplexNumber copy(*this);
-    copy /= other;
-    copy.floor();
-    copy *= other;
-    *this -= copy;
-    return *this;
-  }  
+    *this /= other;
+    return std::move(*this);
+  } 
+
+  ComplexNumber& operator%=(
+      const ComplexNumber& other);
 
   ComplexNumber operator%(
-      const ComplexNumber& other) const
+      const ComplexNumber& other) const &
   {
     ComplexNumber copy(*this);
     copy %= other;
     return copy;
   } 
 
+  ComplexNumber operator%(
+      const ComplexNumber& other) &&
+  {
+    *this %= other;
+    return std::move(*this);
+  } 
+
   ComplexNumber& operator^=(
       const ComplexNumber& other);
 
   ComplexNumber operator^(
-      const ComplexNumber& other) const
+      const ComplexNumber& other) const &
   {
     ComplexNumber copy(*this);
     copy ^= other;
     return copy;
   } 
 
-  ComplexNumber& inverse() 
+  ComplexNumber operator^(
+      const ComplexNumber& other) &&
   {
-    mpq_class divisor = 
-      (m_real * m_real) + (m_imaginary * m_imaginary);
-    if (divisor == 0)
-      throw DivisionByZeroException(__FILE__, __LINE__);
-    m_real /= divisor;
-    m_imaginary /= - divisor;
+    *this ^= other;
+    return std::move(*this);
+  } 
+
+  // *this +/- left * right; Gaussian integers accumulate in place
+  // without a temporary product
+  ComplexNumber& addProduct(
+      const ComplexNumber& left,
+      const ComplexNumber& right);
+
+  ComplexNumber& subProduct(
+      const ComplexNumber& left,
+      const ComplexNumber& right);
+
+  bool canPowMod(
+      const ComplexNumber& exponent,
+      const ComplexNumber& modulus) const;
+
+  ComplexNumber& powMod(
+      const ComplexNumber& exponent,
+      const ComplexNumber& modulus);
+
+  ComplexNumber& negate()
+  {
+    mpq_neg(m_real.get_mpq_t(), m_real.get_mpq_t());
+    mpq_neg(m_imaginary.get_mpq_t(), m_imaginary.get_mpq_t());
     return *this;
   }
 
+  ComplexNumber& inverse();
+
+  // product of all factors along a balanced tree; the factors are 
+  // consumed
+  static ComplexNumber product(std::vector<ComplexNumber>& factors);
+
+  // sum of all terms by binary splitting over unreduced fractions,
+  // reduced once at the end; the terms are consumed
+  static ComplexNumber sum(std::vector<ComplexNumber>& terms);
+
+  // applies a pending power-of-ten scale to both parts
+  ComplexNumber& normalize();
+
   ComplexNumber& floor(); 
 
   std::string to_string() const;
 
+  std::string to_string(
+      const DisplayFormat& format) const;
+
+  // streams the digits, without building the whole string first
+  void write(std::ostream& out,
+      const DisplayFormat& format = DisplayFormat()) const;
+
 private:
   void binExp(unsigned long exponent); 
 
+  ComplexNumber& fusedProduct(
+      const ComplexNumber& left,
+      const ComplexNumber& right,
+      bool subtract);
+
+  bool hasIntegerParts() const
+  { 
+    return m_real.get_den() == 1 && 
+        m_imaginary.get_den() == 1; 
+  }
+
+  ComplexNumber& multiplyRaw(
+      const ComplexNumber& other);
+
+  ComplexNumber& divideRaw(
+      const ComplexNumber& other);
+
+  // value is (m_real + m_imaginary * i) * 10^m_scale; literals with
+  // large exponents keep it until their digits are needed
   mpq_class m_real;
   mpq_class m_imaginary; 
+  long m_scale;
 };
 
 } /* namespace kcalc */
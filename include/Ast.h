@@ -4,6 +4,7 @@
 #include <memory>
 #include <cassert>
 #include <ostream>
+#include <vector>
 
 #include "Arithmetic.h"
 #include "Visitor.h"
@@ -26,6 +27,7 @@ class SymbolTable;
 class AstObject
 {
 public:
+  virtual ~AstObject() = default;
   virtual void accept(Visitor& visitor)
   { }
   virtual std::string to_string() const = 0; 
@@ -235,6 +237,26 @@ public:
   std::unique_ptr<Expression> eval(SymbolTable&) const; 
 
 private:
+  std::unique_ptr<Expression> evalPowerModulo(
+      const ArithmeticExpression& power, 
+      SymbolTable& symbolTable) const;
+
+  std::unique_ptr<Expression> evalFusedProduct(
+      const ArithmeticExpression& product, 
+      SymbolTable& symbolTable) const;
+
+  // long left-deep chains of + and - or of * are evaluated as one 
+  // balanced sum or product; nullptr for short chains
+  std::unique_ptr<Expression> evalChain(
+      SymbolTable& symbolTable) const;
+
+  // evaluates both operands, the left one as a separate task if both
+  // are expensive enough
+  void evalOperands(
+      SymbolTable& symbolTable,
+      std::unique_ptr<Expression>& left, 
+      std::unique_ptr<Expression>& right) const;
+
   Operation   m_operation;
   std::unique_ptr<Expression> m_left;
   std::unique_ptr<Expression> m_right;
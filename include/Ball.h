@@ -0,0 +1,85 @@
+#ifndef KCALC_BALL_H
+#define KCALC_BALL_H
+
+#include <gmpxx.h>
+
+#include <optional>
+#include <string>
+
+namespace kcalc
+{
+
+// A real number as a midpoint and a radius, the exact value lies
+// within the ball around the midpoint. Midpoints are binary floats
+// with the precision of the ball, radii have a few bits only. Every
+// operation rounds its midpoint, adds a bound of the rounding error to
+// the radius and rounds the radius up, so the result holds the exact
+// value for all values of the operands within their balls.
+//
+// Operations whose result is not determined by the balls, like a
+// division by a ball containing zero, throw a PrecisionLossException.
+class Ball
+{
+public:
+  // mantissa * 2^exponent
+  struct Float
+  {
+    mpz_class mantissa;
+    long exponent = 0;
+  };
+
+  // value rounded to precision bits
+  Ball(long value, unsigned long precision);
+  Ball(const mpq_class& value, unsigned long precision);
+
+  static Ball powerOfTen(long exponent, unsigned long precision);
+
+  Ball operator-() const;
+  Ball operator+(const Ball& other) const;
+  Ball operator-(const Ball& other) const;
+  Ball operator*(const Ball& other) const;
+  // throws a DivisionByZeroException if other is zero
+  Ball operator/(const Ball& other) const;
+
+  // the ball is exactly value
+  bool operator==(long value) const;
+  bool operator!=(long value) const
+  { return !(*this == value); }
+
+  // -1 or 1 if all values of the ball are negative or positive, else 0
+  int sign() const;
+
+  bool isExact() const
+  { return m_radius.mantissa == 0; }
+
+  // exactly an integer
+  bool isInteger() const;
+
+  // the value of an exact integer in the range of long
+  std::optional<long> toLong() const;
+
+  friend Ball floor(const Ball& ball);
+
+  // the digits that are the same for all values of the ball when
+  // rounded, at most digits of them, in scientific notation like
+  // 1.25e-3; "[+/- r]" with a bound r of the magnitude if there are
+  // none
+  std::string to_string(unsigned int digits) const;
+
+  // the number of digits of to_string
+  unsigned int correctDigits(unsigned int digits) const;
+
+  unsigned long precision() const
+  { return m_precision; }
+
+private:
+  Ball(Float midpoint, Float radius, unsigned long precision);
+
+  Float m_midpoint;
+  Float m_radius;
+  unsigned long m_precision;
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_BALL_H
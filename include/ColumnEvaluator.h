@@ -0,0 +1,91 @@
+#ifndef KCALC_COLUMN_EVALUATOR_H
+#define KCALC_COLUMN_EVALUATOR_H
+
+#include <complex>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Arithmetic.h"
+#include "ThreadPool.h"
+
+namespace kcalc
+{
+
+// One expression evaluated for many rows of variable values. The
+// expression is compiled into a postfix program whose instructions
+// each process a block of rows, instead of walking the tree once per
+// row.
+//
+//   ColumnEvaluator evaluator("x^2 + 2*x*y");
+//   // columns in the order of evaluator.variables(), here x and y
+//   auto values = evaluator.approximate({x.data(), y.data()}, rows);
+class ColumnEvaluator
+{
+public:
+  // throws like PreparedExpression::prepare
+  explicit ColumnEvaluator(std::string_view text);
+
+  // variables the expression refers to, sorted; the columns passed to
+  // evaluate and approximate are in this order
+  const std::vector<std::string>& variables() const
+  { return m_variables; }
+
+  // exact values, with row blocks evaluated in parallel; throws the
+  // arithmetic exception of the first failing block
+  std::vector<ComplexNumber> evaluate(
+      const std::vector<const ComplexNumber *>& columns,
+      std::size_t rows,
+      ThreadPool& pool = ThreadPool::instance()) const;
+
+  // IEEE double precision with vector kernels, division by zero gives
+  // infinities or NaN; exponents other than integer constants go
+  // through std::pow, the modulus of a complex divisor is NaN
+  std::vector<std::complex<double>> approximate(
+      const std::vector<const double *>& columns,
+      std::size_t rows) const;
+
+  std::vector<std::complex<double>> approximateComplex(
+      const std::vector<const std::complex<double> *>& columns,
+      std::size_t rows) const;
+
+private:
+  enum class OpCode : unsigned char
+  {
+    Load,       // column operand
+    Constant,   // m_constants[operand]
+    Negate,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Modulo,
+    Power,
+    PowerInteger  // operand is a small constant exponent
+  };
+
+  struct Instruction
+  {
+    OpCode code;
+    long operand;
+  };
+
+  class Compiler;
+
+  void evaluateBlock(const std::vector<const ComplexNumber *>& columns,
+      std::size_t start, std::size_t count, ComplexNumber * result) const;
+
+  template<typename Load>
+  std::vector<std::complex<double>> approximateBlocks(std::size_t rows,
+      Load load) const;
+
+  std::vector<std::string> m_variables;
+  std::vector<Instruction> m_program;
+  std::vector<ComplexNumber> m_constants;
+  std::size_t m_depth;
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_COLUMN_EVALUATOR_H
@@ -0,0 +1,39 @@
+#ifndef KCALC_COLUMN_KERNELS_H
+#define KCALC_COLUMN_KERNELS_H
+
+#include <cstddef>
+
+namespace kcalc
+{
+
+// Element-wise arithmetic on columns of doubles, complex columns are
+// stored as separate arrays of real and imaginary parts. The outputs
+// may alias the inputs element by element.
+struct ColumnKernels
+{
+  using Unary = void (*)(const double * a, double * out, std::size_t n);
+  using Binary = void (*)(const double * a, const double * b,
+      double * out, std::size_t n);
+  using Complex = void (*)(const double * aReal, const double * aImag,
+      const double * bReal, const double * bImag,
+      double * outReal, double * outImag, std::size_t n);
+
+  const char * name;
+  Unary negate;
+  Binary add;
+  Binary subtract;
+  Binary multiply;
+  Binary divide;
+  Complex complexMultiply;
+  Complex complexDivide;
+
+  // plain loops, available everywhere
+  static const ColumnKernels& scalar();
+
+  // AVX2 if the processor has it, otherwise scalar()
+  static const ColumnKernels& best();
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_COLUMN_KERNELS_H
@@ -0,0 +1,44 @@
+#ifndef KCALC_COST_MODEL_H
+#define KCALC_COST_MODEL_H
+
+#include <unordered_map>
+
+namespace kcalc
+{
+
+class Expression;
+class SymbolTable;
+
+// Rough size of a value and work to compute it. Bits is the size of
+// the digits of the result, cost counts limb operations with
+// multiplication taken as n log n.
+struct CostEstimate
+{
+  double bits = 0;
+  double cost = 0;
+};
+
+// estimated cost of each node of an expression tree
+using SubtreeCosts = std::unordered_map<const Expression *, double>;
+
+class CostModel
+{
+public:
+  // estimate for evaluating expression, without evaluating anything;
+  // variables are looked up in symbolTable
+  static CostEstimate estimate(
+      const Expression& expression,
+      const SymbolTable& symbolTable);
+  // the same, also recording the cost of every subtree of expression
+  static CostEstimate estimate(
+      const Expression& expression,
+      const SymbolTable& symbolTable,
+      SubtreeCosts& subtrees);
+
+  // cost of a product with a result of the given size
+  static double multiplicationCost(double bits);
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_COST_MODEL_H
@@ -0,0 +1,81 @@
+#ifndef KCALC_CSV_MAP_H
+#define KCALC_CSV_MAP_H
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ColumnEvaluator.h"
+#include "ThreadPool.h"
+
+namespace kcalc
+{
+
+// One expression evaluated for every row of a CSV file, as done by
+// kcalc --map. The header row names the columns, those named like a
+// variable of the expression provide its values, the others are not
+// read. Fields may be quoted but must not contain line breaks.
+//
+// The rows are split into chunks evaluated in parallel with the
+// ColumnEvaluator; results are written in input order, one per row.
+// As text every result is a line, empty if the row failed. Raw output
+// is binary: exact values as the numerators and denominators of the
+// real and imaginary part in the format of mpz_out_raw, with all four
+// zero for a failed row; double values as two native doubles, NaN for
+// a failed row.
+class CsvMap
+{
+public:
+  enum class Output
+  {
+    Text,
+    Raw
+  };
+
+  struct Options
+  {
+    Output output = Output::Text;
+    // double precision instead of exact values
+    bool approximate = false;
+  };
+
+  // line of the input and message of a failed row
+  using ErrorHandler =
+    std::function<void (unsigned long line, const std::string& message)>;
+
+  // throws like PreparedExpression::prepare
+  CsvMap(std::string_view expression, const Options& options);
+
+  // returns the number of failed rows; throws an
+  // UnboundVariableException if the header has no column for a
+  // variable
+  unsigned long run(std::string_view input, std::ostream& out,
+      const ErrorHandler& error,
+      ThreadPool& pool = ThreadPool::instance()) const;
+
+private:
+  struct Chunk;
+
+  void process(Chunk& chunk, const std::vector<std::size_t>& fields,
+      ThreadPool& pool) const;
+
+  template<typename Value, typename Parse>
+  std::vector<std::vector<Value>> parse(Chunk& chunk,
+      const std::vector<std::size_t>& fields, Parse parseField) const;
+
+  void evaluate(Chunk& chunk,
+      const std::vector<std::vector<ComplexNumber>>& columns,
+      ThreadPool& pool) const;
+
+  void approximate(Chunk& chunk,
+      const std::vector<std::vector<std::complex<double>>>& columns) const;
+
+  ColumnEvaluator m_evaluator;
+  Options m_options;
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_CSV_MAP_H
@@ -15,7 +15,8 @@ enum ExceptionClass : unsigned int
 {
   ParserErrorClass     = 0u,
   SemanticErrorClass   = 1000u,
-  ArithmeticErrorClass = 2000u
+  ArithmeticErrorClass = 2000u,
+  InputErrorClass      = 3000u
 };
 
 enum class ExceptionKind : unsigned int
@@ -24,6 +25,15 @@ enum class ExceptionKind : unsigned int
   DivisionByZero = ExceptionClass::ArithmeticErrorClass + 1u, 
   ModuloComplexNumber = ExceptionClass::ArithmeticErrorClass + 2u,  
   PowerIllegalExponent =  ExceptionClass::ArithmeticErrorClass + 3u,   
+  PrecisionLoss = ExceptionClass::ArithmeticErrorClass + 4u,
+  ModuloResidue = ExceptionClass::ArithmeticErrorClass + 5u,
+  BudgetExceeded = ExceptionClass::ArithmeticErrorClass + 6u,
+  Cancelled = ExceptionClass::ArithmeticErrorClass + 7u,
+
+  UnboundVariable = ExceptionClass::SemanticErrorClass + 0u,
+  PreparedAssignment = ExceptionClass::SemanticErrorClass + 1u,
+
+  InvalidField = ExceptionClass::InputErrorClass + 0u,
 
   IllegalEndOfInput = ExceptionClass::ParserErrorClass + 0u,
   UnexpectedToken  = ExceptionClass::ParserErrorClass + 1u,
@@ -142,6 +152,154 @@ public:
 private:
 };  
 
+class PrecisionLossException : public Exception
+{
+public:
+  PrecisionLossException(
+      const char * file,
+      unsigned int line,
+      unsigned long precision) :
+    Exception(file, line), m_precision{precision}
+  { }
+  ExceptionClass exceptionClass() const override
+  { return ArithmeticErrorClass; }
+  ExceptionKind exceptionKind() const override
+  { return ExceptionKind::PrecisionLoss; }
+  std::string what() const override;
+  unsigned long precision() const
+  { return m_precision; }
+private:
+  unsigned long m_precision;
+};
+
+class ModuloResidueException : public Exception
+{
+public:
+  ModuloResidueException(
+      const char * file,
+      unsigned int line,
+      std::string modulus) :
+    Exception(file, line), m_modulus{modulus}
+  { }
+  ExceptionClass exceptionClass() const override
+  { return ArithmeticErrorClass; }
+  ExceptionKind exceptionKind() const override
+  { return ExceptionKind::ModuloResidue; }
+  std::string what() const override;
+  std::string modulus() const
+  { return m_modulus; }
+private:
+  std::string m_modulus;
+};
+
+class BudgetExceededException : public Exception
+{
+public:
+  enum Resource
+  {
+    Time = 0u,
+    Memory = 1u,
+    Digits = 2u
+  };
+
+  BudgetExceededException(
+      const char * file,
+      unsigned int line,
+      Resource resource,
+      std::string limit) :
+    Exception(file, line), m_resource{resource}, m_limit{limit}
+  { }
+  ExceptionClass exceptionClass() const override
+  { return ArithmeticErrorClass; }
+  ExceptionKind exceptionKind() const override
+  { return ExceptionKind::BudgetExceeded; }
+  std::string what() const override;
+  Resource resource() const
+  { return m_resource; }
+  std::string limit() const
+  { return m_limit; }
+private:
+  Resource m_resource;
+  std::string m_limit;
+};
+
+class CancelledException : public Exception
+{
+public:
+  CancelledException(
+      const char * file,
+      unsigned int line) :
+    Exception(file, line)
+  { }
+  ExceptionClass exceptionClass() const override
+  { return ArithmeticErrorClass; }
+  ExceptionKind exceptionKind() const override
+  { return ExceptionKind::Cancelled; }
+  std::string what() const override;
+};
+
+class UnboundVariableException : public Exception
+{
+public:
+  UnboundVariableException(
+      const char * file,
+      unsigned int line,
+      const std::string_view& name) :
+    Exception(file, line),
+    m_name{name.begin(), name.end()}
+  { }
+  ExceptionClass exceptionClass() const override
+  { return SemanticErrorClass; }
+  ExceptionKind exceptionKind() const override
+  { return ExceptionKind::UnboundVariable; }
+  std::string what() const override;
+  std::string name() const
+  { return m_name; }
+private:
+  const std::string m_name;
+};
+
+class PreparedAssignmentException : public Exception
+{
+public:
+  PreparedAssignmentException(
+      const char * file,
+      unsigned int line) :
+    Exception(file, line)
+  { }
+  ExceptionClass exceptionClass() const override
+  { return SemanticErrorClass; }
+  ExceptionKind exceptionKind() const override
+  { return ExceptionKind::PreparedAssignment; }
+  std::string what() const override;
+};
+
+// a field of an input file that is missing or no number
+class InvalidFieldException : public Exception
+{
+public:
+  InvalidFieldException(
+      const char * file,
+      unsigned int line,
+      const std::string_view& column,
+      const std::optional<std::string_view>& text) :
+    Exception(file, line),
+    m_column{column.begin(), column.end()},
+    m_text{text ? std::optional<std::string>(std::string(*text)) : 
+      std::nullopt}
+  { }
+  ExceptionClass exceptionClass() const override
+  { return InputErrorClass; }
+  ExceptionKind exceptionKind() const override
+  { return ExceptionKind::InvalidField; }
+  std::string what() const override;
+  std::string column() const
+  { return m_column; }
+private:
+  const std::string m_column;
+  const std::optional<std::string> m_text;
+};
+
 class ParseError : public Exception
 {
 public:
@@ -0,0 +1,79 @@
+#ifndef KCALC_FIXED_POINT_H
+#define KCALC_FIXED_POINT_H
+
+#include <gmpxx.h>
+
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace kcalc
+{
+
+// A decimal number with a fixed number of places, stored as the
+// integer value * 10^places: a machine word while it fits, else an
+// mpz. Sums, differences and remainders are exact, products and
+// quotients are rounded to the places, half to even. Both operands of
+// an operation have the same places.
+class FixedPoint
+{
+public:
+  FixedPoint(long value, unsigned int places);
+
+  // value * 10^exponent rounded to the places
+  FixedPoint(const mpq_class& value, long exponent, unsigned int places);
+
+  FixedPoint operator-() const;
+  FixedPoint operator+(const FixedPoint& other) const;
+  FixedPoint operator-(const FixedPoint& other) const;
+  FixedPoint operator*(const FixedPoint& other) const;
+  // the next two throw a DivisionByZeroException
+  FixedPoint operator/(const FixedPoint& other) const;
+  // the remainder of the division rounded down, with the sign of other
+  FixedPoint operator%(const FixedPoint& other) const;
+
+  bool operator==(long value) const;
+  bool operator!=(long value) const
+  { return !(*this == value); }
+
+  int sign() const;
+
+  bool isInteger() const;
+
+  std::optional<long> toLong() const;
+
+  // all places, like -0.50
+  std::string to_string() const;
+
+  unsigned int places() const
+  { return m_places; }
+
+  // complex products and quotients with one rounding per part
+  static std::pair<FixedPoint, FixedPoint> multiply(
+      const FixedPoint& a, const FixedPoint& b,
+      const FixedPoint& c, const FixedPoint& d);
+  // throws a DivisionByZeroException if c and d are zero
+  static std::pair<FixedPoint, FixedPoint> divide(
+      const FixedPoint& a, const FixedPoint& b,
+      const FixedPoint& c, const FixedPoint& d);
+
+private:
+  // from the scaled value
+  FixedPoint(mpz_class value, unsigned int places);
+  static FixedPoint word(long value, unsigned int places);
+
+  // the scaled value as mpz, also if it is a word
+  mpz_class scaled() const;
+
+  // a word if value fits into one
+  void assign(mpz_class value);
+
+  bool m_isWord;
+  long m_word;
+  mpz_class m_large;
+  unsigned int m_places;
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_FIXED_POINT_H
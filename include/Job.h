@@ -0,0 +1,61 @@
+#ifndef KCALC_JOB_H
+#define KCALC_JOB_H
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "Ast.h"
+#include "SymbolTable.h"
+
+namespace kcalc
+{
+
+// A statement evaluated on its own thread against a copy of the
+// symbol table, so later statements neither see nor disturb it. The
+// value of an assignment is computed by the job and assigned when it
+// is committed.
+class Job
+{
+public:
+  // the value of the statement in the copied table, null if it has
+  // none; evaluations stop with a CancelledException once cancelled
+  // is set, see Budget
+  using Evaluation = std::function<std::unique_ptr<Expression> (
+      SymbolTable& symbolTable, const std::atomic<bool>& cancelled)>;
+
+  // starts evaluation; variable is the one assigned, if any
+  Job(const SymbolTable& symbolTable, 
+      std::optional<std::string> variable,
+      Evaluation evaluation);
+  // cancels and waits for the evaluation
+  ~Job();
+  Job(const Job&) = delete;
+  Job& operator=(const Job&) = delete;
+
+  void cancel()
+  { m_cancelled.store(true, std::memory_order_relaxed); }
+  bool done() const
+  { return m_done.load(std::memory_order_acquire); }
+
+  // for a done job: assigns the value of an assignment in symbolTable
+  // and returns the value; rethrows the exception of the evaluation
+  std::unique_ptr<Expression> commit(SymbolTable& symbolTable);
+
+private:
+  SymbolTable m_symbolTable;
+  std::optional<std::string> m_variable;
+  std::unique_ptr<Expression> m_value;
+  std::exception_ptr m_exception;
+  std::atomic<bool> m_cancelled{false};
+  std::atomic<bool> m_done{false};
+  std::thread m_thread;
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_JOB_H
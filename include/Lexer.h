@@ -3,8 +3,9 @@
 
 #include "Token.h"
 
-#include <string_view>
 #include <optional>
+#include <regex>
+#include <string_view>
 
 #include <boost/iterator/iterator_adaptor.hpp>
 
@@ -58,7 +59,7 @@ private:
   std::optional<CurrentToken>& current() const;
 
   std::optional<CurrentToken> 
-  matchRegex(TokenKind tokenKind, const char * regex) const; 
+  matchRegex(TokenKind tokenKind, const std::regex& regex) const; 
 
   std::string_view::const_iterator m_end;
   SourcePosition m_pos;
@@ -83,7 +84,7 @@ public:
   { return TokenIterator(); }
 
 private:
-  const std::string_view& m_input;
+  const std::string_view m_input;
 };
 
 } /* namespace kcalc */
@@ -0,0 +1,42 @@
+#ifndef KCALC_MULTI_MODULAR_H
+#define KCALC_MULTI_MODULAR_H
+
+#include <optional>
+
+#include "Arithmetic.h"
+
+namespace kcalc
+{
+
+class Expression;
+class SymbolTable;
+
+// Exact evaluation by residues. A bound on the numerators and
+// denominators of the result gives the number of word-size primes;
+// the expression is evaluated modulo each of them, batches of primes
+// run in parallel on the ThreadPool. The exact value is reconstructed
+// from the residues by CRT and rational reconstruction, and verified
+// modulo one more prime. As bounds are rarely tight, the number of
+// primes doubles until a reconstruction passes the verification.
+//
+// Intermediate values stay the size of a word however much the exact
+// ones grow, which pays off for statements whose intermediate values
+// are much larger than their result.
+class MultiModular
+{
+public:
+  // the exact value; nothing if the expression has remainders, 
+  // exponents that are not integers, variables without a value, a 
+  // bound beyond MaxBits, or a divisor that vanishes modulo a prime.
+  // Exact evaluation gives the value or the error then.
+  static std::optional<ComplexNumber> evaluate(
+      const Expression& expression,
+      const SymbolTable& symbolTable);
+
+  // bound on the bits of numerator and denominator
+  static constexpr double MaxBits = 1 << 22;
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_MULTI_MODULAR_H
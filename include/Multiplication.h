@@ -0,0 +1,39 @@
+#ifndef KCALC_MULTIPLICATION_H
+#define KCALC_MULTIPLICATION_H
+
+#include <gmpxx.h>
+
+namespace kcalc
+{
+
+class ThreadPool;
+
+// Multiplication of large integers on the thread pool. The top levels
+// of a Karatsuba recursion, (a1 B + a0)(b1 B + b0) via a0 b0, a1 b1 and
+// (a0 + a1)(b0 + b1), are spread over tasks until there are enough for
+// all threads; the leaves are plain mpz_mul.
+class Multiplication
+{
+public:
+  // runtime switch, on by default
+  static void setParallel(bool parallel);
+  static bool parallel();
+
+  // threads a single product may use, defaults to the pool's
+  // concurrency
+  static void setThreads(unsigned int threads);
+  static unsigned int threads();
+
+  // true if multiply would split a * b into tasks
+  static bool worthParallel(mpz_srcptr a, mpz_srcptr b);
+
+  // result = a * b; result may alias the operands
+  static void multiply(mpz_ptr result, mpz_srcptr a, mpz_srcptr b);
+
+  static void multiply(mpz_ptr result, mpz_srcptr a, mpz_srcptr b,
+      ThreadPool& pool, unsigned int threads);
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_MULTIPLICATION_H
@@ -0,0 +1,64 @@
+#ifndef KCALC_PREPARED_EXPRESSION_H
+#define KCALC_PREPARED_EXPRESSION_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Arithmetic.h"
+
+namespace kcalc
+{
+
+class Expression;
+class SymbolTable;
+
+// Public entry point of libkcalc: an expression lexed, parsed and 
+// analyzed once and evaluated any number of times with different 
+// variable values.
+//
+//   PreparedExpression area = PreparedExpression::prepare("pi * r^2");
+//   area.bind("pi", ComplexNumber("3.14159")).bind("r", ComplexNumber(2));
+//   ComplexNumber value = area.execute();
+//
+// Copies share the compiled expression and are cheap; each copy has
+// its own bindings. All member functions may be called concurrently
+// on the same handle, an execution sees each variable either before 
+// or after a concurrent bind.
+class PreparedExpression
+{
+public:
+  // throws a ParseError for invalid text and a 
+  // PreparedAssignmentException for an assignment
+  static PreparedExpression prepare(std::string_view text);
+
+  PreparedExpression(const PreparedExpression& other);
+  PreparedExpression(PreparedExpression&& other) noexcept;
+  PreparedExpression& operator=(PreparedExpression other) noexcept;
+  ~PreparedExpression();
+
+  // variables the expression refers to, sorted
+  const std::vector<std::string>& variables() const;
+
+  PreparedExpression& bind(const std::string& name, 
+      const ComplexNumber& value);
+
+  // throws an UnboundVariableException if a variable has no value
+  // and arithmetic exceptions
+  ComplexNumber execute() const;
+
+  std::string to_string() const;
+
+private:
+  struct Compiled;
+
+  explicit PreparedExpression(std::shared_ptr<const Compiled> compiled);
+
+  std::shared_ptr<const Compiled> m_compiled;
+  std::unique_ptr<SymbolTable> m_bindings;
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_PREPARED_EXPRESSION_H
@@ -0,0 +1,83 @@
+#ifndef KCALC_RADIX_CONVERSION_H
+#define KCALC_RADIX_CONVERSION_H 
+
+#include <gmpxx.h>
+
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace kcalc 
+{
+
+class ThreadPool;
+
+// Decimal digits spread over up to two pieces of text, e.g. the 
+// integer and the fractional part of a literal without the point.
+class DigitSequence
+{
+public:
+  DigitSequence(
+      const std::string_view& first,
+      const std::string_view& second = std::string_view()) :
+    m_first{first}, m_second{second}
+  { }
+
+  std::size_t size() const
+  { return m_first.size() + m_second.size(); }
+
+  char operator[](std::size_t index) const
+  { 
+    return index < m_first.size() ? m_first[index] :
+      m_second[index - m_first.size()];
+  }
+
+private:
+  std::string_view m_first;
+  std::string_view m_second;
+};
+
+class RadixConversion
+{
+public:
+  // 10^(2^k), computed once per process and shared by all threads
+  static const mpz_class& tenToTwoPower(unsigned int k);
+
+  // 10^exponent, assembled from the cached 10^(2^k)
+  static void powerOfTen(mpz_ptr result, unsigned long exponent);
+
+  // value of the digits [begin, end), divide-and-conquer along the
+  // cached powers for long sequences
+  static void fromDigits(mpz_ptr result, const DigitSequence& digits,
+      std::size_t begin, std::size_t end);
+
+  static void fromDigits(mpz_ptr result, const DigitSequence& digits)
+  { fromDigits(result, digits, 0, digits.size()); }
+
+  // streams the decimal digits of a non-negative value in chunks,
+  // splitting along the cached powers; pads with zeros to width
+  static void writeDigits(std::ostream& out, mpz_srcptr value,
+      std::size_t width = 0);
+
+  // all digits of a non-negative value, the halves of each split
+  // are converted concurrently on the pool
+  static std::string toString(mpz_srcptr value, ThreadPool& pool);
+
+  static void writeZeros(std::ostream& out, std::size_t count);
+
+  // exact number of decimal digits of a non-negative value
+  static std::size_t digitCount(mpz_srcptr value);
+
+  // first and last count digits of a non-negative value
+  static std::string leadingDigits(mpz_srcptr value, std::size_t count);
+  static std::string trailingDigits(mpz_srcptr value, std::size_t count);
+
+  // |numerator / denominator| ~ 0.d1d2...dcount * 10^exponent, 
+  // computed from the top limbs only; denominator may be null
+  static std::string significantDigits(mpz_srcptr numerator,
+      mpz_srcptr denominator, std::size_t count, long& exponent);
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_RADIX_CONVERSION_H  
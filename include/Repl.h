@@ -27,8 +27,11 @@ public:
   Repl()
     : m_prompt{}
   { }
+  // idle runs about ten times a second while waiting for input, the
+  // lines it returns are printed above the prompt
   void run(const std::function<
-      void (Prompt&, const char *)>&);
+      void (Prompt&, const char *)>&,
+      const std::function<std::string ()>& idle = nullptr);
 private:
   Prompt m_prompt;
 }; 
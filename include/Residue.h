@@ -0,0 +1,94 @@
+#ifndef KCALC_RESIDUE_H
+#define KCALC_RESIDUE_H
+
+#include <gmpxx.h>
+
+#include <optional>
+#include <string>
+
+namespace kcalc
+{
+
+// The modulus of residues. Odd moduli below 2^63 keep residues in a
+// machine word in Montgomery form with R = 2^64, all others in an
+// mpz.
+class Modulus
+{
+public:
+  // modulus is at least 2
+  explicit Modulus(const mpz_class& modulus);
+
+  const mpz_class& value() const
+  { return m_value; }
+
+  bool isWord() const
+  { return m_isWord; }
+
+private:
+  friend class Residue;
+
+  // product / R mod the modulus, for products below modulus * R
+  unsigned long reduce(unsigned __int128 product) const;
+  // the Montgomery form of a value below the modulus
+  unsigned long toMontgomery(unsigned long value) const;
+
+  mpz_class m_value;
+  bool m_isWord;
+  unsigned long m_word = 0;
+  // -modulus^-1 mod R
+  unsigned long m_negativeInverse = 0;
+  // R^2 mod modulus
+  unsigned long m_rSquared = 0;
+};
+
+// An integer modulo a Modulus, which has to outlive it. Both operands
+// of an operation have the same modulus.
+class Residue
+{
+public:
+  Residue(long value, const Modulus& modulus);
+  Residue(const mpz_class& value, const Modulus& modulus);
+
+  // value * 10^exponent; throws a DivisionByZeroException if its
+  // denominator is a multiple of the modulus
+  Residue(const mpq_class& value, long exponent, const Modulus& modulus);
+
+  Residue operator-() const;
+  Residue operator+(const Residue& other) const;
+  Residue operator-(const Residue& other) const;
+  Residue operator*(const Residue& other) const;
+  // throws a DivisionByZeroException if other has no inverse
+  Residue operator/(const Residue& other) const;
+
+  bool operator==(long value) const;
+  bool operator!=(long value) const
+  { return !(*this == value); }
+
+  // throws a DivisionByZeroException if there is none
+  Residue inverse() const;
+
+  // the representative from 0 to the modulus - 1
+  mpz_class value() const;
+
+  std::string to_string() const
+  { return value().get_str(); }
+
+private:
+  Residue(const Modulus& modulus, unsigned long montgomery)
+    : m_modulus{&modulus}, m_word{montgomery}
+  { }
+  static Residue word(unsigned long montgomery, const Modulus& modulus);
+  // from a representative
+  static Residue large(mpz_class value, const Modulus& modulus);
+
+  const Modulus * m_modulus;
+  // in Montgomery form
+  unsigned long m_word = 0;
+  // only for moduli that are no words, which saves word residues the
+  // calls to initialize and clear an mpz
+  std::optional<mpz_class> m_large;
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_RESIDUE_H
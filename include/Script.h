@@ -0,0 +1,172 @@
+#ifndef KCALC_SCRIPT_H
+#define KCALC_SCRIPT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ThreadPool.h"
+
+namespace kcalc
+{
+
+class Expression;
+
+// Lines of a script read in large blocks from a file descriptor, or
+// taken from a string. Used instead of readline when there is no
+// terminal to interact with.
+class LineReader
+{
+public:
+  explicit LineReader(int fd);
+  explicit LineReader(std::string_view text);
+  LineReader(const LineReader&) = delete;
+  LineReader& operator=(const LineReader&) = delete;
+
+  // next line without its line break, valid until the next call;
+  // false at the end of the input. Throws std::system_error if
+  // reading fails.
+  bool next(std::string_view& line);
+
+  // number of the line last returned, counting from 1
+  unsigned int lineNumber() const
+  { return m_line; }
+
+private:
+  void fill();
+
+  int m_fd;
+  std::vector<char> m_buffer;
+  std::size_t m_begin;
+  std::size_t m_end;
+  bool m_eof;
+  unsigned int m_line;
+};
+
+// Stream buffer writing to a file descriptor in large blocks, flushed
+// on sync and destruction only.
+class OutputBuffer : public std::streambuf
+{
+public:
+  explicit OutputBuffer(int fd);
+  ~OutputBuffer() override;
+  OutputBuffer(const OutputBuffer&) = delete;
+  OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+protected:
+  int_type overflow(int_type c) override;
+  std::streamsize xsputn(const char * data, std::streamsize size) override;
+  int sync() override;
+
+private:
+  bool flush();
+
+  int m_fd;
+  std::vector<char> m_buffer;
+};
+
+// Whole contents of a file, mapped into memory if it is a regular file
+// and read otherwise, so that pipes work as well.
+class MappedFile
+{
+public:
+  // "-" is standard input; throws std::system_error
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  std::string_view contents() const
+  { 
+    return m_map != nullptr ? 
+      std::string_view(static_cast<const char *>(m_map), m_size) :
+      std::string_view(m_buffer.data(), m_buffer.size());
+  }
+
+private:
+  void * m_map;
+  std::size_t m_size;
+  std::vector<char> m_buffer;
+};
+
+// false for blank lines and comments starting with #
+bool isStatement(std::string_view line);
+
+// A script line in the reorder window of a ParallelScript. It runs as
+// a task once the lines it depends on have finished and is handed 
+// back when it reaches the front of the window.
+struct BatchLine
+{
+  BatchLine();
+  ~BatchLine();
+
+  std::string text;
+  unsigned int number = 0;
+  // commands start with : and are not evaluated as tasks
+  bool command = false;
+  // filled in by the evaluation
+  std::string output;
+  std::unique_ptr<Expression> value;
+  std::string error;
+  unsigned int column = 0;
+
+  // unfinished lines this one waits for, plus one while it is being
+  // scheduled
+  std::atomic<unsigned int> predecessors{1};
+  std::mutex mutex;
+  std::vector<std::shared_ptr<BatchLine>> successors;
+  std::atomic<bool> done{false};
+};
+
+// Runs the statements of a script as tasks of a pool, each after the
+// earlier lines it depends on through the symbol table (see 
+// BatchDependencies), and hands them back in input order. A command
+// changes how later lines are evaluated, so nothing after it is read
+// before all lines up to it are handed back.
+class ParallelScript
+{
+public:
+  // evaluates a statement on the pool
+  using Evaluate = std::function<void (BatchLine& line)>;
+  // takes the next line or command on the calling thread, false if
+  // it failed
+  using Deliver = std::function<bool (BatchLine& line)>;
+
+  // lines in flight per thread of the pool
+  static constexpr unsigned int WindowLinesPerThread = 256;
+
+  ParallelScript(ThreadPool& pool, Evaluate evaluate);
+  ParallelScript(const ParallelScript&) = delete;
+  ParallelScript& operator=(const ParallelScript&) = delete;
+
+  // reads all lines, false if any was not delivered successfully
+  bool run(LineReader& reader, const Deliver& deliver);
+
+private:
+  using LinePtr = std::shared_ptr<BatchLine>;
+
+  // starts line once the unfinished predecessors have finished
+  void schedule(const LinePtr& line, 
+      const std::vector<LinePtr>& predecessors);
+  void release(const LinePtr& line);
+  void execute(const LinePtr& line);
+  // runs pending tasks until line is done
+  void wait(BatchLine& line);
+
+  ThreadPool& m_pool;
+  Evaluate m_evaluate;
+  std::mutex m_mutex;
+  std::condition_variable m_finished;
+  TaskGroup m_group;
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_SCRIPT_H
@@ -0,0 +1,123 @@
+#ifndef KCALC_SERVER_H
+#define KCALC_SERVER_H
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ThreadPool.h"
+
+namespace kcalc
+{
+
+// Latencies in buckets of a quarter power of two, so percentiles are
+// accurate to about 20%.
+class LatencyHistogram
+{
+public:
+  void record(double microseconds);
+  void merge(const LatencyHistogram& other);
+
+  unsigned long count() const
+  { return m_count; }
+
+  double mean() const
+  { return m_count > 0 ? m_sum / m_count : 0; }
+
+  double max() const
+  { return m_max; }
+
+  // upper bound of the bucket holding the given fraction of requests
+  double percentile(double fraction) const;
+
+private:
+  static constexpr unsigned int SubBuckets = 4;
+
+  std::array<unsigned long, 48 * SubBuckets> m_buckets{};
+  unsigned long m_count = 0;
+  double m_sum = 0;
+  double m_max = 0;
+};
+
+// Line oriented server on a Unix domain socket. Every request line of
+// a connection gets exactly one response line, in order. Requests of
+// one connection are handled one at a time on the thread pool, those
+// of different connections in parallel; an epoll loop on the thread
+// calling run() does all socket I/O. A connection that sends faster
+// than its responses are read is no longer read from until it
+// catches up.
+class Server
+{
+public:
+  // state of one connection, used by one task at a time
+  class Session
+  {
+  public:
+    virtual ~Session() = default;
+
+    // response to one request, line breaks are replaced by spaces
+    virtual std::string handle(std::string_view request) = 0;
+  };
+
+  using SessionFactory = std::function<std::unique_ptr<Session> ()>;
+
+  // listens on path, replacing a stale socket there; throws
+  // std::system_error
+  Server(const std::string& path, SessionFactory factory,
+      ThreadPool& pool = ThreadPool::instance());
+  ~Server();
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+  // serves until stop() is called or the process gets SIGINT or
+  // SIGTERM, then waits for running requests and closes all
+  // connections
+  void run();
+
+  // may be called from any thread
+  void stop();
+
+  // time from receiving a request to queueing its response; only
+  // valid while run() is not active
+  const LatencyHistogram& latency() const
+  { return m_latency; }
+
+  // the request :stats is answered by the server with this line
+  std::string statistics() const;
+
+private:
+  struct Connection;
+  using ConnectionPtr = std::shared_ptr<Connection>;
+
+  void accept();
+  void receive(const ConnectionPtr& connection);
+  void send(const ConnectionPtr& connection);
+  void dispatch(const ConnectionPtr& connection);
+  void complete();
+  void update(const ConnectionPtr& connection);
+  void close(const ConnectionPtr& connection);
+
+  std::string m_path;
+  SessionFactory m_factory;
+  ThreadPool& m_pool;
+  int m_listener;
+  int m_epoll;
+  int m_wake;
+  std::map<int, ConnectionPtr> m_connections;
+  unsigned int m_running;
+  bool m_stopping;
+  LatencyHistogram m_latency;
+  std::atomic<bool> m_stop;
+  std::mutex m_mutex;
+  std::vector<ConnectionPtr> m_completed;
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_SERVER_H
@@ -2,26 +2,42 @@
 #define KCALC_SYMBOLTABLE_H 
 
 #include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 
 namespace kcalc 
 {
 
+// Inserts may run concurrently with lookups and retrievals; an
+// expression that was looked up stays valid after it is replaced.
 class SymbolTable
 {
 public:
+  SymbolTable() = default;
+  // the stored expressions are immutable and shared with other
+  SymbolTable(const SymbolTable& other)
+  {
+    std::shared_lock<std::shared_mutex> lock(other.m_mutex);
+    m_symbols = other.m_symbols;
+  }
+  SymbolTable& operator=(const SymbolTable&) = delete;
+
   void insert(const std::string& variableName, 
       const Expression& object)
   {
+    std::shared_ptr<const Expression> clone = object.cloneExpression();
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
     auto it = m_symbols.find(variableName);
     if (it != m_symbols.end())
       m_symbols.erase(it);
     m_symbols.insert(std::make_pair(
-          variableName, 
-          std::move(object.cloneExpression())));
+          variableName, std::move(clone)));
   }
   std::unique_ptr<Expression> retrieve(
       const std::string& variableName)
   {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
     auto it = m_symbols.find(variableName);
     if (it != m_symbols.end())
     {
@@ -30,9 +46,17 @@ public:
     }
     return nullptr;
   }
+  std::shared_ptr<const Expression> lookup(
+      const std::string& variableName) const
+  {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    auto it = m_symbols.find(variableName);
+    return it != m_symbols.end() ? it->second : nullptr;
+  }
 private:
+  mutable std::shared_mutex m_mutex;
   std::map<std::string, 
-    std::unique_ptr<Expression> > m_symbols;
+    std::shared_ptr<const Expression> > m_symbols;
 };
 
 } /* namespace kcalc */
@@ -0,0 +1,71 @@
+#ifndef KCALC_SYMBOL_USAGE_H
+#define KCALC_SYMBOL_USAGE_H
+
+#include "Visitor.h"
+
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace kcalc
+{
+
+// Variables a statement refers to and the one it assigns. Variables 
+// hold unevaluated expressions, so reads of other variables through
+// the referenced ones are not included.
+class SymbolUsage : public Visitor
+{
+public:
+  explicit SymbolUsage(AstObject& statement);
+
+  const std::set<std::string>& reads() const
+  { return m_reads; }
+
+  const std::optional<std::string>& write() const
+  { return m_write; }
+
+  // true if the statement neither reads nor writes the symbol table
+  bool independent() const
+  { return m_reads.empty() && !m_write; }
+
+protected:
+  void visit(Variable& variable) override;
+
+private:
+  std::set<std::string> m_reads;
+  std::optional<std::string> m_write;
+};
+
+// Dependencies of script lines through the symbol table, by line 
+// number. A line runs after the last assignment of each variable it 
+// reads, an assignment after the previous one and after all lines 
+// reading the old value. Variables hold unevaluated expressions, so 
+// reading a variable also reads the variables its expression refers 
+// to, transitively and as they are defined when the line is read.
+class BatchDependencies
+{
+public:
+  // the earlier lines that line has to wait for, in increasing order;
+  // lines are added in increasing order
+  std::vector<unsigned int> add(unsigned int line, 
+      const SymbolUsage& usage);
+
+  // lines before line have finished and are not waited for any more
+  void finishedBefore(unsigned int line)
+  { m_unfinished = line; }
+
+private:
+  // reads with the references of each name read, transitively
+  std::set<std::string> closure(std::set<std::string> reads) const;
+
+  unsigned int m_unfinished = 0;
+  std::map<std::string, unsigned int> m_writers;
+  std::map<std::string, std::vector<unsigned int>> m_readers;
+  std::map<std::string, std::set<std::string>> m_references;
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_SYMBOL_USAGE_H
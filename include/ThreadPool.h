@@ -0,0 +1,102 @@
+#ifndef KCALC_THREAD_POOL_H
+#define KCALC_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kcalc
+{
+
+// Fixed set of worker threads executing queued tasks. Each worker owns
+// a deque: tasks it forks are pushed and popped at the back, idle 
+// workers steal from the front of the others. Tasks from outside the
+// pool go through a shared queue. Threads waiting for tasks (see 
+// TaskGroup) run queued tasks themselves, so nested parallelism cannot
+// deadlock and a pool without workers degrades to sequential 
+// execution on the calling thread.
+class ThreadPool
+{
+public:
+  explicit ThreadPool(unsigned int workers);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // process wide pool with one worker less than hardware threads,
+  // the thread waiting for the results is the last one
+  static ThreadPool& instance();
+
+  // joins the current workers and starts new ones; only valid while
+  // no tasks are queued or running
+  void resize(unsigned int workers);
+
+  unsigned int workers() const
+  { return m_threads.size(); }
+
+  unsigned int concurrency() const
+  { return m_threads.size() + 1; }
+
+  void submit(std::function<void ()> task);
+
+  // runs one queued task on the calling thread, false if there was
+  // none
+  bool runPending();
+
+private:
+  using Task = std::function<void ()>;
+
+  struct WorkerQueue
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void start(unsigned int workers);
+  void stop();
+  void workerLoop(unsigned int index);
+  bool take(Task& task);
+
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  std::deque<Task> m_tasks;
+  std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+  std::vector<std::thread> m_threads;
+  std::atomic<unsigned long> m_queued;
+  bool m_stop;
+};
+
+// Tasks forked from one place and joined together. wait() rethrows
+// the first exception thrown by any of the tasks.
+class TaskGroup
+{
+public:
+  explicit TaskGroup(ThreadPool& pool = ThreadPool::instance())
+    : m_pool{pool}, m_pending{0}
+  { }
+  ~TaskGroup();
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  void run(std::function<void ()> task);
+  void wait();
+
+private:
+  void finish(std::exception_ptr exception);
+
+  ThreadPool& m_pool;
+  std::atomic<unsigned int> m_pending;
+  std::mutex m_mutex;
+  std::condition_variable m_done;
+  std::exception_ptr m_exception;
+};
+
+} /* namespace kcalc */
+
+#endif // KCALC_THREAD_POOL_H
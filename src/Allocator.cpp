@@ -0,0 +1,493 @@
+#include "Allocator.h"
+#include "Exceptions.h"
+
+#include <gmp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace kcalc
+{
+
+namespace 
+{
+
+constexpr std::size_t SmallClassGranularity = 16;
+constexpr std::size_t SmallClassLimit = 256;
+constexpr std::size_t MaxPooledSize = 4096;
+constexpr unsigned int NumberOfClasses = 20;
+constexpr unsigned int MaxBlocksPerClass = 256;
+constexpr std::size_t ArenaAlignment = 16;
+// blocks counted by a memory budget start with its tag, which moves
+// them off the alignment of malloc and the pool
+constexpr std::size_t BlockTagSize = 8;
+static_assert(alignof(std::max_align_t) == 2 * BlockTagSize);
+constexpr std::size_t FirstChunkSize = 64 * 1024;
+constexpr std::size_t MaxChunkSize = 16 * 1024 * 1024;
+// the clock is read at the checkpoint after a large allocation and
+// at every so many checkpoints
+constexpr unsigned int ChecksPerClockRead = 64;
+constexpr double BitsPerDigit = 3.32192809488736234787;
+
+struct FreeBlock
+{
+  FreeBlock * next;
+};
+
+struct Pool
+{
+  FreeBlock * heads[NumberOfClasses];
+  unsigned int counts[NumberOfClasses];
+};
+
+struct PoolDrain
+{
+  ~PoolDrain();
+};
+
+thread_local Pool t_pool;
+thread_local bool t_poolClosed;
+thread_local PoolDrain t_poolDrain;
+thread_local AllocationStatistics t_statistics;
+thread_local StatementArena * t_innermostArena;
+thread_local StatementArena * t_allocationArena;
+thread_local StatementBudget * t_budget;
+thread_local unsigned int t_budgetChecks;
+
+std::atomic<bool> g_installed{false};
+std::atomic<unsigned long> g_allocations{0};
+std::atomic<unsigned long> g_bytes{0};
+std::atomic<std::uint64_t> g_budgetTags{0};
+std::atomic<bool> g_interrupted{false};
+static_assert(std::atomic<bool>::is_always_lock_free,
+    "interrupt() is called by signal handlers");
+
+unsigned int classIndex(std::size_t size)
+{
+  assert(size <= MaxPooledSize);
+  if (size <= SmallClassLimit)
+    return size == 0 ? 0 : (size - 1) / SmallClassGranularity;
+  unsigned int index = SmallClassLimit / SmallClassGranularity;
+  for (std::size_t limit = 2 * SmallClassLimit; limit < size; limit *= 2)
+    ++index;
+  return index;
+}
+
+std::size_t classSize(unsigned int index)
+{
+  assert(index < NumberOfClasses);
+  unsigned int small = SmallClassLimit / SmallClassGranularity;
+  if (index < small)
+    return (index + 1) * SmallClassGranularity;
+  return (2 * SmallClassLimit) << (index - small);
+}
+
+[[noreturn]] void outOfMemory(std::size_t size)
+{
+  std::cerr << "kcalc: cannot allocate " << size 
+            << " bytes." << std::endl;
+  std::abort();
+}
+
+void * checked(void * ptr, std::size_t size)
+{
+  if (ptr == nullptr)
+    outOfMemory(size);
+  return ptr;
+}
+
+void account(std::size_t allocated, std::size_t freed)
+{
+  ++t_statistics.allocations;
+  t_statistics.bytes += allocated;
+  t_statistics.liveBytes += static_cast<long long>(allocated) - 
+    static_cast<long long>(freed);
+  t_statistics.peakBytes = 
+    std::max(t_statistics.peakBytes, t_statistics.liveBytes);
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_bytes.fetch_add(allocated, std::memory_order_relaxed);
+}
+
+StatementArena * owningArena(const void * ptr);
+
+bool isTagged(const void * ptr)
+{
+  return reinterpret_cast<std::uintptr_t>(ptr) % alignof(std::max_align_t) ==
+    BlockTagSize;
+}
+
+void * tag(void * block, std::uint64_t value)
+{
+  assert(!isTagged(block));
+  std::memcpy(block, &value, sizeof(value));
+  return static_cast<char *>(block) + BlockTagSize;
+}
+
+std::uint64_t tagOf(const void * ptr)
+{
+  std::uint64_t value;
+  std::memcpy(&value, static_cast<const char *>(ptr) - BlockTagSize,
+      sizeof(value));
+  return value;
+}
+
+void * poolAllocate(std::size_t size)
+{
+  if (size > MaxPooledSize)
+    return checked(std::malloc(size), size);
+  unsigned int index = classIndex(size);
+  FreeBlock * block = t_pool.heads[index];
+  if (block != nullptr)
+  {
+    t_pool.heads[index] = block->next;
+    --t_pool.counts[index];
+    return block;
+  }
+  return checked(std::malloc(classSize(index)), size);
+}
+
+void poolFree(void * ptr, std::size_t size)
+{
+  if (size > MaxPooledSize || t_poolClosed)
+  {
+    std::free(ptr);
+    return;
+  }
+  unsigned int index = classIndex(size);
+  if (t_pool.counts[index] >= MaxBlocksPerClass)
+  {
+    std::free(ptr);
+    return;
+  }
+  static_cast<void>(&t_poolDrain);
+  FreeBlock * block = static_cast<FreeBlock *>(ptr);
+  block->next = t_pool.heads[index];
+  t_pool.heads[index] = block;
+  ++t_pool.counts[index];
+}
+
+PoolDrain::~PoolDrain()
+{
+  t_poolClosed = true;
+  for (unsigned int i = 0; i < NumberOfClasses; ++i)
+  {
+    while (t_pool.heads[i] != nullptr)
+    {
+      FreeBlock * next = t_pool.heads[i]->next;
+      std::free(t_pool.heads[i]);
+      t_pool.heads[i] = next;
+    }
+    t_pool.counts[i] = 0;
+  }
+}
+
+void * gmpAllocate(std::size_t size)
+{
+  account(size, 0);
+  StatementBudget * budget = t_budget;
+  if (budget != nullptr)
+    budget->allocate(size);
+  if (t_allocationArena != nullptr)
+    return t_allocationArena->allocate(size);
+  if (budget != nullptr && budget->blockTag() != 0)
+    return tag(poolAllocate(size + BlockTagSize), budget->blockTag());
+  return poolAllocate(size);
+}
+
+void gmpFree(void * ptr, std::size_t size)
+{
+  if (ptr == nullptr)
+    return;
+  t_statistics.liveBytes -= static_cast<long long>(size);
+  StatementArena * arena = owningArena(ptr);
+  if (arena != nullptr)
+    arena->release(size);
+  else if (isTagged(ptr))
+  {
+    // only blocks of the current budget make room in it
+    StatementBudget * budget = t_budget;
+    if (budget != nullptr && budget->blockTag() == tagOf(ptr))
+      budget->release(size);
+    poolFree(static_cast<char *>(ptr) - BlockTagSize,
+        size + BlockTagSize);
+  }
+  else
+    poolFree(ptr, size);
+}
+
+void * gmpReallocate(void * ptr, std::size_t oldSize, std::size_t newSize)
+{
+  StatementArena * arena = owningArena(ptr);
+  account(newSize, oldSize);
+  void * result;
+  if (arena != nullptr)
+  {
+    result = arena->allocate(newSize);
+    std::memcpy(result, ptr, std::min(oldSize, newSize));
+    arena->release(oldSize);
+    // the arena does not reuse the old block
+    if (t_budget != nullptr)
+      t_budget->allocate(newSize);
+    return result;
+  }
+  // a tagged block keeps its tag, which the copies include
+  std::size_t tagSize = isTagged(ptr) ? BlockTagSize : 0;
+  char * block = static_cast<char *>(ptr) - tagSize;
+  StatementBudget * budget = t_budget;
+  bool counted = tagSize != 0 && budget != nullptr &&
+    budget->blockTag() == tagOf(ptr);
+  oldSize += tagSize;
+  newSize += tagSize;
+  if (oldSize > MaxPooledSize && newSize > MaxPooledSize)
+    result = checked(std::realloc(block, newSize), newSize);
+  else if (oldSize <= MaxPooledSize && newSize <= MaxPooledSize &&
+      classIndex(oldSize) == classIndex(newSize))
+    result = block;
+  else
+  {
+    result = poolAllocate(newSize);
+    std::memcpy(result, block, std::min(oldSize, newSize));
+    poolFree(block, oldSize);
+  }
+  // a block from before the budget counts with its growth, which its
+  // release does not give back
+  if (budget != nullptr && newSize > oldSize)
+    budget->allocate(newSize - oldSize);
+  else if (counted && newSize < oldSize)
+    budget->release(oldSize - newSize);
+  return static_cast<char *>(result) + tagSize;
+}
+
+// Only the arenas of the calling thread are searched. Pool tasks run
+// without an arena and never free or grow the limbs of the statement
+// that forked them: since GMP 6.2 mpz_init does not allocate, so the
+// values a task creates start out of its own memory.
+static_assert(__GNU_MP_RELEASE >= 60200,
+    "arena blocks must not reach the memory functions of other threads");
+
+StatementArena * owningArena(const void * ptr)
+{
+  for (StatementArena * arena = t_innermostArena; arena != nullptr;
+      arena = arena->previous())
+  {
+    if (arena->owns(ptr))
+      return arena;
+  }
+  return nullptr;
+}
+
+} /* anonymous namespace */
+
+void GmpAllocator::install()
+{
+  bool expected = false;
+  if (g_installed.compare_exchange_strong(expected, true))
+    mp_set_memory_functions(&gmpAllocate, &gmpReallocate, &gmpFree);
+}
+
+bool GmpAllocator::installed()
+{ return g_installed.load(); }
+
+AllocationStatistics GmpAllocator::statistics()
+{ return t_statistics; }
+
+void GmpAllocator::resetStatistics()
+{ 
+  long long live = t_statistics.liveBytes;
+  t_statistics = AllocationStatistics();
+  t_statistics.liveBytes = live;
+  t_statistics.peakBytes = live;
+}
+
+unsigned long GmpAllocator::totalAllocations()
+{ return g_allocations.load(std::memory_order_relaxed); }
+
+unsigned long GmpAllocator::totalBytes()
+{ return g_bytes.load(std::memory_order_relaxed); }
+
+StatementArena::StatementArena() :
+  m_chunks{}, m_current{nullptr}, m_end{nullptr},
+  m_nextChunkSize{FirstChunkSize}, m_liveBytes{0},
+  m_previous{t_innermostArena}, 
+  m_previousAllocation{t_allocationArena}
+{
+  t_innermostArena = this;
+  t_allocationArena = this;
+}
+
+StatementArena::~StatementArena()
+{
+  assert(t_innermostArena == this);
+  t_innermostArena = m_previous;
+  t_allocationArena = m_previousAllocation;
+  t_statistics.liveBytes -= static_cast<long long>(m_liveBytes);
+  for (auto& chunk : m_chunks)
+    std::free(chunk.begin);
+}
+
+void * StatementArena::allocate(std::size_t size)
+{
+  std::size_t aligned = (size + ArenaAlignment - 1) & 
+    ~(ArenaAlignment - 1);
+  if (static_cast<std::size_t>(m_end - m_current) < aligned)
+  {
+    std::size_t chunkSize = std::max(m_nextChunkSize, aligned);
+    char * chunk = static_cast<char *>(
+        checked(std::malloc(chunkSize), chunkSize));
+    m_chunks.push_back(Chunk{chunk, chunkSize});
+    m_current = chunk;
+    m_end = chunk + chunkSize;
+    m_nextChunkSize = std::min(2 * m_nextChunkSize, MaxChunkSize);
+  }
+  void * result = m_current;
+  m_current += aligned;
+  m_liveBytes += size;
+  return result;
+}
+
+bool StatementArena::owns(const void * ptr) const
+{
+  const char * address = static_cast<const char *>(ptr);
+  for (auto& chunk : m_chunks)
+  {
+    if (chunk.begin <= address && address < chunk.begin + chunk.size)
+      return true;
+  }
+  return false;
+}
+
+void StatementArena::release(std::size_t size)
+{ 
+  assert(m_liveBytes >= size);
+  m_liveBytes -= size; 
+}
+
+std::size_t StatementArena::capacity() const
+{
+  std::size_t result = 0;
+  for (auto& chunk : m_chunks)
+    result += chunk.size;
+  return result;
+}
+
+ArenaSuspension::ArenaSuspension() :
+  m_suspended{t_allocationArena}
+{
+  t_allocationArena = nullptr;
+}
+
+ArenaSuspension::~ArenaSuspension()
+{
+  t_allocationArena = m_suspended;
+}
+
+StatementBudget::StatementBudget(const Budget& budget) :
+  m_budget{budget}, 
+  m_deadline{std::chrono::steady_clock::now() + 
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(budget.seconds))},
+  m_liveBytes{0}, 
+  m_blockTag{budget.bytes != 0 ?
+    g_budgetTags.fetch_add(1, std::memory_order_relaxed) + 1 : 0},
+  m_previous{t_budget}
+{
+  t_budget = this;
+}
+
+StatementBudget::~StatementBudget()
+{
+  assert(t_budget == this);
+  t_budget = m_previous;
+}
+
+StatementBudget * StatementBudget::current()
+{ return t_budget; }
+
+void StatementBudget::checkSize(double bits)
+{
+  StatementBudget * budget = t_budget;
+  if (budget == nullptr)
+    return;
+  const Budget& limits = budget->m_budget;
+  if (limits.digits != 0 && bits > limits.digits * BitsPerDigit)
+    throw BudgetExceededException(__FILE__, __LINE__,
+        BudgetExceededException::Digits, std::to_string(limits.digits));
+  if (limits.bytes != 0 && bits / 8 > limits.bytes)
+    throw BudgetExceededException(__FILE__, __LINE__,
+        BudgetExceededException::Memory, std::to_string(limits.bytes));
+}
+
+void StatementBudget::checkpoint()
+{
+  StatementBudget * budget = t_budget;
+  if (budget != nullptr)
+    budget->check(++t_budgetChecks % ChecksPerClockRead == 0);
+}
+
+void StatementBudget::interrupt()
+{ g_interrupted.store(true, std::memory_order_relaxed); }
+
+void StatementBudget::clearInterrupt()
+{ g_interrupted.store(false, std::memory_order_relaxed); }
+
+bool StatementBudget::interrupted()
+{ return g_interrupted.load(std::memory_order_relaxed); }
+
+void StatementBudget::check(bool clock)
+{
+  if ((m_budget.interruptible && 
+        g_interrupted.load(std::memory_order_relaxed)) ||
+      (m_budget.cancelled != nullptr && 
+       m_budget.cancelled->load(std::memory_order_relaxed)))
+    throw CancelledException(__FILE__, __LINE__);
+  if (m_budget.bytes != 0 && m_liveBytes.load(std::memory_order_relaxed) > 
+      static_cast<long long>(m_budget.bytes))
+    throw BudgetExceededException(__FILE__, __LINE__,
+        BudgetExceededException::Memory, std::to_string(m_budget.bytes));
+  if (clock && m_budget.seconds != 0 && 
+      std::chrono::steady_clock::now() > m_deadline)
+  {
+    std::ostringstream limit;
+    limit << m_budget.seconds;
+    throw BudgetExceededException(__FILE__, __LINE__,
+        BudgetExceededException::Time, limit.str());
+  }
+}
+
+void StatementBudget::allocate(std::size_t size)
+{
+  if (m_budget.bytes != 0)
+    m_liveBytes.fetch_add(static_cast<long long>(size), 
+        std::memory_order_relaxed);
+  if (size > MaxPooledSize)
+    t_budgetChecks = ChecksPerClockRead - 1;
+}
+
+void StatementBudget::release(std::size_t size)
+{
+  m_liveBytes.fetch_sub(static_cast<long long>(size), 
+      std::memory_order_relaxed);
+}
+
+std::uint64_t StatementBudget::blockTag() const
+{ return m_blockTag; }
+
+StatementBudget::Scope::Scope(StatementBudget * budget) :
+  m_previous{t_budget}
+{
+  t_budget = budget;
+}
+
+StatementBudget::Scope::~Scope()
+{
+  t_budget = m_previous;
+}
+
+} /* namespace kcalc */
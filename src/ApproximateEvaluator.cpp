@@ -0,0 +1,640 @@
+#include "ApproximateEvaluator.h"
+#include "Allocator.h"
+#include "Exceptions.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <optional>
+#include <type_traits>
+
+namespace kcalc
+{
+
+namespace
+{
+
+// bits of the intermediate float a constant is rounded to before it
+// is converted to double or long double
+constexpr unsigned long ConversionBits = 128;
+
+template<typename Real>
+struct Value
+{
+  Real real;
+  Real imag;
+};
+
+std::string scientific(bool negative, const std::string& digits,
+    long exponent)
+{
+  std::string text = negative ? "-" : "";
+  text += digits[0];
+  if (digits.size() > 1)
+  {
+    text += '.';
+    text.append(digits, 1);
+  }
+  text += exponent < 0 ? "e-" : "e+";
+  text += std::to_string(exponent < 0 ? -exponent : exponent);
+  return text;
+}
+
+template<typename Real>
+bool negative(const Real& value)
+{ return value < 0; }
+
+bool negative(const Ball& value)
+{ return value.sign() < 0; }
+
+bool negative(const FixedPoint& value)
+{ return value.sign() < 0; }
+
+// residues are printed by their representative
+bool negative(const Residue&)
+{ return false; }
+
+template<typename Real>
+std::string format(const Real& value, unsigned int digits)
+{
+  if (value == 0)
+    return "0";
+  if constexpr (std::is_same_v<Real, Ball>)
+    return value.to_string(digits);
+  else if constexpr (std::is_same_v<Real, mpf_class>)
+  {
+    mp_exp_t exponent;
+    std::string text = value.get_str(exponent, 10, digits);
+    bool negative = text[0] == '-';
+    if (negative)
+      text.erase(0, 1);
+    text.resize(digits, '0');
+    return scientific(negative, text, exponent - 1);
+  }
+  else
+  {
+    if (std::isnan(value))
+      return "nan";
+    if (std::isinf(value))
+      return value < 0 ? "-inf" : "inf";
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%.*Le", int(digits) - 1,
+        static_cast<long double>(std::fabs(value)));
+    std::string text(buffer);
+    std::size_t mark = text.find('e');
+    long exponent = std::strtol(text.c_str() + mark + 1, nullptr, 10);
+    text.erase(mark);
+    if (digits > 1)
+      text.erase(1, 1);
+    return scientific(value < 0, text, exponent);
+  }
+}
+
+// decimals print all their places, also for 0
+std::string format(const FixedPoint& value, unsigned int)
+{ return value.to_string(); }
+
+std::string format(const Residue& value, unsigned int)
+{ return value.to_string(); }
+
+template<typename Real>
+std::string format(const Value<Real>& value, unsigned int digits)
+{
+  if (value.imag == 0)
+    return format(value.real, digits);
+  if (value.real == 0)
+    return format(value.imag, digits) + "i";
+  std::string text = format(value.real, digits);
+  text += negative(value.imag) ? " - " : " + ";
+  Real imag = negative(value.imag) ? Real(-value.imag) : value.imag;
+  return text + format(imag, digits) + "i";
+}
+
+bool isInteger(const mpf_class& value)
+{ return mpf_integer_p(value.get_mpf_t()); }
+
+bool isInteger(const Ball& value)
+{ return value.isInteger(); }
+
+std::optional<long> toLong(const mpf_class& value)
+{
+  if (!value.fits_slong_p())
+    return std::nullopt;
+  return value.get_si();
+}
+
+std::optional<long> toLong(const Ball& value)
+{ return value.toLong(); }
+
+bool isInteger(const FixedPoint& value)
+{ return value.isInteger(); }
+
+std::optional<long> toLong(const FixedPoint& value)
+{ return value.toLong(); }
+
+// One evaluation of an expression. Every variable is evaluated at
+// most once, also if it is used repeatedly by the expressions of
+// other variables.
+template<typename Real>
+class Evaluation
+{
+public:
+  // precision is in bits, or in places for FixedPoint; digits are
+  // those of values in error messages
+  Evaluation(const SymbolTable& symbolTable, unsigned long precision,
+      unsigned int digits)
+    : m_symbolTable{symbolTable}, m_precision{precision}, m_digits{digits}
+  { }
+
+  // for Residue, the modulus has to outlive the evaluation
+  Evaluation(const SymbolTable& symbolTable, const Modulus& modulus,
+      unsigned int digits)
+    : m_symbolTable{symbolTable}, m_precision{0}, m_digits{digits},
+      m_modulus{&modulus}
+  { }
+
+  Value<Real> evaluate(const Expression& expression);
+
+private:
+  Real make(long value) const
+  {
+    if constexpr (std::is_same_v<Real, mpf_class>)
+      return mpf_class(value, m_precision);
+    else if constexpr (std::is_same_v<Real, Ball>)
+      return Ball(value, m_precision);
+    else if constexpr (std::is_same_v<Real, FixedPoint>)
+      return FixedPoint(value, m_precision);
+    else if constexpr (std::is_same_v<Real, Residue>)
+      return Residue(value, *m_modulus);
+    else
+      return Real(value);
+  }
+
+  Value<Real> convert(const ComplexNumber& number) const;
+  Value<Real> variable(const Variable& variable);
+  Value<Real> multiply(const Value<Real>& a, const Value<Real>& b) const;
+  Value<Real> divide(const Value<Real>& a, const Value<Real>& b) const;
+  Value<Real> modulo(const Value<Real>& a, const Value<Real>& b) const;
+  Value<Real> power(const Value<Real>& a, const Value<Real>& b) const;
+  Value<Real> power(Value<Real> base, unsigned long exponent) const;
+  Value<Real> power(const Value<Real>& base, ComplexNumber exponent) const;
+
+  // the exact value, for exponents of residues
+  ComplexNumber exact(const Expression& expression);
+
+  const SymbolTable& m_symbolTable;
+  unsigned long m_precision;
+  unsigned int m_digits;
+  const Modulus * m_modulus = nullptr;
+  std::map<std::string, Value<Real>, std::less<>> m_variables;
+  std::map<std::string, ComplexNumber, std::less<>> m_exact;
+};
+
+template<typename Real>
+Value<Real> Evaluation<Real>::evaluate(const Expression& expression)
+{
+  switch (expression.kind())
+  {
+    case ObjectKind::Number:
+      return convert(static_cast<const Number&>(expression).number());
+    case ObjectKind::Variable:
+      return variable(static_cast<const Variable&>(expression));
+    case ObjectKind::UnaryMinus:
+    {
+      // subtracted from zero, which has no sign: the branch cut of
+      // pow would tell -0 apart
+      Value<Real> value = evaluate(
+          static_cast<const UnaryMinusExpression&>(expression).inner());
+      return { Real(make(0) - value.real), Real(make(0) - value.imag) };
+    }
+    case ObjectKind::ArithmeticExpression:
+      break;
+    case ObjectKind::Assignment:
+      assert(false);
+  }
+  auto& arithmetic = static_cast<const ArithmeticExpression&>(expression);
+  if constexpr (std::is_same_v<Real, Residue>)
+  {
+    // exponents are integers, not residues, and residues have no
+    // remainders
+    if (arithmetic.operation() == ArithmeticExpression::Power)
+      return power(evaluate(arithmetic.left()), exact(arithmetic.right()));
+    if (arithmetic.operation() == ArithmeticExpression::Modulo)
+      throw ModuloResidueException(__FILE__, __LINE__,
+          m_modulus->value().get_str());
+  }
+  Value<Real> a = evaluate(arithmetic.left());
+  Value<Real> b = evaluate(arithmetic.right());
+  switch (arithmetic.operation())
+  {
+    case ArithmeticExpression::Add:
+      return { Real(a.real + b.real), Real(a.imag + b.imag) };
+    case ArithmeticExpression::Subtract:
+      return { Real(a.real - b.real), Real(a.imag - b.imag) };
+    case ArithmeticExpression::Multiply:
+      return multiply(a, b);
+    case ArithmeticExpression::Divide:
+      return divide(a, b);
+    case ArithmeticExpression::Modulo:
+      if constexpr (!std::is_same_v<Real, Residue>)
+        return modulo(a, b);
+      break;
+    case ArithmeticExpression::Power:
+      if constexpr (!std::is_same_v<Real, Residue>)
+        return power(a, b);
+      break;
+  }
+  assert(false);
+  return a;
+}
+
+template<typename Real>
+Value<Real> Evaluation<Real>::convert(const ComplexNumber& number) const
+{
+  if constexpr (std::is_same_v<Real, FixedPoint>)
+    return { FixedPoint(number.realMantissa(), number.scale(), m_precision),
+      FixedPoint(number.imaginaryMantissa(), number.scale(), m_precision) };
+  else if constexpr (std::is_same_v<Real, Residue>)
+    return { Residue(number.realMantissa(), number.scale(), *m_modulus),
+      Residue(number.imaginaryMantissa(), number.scale(), *m_modulus) };
+  else if constexpr (std::is_same_v<Real, Ball>)
+  {
+    Value<Real> value{ Ball(number.realMantissa(), m_precision),
+      Ball(number.imaginaryMantissa(), m_precision) };
+    if (!number.isScaled())
+      return value;
+    Ball scale = Ball::powerOfTen(number.scale(), m_precision);
+    return { value.real * scale, value.imag * scale };
+  }
+  else if constexpr (!std::is_same_v<Real, mpf_class>)
+  {
+    // the truncated leading bits and the rest round to the nearest
+    // value; both are scaled in Real, so values beyond the range of
+    // Real become infinities or zeros instead of an mpf overflow
+    mpf_class real(0, ConversionBits), imag(0, ConversionBits);
+    number.approximate(real, imag);
+    auto scaled = [](double mantissa, long exponent) {
+      // far beyond the exponent range of any Real
+      constexpr long Limit = 1L << 20;
+      return std::ldexp(static_cast<Real>(mantissa), 
+          static_cast<int>(std::clamp(exponent, -Limit, Limit))); };
+    auto split = [&scaled](mpf_class& value) {
+      long exponent;
+      double high = mpf_get_d_2exp(&exponent, value.get_mpf_t());
+      Real result = scaled(high, exponent);
+      if (!std::isfinite(result) || result == 0)
+        return result;
+      mpf_class leading(high, ConversionBits);
+      if (exponent >= 0)
+        mpf_mul_2exp(leading.get_mpf_t(), leading.get_mpf_t(), exponent);
+      else
+        mpf_div_2exp(leading.get_mpf_t(), leading.get_mpf_t(), -exponent);
+      value -= leading;
+      double low = mpf_get_d_2exp(&exponent, value.get_mpf_t());
+      return Real(result + scaled(low, exponent)); };
+    return { split(real), split(imag) };
+  }
+  else
+  {
+    Value<Real> value{ make(0), make(0) };
+    number.approximate(value.real, value.imag);
+    return value;
+  }
+}
+
+template<typename Real>
+Value<Real> Evaluation<Real>::variable(const Variable& variable)
+{
+  auto known = m_variables.find(variable.name());
+  if (known != m_variables.end())
+    return known->second;
+  std::shared_ptr<const Expression> expression =
+    m_symbolTable.lookup(std::string(variable.name()));
+  if (!expression)
+    throw UnboundVariableException(__FILE__, __LINE__, variable.name());
+  Value<Real> value = evaluate(*expression);
+  m_variables.emplace(variable.name(), value);
+  return value;
+}
+
+template<typename Real>
+Value<Real> Evaluation<Real>::multiply(
+    const Value<Real>& a, const Value<Real>& b) const
+{
+  if (a.imag == 0 && b.imag == 0)
+    return { Real(a.real * b.real), make(0) };
+  if constexpr (std::is_same_v<Real, FixedPoint>)
+  {
+    auto [real, imag] = FixedPoint::multiply(a.real, a.imag, 
+        b.real, b.imag);
+    return { real, imag };
+  }
+  return { Real(a.real * b.real - a.imag * b.imag),
+    Real(a.real * b.imag + a.imag * b.real) };
+}
+
+template<typename Real>
+Value<Real> Evaluation<Real>::divide(
+    const Value<Real>& a, const Value<Real>& b) const
+{
+  if (b.imag == 0)
+  {
+    if (b.real == 0)
+      throw DivisionByZeroException(__FILE__, __LINE__);
+    return { Real(a.real / b.real), Real(a.imag / b.real) };
+  }
+  if constexpr (std::is_same_v<Real, FixedPoint>)
+  {
+    auto [real, imag] = FixedPoint::divide(a.real, a.imag, 
+        b.real, b.imag);
+    return { real, imag };
+  }
+  if constexpr (std::is_floating_point_v<Real>)
+  {
+    // Smith's algorithm, the square of the divisor overflows or
+    // underflows far inside the range of Real
+    if (std::abs(b.real) >= std::abs(b.imag))
+    {
+      Real ratio = b.imag / b.real;
+      Real denominator = b.real + b.imag * ratio;
+      return { Real((a.real + a.imag * ratio) / denominator),
+        Real((a.imag - a.real * ratio) / denominator) };
+    }
+    Real ratio = b.real / b.imag;
+    Real denominator = b.real * ratio + b.imag;
+    return { Real((a.real * ratio + a.imag) / denominator),
+      Real((a.imag * ratio - a.real) / denominator) };
+  }
+  Real norm = b.real * b.real + b.imag * b.imag;
+  return { Real((a.real * b.real + a.imag * b.imag) / norm),
+    Real((a.imag * b.real - a.real * b.imag) / norm) };
+}
+
+// each part is reduced on its own like in exact arithmetic, the
+// result has the sign of the divisor
+template<typename Real>
+Value<Real> Evaluation<Real>::modulo(
+    const Value<Real>& a, const Value<Real>& b) const
+{
+  if constexpr (std::is_same_v<Real, Ball>)
+    if (b.imag.sign() == 0 && b.imag != 0)
+      throw PrecisionLossException(__FILE__, __LINE__, m_precision);
+  if (b.imag != 0)
+    throw ModuloComplexNumberException(__FILE__, __LINE__,
+        format(a, m_digits), format(b, m_digits));
+  if constexpr (std::is_same_v<Real, FixedPoint>)
+    return { a.real % b.real, a.imag % b.real };
+  else
+  {
+    if (b.real == 0)
+      throw DivisionByZeroException(__FILE__, __LINE__);
+    using std::floor;
+    auto reduce = [&b](const Real& value) {
+      return Real(value - b.real * Real(floor(Real(value / b.real)))); };
+    return { reduce(a.real), reduce(a.imag) };
+  }
+}
+
+template<typename Real>
+Value<Real> Evaluation<Real>::power(
+    Value<Real> base, unsigned long exponent) const
+{
+  Value<Real> result{ make(1), make(0) };
+  while (exponent > 0)
+  {
+    StatementBudget::checkpoint();
+    if (exponent & 1)
+      result = multiply(result, base);
+    exponent >>= 1;
+    if (exponent > 0)
+      base = multiply(base, base);
+  }
+  return result;
+}
+
+// left to right over the bits of the exponent, which can be larger
+// than a word
+template<typename Real>
+Value<Real> Evaluation<Real>::power(
+    const Value<Real>& base, ComplexNumber exponent) const
+{
+  exponent.normalize();
+  if (exponent.imaginary() != 0)
+    throw PowerIllegalExponentException(__FILE__, __LINE__,
+        PowerIllegalExponentException::ComplexExponent,
+        exponent.to_string());
+  if (exponent.real().get_den() != 1)
+    throw PowerIllegalExponentException(__FILE__, __LINE__,
+        PowerIllegalExponentException::RationalExponent,
+        exponent.to_string());
+  mpz_class bits = abs(exponent.real().get_num());
+  Value<Real> factor = exponent.real() < 0 ?
+    divide({ make(1), make(0) }, base) : base;
+  Value<Real> result{ make(1), make(0) };
+  for (std::size_t bit = mpz_sizeinbase(bits.get_mpz_t(), 2); bit-- > 0;)
+  {
+    StatementBudget::checkpoint();
+    result = multiply(result, result);
+    if (mpz_tstbit(bits.get_mpz_t(), bit))
+      result = multiply(result, factor);
+  }
+  return result;
+}
+
+template<typename Real>
+ComplexNumber Evaluation<Real>::exact(const Expression& expression)
+{
+  switch (expression.kind())
+  {
+    case ObjectKind::Number:
+      return static_cast<const Number&>(expression).number();
+    case ObjectKind::Variable:
+    {
+      auto& variable = static_cast<const Variable&>(expression);
+      auto known = m_exact.find(variable.name());
+      if (known != m_exact.end())
+        return known->second;
+      std::shared_ptr<const Expression> content =
+        m_symbolTable.lookup(std::string(variable.name()));
+      if (!content)
+        throw UnboundVariableException(__FILE__, __LINE__, 
+            variable.name());
+      ComplexNumber value = exact(*content);
+      m_exact.emplace(variable.name(), value);
+      return value;
+    }
+    case ObjectKind::UnaryMinus:
+      return exact(
+          static_cast<const UnaryMinusExpression&>(expression).inner())
+        .negate();
+    case ObjectKind::ArithmeticExpression:
+      break;
+    case ObjectKind::Assignment:
+      assert(false);
+  }
+  auto& arithmetic = static_cast<const ArithmeticExpression&>(expression);
+  ComplexNumber a = exact(arithmetic.left());
+  ComplexNumber b = exact(arithmetic.right());
+  switch (arithmetic.operation())
+  {
+    case ArithmeticExpression::Add:
+      return a + b;
+    case ArithmeticExpression::Subtract:
+      return a - b;
+    case ArithmeticExpression::Multiply:
+      return ComplexNumber(a * b);
+    case ArithmeticExpression::Divide:
+      return a / b;
+    case ArithmeticExpression::Modulo:
+      return a % b;
+    case ArithmeticExpression::Power:
+      return a ^ b;
+  }
+  assert(false);
+  return a;
+}
+
+template<typename Real>
+Value<Real> Evaluation<Real>::power(
+    const Value<Real>& a, const Value<Real>& b) const
+{
+  if constexpr (!std::is_floating_point_v<Real>)
+  {
+    if constexpr (std::is_same_v<Real, Ball>)
+      if (!b.real.isExact() || !b.imag.isExact())
+        throw PrecisionLossException(__FILE__, __LINE__, m_precision);
+    if (b.imag != 0)
+      throw PowerIllegalExponentException(__FILE__, __LINE__,
+          PowerIllegalExponentException::ComplexExponent,
+          format(b, m_digits));
+    if (!isInteger(b.real))
+      throw PowerIllegalExponentException(__FILE__, __LINE__,
+          PowerIllegalExponentException::RationalExponent,
+          format(b, m_digits));
+    std::optional<long> integer = toLong(b.real);
+    if (!integer)
+      throw ExponentiationOverflow(__FILE__, __LINE__, format(b, m_digits));
+    long exponent = *integer;
+    if (exponent >= 0)
+      return power(a, static_cast<unsigned long>(exponent));
+    return divide({ make(1), make(0) },
+        power(a, 0ul - static_cast<unsigned long>(exponent)));
+  }
+  else
+  {
+    // integral exponents of real numbers are as exact as pow allows,
+    // those of complex ones are repeated multiplications
+    bool integral = b.imag == 0 && std::nearbyint(b.real) == b.real;
+    if (a.imag == 0 && b.imag == 0 && (integral || a.real >= 0))
+      return { std::pow(a.real, b.real), 0 };
+    if (integral && std::fabs(b.real) < 0x1p62)
+    {
+      long exponent = static_cast<long>(b.real);
+      if (exponent >= 0)
+        return power(a, static_cast<unsigned long>(exponent));
+      return divide({ 1, 0 },
+          power(a, 0ul - static_cast<unsigned long>(exponent)));
+    }
+    std::complex<Real> value = std::pow(std::complex<Real>(a.real, a.imag),
+        std::complex<Real>(b.real, b.imag));
+    return { value.real(), value.imag() };
+  }
+}
+
+template<typename Real>
+std::string evaluate(const Expression& expression,
+    const SymbolTable& symbolTable, unsigned long bits,
+    unsigned int digits)
+{
+  Evaluation<Real> evaluation(symbolTable, bits, digits);
+  return format(evaluation.evaluate(expression), digits);
+}
+
+std::string evaluateBall(const Expression& expression,
+    const SymbolTable& symbolTable, unsigned long bits,
+    unsigned int digits, unsigned int minimumDigits)
+{
+  Evaluation<Ball> evaluation(symbolTable, bits, digits);
+  Value<Ball> value = evaluation.evaluate(expression);
+  for (const Ball* part : { &value.real, &value.imag })
+    if (*part != 0 && part->correctDigits(digits) < minimumDigits)
+      throw PrecisionLossException(__FILE__, __LINE__, bits);
+  return format(value, digits);
+}
+
+std::string evaluateModular(const Expression& expression,
+    const SymbolTable& symbolTable, const mpz_class& modulus,
+    unsigned int digits)
+{
+  Modulus field(modulus);
+  Evaluation<Residue> evaluation(symbolTable, field, digits);
+  return format(evaluation.evaluate(expression), digits);
+}
+
+} /* namespace */
+
+ApproximateEvaluator::ApproximateEvaluator(
+    const Approximation& approximation)
+  : m_approximation{approximation}
+{ 
+  assert(approximation.precision != Precision::Exact); 
+  assert(approximation.precision != Precision::Modular ||
+      approximation.modulus >= 2);
+}
+
+unsigned int ApproximateEvaluator::digits() const
+{
+  switch (m_approximation.precision)
+  {
+    case Precision::Exact:
+    case Precision::Double:
+      return std::numeric_limits<double>::digits10;
+    case Precision::LongDouble:
+      return std::numeric_limits<long double>::digits10;
+    case Precision::Decimal:
+      return m_approximation.places;
+    case Precision::Modular:
+      return mpz_sizeinbase(m_approximation.modulus.get_mpz_t(), 10);
+    case Precision::Float:
+    case Precision::Ball:
+      // log10(2) = 0.30103
+      return std::max(1ul, m_approximation.bits * 30103 / 100000);
+  }
+  return 0;
+}
+
+std::string ApproximateEvaluator::evaluate(const Expression& expression,
+    const SymbolTable& symbolTable) const
+{
+  switch (m_approximation.precision)
+  {
+    case Precision::Exact:
+      break;
+    case Precision::Double:
+      return kcalc::evaluate<double>(expression, symbolTable,
+          m_approximation.bits, digits());
+    case Precision::LongDouble:
+      return kcalc::evaluate<long double>(expression, symbolTable,
+          m_approximation.bits, digits());
+    case Precision::Float:
+      return kcalc::evaluate<mpf_class>(expression, symbolTable,
+          m_approximation.bits, digits());
+    case Precision::Ball:
+      return evaluateBall(expression, symbolTable, m_approximation.bits,
+          digits(), std::min(m_approximation.minimumDigits, digits()));
+    case Precision::Decimal:
+      return kcalc::evaluate<FixedPoint>(expression, symbolTable,
+          m_approximation.places, digits());
+    case Precision::Modular:
+      return evaluateModular(expression, symbolTable, 
+          m_approximation.modulus, digits());
+  }
+  return std::string();
+}
+
+} /* namespace kcalc */
@@ -1,8 +1,15 @@
 #include "Arithmetic.h"
+#include "Allocator.h"
 #include "Exceptions.h"
+#include "Multiplication.h"
+#include "RadixConversion.h"
 
+#include <algorithm>
 #include <cassert>
+#include <climits>
+#include <cmath>
 #include <iterator> 
+#include <sstream>
 
 namespace kcalc 
 { 
@@ -22,128 +29,716 @@ static long parseExponent(const std::string_view& view)
   return val;
 } 
 
+static const long ScaledLiteralThreshold = 4096;
+
+static unsigned long magnitude(long value)
+{
+  return value < 0 ? -static_cast<unsigned long>(value) :
+    static_cast<unsigned long>(value);
+}
+
+// num / 10^k in lowest terms, only factors 2 and 5 can cancel
+static void divideByPowerOfTen(mpq_ptr number, unsigned long k)
+{
+  mpz_ptr num = mpq_numref(number);
+  mpz_ptr den = mpq_denref(number);
+  if (mpz_sgn(num) == 0)
+    return;
+  unsigned long twos = std::min<unsigned long>(mpz_scan1(num, 0), k);
+  mpz_tdiv_q_2exp(num, num, twos);
+  mpz_class five(5);
+  unsigned long fives = mpz_remove(num, num, five.get_mpz_t());
+  if (fives > k)
+  {
+    mpz_class power;
+    mpz_ui_pow_ui(power.get_mpz_t(), 5, fives - k);
+    mpz_mul(num, num, power.get_mpz_t());
+    fives = k;
+  }
+  if (twos == 0 && fives == 0)
+    RadixConversion::powerOfTen(den, k);
+  else
+  {
+    mpz_ui_pow_ui(den, 5, k - fives);
+    mpz_mul_2exp(den, den, k - twos);
+  }
+}
+
 ComplexNumber::ComplexNumber(const std::string_view& text)
-  : m_real(), m_imaginary()
+  : m_real(), m_imaginary(), m_scale{0}
 {
-  auto end = text.end();
+  assert(!text.empty());
+  std::size_t size = text.size();
   bool complexI = false;
   if (text.back() == 'i') 
   {
-    end = text.begin() + text.size() - 1;
+    --size;
     complexI = true;
   } 
-  auto decimalPoint = std::find_if(text.begin(), end, 
-      [](char c) { return c == '.'; });
-  auto exponential = std::find_if(text.begin(), end, 
-      [](char c) { return c == 'E' || c == 'e'; });
-  std::string number(text.begin(), 
-      decimalPoint != end ? decimalPoint : 
-      ( exponential != end ? exponential :
-        end ));
-  if (decimalPoint != end && 
-      decimalPoint + 1 != exponential)
-  {
-    number.append(decimalPoint+1, exponential);
-    int numberOfDecimals = std::distance(decimalPoint + 1,
-      exponential); 
-    number.append("/1");
-    for(int i = 0; i < numberOfDecimals; ++i)
-      number.append("0");
-  }
-  if (number.empty())
-    number = "1"; 
-  mpq_t num;
-  mpq_init(num);
-  mpq_set_str(num, number.c_str(), 10);
-  mpq_canonicalize(num);
-
-  if (exponential != end)
-  {
-    ++exponential;
-    assert(exponential != end);
-    long exp = parseExponent(
-        std::string_view(exponential, 
-          std::distance(exponential, end)));
-    unsigned long posExp = std::abs(exp);
-    mpz_t tenPow;
-    mpz_init(tenPow);
-    mpz_set_ui(tenPow, 10);
-    mpz_ui_pow_ui(tenPow, 10, posExp);
-    mpq_t tenPowQ;
-    mpq_init(tenPowQ);
-    mpq_set_z(tenPowQ, tenPow);
-    mpz_clear(tenPow); 
-    if (exp > 0)
-      mpq_mul(num, num, tenPowQ);
-    else
-      mpq_div(num, num, tenPowQ);
-    mpq_clear(tenPowQ);
+  std::size_t start = 0;
+  bool negative = false;
+  if (start < size && (text[start] == '-' || text[start] == '+'))
+  {
+    negative = text[start] == '-';
+    ++start;
+  }
+  std::size_t exponential = std::min(size, 
+      text.find_first_of("eE", start));
+  std::size_t decimalPoint = std::min(exponential, 
+      text.find('.', start)); 
+  std::string_view integerPart = 
+    text.substr(start, decimalPoint - start);
+  std::string_view fractionalPart = decimalPoint < exponential ?
+    text.substr(decimalPoint + 1, exponential - decimalPoint - 1) :
+    std::string_view();
+  bool noDigits = integerPart.empty() && fractionalPart.empty();
+  while (!fractionalPart.empty() && fractionalPart.back() == '0')
+    fractionalPart.remove_suffix(1);
+  long scale = -static_cast<long>(fractionalPart.size());
+  if (exponential < size)
+  {
+    std::string_view exponent = 
+      text.substr(exponential + 1, size - exponential - 1);
+    long exp = parseExponent(exponent);
+    if (__builtin_add_overflow(scale, exp, &scale))
+      throw ExponentiationOverflow(__FILE__, __LINE__, exponent);
+  }
+
+  mpq_class value;
+  mpz_ptr num = mpq_numref(value.get_mpq_t());
+  if (noDigits)
+    mpz_set_ui(num, 1);
+  else
+    RadixConversion::fromDigits(num, 
+        DigitSequence(integerPart, fractionalPart));
+  if (negative)
+    mpz_neg(num, num);
+  if (mpz_sgn(num) == 0)
+    scale = 0;
+  if (scale <= -ScaledLiteralThreshold || 
+      ScaledLiteralThreshold <= scale)
+    m_scale = scale;
+  else if (scale > 0)
+  {
+    mpz_class power;
+    RadixConversion::powerOfTen(power.get_mpz_t(), scale);
+    mpz_mul(num, num, power.get_mpz_t());
   }
-  mpq_class temp(num); 
+  else if (scale < 0)
+    divideByPowerOfTen(value.get_mpq_t(), magnitude(scale));
   if (complexI)
-    m_imaginary.swap(temp);
+    m_imaginary.swap(value);
   else
-    m_real.swap(temp);
-  mpq_clear(num);
+    m_real.swap(value);
 } 
 
+ComplexNumber& ComplexNumber::normalize()
+{
+  if (m_scale != 0)
+  {
+    mpq_class power;
+    RadixConversion::powerOfTen(
+        mpq_numref(power.get_mpq_t()), magnitude(m_scale));
+    auto apply = m_scale > 0 ? mpq_mul : mpq_div;
+    if (m_real != 0)
+      apply(m_real.get_mpq_t(), m_real.get_mpq_t(), 
+          power.get_mpq_t());
+    if (m_imaginary != 0)
+      apply(m_imaginary.get_mpq_t(), m_imaginary.get_mpq_t(), 
+          power.get_mpq_t());
+    m_scale = 0;
+  }
+  return *this;
+}
+
+// writes the integer value * 10^zeros
+static void writeInteger(std::ostream& out, mpz_srcptr value,
+    bool withSign, unsigned long zeros, const DisplayFormat& format)
+{
+  if (mpz_sgn(value) == 0)
+  {
+    out.put('0');
+    return;
+  }
+  if (withSign && mpz_sgn(value) < 0)
+    out.put('-');
+  mpz_t absolute;
+  mpz_roinit_n(absolute, mpz_limbs_read(value), mpz_size(value));
+  std::size_t count = format.digits;
+  if (format.mode == DisplayMode::Truncated &&
+      mpz_sizeinbase(absolute, 10) + zeros > 2 * count + 3)
+  {
+    std::size_t digits = RadixConversion::digitCount(absolute);
+    if (digits + zeros > 2 * count + 3)
+    {
+      std::string leading = RadixConversion::leadingDigits(
+          absolute, std::min(count, digits));
+      out << leading;
+      RadixConversion::writeZeros(out, count - leading.size());
+      out << "...";
+      if (zeros >= count)
+        RadixConversion::writeZeros(out, count);
+      else
+      {
+        out << RadixConversion::trailingDigits(absolute, count - zeros);
+        RadixConversion::writeZeros(out, zeros);
+      }
+      out << " (" << digits + zeros << " digits)";
+      return;
+    }
+  }
+  RadixConversion::writeDigits(out, absolute);
+  RadixConversion::writeZeros(out, zeros);
+}
+
+static void writeScientific(std::ostream& out, mpq_srcptr value,
+    bool withSign, long scale, const DisplayFormat& format)
+{
+  if (withSign && mpq_sgn(value) < 0)
+    out.put('-');
+  std::size_t count = std::max(1u, format.digits);
+  long exponent;
+  std::string digits = RadixConversion::significantDigits(
+      mpq_numref(value), mpq_denref(value), count, exponent);
+  out.put(digits[0]);
+  if (count > 1)
+  {
+    out.put('.');
+    out.write(digits.data() + 1, count - 1);
+  }
+  exponent += scale - 1;
+  out << 'e' << (exponent < 0 ? '-' : '+') << magnitude(exponent);
+}
+
+static double bitSize(const mpq_class& number)
+{
+  if (number == 0)
+    return 0;
+  double bits = mpz_sizeinbase(number.get_num_mpz_t(), 2);
+  if (number.get_den() != 1)
+    bits += mpz_sizeinbase(number.get_den_mpz_t(), 2);
+  return bits;
+}
+
+double ComplexNumber::bitSize() const
+{
+  // log2(10) bits per pending decimal digit
+  return kcalc::bitSize(m_real) + kcalc::bitSize(m_imaginary) +
+    3.33 * std::abs(double(m_scale));
+}
+
+std::complex<double> ComplexNumber::approximate() const
+{
+  // beyond the range of double the scale is applied in floating point
+  if (magnitude(m_scale) > 400)
+  {
+    double power = std::pow(10.0, double(m_scale));
+    return { m_real.get_d() * power, m_imaginary.get_d() * power };
+  }
+  if (m_scale != 0)
+    return ComplexNumber(*this).normalize().approximate();
+  return { m_real.get_d(), m_imaginary.get_d() };
+}
+
+void ComplexNumber::approximate(mpf_class& real,
+    mpf_class& imaginary) const
+{
+  real = m_real;
+  imaginary = m_imaginary;
+  if (m_scale == 0)
+    return;
+  mpf_class power(10, std::max(real.get_prec(), imaginary.get_prec()));
+  mpf_pow_ui(power.get_mpf_t(), power.get_mpf_t(), magnitude(m_scale));
+  if (m_scale > 0)
+  {
+    real *= power;
+    imaginary *= power;
+  }
+  else
+  {
+    real /= power;
+    imaginary /= power;
+  }
+}
+
+std::optional<long> ComplexNumber::toLong() const
+{
+  if (!isInteger())
+    return std::nullopt;
+  if (m_real == 0)
+    return 0;
+  // 10^19 and more do not fit, unless the mantissa has a denominator
+  if (m_scale > 18 && hasIntegerParts())
+    return std::nullopt;
+  if (m_scale != 0)
+    return ComplexNumber(*this).normalize().toLong();
+  if (!m_real.get_num().fits_slong_p())
+    return std::nullopt;
+  return m_real.get_num().get_si();
+}
+
 std::string ComplexNumber::to_string() const 
+{ return to_string(DisplayFormat()); }
+
+std::string ComplexNumber::to_string(
+    const DisplayFormat& format) const 
+{
+  std::ostringstream stream;
+  write(stream, format);
+  return stream.str();
+}
+
+void ComplexNumber::write(std::ostream& out, 
+    const DisplayFormat& format) const
 {
-  std::string result;
+  bool scientific = format.mode == DisplayMode::Scientific;
+  if (!scientific && (m_scale < 0 || 
+        (m_scale > 0 && !hasIntegerParts())))
+  {
+    ComplexNumber(*this).normalize().write(out, format);
+    return;
+  }
+  unsigned long zeros = scientific ? 0 : m_scale;
   bool printReal = m_real != 0;
   bool printImaginary = m_imaginary != 0;
   if (printReal)
-    result.append(m_real.get_str());
+  {
+    if (scientific)
+      writeScientific(out, m_real.get_mpq_t(), true, m_scale, format);
+    else
+    {
+      writeInteger(out, m_real.get_num_mpz_t(), true, zeros, format);
+      if (m_real.get_den() != 1)
+      {
+        out.put('/');
+        writeInteger(out, m_real.get_den_mpz_t(), true, 0, format);
+      }
+    }
+  }
   if (printReal && printImaginary)
   {
     if (m_imaginary > 0)
-      result.append(" + ");
+      out << " + ";
     else
-      result.append(" - ");
+      out << " - ";
   }
   if (printImaginary)
   {
-    mpq_class num = printReal ?
-      abs(m_imaginary.get_num()) :
-      m_imaginary.get_num();
-    mpz_class den = m_imaginary.get_den();
-    if (num != 1 && num != -1)
-      result.append(num.get_str());
-    if (num == -1)
-      result.append("-");
-    result.append("i"); 
-    if (den != 1)
+    if (scientific)
+      writeScientific(out, m_imaginary.get_mpq_t(), !printReal, 
+          m_scale, format);
+    else
+    {
+      mpz_srcptr num = m_imaginary.get_num_mpz_t();
+      if (zeros != 0 || mpz_cmpabs_ui(num, 1) != 0)
+        writeInteger(out, num, !printReal, zeros, format);
+      else if (!printReal && mpz_sgn(num) < 0)
+        out.put('-');
+    }
+    out.put('i'); 
+    if (!scientific && m_imaginary.get_den() != 1)
     {
-      result.append("/");
-      result.append(den.get_str());
+      out.put('/');
+      writeInteger(out, m_imaginary.get_den_mpz_t(), true, 0, format);
     }
   }
   if (!printReal && !printImaginary)
-    result.append("0");
-  return result;
+    out.put('0');
 } 
 
+static long combineScales(long left, long right, bool subtract)
+{
+  long scale;
+  if (subtract ? __builtin_sub_overflow(left, right, &scale) :
+      __builtin_add_overflow(left, right, &scale))
+    throw ExponentiationOverflow(__FILE__, __LINE__, 
+        std::to_string(right));
+  return scale;
+}
+
+ComplexNumber& ComplexNumber::operator*=(
+    const ComplexNumber& other)
+{
+  long scale = combineScales(m_scale, other.m_scale, false);
+  if (StatementBudget::current() != nullptr)
+    StatementBudget::checkSize(bitSize() + other.bitSize());
+  multiplyRaw(other);
+  m_scale = scale;
+  return *this;
+}
+
+ComplexNumber& ComplexNumber::multiplyRaw(
+    const ComplexNumber& other)
+{
+  if (hasIntegerParts() && other.hasIntegerParts())
+  {
+    mpz_srcptr a = m_real.get_num_mpz_t();
+    mpz_srcptr b = m_imaginary.get_num_mpz_t();
+    mpz_class real, imag;
+    if (this == &other)
+    {
+      // (a + bi)^2 == (a + b)(a - b) + 2abi
+      mpz_class temp;
+      mpz_add(real.get_mpz_t(), a, b);
+      mpz_sub(temp.get_mpz_t(), a, b);
+      Multiplication::multiply(real.get_mpz_t(), 
+          real.get_mpz_t(), temp.get_mpz_t());
+      Multiplication::multiply(imag.get_mpz_t(), a, b);
+      mpz_mul_2exp(imag.get_mpz_t(), imag.get_mpz_t(), 1);
+    }
+    else
+    {
+      mpz_srcptr c = other.m_real.get_num_mpz_t();
+      mpz_srcptr d = other.m_imaginary.get_num_mpz_t();
+      if (Multiplication::worthParallel(a, c) || 
+          Multiplication::worthParallel(b, d) ||
+          Multiplication::worthParallel(a, d) ||
+          Multiplication::worthParallel(b, c))
+      {
+        mpz_class temp;
+        Multiplication::multiply(real.get_mpz_t(), a, c);
+        Multiplication::multiply(temp.get_mpz_t(), b, d);
+        mpz_sub(real.get_mpz_t(), real.get_mpz_t(), temp.get_mpz_t());
+        Multiplication::multiply(imag.get_mpz_t(), a, d);
+        Multiplication::multiply(temp.get_mpz_t(), b, c);
+        mpz_add(imag.get_mpz_t(), imag.get_mpz_t(), temp.get_mpz_t());
+      }
+      else
+      {
+        mpz_mul(real.get_mpz_t(), a, c);
+        mpz_submul(real.get_mpz_t(), b, d);
+        mpz_mul(imag.get_mpz_t(), a, d);
+        mpz_addmul(imag.get_mpz_t(), b, c);
+      }
+    }
+    mpz_swap(m_real.get_num_mpz_t(), real.get_mpz_t());
+    mpz_swap(m_imaginary.get_num_mpz_t(), imag.get_mpz_t());
+  }
+  else if (other.m_imaginary == 0 && this != &other)
+  {
+    mpq_mul(m_real.get_mpq_t(), m_real.get_mpq_t(), 
+        other.m_real.get_mpq_t());
+    mpq_mul(m_imaginary.get_mpq_t(), m_imaginary.get_mpq_t(), 
+        other.m_real.get_mpq_t());
+  }
+  else
+  {
+    mpq_class real, imag, temp;
+    mpq_mul(real.get_mpq_t(), m_real.get_mpq_t(), 
+        other.m_real.get_mpq_t());
+    mpq_mul(temp.get_mpq_t(), m_imaginary.get_mpq_t(), 
+        other.m_imaginary.get_mpq_t());
+    mpq_sub(real.get_mpq_t(), real.get_mpq_t(), temp.get_mpq_t());
+    mpq_mul(imag.get_mpq_t(), m_real.get_mpq_t(), 
+        other.m_imaginary.get_mpq_t());
+    mpq_mul(temp.get_mpq_t(), m_imaginary.get_mpq_t(), 
+        other.m_real.get_mpq_t());
+    mpq_add(imag.get_mpq_t(), imag.get_mpq_t(), temp.get_mpq_t());
+    m_real.swap(real);
+    m_imaginary.swap(imag);
+  }
+  return *this;
+}
+
+ComplexNumber& ComplexNumber::fusedProduct(
+    const ComplexNumber& left,
+    const ComplexNumber& right,
+    bool subtract)
+{
+  if (this != &left && this != &right &&
+      m_scale == 0 && left.m_scale == 0 && right.m_scale == 0 &&
+      hasIntegerParts() && left.hasIntegerParts() &&
+      right.hasIntegerParts())
+  {
+    // (a + bi)(c + di) == (ac - bd) + (ad + bc)i, accumulated in place
+    auto add = subtract ? mpz_submul : mpz_addmul;
+    auto sub = subtract ? mpz_addmul : mpz_submul;
+    mpz_srcptr a = left.m_real.get_num_mpz_t();
+    mpz_srcptr b = left.m_imaginary.get_num_mpz_t();
+    mpz_srcptr c = right.m_real.get_num_mpz_t();
+    mpz_srcptr d = right.m_imaginary.get_num_mpz_t();
+    mpz_ptr re = m_real.get_num_mpz_t();
+    mpz_ptr im = m_imaginary.get_num_mpz_t();
+    add(re, a, c);
+    sub(re, b, d);
+    add(im, a, d);
+    add(im, b, c);
+  }
+  else
+  {
+    ComplexNumber product(left);
+    product *= right;
+    if (subtract)
+      *this -= product;
+    else
+      *this += product;
+  }
+  return *this;
+}
+
+ComplexNumber& ComplexNumber::addProduct(
+    const ComplexNumber& left,
+    const ComplexNumber& right)
+{ return fusedProduct(left, right, false); }
+
+ComplexNumber& ComplexNumber::subProduct(
+    const ComplexNumber& left,
+    const ComplexNumber& right)
+{ return fusedProduct(left, right, true); }
+
+ComplexNumber ComplexNumber::product(
+    std::vector<ComplexNumber>& factors)
+{
+  assert(!factors.empty());
+  for (std::size_t size = factors.size(); size > 1; size = (size + 1) / 2)
+  {
+    for (std::size_t i = 0; i + 1 < size; i += 2)
+    {
+      factors[i] *= factors[i + 1];
+      if (i != 0)
+        factors[i / 2] = std::move(factors[i]);
+    }
+    if (size % 2 != 0)
+      factors[size / 2] = std::move(factors[size - 1]);
+  }
+  ComplexNumber result(std::move(factors.front()));
+  factors.clear();
+  return result;
+}
+
+// numerators[i] / denominators[i] summed pairwise, the result is left
+// in the first entries
+static void splitSum(std::vector<mpz_class>& numerators,
+    std::vector<mpz_class>& denominators)
+{
+  mpz_class temp;
+  for (std::size_t size = numerators.size(); size > 1; 
+      size = (size + 1) / 2)
+  {
+    for (std::size_t i = 0; i + 1 < size; i += 2)
+    {
+      mpz_ptr a = numerators[i].get_mpz_t();
+      mpz_ptr b = denominators[i].get_mpz_t();
+      mpz_srcptr c = numerators[i + 1].get_mpz_t();
+      mpz_srcptr d = denominators[i + 1].get_mpz_t();
+      // a/b + c/d == (a d + c b) / (b d), equal denominators stay
+      if (mpz_cmp(b, d) == 0)
+        mpz_add(a, a, c);
+      else
+      {
+        Multiplication::multiply(a, a, d);
+        Multiplication::multiply(temp.get_mpz_t(), c, b);
+        mpz_add(a, a, temp.get_mpz_t());
+        Multiplication::multiply(b, b, d);
+      }
+      numerators[i / 2].swap(numerators[i]);
+      denominators[i / 2].swap(denominators[i]);
+    }
+    if (size % 2 != 0)
+    {
+      numerators[size / 2].swap(numerators[size - 1]);
+      denominators[size / 2].swap(denominators[size - 1]);
+    }
+  }
+}
+
+ComplexNumber ComplexNumber::sum(std::vector<ComplexNumber>& terms)
+{
+  assert(!terms.empty());
+  long scale = terms.front().m_scale;
+  bool sameScale = std::all_of(terms.begin(), terms.end(),
+      [scale](const ComplexNumber& term) { return term.m_scale == scale; });
+  std::vector<mpz_class> numerators(terms.size());
+  std::vector<mpz_class> denominators(terms.size());
+  ComplexNumber result(0);
+  for (mpq_class ComplexNumber::* part : 
+      { &ComplexNumber::m_real, &ComplexNumber::m_imaginary })
+  {
+    for (std::size_t i = 0; i < terms.size(); ++i)
+    {
+      if (!sameScale)
+        terms[i].normalize();
+      mpq_ptr value = (terms[i].*part).get_mpq_t();
+      mpz_swap(numerators[i].get_mpz_t(), mpq_numref(value));
+      mpz_swap(denominators[i].get_mpz_t(), mpq_denref(value));
+    }
+    splitSum(numerators, denominators);
+    mpq_ptr value = (result.*part).get_mpq_t();
+    mpz_swap(mpq_numref(value), numerators.front().get_mpz_t());
+    mpz_swap(mpq_denref(value), denominators.front().get_mpz_t());
+    mpq_canonicalize(value);
+  }
+  result.m_scale = sameScale ? scale : 0;
+  terms.clear();
+  return result;
+}
+
 static void do_floor(mpq_class& number)
 {
   mpq_ptr num = number.get_mpq_t();
   assert(num != nullptr);
-  mpz_t floor;
-  mpz_init(floor);
-  mpz_set_q(floor, num);
-  mpq_t floorQ;
-  mpq_init(floorQ);
-  mpq_set_z(floorQ, floor);
-  mpq_class tmp(floorQ); 
-  if (number < 0 && 
-      tmp != number)
-    tmp -= 1;
-  number.swap(tmp);
-  mpq_clear(floorQ);
-  mpz_clear(floor);
+  if (mpz_cmp_ui(mpq_denref(num), 1) != 0)
+  {
+    mpz_fdiv_q(mpq_numref(num), mpq_numref(num), mpq_denref(num));
+    mpz_set_ui(mpq_denref(num), 1);
+  }
+}
+
+static void do_modulo(mpq_class& number, 
+    const mpq_class& modulus,
+    mpz_class& temp1, mpz_class& temp2)
+{
+  mpq_ptr num = number.get_mpq_t();
+  mpq_srcptr mod = modulus.get_mpq_t();
+  assert(num != nullptr && mod != nullptr);
+  if (mpz_cmp_ui(mpq_denref(num), 1) == 0 &&
+      mpz_cmp_ui(mpq_denref(mod), 1) == 0)
+    mpz_fdiv_r(mpq_numref(num), mpq_numref(num), mpq_numref(mod));
+  else
+  {
+    // a/b mod p/q == ((a*q) mod (p*b)) / (b*q)
+    mpz_mul(temp1.get_mpz_t(), mpq_numref(num), mpq_denref(mod));
+    mpz_mul(temp2.get_mpz_t(), mpq_numref(mod), mpq_denref(num));
+    mpz_fdiv_r(mpq_numref(num), temp1.get_mpz_t(), temp2.get_mpz_t());
+    mpz_mul(mpq_denref(num), mpq_denref(num), mpq_denref(mod));
+    mpq_canonicalize(num);
+  }
+}
+
+ComplexNumber& ComplexNumber::operator/=(
+    const ComplexNumber& other)
+{
+  if (this == &other)
+  {
+    if (m_real == 0 && m_imaginary == 0)
+      throw DivisionByZeroException(__FILE__, __LINE__);
+    m_real = 1;
+    m_imaginary = 0;
+    m_scale = 0;
+    return *this;
+  }
+  long scale = combineScales(m_scale, other.m_scale, true);
+  divideRaw(other);
+  m_scale = scale;
+  return *this;
+}
+
+ComplexNumber& ComplexNumber::divideRaw(
+    const ComplexNumber& other)
+{
+  assert(this != &other);
+  if (other.m_imaginary == 0)
+  {
+    if (other.m_real == 0)
+      throw DivisionByZeroException(__FILE__, __LINE__);
+    mpq_div(m_real.get_mpq_t(), m_real.get_mpq_t(), 
+        other.m_real.get_mpq_t());
+    mpq_div(m_imaginary.get_mpq_t(), m_imaginary.get_mpq_t(), 
+        other.m_real.get_mpq_t());
+  }
+  else if (hasIntegerParts() && other.hasIntegerParts())
+  {
+    // (a + bi) / (c + di) == ((ac + bd) + (bc - ad)i) / (c^2 + d^2)
+    mpz_srcptr a = m_real.get_num_mpz_t();
+    mpz_srcptr b = m_imaginary.get_num_mpz_t();
+    mpz_srcptr c = other.m_real.get_num_mpz_t();
+    mpz_srcptr d = other.m_imaginary.get_num_mpz_t();
+    mpz_class norm, real, imag;
+    mpz_mul(norm.get_mpz_t(), c, c);
+    mpz_addmul(norm.get_mpz_t(), d, d);
+    mpz_mul(real.get_mpz_t(), a, c);
+    mpz_addmul(real.get_mpz_t(), b, d);
+    mpz_mul(imag.get_mpz_t(), b, c);
+    mpz_submul(imag.get_mpz_t(), a, d);
+    mpq_ptr re = m_real.get_mpq_t();
+    mpq_ptr im = m_imaginary.get_mpq_t();
+    mpz_swap(mpq_numref(re), real.get_mpz_t());
+    mpz_set(mpq_denref(re), norm.get_mpz_t());
+    mpz_swap(mpq_numref(im), imag.get_mpz_t());
+    mpz_swap(mpq_denref(im), norm.get_mpz_t());
+    mpq_canonicalize(re);
+    mpq_canonicalize(im);
+  }
+  else
+  {
+    mpq_class norm, real, imag, temp;
+    mpq_mul(norm.get_mpq_t(), other.m_real.get_mpq_t(), 
+        other.m_real.get_mpq_t());
+    mpq_mul(temp.get_mpq_t(), other.m_imaginary.get_mpq_t(), 
+        other.m_imaginary.get_mpq_t());
+    mpq_add(norm.get_mpq_t(), norm.get_mpq_t(), temp.get_mpq_t());
+    mpq_mul(real.get_mpq_t(), m_real.get_mpq_t(), 
+        other.m_real.get_mpq_t());
+    mpq_mul(temp.get_mpq_t(), m_imaginary.get_mpq_t(), 
+        other.m_imaginary.get_mpq_t());
+    mpq_add(real.get_mpq_t(), real.get_mpq_t(), temp.get_mpq_t());
+    mpq_mul(imag.get_mpq_t(), m_imaginary.get_mpq_t(), 
+        other.m_real.get_mpq_t());
+    mpq_mul(temp.get_mpq_t(), m_real.get_mpq_t(), 
+        other.m_imaginary.get_mpq_t());
+    mpq_sub(imag.get_mpq_t(), imag.get_mpq_t(), temp.get_mpq_t());
+    mpq_div(m_real.get_mpq_t(), real.get_mpq_t(), norm.get_mpq_t());
+    mpq_div(m_imaginary.get_mpq_t(), imag.get_mpq_t(), norm.get_mpq_t());
+  }
+  return *this;
+}
+
+ComplexNumber& ComplexNumber::operator%=(
+    const ComplexNumber& other)
+{
+  if (other.m_imaginary != 0)
+    throw ModuloComplexNumberException(__FILE__, __LINE__,
+        to_string(), other.to_string());
+  if (other.m_real == 0)
+    throw DivisionByZeroException(__FILE__, __LINE__);
+  if (this == &other)
+  {
+    m_real = 0;
+    m_scale = 0;
+  }
+  else if (other.m_scale != 0)
+    *this %= ComplexNumber(other).normalize();
+  else
+  {
+    normalize();
+    mpz_class temp1, temp2;
+    if (m_real != 0)
+      do_modulo(m_real, other.m_real, temp1, temp2);
+    if (m_imaginary != 0)
+      do_modulo(m_imaginary, other.m_real, temp1, temp2);
+  }
+  return *this;
+}
+
+ComplexNumber& ComplexNumber::inverse()
+{
+  m_scale = combineScales(0, m_scale, true);
+  if (m_imaginary == 0)
+  {
+    if (m_real == 0)
+      throw DivisionByZeroException(__FILE__, __LINE__);
+    mpq_inv(m_real.get_mpq_t(), m_real.get_mpq_t());
+  }
+  else
+  {
+    mpq_class divisor, temp;
+    mpq_mul(divisor.get_mpq_t(), m_real.get_mpq_t(), 
+        m_real.get_mpq_t());
+    mpq_mul(temp.get_mpq_t(), m_imaginary.get_mpq_t(), 
+        m_imaginary.get_mpq_t());
+    mpq_add(divisor.get_mpq_t(), divisor.get_mpq_t(), temp.get_mpq_t());
+    mpq_div(m_real.get_mpq_t(), m_real.get_mpq_t(), 
+        divisor.get_mpq_t());
+    mpq_div(m_imaginary.get_mpq_t(), m_imaginary.get_mpq_t(), 
+        divisor.get_mpq_t());
+    mpq_neg(m_imaginary.get_mpq_t(), m_imaginary.get_mpq_t());
+  }
+  return *this;
 }
 
 ComplexNumber& ComplexNumber::floor() 
 {
+  normalize();
   if (m_real != 0)
     do_floor(m_real);
   if (m_imaginary != 0)
@@ -158,6 +753,7 @@ void ComplexNumber::binExp(unsigned long exponent)
   m_imaginary = 0;
   while (exponent > 0)
   {
+    StatementBudget::checkpoint();
     if (exponent & 1) 
       *this *= copy;
     copy *= copy;
@@ -168,6 +764,8 @@ void ComplexNumber::binExp(unsigned long exponent)
 ComplexNumber& ComplexNumber::operator^=(
     const ComplexNumber& other)
 {
+  if (other.m_scale != 0)
+    return *this ^= ComplexNumber(other).normalize();
   if (other.m_imaginary != 0)
     throw PowerIllegalExponentException(__FILE__, __LINE__,
         PowerIllegalExponentException::ComplexExponent, 
@@ -182,6 +780,14 @@ ComplexNumber& ComplexNumber::operator^=(
     throw ExponentiationOverflow(__FILE__, __LINE__,
         other.to_string());  
   long lexp = exp.get_si();
+  long scale;
+  if (__builtin_mul_overflow(m_scale, lexp, &scale))
+    throw ExponentiationOverflow(__FILE__, __LINE__,
+        other.to_string());  
+  // the result has about exponent times the bits beyond the leading
+  // one, impossible powers are rejected before they are computed
+  StatementBudget::checkSize((bitSize() - 1) * magnitude(lexp));
+  m_scale = 0;
   if (lexp == 0)
   {
     m_real = 1;
@@ -191,9 +797,79 @@ ComplexNumber& ComplexNumber::operator^=(
   {
     if (lexp < 0)
       inverse();
-    binExp(std::abs(lexp));
+    binExp(magnitude(lexp));
   }
+  m_scale = scale;
   return *this;
 } 
 
-} /* namespace kcalc */ 
+bool ComplexNumber::canPowMod(
+    const ComplexNumber& exponent,
+    const ComplexNumber& modulus) const
+{
+  if (m_scale != 0 || exponent.m_scale != 0 || modulus.m_scale != 0)
+    return ComplexNumber(*this).normalize().canPowMod(
+        ComplexNumber(exponent).normalize(),
+        ComplexNumber(modulus).normalize());
+  return isGaussianInteger() && 
+    exponent.isInteger() && exponent.m_real >= 0 &&
+    modulus.isInteger() && modulus.m_real != 0;
+}
+
+static void gaussianMulMod(
+    mpz_ptr re, mpz_ptr im,
+    mpz_srcptr otherRe, mpz_srcptr otherIm,
+    mpz_srcptr modulus, mpz_ptr temp1, mpz_ptr temp2)
+{
+  mpz_mul(temp1, re, otherRe);
+  mpz_submul(temp1, im, otherIm);
+  mpz_mul(temp2, re, otherIm);
+  mpz_addmul(temp2, im, otherRe);
+  mpz_fdiv_r(re, temp1, modulus);
+  mpz_fdiv_r(im, temp2, modulus);
+}
+
+ComplexNumber& ComplexNumber::powMod(
+    const ComplexNumber& exponent,
+    const ComplexNumber& modulus)
+{
+  assert(canPowMod(exponent, modulus));
+  if (exponent.m_scale != 0 || modulus.m_scale != 0)
+    return powMod(ComplexNumber(exponent).normalize(),
+        ComplexNumber(modulus).normalize());
+  normalize();
+  mpz_srcptr exp = exponent.m_real.get_num_mpz_t();
+  mpz_class mod = abs(modulus.m_real.get_num());
+  mpz_ptr re = m_real.get_num_mpz_t();
+  mpz_ptr im = m_imaginary.get_num_mpz_t();
+  if (m_imaginary == 0)
+    mpz_powm(re, re, exp, mod.get_mpz_t());
+  else
+  {
+    mpz_class baseRe, baseIm, temp1, temp2;
+    mpz_fdiv_r(baseRe.get_mpz_t(), re, mod.get_mpz_t());
+    mpz_fdiv_r(baseIm.get_mpz_t(), im, mod.get_mpz_t());
+    mpz_set_ui(re, 1);
+    mpz_fdiv_r(re, re, mod.get_mpz_t());
+    mpz_set_ui(im, 0);
+    for (size_t bit = mpz_sizeinbase(exp, 2); bit-- > 0; )
+    {
+      gaussianMulMod(re, im, re, im, mod.get_mpz_t(),
+          temp1.get_mpz_t(), temp2.get_mpz_t());
+      if (mpz_tstbit(exp, bit))
+        gaussianMulMod(re, im, 
+            baseRe.get_mpz_t(), baseIm.get_mpz_t(),
+            mod.get_mpz_t(), temp1.get_mpz_t(), temp2.get_mpz_t());
+    }
+  }
+  if (modulus.m_real < 0)
+  {
+    if (mpz_sgn(re) != 0)
+      mpz_sub(re, re, mod.get_mpz_t());
+    if (mpz_sgn(im) != 0)
+      mpz_sub(im, im, mod.get_mpz_t());
+  }
+  return *this;
+}
+
+} /* namespace kcalc */
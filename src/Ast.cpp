@@ -1,8 +1,12 @@
 #include "Ast.h"
+#include "Allocator.h"
+#include "CostModel.h"
 #include "Exceptions.h"
 #include "SymbolTable.h"
+#include "ThreadPool.h"
 
 #include <cassert>
+#include <exception>
 
 namespace kcalc
 {
@@ -80,48 +84,317 @@ void ArithmeticExpression::invertOperation()
   } 
 }
 
+std::unique_ptr<Expression> ArithmeticExpression::evalPowerModulo(
+    const ArithmeticExpression& power,
+    SymbolTable& symbolTable) const
+{
+  assert(m_operation == Modulo && power.operation() == Power);
+  std::unique_ptr<Expression> base_ptr = power.left().eval(symbolTable);
+  std::unique_ptr<Expression> exponent_ptr = power.right().eval(symbolTable); 
+  std::unique_ptr<Expression> modulus_ptr = m_right->eval(symbolTable);
+  std::unique_ptr<Expression> power_ptr;
+  if (base_ptr->kind() == ObjectKind::Number &&
+      exponent_ptr->kind() == ObjectKind::Number)
+  {
+    ComplexNumber& base 
+      = static_cast<Number *>(base_ptr.get())->number();
+    const ComplexNumber& exponent 
+      = static_cast<const Number *>(exponent_ptr.get())->number();
+    if (modulus_ptr->kind() == ObjectKind::Number)
+    {
+      const ComplexNumber& modulus 
+        = static_cast<const Number *>(modulus_ptr.get())->number(); 
+      if (base.canPowMod(exponent, modulus))
+      {
+        base.powMod(exponent, modulus);
+        return base_ptr;
+      }
+    }
+    base ^= exponent;
+    power_ptr = std::move(base_ptr);
+  }
+  else
+    power_ptr = std::make_unique<ArithmeticExpression>(
+        Power, std::move(base_ptr), std::move(exponent_ptr));
+  if (power_ptr->kind() == ObjectKind::Number &&
+      modulus_ptr->kind() == ObjectKind::Number)
+  {
+    static_cast<Number *>(power_ptr.get())->number() %= 
+      static_cast<const Number *>(modulus_ptr.get())->number();
+    return power_ptr;
+  }
+  else
+    return std::make_unique<ArithmeticExpression>(
+        Modulo, std::move(power_ptr), std::move(modulus_ptr));
+}
+
+std::unique_ptr<Expression> ArithmeticExpression::evalFusedProduct(
+    const ArithmeticExpression& product,
+    SymbolTable& symbolTable) const
+{
+  assert((m_operation == Add || m_operation == Subtract) && 
+      product.operation() == Multiply);
+  std::unique_ptr<Expression> left_ptr = m_left->eval(symbolTable);
+  std::unique_ptr<Expression> factor_ptr = product.left().eval(symbolTable);
+  std::unique_ptr<Expression> other_ptr = product.right().eval(symbolTable); 
+  std::unique_ptr<Expression> product_ptr;
+  if (factor_ptr->kind() == ObjectKind::Number &&
+      other_ptr->kind() == ObjectKind::Number)
+  {
+    ComplexNumber& factor 
+      = static_cast<Number *>(factor_ptr.get())->number();
+    const ComplexNumber& other 
+      = static_cast<const Number *>(other_ptr.get())->number();
+    if (left_ptr->kind() == ObjectKind::Number)
+    {
+      ComplexNumber& left 
+        = static_cast<Number *>(left_ptr.get())->number();
+      if (m_operation == Add)
+        left.addProduct(factor, other);
+      else
+        left.subProduct(factor, other);
+      return left_ptr;
+    }
+    factor *= other;
+    product_ptr = std::move(factor_ptr);
+  }
+  else
+    product_ptr = std::make_unique<ArithmeticExpression>(
+        Multiply, std::move(factor_ptr), std::move(other_ptr));
+  if (left_ptr->kind() == ObjectKind::Number &&
+      product_ptr->kind() == ObjectKind::Number)
+  {
+    ComplexNumber& left 
+      = static_cast<Number *>(left_ptr.get())->number();
+    const ComplexNumber& right
+      = static_cast<const Number *>(product_ptr.get())->number();
+    if (m_operation == Add)
+      left += right;
+    else
+      left -= right;
+    return left_ptr;
+  }
+  else
+    return std::make_unique<ArithmeticExpression>(
+        m_operation, std::move(left_ptr), std::move(product_ptr));
+}
+
+// chains with fewer operands are evaluated node by node
+static const std::size_t MinChainLength = 4;
+
+static bool sameChain(ArithmeticExpression::Operation root,
+    ArithmeticExpression::Operation operation)
+{
+  if (root == ArithmeticExpression::Multiply)
+    return operation == ArithmeticExpression::Multiply;
+  return operation == ArithmeticExpression::Add ||
+    operation == ArithmeticExpression::Subtract;
+}
+
+std::unique_ptr<Expression> ArithmeticExpression::evalChain(
+    SymbolTable& symbolTable) const
+{
+  // operands of the left spine, rightmost first
+  std::vector<const ArithmeticExpression *> nodes;
+  const Expression * node = this;
+  while (node->kind() == ObjectKind::ArithmeticExpression &&
+      sameChain(m_operation, 
+        static_cast<const ArithmeticExpression *>(node)->operation()))
+  {
+    nodes.push_back(static_cast<const ArithmeticExpression *>(node));
+    node = &nodes.back()->left();
+  }
+  if (nodes.size() + 1 < MinChainLength)
+    return nullptr;
+  std::vector<std::unique_ptr<Expression>> values;
+  values.reserve(nodes.size() + 1);
+  values.push_back(node->eval(symbolTable));
+  bool numeric = values.back()->kind() == ObjectKind::Number;
+  for (auto it = nodes.rbegin(); it != nodes.rend(); ++it)
+  {
+    values.push_back((*it)->right().eval(symbolTable));
+    numeric = numeric && values.back()->kind() == ObjectKind::Number;
+  }
+  if (numeric)
+  {
+    std::vector<ComplexNumber> numbers;
+    numbers.reserve(values.size());
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+      numbers.push_back(std::move(
+            static_cast<Number *>(values[i].get())->number()));
+      if (i > 0 && nodes[nodes.size() - i]->operation() == Subtract)
+        numbers.back().negate();
+    }
+    static_cast<Number *>(values.front().get())->number() = 
+      m_operation == Multiply ? ComplexNumber::product(numbers) :
+      ComplexNumber::sum(numbers);
+    return std::move(values.front());
+  }
+  // symbolic operands, fold from the left as the binary nodes would
+  std::unique_ptr<Expression> result = std::move(values.front());
+  for (std::size_t i = 1; i < values.size(); ++i)
+  {
+    Operation operation = nodes[nodes.size() - i]->operation();
+    if (result->kind() == ObjectKind::Number &&
+        values[i]->kind() == ObjectKind::Number)
+    {
+      ComplexNumber& left = static_cast<Number *>(result.get())->number();
+      const ComplexNumber& right = 
+        static_cast<const Number *>(values[i].get())->number();
+      if (operation == Add)
+        left += right;
+      else if (operation == Subtract)
+        left -= right;
+      else
+        left *= right;
+    }
+    else
+      result = std::make_unique<ArithmeticExpression>(
+          operation, std::move(result), std::move(values[i]));
+  }
+  return result;
+}
+
+// estimated work below which a subtree is not worth a task
+static const double ForkCost = 1e5;
+
+// costs of the subtrees of the tree being evaluated, estimated once at
+// its root instead of at every node
+static thread_local const SubtreeCosts * t_subtreeCosts = nullptr;
+
+namespace
+{
+
+class SubtreeCostsScope
+{
+public:
+  explicit SubtreeCostsScope(const SubtreeCosts * costs)
+    : m_previous(t_subtreeCosts)
+  { t_subtreeCosts = costs; }
+  ~SubtreeCostsScope()
+  { t_subtreeCosts = m_previous; }
+  SubtreeCostsScope(const SubtreeCostsScope&) = delete;
+  SubtreeCostsScope& operator=(const SubtreeCostsScope&) = delete;
+private:
+  const SubtreeCosts * m_previous;
+};
+
+} /* anonymous namespace */
+
+void ArithmeticExpression::evalOperands(
+    SymbolTable& symbolTable,
+    std::unique_ptr<Expression>& left, 
+    std::unique_ptr<Expression>& right) const
+{
+  ThreadPool& pool = ThreadPool::instance();
+  if (pool.workers() == 0)
+  {
+    left = m_left->eval(symbolTable);
+    right = m_right->eval(symbolTable);
+    return;
+  }
+  SubtreeCosts estimated;
+  const SubtreeCosts * costs = t_subtreeCosts;
+  if (costs == nullptr || costs->count(m_left.get()) == 0 ||
+      costs->count(m_right.get()) == 0)
+  {
+    CostModel::estimate(*this, symbolTable, estimated);
+    costs = &estimated;
+  }
+  SubtreeCostsScope scope(costs);
+  if (costs->at(m_left.get()) < ForkCost ||
+      costs->at(m_right.get()) < ForkCost)
+  {
+    left = m_left->eval(symbolTable);
+    right = m_right->eval(symbolTable);
+    return;
+  }
+  TaskGroup group(pool);
+  group.run([&, costs]() 
+  { 
+    SubtreeCostsScope scope(costs);
+    left = m_left->eval(symbolTable); 
+  });
+  std::exception_ptr exception;
+  try
+  {
+    right = m_right->eval(symbolTable);
+  }
+  catch (...)
+  {
+    exception = std::current_exception();
+  }
+  // an exception of the left operand wins, as it would sequentially
+  group.wait();
+  if (exception)
+    std::rethrow_exception(exception);
+}
+
 std::unique_ptr<Expression> ArithmeticExpression::eval(SymbolTable& symbolTable) const
 {
   assert(m_left && m_right); 
-  std::unique_ptr<Expression> left_ptr = m_left->eval(symbolTable);
-  std::unique_ptr<Expression> right_ptr = m_right->eval(symbolTable);
+  StatementBudget::checkpoint();
+  if (m_operation == Modulo && 
+      m_left->kind() == ObjectKind::ArithmeticExpression)
+  {
+    auto& power = static_cast<const ArithmeticExpression&>(*m_left);
+    if (power.operation() == Power)
+      return evalPowerModulo(power, symbolTable);
+  }
+  if (m_operation == Add || m_operation == Subtract || 
+      m_operation == Multiply)
+  {
+    std::unique_ptr<Expression> chain = evalChain(symbolTable);
+    if (chain)
+      return chain;
+  }
+  if ((m_operation == Add || m_operation == Subtract) &&
+      m_right->kind() == ObjectKind::ArithmeticExpression)
+  {
+    auto& product = static_cast<const ArithmeticExpression&>(*m_right);
+    if (product.operation() == Multiply)
+      return evalFusedProduct(product, symbolTable);
+  }
+  std::unique_ptr<Expression> left_ptr, right_ptr;
+  evalOperands(symbolTable, left_ptr, right_ptr);
   if (left_ptr->kind() == ObjectKind::Number &&
       right_ptr->kind() == ObjectKind::Number)
   {
-    const Number * left 
-      = static_cast<const Number *>(left_ptr.get());
-    const Number * right 
-      = static_cast<const Number *>(right_ptr.get()); 
+    ComplexNumber& left 
+      = static_cast<Number *>(left_ptr.get())->number();
+    const ComplexNumber& right 
+      = static_cast<const Number *>(right_ptr.get())->number(); 
     switch(m_operation)
     {
       case Add:
-        return std::make_unique<Number>(
-            left->number() + right->number());
+        left += right;
+        break;
       case Subtract:
-        return std::make_unique<Number>(
-            left->number() - right->number());
+        left -= right;
+        break;
       case Multiply:
-        return std::make_unique<Number>(
-            left->number() * right->number());
+        left *= right;
+        break;
       case Divide:
-        return std::make_unique<Number>(
-            left->number() / right->number());
+        left /= right;
+        break;
       case Power:
-        return std::make_unique<Number>(
-            left->number() ^ right->number());
+        left ^= right;
+        break;
       case Modulo:
-        return std::make_unique<Number>(
-            left->number() % right->number());
+        left %= right;
+        break;
       default:
         assert(1 == 0);
         break;
     } 
+    return left_ptr;
   }
   else
     return std::make_unique<ArithmeticExpression>(
         m_operation, std::move(left_ptr), 
         std::move(right_ptr));
-  throw 0;
 }
 
 std::string UnaryMinusExpression::to_string() const 
@@ -138,10 +411,8 @@ std::unique_ptr<Expression> UnaryMinusExpression::eval(SymbolTable& symbolTable)
   std::unique_ptr<Expression> inner_ptr = m_inner->eval(symbolTable); 
   if (inner_ptr->kind() == ObjectKind::Number)
   {
-    const Number * inner 
-      = static_cast<const Number *>(inner_ptr.get()); 
-    return std::make_unique<Number>(
-        ComplexNumber(-1,0) * inner->number());
+    static_cast<Number *>(inner_ptr.get())->number().negate();
+    return inner_ptr;
   }
   else
     return std::make_unique<UnaryMinusExpression>(
@@ -0,0 +1,493 @@
+#include "Ball.h"
+#include "Exceptions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace kcalc
+{
+
+namespace
+{
+
+using Float = Ball::Float;
+
+// bits of radii and of the bounds computed for them
+constexpr unsigned long RadiusBits = 30;
+
+// a radius further below the precision of the midpoint is widened when
+// bounds are printed, which keeps the exact sums short
+constexpr long MaximumGap = 64;
+
+struct Decimal
+{
+  // d.ddd..., empty if there are none
+  std::string digits;
+  // of the first digit
+  long exponent = 0;
+};
+
+unsigned long bits(const mpz_class& value)
+{
+  return value == 0 ? 0 : mpz_sizeinbase(value.get_mpz_t(), 2);
+}
+
+bool isZero(const Float& x)
+{ return x.mantissa == 0; }
+
+// |x| < 2^top(x) for x != 0
+long top(const Float& x)
+{ return x.exponent + long(bits(x.mantissa)); }
+
+Float power2(long exponent)
+{ return { 1, exponent }; }
+
+Float magnitude(const Float& x)
+{ return { abs(x.mantissa), x.exponent }; }
+
+Float negated(const Float& x)
+{ return { -x.mantissa, x.exponent }; }
+
+// cuts the mantissa to precision bits toward zero, true if that
+// changed the value; the error is below 2^x.exponent then
+bool truncate(Float& x, unsigned long precision)
+{
+  unsigned long size = bits(x.mantissa);
+  if (size <= precision)
+    return false;
+  unsigned long shift = size - precision;
+  bool inexact = mpz_scan1(x.mantissa.get_mpz_t(), 0) < shift;
+  mpz_tdiv_q_2exp(x.mantissa.get_mpz_t(), x.mantissa.get_mpz_t(), shift);
+  x.exponent += long(shift);
+  return inexact;
+}
+
+// non-negative x rounded to the bits of a radius
+Float up(Float x)
+{
+  if (truncate(x, RadiusBits))
+    x.mantissa += 1;
+  return x;
+}
+
+Float down(Float x)
+{
+  truncate(x, RadiusBits);
+  return x;
+}
+
+// exact, the mantissa grows by the difference of the exponents
+Float sum(const Float& a, const Float& b)
+{
+  if (isZero(a))
+    return b;
+  if (isZero(b))
+    return a;
+  const Float& high = a.exponent >= b.exponent ? a : b;
+  const Float& low = a.exponent >= b.exponent ? b : a;
+  Float result;
+  mpz_mul_2exp(result.mantissa.get_mpz_t(), high.mantissa.get_mpz_t(),
+      high.exponent - low.exponent);
+  result.mantissa += low.mantissa;
+  result.exponent = low.exponent;
+  return result;
+}
+
+// upper bound of a + b for non-negative a and b
+Float addUp(const Float& a, const Float& b)
+{
+  if (isZero(a))
+    return b;
+  if (isZero(b))
+    return a;
+  const Float& high = top(a) >= top(b) ? a : b;
+  const Float& low = top(a) >= top(b) ? b : a;
+  // below the last bit of high
+  if (top(low) <= high.exponent)
+  {
+    Float result = high;
+    result.mantissa += 1;
+    return up(result);
+  }
+  return up(sum(a, b));
+}
+
+Float multiplyUp(const Float& a, const Float& b)
+{ return up({ a.mantissa * b.mantissa, a.exponent + b.exponent }); }
+
+Float multiplyDown(const Float& a, const Float& b)
+{ return down({ a.mantissa * b.mantissa, a.exponent + b.exponent }); }
+
+// upper bound of a / b for non-negative a and positive b
+Float divideUp(const Float& a, const Float& b)
+{
+  if (isZero(a))
+    return a;
+  unsigned long shift = RadiusBits + bits(b.mantissa);
+  Float result;
+  mpz_mul_2exp(result.mantissa.get_mpz_t(), a.mantissa.get_mpz_t(),
+      shift);
+  mpz_cdiv_q(result.mantissa.get_mpz_t(), result.mantissa.get_mpz_t(),
+      b.mantissa.get_mpz_t());
+  result.exponent = a.exponent - long(shift) - b.exponent;
+  return up(result);
+}
+
+// lower bound of a - b for non-negative a and b, not positive if b
+// may be as large as a
+Float subtractDown(const Float& a, const Float& b)
+{
+  if (isZero(b))
+    return down(a);
+  if (isZero(a) || top(b) > top(a))
+    return negated(b);
+  if (top(b) <= a.exponent)
+  {
+    Float result = a;
+    result.mantissa -= 1;
+    return down(result);
+  }
+  return down(sum(a, negated(b)));
+}
+
+// the value of the bits above the binary point, rounded down
+mpz_class floorOf(const Float& x)
+{
+  mpz_class result;
+  if (x.exponent >= 0)
+    mpz_mul_2exp(result.get_mpz_t(), x.mantissa.get_mpz_t(), x.exponent);
+  else
+    mpz_fdiv_q_2exp(result.get_mpz_t(), x.mantissa.get_mpz_t(),
+        -x.exponent);
+  return result;
+}
+
+bool isInteger(const Float& x)
+{
+  return isZero(x) || x.exponent >= 0 ||
+    mpz_scan1(x.mantissa.get_mpz_t(), 0) >=
+    static_cast<unsigned long>(-x.exponent);
+}
+
+// the first count digits of a positive x, truncated
+Decimal decimal(const Float& x, unsigned int count)
+{
+  // 2^(top - 1) <= x and log10(2) = 0.30103
+  long exponent = long(std::floor((top(x) - 1) * 0.30102999566398120));
+  for (;;)
+  {
+    long shift = long(count) - 1 - exponent;
+    mpz_class numerator = x.mantissa, denominator = 1;
+    if (shift >= 0)
+    {
+      mpz_ui_pow_ui(denominator.get_mpz_t(), 10, shift);
+      numerator *= denominator;
+      denominator = 1;
+    }
+    else
+      mpz_ui_pow_ui(denominator.get_mpz_t(), 10, -shift);
+    if (x.exponent >= 0)
+      mpz_mul_2exp(numerator.get_mpz_t(), numerator.get_mpz_t(),
+          x.exponent);
+    else
+      mpz_mul_2exp(denominator.get_mpz_t(), denominator.get_mpz_t(),
+          -x.exponent);
+    mpz_tdiv_q(numerator.get_mpz_t(), numerator.get_mpz_t(),
+        denominator.get_mpz_t());
+    std::string digits = numerator.get_str();
+    if (digits.size() >= count)
+    {
+      exponent += long(digits.size() - count);
+      digits.resize(count);
+      return { digits, exponent };
+    }
+    --exponent;
+  }
+}
+
+// adds one to the last digit
+void increment(Decimal& value)
+{
+  std::size_t i = value.digits.size();
+  while (i > 0 && value.digits[i - 1] == '9')
+    value.digits[--i] = '0';
+  if (i > 0)
+    ++value.digits[i - 1];
+  else
+  {
+    value.digits.insert(0, "1");
+    value.digits.pop_back();
+    ++value.exponent;
+  }
+}
+
+// the first n of more digits, half rounded up
+Decimal round(const Decimal& value, std::size_t n)
+{
+  Decimal result{ value.digits.substr(0, n), value.exponent };
+  if (value.digits[n] >= '5')
+    increment(result);
+  return result;
+}
+
+std::string scientific(bool negative, const Decimal& value)
+{
+  std::string text = negative ? "-" : "";
+  text += value.digits[0];
+  if (value.digits.size() > 1)
+  {
+    text += '.';
+    text.append(value.digits, 1);
+  }
+  text += value.exponent < 0 ? "e-" : "e+";
+  text += std::to_string(value.exponent < 0 ? -value.exponent :
+      value.exponent);
+  return text;
+}
+
+// the digits all values of a ball with a non-zero midpoint round to
+Decimal correct(const Float& midpoint, Float radius,
+    unsigned long precision, unsigned int digits)
+{
+  if (!isZero(radius) && top(radius) > top(midpoint))
+    return {};
+  long gap = top(midpoint) - long(precision) - MaximumGap;
+  if (!isZero(radius) && top(radius) < gap)
+    radius = power2(gap);
+  Float value = magnitude(midpoint);
+  Float low = sum(value, negated(radius));
+  if (low.mantissa <= 0)
+    return {};
+  Decimal lower = decimal(low, digits + 1);
+  Decimal upper = decimal(sum(value, radius), digits + 1);
+  for (unsigned int n = digits; n > 0; --n)
+  {
+    Decimal a = round(lower, n);
+    Decimal b = round(upper, n);
+    if (a.digits == b.digits && a.exponent == b.exponent)
+      return a;
+  }
+  return {};
+}
+
+} /* namespace */
+
+Ball::Ball(Float midpoint, Float radius, unsigned long precision)
+  : m_midpoint{std::move(midpoint)}, m_radius{std::move(radius)},
+  m_precision{precision}
+{ }
+
+Ball::Ball(long value, unsigned long precision)
+  : m_midpoint{value, 0}, m_precision{precision}
+{
+  if (truncate(m_midpoint, precision))
+    m_radius = power2(m_midpoint.exponent);
+}
+
+Ball::Ball(const mpq_class& value, unsigned long precision)
+  : m_precision{precision}
+{
+  const mpz_class& numerator = value.get_num();
+  const mpz_class& denominator = value.get_den();
+  if (denominator == 1)
+    m_midpoint.mantissa = numerator;
+  else
+  {
+    long shift = std::max(0l, long(precision + bits(denominator)) -
+        long(bits(numerator)) + 2);
+    mpz_class remainder;
+    mpz_mul_2exp(m_midpoint.mantissa.get_mpz_t(),
+        numerator.get_mpz_t(), shift);
+    mpz_tdiv_qr(m_midpoint.mantissa.get_mpz_t(), remainder.get_mpz_t(),
+        m_midpoint.mantissa.get_mpz_t(), denominator.get_mpz_t());
+    m_midpoint.exponent = -shift;
+    if (remainder != 0)
+      m_radius = power2(m_midpoint.exponent);
+  }
+  if (truncate(m_midpoint, precision))
+    m_radius = addUp(m_radius, power2(m_midpoint.exponent));
+}
+
+Ball Ball::powerOfTen(long exponent, unsigned long precision)
+{
+  unsigned long n = exponent < 0 ? 0ul - static_cast<unsigned long>(
+      exponent) : static_cast<unsigned long>(exponent);
+  // the errors of the squarings stay below the precision
+  unsigned long guard = 2 * bits(mpz_class(n)) + 8;
+  Ball result(1, precision + guard);
+  Ball base(10, precision + guard);
+  while (n > 0)
+  {
+    if (n & 1)
+      result = result * base;
+    n >>= 1;
+    if (n > 0)
+      base = base * base;
+  }
+  if (exponent < 0)
+    result = Ball(1, precision + guard) / result;
+  if (truncate(result.m_midpoint, precision))
+    result.m_radius = addUp(result.m_radius, 
+        power2(result.m_midpoint.exponent));
+  result.m_precision = precision;
+  return result;
+}
+
+Ball Ball::operator-() const
+{ return Ball(negated(m_midpoint), m_radius, m_precision); }
+
+Ball Ball::operator+(const Ball& other) const
+{
+  unsigned long precision = std::max(m_precision, other.m_precision);
+  Float radius = addUp(m_radius, other.m_radius);
+  const Float& a = m_midpoint;
+  const Float& b = other.m_midpoint;
+  if (isZero(a) || isZero(b))
+    return Ball(isZero(a) ? b : a, std::move(radius), precision);
+  const Float& high = top(a) >= top(b) ? a : b;
+  const Float& low = top(a) >= top(b) ? b : a;
+  Float midpoint;
+  // far below the precision of the sum
+  if (top(low) < top(high) - long(precision) - 2)
+  {
+    midpoint = high;
+    radius = addUp(radius, power2(top(low)));
+  }
+  else
+  {
+    midpoint = sum(a, b);
+    if (truncate(midpoint, precision))
+      radius = addUp(radius, power2(midpoint.exponent));
+  }
+  return Ball(std::move(midpoint), std::move(radius), precision);
+}
+
+Ball Ball::operator-(const Ball& other) const
+{ return *this + -other; }
+
+Ball Ball::operator*(const Ball& other) const
+{
+  unsigned long precision = std::max(m_precision, other.m_precision);
+  Float midpoint{ m_midpoint.mantissa * other.m_midpoint.mantissa,
+    m_midpoint.exponent + other.m_midpoint.exponent };
+  // |x y - x' y'| <= |x| ry + |y| rx + rx ry
+  Float radius = addUp(
+      addUp(multiplyUp(up(magnitude(m_midpoint)), other.m_radius),
+        multiplyUp(up(magnitude(other.m_midpoint)), m_radius)),
+      multiplyUp(m_radius, other.m_radius));
+  if (truncate(midpoint, precision))
+    radius = addUp(radius, power2(midpoint.exponent));
+  return Ball(std::move(midpoint), std::move(radius), precision);
+}
+
+Ball Ball::operator/(const Ball& other) const
+{
+  unsigned long precision = std::max(m_precision, other.m_precision);
+  if (other == 0)
+    throw DivisionByZeroException(__FILE__, __LINE__);
+  Float divisor = down(magnitude(other.m_midpoint));
+  Float lower = subtractDown(divisor, other.m_radius);
+  if (lower.mantissa <= 0)
+    throw PrecisionLossException(__FILE__, __LINE__, precision);
+  Float midpoint;
+  Float radius;
+  if (!isZero(m_midpoint))
+  {
+    const mpz_class& divisorMantissa = other.m_midpoint.mantissa;
+    long shift = std::max(0l, long(precision + bits(divisorMantissa)) -
+        long(bits(m_midpoint.mantissa)) + 2);
+    mpz_class remainder;
+    mpz_mul_2exp(midpoint.mantissa.get_mpz_t(),
+        m_midpoint.mantissa.get_mpz_t(), shift);
+    mpz_tdiv_qr(midpoint.mantissa.get_mpz_t(), remainder.get_mpz_t(),
+        midpoint.mantissa.get_mpz_t(), divisorMantissa.get_mpz_t());
+    midpoint.exponent = m_midpoint.exponent - shift -
+      other.m_midpoint.exponent;
+    if (remainder != 0)
+      radius = power2(midpoint.exponent);
+    if (truncate(midpoint, precision))
+      radius = addUp(radius, power2(midpoint.exponent));
+  }
+  // |x/y - x'/y'| <= (|x| ry + |y| rx) / (|y| (|y| - ry))
+  Float error = divideUp(
+      addUp(multiplyUp(up(magnitude(m_midpoint)), other.m_radius),
+        multiplyUp(up(magnitude(other.m_midpoint)), m_radius)),
+      multiplyDown(divisor, lower));
+  radius = addUp(radius, error);
+  return Ball(std::move(midpoint), std::move(radius), precision);
+}
+
+bool Ball::operator==(long value) const
+{
+  if (!isExact())
+    return false;
+  if (value == 0 || isZero(m_midpoint))
+    return value == 0 && isZero(m_midpoint);
+  if (top(m_midpoint) > 64 || !kcalc::isInteger(m_midpoint))
+    return false;
+  return floorOf(m_midpoint) == value;
+}
+
+int Ball::sign() const
+{
+  if (isZero(m_midpoint) ||
+      subtractDown(down(magnitude(m_midpoint)), m_radius).mantissa <= 0)
+    return 0;
+  return sgn(m_midpoint.mantissa);
+}
+
+bool Ball::isInteger() const
+{ return isExact() && kcalc::isInteger(m_midpoint); }
+
+std::optional<long> Ball::toLong() const
+{
+  if (!isInteger() || (!isZero(m_midpoint) && top(m_midpoint) > 63))
+    return std::nullopt;
+  return floorOf(m_midpoint).get_si();
+}
+
+Ball floor(const Ball& ball)
+{
+  const Float& midpoint = ball.m_midpoint;
+  const Float& radius = ball.m_radius;
+  unsigned long precision = ball.m_precision;
+  if (ball.isExact())
+    return isInteger(midpoint) ? ball :
+      Ball(Float{ floorOf(midpoint), 0 }, Float(), precision);
+  // the ball is wider than 1 or contains an integer
+  if (top(radius) > 0 || isInteger(midpoint))
+    throw PrecisionLossException(__FILE__, __LINE__, precision);
+  mpz_class result = floorOf(midpoint);
+  if (top(radius) > midpoint.exponent &&
+      (floorOf(sum(midpoint, negated(radius))) != result ||
+       floorOf(sum(midpoint, radius)) != result))
+    throw PrecisionLossException(__FILE__, __LINE__, precision);
+  return Ball(Float{ std::move(result), 0 }, Float(), precision);
+}
+
+std::string Ball::to_string(unsigned int digits) const
+{
+  if (*this == 0)
+    return "0";
+  if (!isZero(m_midpoint))
+  {
+    Decimal value = correct(m_midpoint, m_radius, m_precision, digits);
+    if (!value.digits.empty())
+      return scientific(m_midpoint.mantissa < 0, value);
+  }
+  Decimal bound = decimal(addUp(up(magnitude(m_midpoint)), m_radius), 3);
+  increment(bound);
+  return "[+/- " + scientific(false, bound) + "]";
+}
+
+unsigned int Ball::correctDigits(unsigned int digits) const
+{
+  if (*this == 0)
+    return digits;
+  if (isZero(m_midpoint))
+    return 0;
+  return correct(m_midpoint, m_radius, m_precision, digits).digits.size();
+}
+
+} /* namespace kcalc */
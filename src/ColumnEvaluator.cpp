@@ -0,0 +1,557 @@
+#include "ColumnEvaluator.h"
+#include "Allocator.h"
+#include "Ast.h"
+#include "ColumnKernels.h"
+#include "Exceptions.h"
+#include "Parser.h"
+#include "SemanticAnalyzer.h"
+#include "SymbolTable.h"
+#include "SymbolUsage.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace kcalc
+{
+
+namespace
+{
+
+// rows per instruction in double precision, a few columns of them fit
+// into the first level cache
+constexpr std::size_t ApproximateBlockRows = 1024;
+
+// rows per task in exact mode
+constexpr std::size_t MinExactBlockRows = 16;
+constexpr std::size_t MaxExactBlockRows = 1024;
+
+// constant exponents up to this size are expanded into multiplications
+constexpr long MaxPowerInteger = 1024;
+
+// column of a block, imag is null if all imaginary parts are zero
+struct Operand
+{
+  const double * real;
+  const double * imag;
+};
+
+struct Buffer
+{
+  double * real;
+  double * imag;
+};
+
+Operand copy(Operand a, Buffer out, std::size_t n)
+{
+  if (a.real != out.real)
+    std::copy_n(a.real, n, out.real);
+  if (a.imag != nullptr && a.imag != out.imag)
+    std::copy_n(a.imag, n, out.imag);
+  return { out.real, a.imag != nullptr ? out.imag : nullptr };
+}
+
+Operand negate(const ColumnKernels& kernels, Operand a, Buffer out,
+    std::size_t n)
+{
+  kernels.negate(a.real, out.real, n);
+  if (a.imag == nullptr)
+    return { out.real, nullptr };
+  kernels.negate(a.imag, out.imag, n);
+  return { out.real, out.imag };
+}
+
+Operand add(const ColumnKernels& kernels, Operand a, Operand b,
+    Buffer out, std::size_t n, bool subtract)
+{
+  ColumnKernels::Binary operation =
+    subtract ? kernels.subtract : kernels.add;
+  operation(a.real, b.real, out.real, n);
+  if (a.imag != nullptr && b.imag != nullptr)
+    operation(a.imag, b.imag, out.imag, n);
+  else if (a.imag != nullptr && a.imag != out.imag)
+    std::copy_n(a.imag, n, out.imag);
+  else if (b.imag != nullptr && subtract)
+    kernels.negate(b.imag, out.imag, n);
+  else if (b.imag != nullptr)
+    std::copy_n(b.imag, n, out.imag);
+  else if (a.imag == nullptr)
+    return { out.real, nullptr };
+  return { out.real, out.imag };
+}
+
+// the imaginary part is written first, out may alias the real part of
+// either operand
+Operand multiply(const ColumnKernels& kernels, Operand a, Operand b,
+    Buffer out, std::size_t n)
+{
+  if (a.imag != nullptr && b.imag != nullptr)
+    kernels.complexMultiply(a.real, a.imag, b.real, b.imag,
+        out.real, out.imag, n);
+  else if (a.imag != nullptr)
+  {
+    kernels.multiply(a.imag, b.real, out.imag, n);
+    kernels.multiply(a.real, b.real, out.real, n);
+  }
+  else if (b.imag != nullptr)
+  {
+    kernels.multiply(a.real, b.imag, out.imag, n);
+    kernels.multiply(a.real, b.real, out.real, n);
+  }
+  else
+  {
+    kernels.multiply(a.real, b.real, out.real, n);
+    return { out.real, nullptr };
+  }
+  return { out.real, out.imag };
+}
+
+Operand divide(const ColumnKernels& kernels, Operand a, Operand b,
+    Buffer out, const double * zeros, std::size_t n)
+{
+  if (b.imag != nullptr)
+    kernels.complexDivide(a.real, a.imag != nullptr ? a.imag : zeros,
+        b.real, b.imag, out.real, out.imag, n);
+  else if (a.imag != nullptr)
+  {
+    kernels.divide(a.imag, b.real, out.imag, n);
+    kernels.divide(a.real, b.real, out.real, n);
+  }
+  else
+  {
+    kernels.divide(a.real, b.real, out.real, n);
+    return { out.real, nullptr };
+  }
+  return { out.real, out.imag };
+}
+
+double modulo(double a, double b)
+{
+  return a - b * std::floor(a / b);
+}
+
+std::complex<double> raise(std::complex<double> base,
+    std::complex<double> exponent)
+{
+  if (exponent.imag() == 0 && std::nearbyint(exponent.real()) ==
+      exponent.real() && std::abs(exponent.real()) <= MaxPowerInteger)
+  {
+    long remaining = std::abs(long(exponent.real()));
+    std::complex<double> result = 1;
+    while (remaining > 0)
+    {
+      if (remaining & 1)
+        result *= base;
+      base *= base;
+      remaining >>= 1;
+    }
+    return exponent.real() < 0 ? 1.0 / result : result;
+  }
+  if (base.imag() == 0 && exponent.imag() == 0 && base.real() >= 0)
+    return std::pow(base.real(), exponent.real());
+  return std::pow(base, exponent);
+}
+
+// element by element, for the operations without vector kernels
+template<typename Operation>
+Operand elementwise(Operand a, Operand b, Buffer out, std::size_t n,
+    Operation operation)
+{
+  bool complex = false;
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    std::complex<double> value = operation(
+        std::complex<double>(a.real[i], a.imag ? a.imag[i] : 0.0),
+        std::complex<double>(b.real[i], b.imag ? b.imag[i] : 0.0));
+    out.real[i] = value.real();
+    out.imag[i] = value.imag();
+    complex = complex || value.imag() != 0;
+  }
+  return { out.real, complex ? out.imag : nullptr };
+}
+
+} /* anonymous namespace */
+
+// Emits the program in postfix order while tracking the stack depth.
+class ColumnEvaluator::Compiler : public Visitor
+{
+public:
+  explicit Compiler(ColumnEvaluator& evaluator)
+    : Visitor{VisitorOrdering::PreOrder, ParentHandling::BeforeParent},
+      m_evaluator{evaluator}, m_depth{0}
+  { }
+
+protected:
+  void visit(Number& number) override
+  {
+    m_evaluator.m_constants.push_back(number.number());
+    emit(OpCode::Constant, m_evaluator.m_constants.size() - 1, 1);
+  }
+
+  void visit(Variable& variable) override
+  {
+    const std::vector<std::string>& variables = m_evaluator.m_variables;
+    auto position = std::lower_bound(variables.begin(), variables.end(),
+        variable.name());
+    emit(OpCode::Load, position - variables.begin(), 1);
+  }
+
+  void visit(UnaryMinusExpression&) override
+  {
+    emit(OpCode::Negate, 0, 0);
+  }
+
+  void visit(ArithmeticExpression& expression) override
+  {
+    switch (expression.operation())
+    {
+      case ArithmeticExpression::Add:
+        emit(OpCode::Add, 0, -1);
+        break;
+      case ArithmeticExpression::Subtract:
+        emit(OpCode::Subtract, 0, -1);
+        break;
+      case ArithmeticExpression::Multiply:
+        emit(OpCode::Multiply, 0, -1);
+        break;
+      case ArithmeticExpression::Divide:
+        emit(OpCode::Divide, 0, -1);
+        break;
+      case ArithmeticExpression::Modulo:
+        emit(OpCode::Modulo, 0, -1);
+        break;
+      case ArithmeticExpression::Power:
+        if (!powerInteger())
+          emit(OpCode::Power, 0, -1);
+        break;
+    }
+  }
+
+private:
+  // replaces a small constant exponent just pushed
+  bool powerInteger()
+  {
+    Instruction& last = m_evaluator.m_program.back();
+    if (last.code != OpCode::Constant)
+      return false;
+    std::optional<long> exponent =
+      m_evaluator.m_constants[last.operand].toLong();
+    if (!exponent || std::abs(*exponent) > MaxPowerInteger)
+      return false;
+    last = { OpCode::PowerInteger, *exponent };
+    --m_depth;
+    return true;
+  }
+
+  void emit(OpCode code, long operand, int change)
+  {
+    m_evaluator.m_program.push_back({ code, operand });
+    m_depth += change;
+    m_evaluator.m_depth = std::max(m_evaluator.m_depth, m_depth);
+  }
+
+  ColumnEvaluator& m_evaluator;
+  std::size_t m_depth;
+};
+
+ColumnEvaluator::ColumnEvaluator(std::string_view text)
+  : m_depth{0}
+{
+  Lexer lexer(text);
+  Parser parser(lexer);
+  std::unique_ptr<AstObject> statement = parser.parse();
+  if (!statement)
+    throw IllegalEndOfInput(__FILE__, __LINE__, std::nullopt,
+        { TokenKind::LeftParen, TokenKind::Number, TokenKind::Identifier });
+  if (statement->kind() == ObjectKind::Assignment)
+    throw PreparedAssignmentException(__FILE__, __LINE__);
+  SymbolTable empty;
+  SemanticAnalyzer analyzer(empty);
+  statement->accept(analyzer);
+  SymbolUsage usage(*statement);
+  m_variables.assign(usage.reads().begin(), usage.reads().end());
+  Compiler compiler(*this);
+  statement->accept(compiler);
+}
+
+std::vector<ComplexNumber> ColumnEvaluator::evaluate(
+    const std::vector<const ComplexNumber *>& columns,
+    std::size_t rows,
+    ThreadPool& pool) const
+{
+  if (columns.size() != m_variables.size())
+    throw std::invalid_argument("one column per variable expected");
+  std::vector<ComplexNumber> result(rows, ComplexNumber(0));
+  std::size_t blockRows = std::clamp<std::size_t>(
+      rows / (4 * pool.concurrency()), MinExactBlockRows,
+      MaxExactBlockRows);
+  TaskGroup group(pool);
+  for (std::size_t start = 0; start < rows; start += blockRows)
+  {
+    std::size_t count = std::min(blockRows, rows - start);
+    group.run([this, &columns, &result, start, count]() {
+        evaluateBlock(columns, start, count, result.data() + start); });
+  }
+  group.wait();
+  return result;
+}
+
+void ColumnEvaluator::evaluateBlock(
+    const std::vector<const ComplexNumber *>& columns,
+    std::size_t start, std::size_t count, ComplexNumber * result) const
+{
+  // a column of the block, or a constant with stride 0
+  struct Values
+  {
+    const ComplexNumber * data;
+    std::size_t stride;
+
+    const ComplexNumber& operator[](std::size_t i) const
+    { return data[i * stride]; }
+  };
+
+  // products of large values fork and wait with the arena active;
+  // tasks of other blocks stolen meanwhile run with it suspended
+  StatementArena arena;
+  std::vector<std::vector<ComplexNumber>> buffers(m_depth);
+  std::vector<Values> stack;
+  stack.reserve(m_depth);
+  // the operation applied in place to the buffer of the operand at
+  // position, after copying the operand there
+  auto apply = [&](std::size_t position, auto operation) {
+    std::vector<ComplexNumber>& out = buffers[position];
+    if (out.empty())
+      out.assign(count, ComplexNumber(0));
+    Values operand = stack[position];
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      if (operand.data != out.data())
+        out[i] = operand[i];
+      operation(out[i], i);
+    }
+    stack[position] = { out.data(), 1 };
+  };
+  for (const Instruction& instruction : m_program)
+  {
+    std::size_t top = stack.size() - 1;
+    switch (instruction.code)
+    {
+      case OpCode::Load:
+        stack.push_back({ columns[instruction.operand] + start, 1 });
+        break;
+      case OpCode::Constant:
+        stack.push_back({ &m_constants[instruction.operand], 0 });
+        break;
+      case OpCode::Negate:
+        apply(top, [](ComplexNumber& value, std::size_t) {
+            value.negate(); });
+        break;
+      case OpCode::PowerInteger:
+      {
+        const ComplexNumber exponent(instruction.operand);
+        apply(top, [&exponent](ComplexNumber& value, std::size_t) {
+            value ^= exponent; });
+        break;
+      }
+      default:
+      {
+        Values right = stack.back();
+        stack.pop_back();
+        --top;
+        switch (instruction.code)
+        {
+          case OpCode::Add:
+            apply(top, [right](ComplexNumber& value, std::size_t i) {
+                value += right[i]; });
+            break;
+          case OpCode::Subtract:
+            apply(top, [right](ComplexNumber& value, std::size_t i) {
+                value -= right[i]; });
+            break;
+          case OpCode::Multiply:
+            apply(top, [right](ComplexNumber& value, std::size_t i) {
+                value *= right[i]; });
+            break;
+          case OpCode::Divide:
+            apply(top, [right](ComplexNumber& value, std::size_t i) {
+                value /= right[i]; });
+            break;
+          case OpCode::Modulo:
+            apply(top, [right](ComplexNumber& value, std::size_t i) {
+                value %= right[i]; });
+            break;
+          default:
+            apply(top, [right](ComplexNumber& value, std::size_t i) {
+                value ^= right[i]; });
+            break;
+        }
+      }
+    }
+  }
+  ArenaSuspension persistent;
+  for (std::size_t i = 0; i < count; ++i)
+    result[i] = stack.back()[i];
+}
+
+template<typename Load>
+std::vector<std::complex<double>> ColumnEvaluator::approximateBlocks(
+    std::size_t rows, Load load) const
+{
+  const ColumnKernels& kernels = ColumnKernels::best();
+  std::size_t blockRows = std::max<std::size_t>(
+      std::min(rows, ApproximateBlockRows), 1);
+  // one buffer per stack position, one for powers, one per variable,
+  // then ones and zeros
+  std::size_t buffers = m_depth + 1 + m_variables.size();
+  std::vector<double> storage(2 * (buffers + 1) * blockRows);
+  auto buffer = [&](std::size_t index) -> Buffer {
+    double * real = storage.data() + 2 * index * blockRows;
+    return { real, real + blockRows };
+  };
+  Buffer scratch = buffer(m_depth);
+  Buffer constants = buffer(buffers);
+  std::fill_n(constants.real, blockRows, 1.0);
+  std::fill_n(constants.imag, blockRows, 0.0);
+  const double * ones = constants.real;
+  const double * zeros = constants.imag;
+  std::vector<std::vector<double>> constantReal, constantImag;
+  for (const ComplexNumber& constant : m_constants)
+  {
+    std::complex<double> value = constant.approximate();
+    constantReal.emplace_back(blockRows, value.real());
+    constantImag.emplace_back(value.imag() != 0 ? blockRows : 0,
+        value.imag());
+  }
+
+  std::vector<std::complex<double>> result(rows);
+  std::vector<Operand> inputs(m_variables.size());
+  std::vector<Operand> stack;
+  stack.reserve(m_depth);
+  for (std::size_t start = 0; start < rows; start += blockRows)
+  {
+    std::size_t n = std::min(blockRows, rows - start);
+    for (std::size_t column = 0; column < inputs.size(); ++column)
+      inputs[column] = load(column, start, n,
+          buffer(m_depth + 1 + column));
+    stack.clear();
+    for (const Instruction& instruction : m_program)
+    {
+      std::size_t top = stack.size() - 1;
+      switch (instruction.code)
+      {
+        case OpCode::Load:
+          stack.push_back(inputs[instruction.operand]);
+          break;
+        case OpCode::Constant:
+        {
+          const std::vector<double>& imag =
+            constantImag[instruction.operand];
+          stack.push_back({ constantReal[instruction.operand].data(),
+              imag.empty() ? nullptr : imag.data() });
+          break;
+        }
+        case OpCode::Negate:
+          stack[top] = negate(kernels, stack[top], buffer(top), n);
+          break;
+        case OpCode::PowerInteger:
+        {
+          Buffer out = buffer(top);
+          long exponent = std::abs(instruction.operand);
+          Operand base = copy(stack[top], scratch, n);
+          Operand product{ ones, nullptr };
+          bool first = true;
+          while (exponent > 0)
+          {
+            if (exponent & 1)
+              product = first ? copy(base, out, n) :
+                multiply(kernels, product, base, out, n);
+            first = first && (exponent & 1) == 0;
+            exponent >>= 1;
+            if (exponent > 0)
+              base = multiply(kernels, base, base, scratch, n);
+          }
+          if (instruction.operand < 0)
+            product = divide(kernels, { ones, nullptr }, product, out,
+                zeros, n);
+          stack[top] = product;
+          break;
+        }
+        default:
+        {
+          Operand right = stack.back();
+          stack.pop_back();
+          --top;
+          Operand left = stack[top];
+          Buffer out = buffer(top);
+          switch (instruction.code)
+          {
+            case OpCode::Add:
+              stack[top] = add(kernels, left, right, out, n, false);
+              break;
+            case OpCode::Subtract:
+              stack[top] = add(kernels, left, right, out, n, true);
+              break;
+            case OpCode::Multiply:
+              stack[top] = multiply(kernels, left, right, out, n);
+              break;
+            case OpCode::Divide:
+              stack[top] = divide(kernels, left, right, out, zeros, n);
+              break;
+            case OpCode::Modulo:
+              stack[top] = elementwise(left, right, out, n,
+                  [](std::complex<double> a, std::complex<double> b) {
+                    if (b.imag() != 0)
+                      return std::complex<double>(NAN, NAN);
+                    return std::complex<double>(
+                        modulo(a.real(), b.real()),
+                        a.imag() != 0 ? modulo(a.imag(), b.real()) : 0);
+                  });
+              break;
+            default:
+              stack[top] = elementwise(left, right, out, n, raise);
+              break;
+          }
+        }
+      }
+    }
+    Operand value = stack.back();
+    for (std::size_t i = 0; i < n; ++i)
+      result[start + i] = { value.real[i],
+        value.imag != nullptr ? value.imag[i] : 0.0 };
+  }
+  return result;
+}
+
+std::vector<std::complex<double>> ColumnEvaluator::approximateComplex(
+    const std::vector<const std::complex<double> *>& columns,
+    std::size_t rows) const
+{
+  if (columns.size() != m_variables.size())
+    throw std::invalid_argument("one column per variable expected");
+  return approximateBlocks(rows, [&columns](std::size_t column,
+        std::size_t start, std::size_t n, Buffer out) -> Operand {
+      const std::complex<double> * values = columns[column] + start;
+      bool complex = false;
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        out.real[i] = values[i].real();
+        out.imag[i] = values[i].imag();
+        complex = complex || values[i].imag() != 0;
+      }
+      return { out.real, complex ? out.imag : nullptr };
+    });
+}
+
+std::vector<std::complex<double>> ColumnEvaluator::approximate(
+    const std::vector<const double *>& columns,
+    std::size_t rows) const
+{
+  if (columns.size() != m_variables.size())
+    throw std::invalid_argument("one column per variable expected");
+  return approximateBlocks(rows, [&columns](std::size_t column,
+        std::size_t start, std::size_t, Buffer) -> Operand {
+      return { columns[column] + start, nullptr };
+    });
+}
+
+} /* namespace kcalc */
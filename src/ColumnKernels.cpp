@@ -0,0 +1,224 @@
+#include "ColumnKernels.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KCALC_HAVE_AVX2_KERNELS 1
+#endif
+
+namespace kcalc
+{
+
+namespace
+{
+
+void negateScalar(const double * a, double * out, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i)
+    out[i] = -a[i];
+}
+
+void addScalar(const double * a, const double * b, double * out,
+    std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i)
+    out[i] = a[i] + b[i];
+}
+
+void subtractScalar(const double * a, const double * b, double * out,
+    std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i)
+    out[i] = a[i] - b[i];
+}
+
+void multiplyScalar(const double * a, const double * b, double * out,
+    std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i)
+    out[i] = a[i] * b[i];
+}
+
+void divideScalar(const double * a, const double * b, double * out,
+    std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i)
+    out[i] = a[i] / b[i];
+}
+
+void complexMultiplyScalar(const double * aReal, const double * aImag,
+    const double * bReal, const double * bImag,
+    double * outReal, double * outImag, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    double real = aReal[i] * bReal[i] - aImag[i] * bImag[i];
+    double imag = aReal[i] * bImag[i] + aImag[i] * bReal[i];
+    outReal[i] = real;
+    outImag[i] = imag;
+  }
+}
+
+void complexDivideScalar(const double * aReal, const double * aImag,
+    const double * bReal, const double * bImag,
+    double * outReal, double * outImag, std::size_t n)
+{
+  // Smith's algorithm: the divisor is scaled by its larger part, its
+  // square would overflow or underflow far inside the double range
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    bool realLarger = std::abs(bReal[i]) >= std::abs(bImag[i]);
+    double larger = realLarger ? bReal[i] : bImag[i];
+    double smaller = realLarger ? bImag[i] : bReal[i];
+    double first = realLarger ? aReal[i] : aImag[i];
+    double second = realLarger ? aImag[i] : aReal[i];
+    double ratio = smaller / larger;
+    double denominator = larger + smaller * ratio;
+    double real = (first + second * ratio) / denominator;
+    double imag = (second - first * ratio) / denominator;
+    outReal[i] = real;
+    outImag[i] = realLarger ? imag : -imag;
+  }
+}
+
+#ifdef KCALC_HAVE_AVX2_KERNELS
+
+// Four doubles per instruction, the tail of fewer than four elements
+// goes through the scalar loops. No fused multiply-add, so results are
+// identical to the scalar kernels.
+
+#define KCALC_AVX2 __attribute__((target("avx2")))
+
+KCALC_AVX2 void negateAvx2(const double * a, double * out, std::size_t n)
+{
+  const __m256d sign = _mm256_set1_pd(-0.0);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(out + i, _mm256_xor_pd(_mm256_loadu_pd(a + i), sign));
+  negateScalar(a + i, out + i, n - i);
+}
+
+#define KCALC_AVX2_BINARY(name, intrinsic)                               \
+KCALC_AVX2 void name##Avx2(const double * a, const double * b,           \
+    double * out, std::size_t n)                                         \
+{                                                                        \
+  std::size_t i = 0;                                                     \
+  for (; i + 4 <= n; i += 4)                                             \
+    _mm256_storeu_pd(out + i, intrinsic(_mm256_loadu_pd(a + i),          \
+          _mm256_loadu_pd(b + i)));                                      \
+  name##Scalar(a + i, b + i, out + i, n - i);                            \
+}
+
+KCALC_AVX2_BINARY(add, _mm256_add_pd)
+KCALC_AVX2_BINARY(subtract, _mm256_sub_pd)
+KCALC_AVX2_BINARY(multiply, _mm256_mul_pd)
+KCALC_AVX2_BINARY(divide, _mm256_div_pd)
+
+#undef KCALC_AVX2_BINARY
+
+KCALC_AVX2 void complexMultiplyAvx2(
+    const double * aReal, const double * aImag,
+    const double * bReal, const double * bImag,
+    double * outReal, double * outImag, std::size_t n)
+{
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256d ar = _mm256_loadu_pd(aReal + i);
+    __m256d ai = _mm256_loadu_pd(aImag + i);
+    __m256d br = _mm256_loadu_pd(bReal + i);
+    __m256d bi = _mm256_loadu_pd(bImag + i);
+    _mm256_storeu_pd(outReal + i, _mm256_sub_pd(
+          _mm256_mul_pd(ar, br), _mm256_mul_pd(ai, bi)));
+    _mm256_storeu_pd(outImag + i, _mm256_add_pd(
+          _mm256_mul_pd(ar, bi), _mm256_mul_pd(ai, br)));
+  }
+  complexMultiplyScalar(aReal + i, aImag + i, bReal + i, bImag + i,
+      outReal + i, outImag + i, n - i);
+}
+
+KCALC_AVX2 void complexDivideAvx2(
+    const double * aReal, const double * aImag,
+    const double * bReal, const double * bImag,
+    double * outReal, double * outImag, std::size_t n)
+{
+  const __m256d sign = _mm256_set1_pd(-0.0);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256d ar = _mm256_loadu_pd(aReal + i);
+    __m256d ai = _mm256_loadu_pd(aImag + i);
+    __m256d br = _mm256_loadu_pd(bReal + i);
+    __m256d bi = _mm256_loadu_pd(bImag + i);
+    // the lanes of complexDivideScalar, selected by blends
+    __m256d realLarger = _mm256_cmp_pd(_mm256_andnot_pd(sign, br),
+        _mm256_andnot_pd(sign, bi), _CMP_GE_OQ);
+    __m256d larger = _mm256_blendv_pd(bi, br, realLarger);
+    __m256d smaller = _mm256_blendv_pd(br, bi, realLarger);
+    __m256d first = _mm256_blendv_pd(ai, ar, realLarger);
+    __m256d second = _mm256_blendv_pd(ar, ai, realLarger);
+    __m256d ratio = _mm256_div_pd(smaller, larger);
+    __m256d denominator = _mm256_add_pd(larger,
+        _mm256_mul_pd(smaller, ratio));
+    __m256d real = _mm256_div_pd(_mm256_add_pd(first,
+          _mm256_mul_pd(second, ratio)), denominator);
+    __m256d imag = _mm256_div_pd(_mm256_sub_pd(second,
+          _mm256_mul_pd(first, ratio)), denominator);
+    _mm256_storeu_pd(outReal + i, real);
+    _mm256_storeu_pd(outImag + i, _mm256_blendv_pd(
+          _mm256_xor_pd(imag, sign), imag, realLarger));
+  }
+  complexDivideScalar(aReal + i, aImag + i, bReal + i, bImag + i,
+      outReal + i, outImag + i, n - i);
+}
+
+#undef KCALC_AVX2
+
+const ColumnKernels Avx2Kernels = {
+  "avx2",
+  negateAvx2,
+  addAvx2,
+  subtractAvx2,
+  multiplyAvx2,
+  divideAvx2,
+  complexMultiplyAvx2,
+  complexDivideAvx2
+};
+
+#endif // KCALC_HAVE_AVX2_KERNELS
+
+const ColumnKernels ScalarKernels = {
+  "scalar",
+  negateScalar,
+  addScalar,
+  subtractScalar,
+  multiplyScalar,
+  divideScalar,
+  complexMultiplyScalar,
+  complexDivideScalar
+};
+
+const ColumnKernels& selectKernels()
+{
+#ifdef KCALC_HAVE_AVX2_KERNELS
+  if (__builtin_cpu_supports("avx2"))
+    return Avx2Kernels;
+#endif
+  return ScalarKernels;
+}
+
+} /* anonymous namespace */
+
+const ColumnKernels& ColumnKernels::scalar()
+{
+  return ScalarKernels;
+}
+
+const ColumnKernels& ColumnKernels::best()
+{
+  static const ColumnKernels& kernels = selectKernels();
+  return kernels;
+}
+
+} /* namespace kcalc */
@@ -0,0 +1,168 @@
+#include "CostModel.h"
+#include "Ast.h"
+#include "SymbolTable.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace kcalc
+{
+
+namespace
+{
+
+// variables referring to variables, deeper chains are not followed
+constexpr unsigned int MaxVariableDepth = 32;
+
+CostEstimate estimateRecursive(
+    const Expression& expression,
+    const SymbolTable& symbolTable,
+    unsigned int depth,
+    SubtreeCosts * subtrees);
+
+CostEstimate estimateNode(
+    const Expression& expression,
+    const SymbolTable& symbolTable,
+    unsigned int depth,
+    SubtreeCosts * subtrees);
+
+// an exponent of b bits is taken to be 2^(b - 1/2)
+double exponentValue(const CostEstimate& exponent)
+{ return std::max(1.0, std::exp2(std::min(exponent.bits, 62.0) - 0.5)); }
+
+CostEstimate estimateArithmetic(
+    const ArithmeticExpression& expression,
+    const SymbolTable& symbolTable,
+    unsigned int depth,
+    SubtreeCosts * subtrees)
+{
+  using Operation = ArithmeticExpression::Operation;
+  CostEstimate right = estimateRecursive(expression.right(), 
+      symbolTable, depth, subtrees);
+  if (expression.operation() == Operation::Modulo &&
+      expression.left().kind() == ObjectKind::ArithmeticExpression)
+  {
+    auto& power = static_cast<const ArithmeticExpression&>(
+        expression.left());
+    if (power.operation() == Operation::Power)
+    {
+      // evaluated as modular exponentiation, one squaring and at most
+      // one multiplication per exponent bit
+      CostEstimate base = estimateRecursive(power.left(), 
+          symbolTable, depth, subtrees);
+      CostEstimate exponent = estimateRecursive(power.right(), 
+          symbolTable, depth, subtrees);
+      CostEstimate result;
+      result.bits = right.bits;
+      result.cost = base.cost + exponent.cost + right.cost + 
+        2 * exponent.bits * CostModel::multiplicationCost(2 * right.bits);
+      return result;
+    }
+  }
+  CostEstimate left = estimateRecursive(expression.left(), 
+      symbolTable, depth, subtrees);
+  CostEstimate result;
+  result.cost = left.cost + right.cost;
+  switch (expression.operation())
+  {
+    case Operation::Add:
+    case Operation::Subtract:
+      result.bits = std::max(left.bits, right.bits) + 1;
+      result.cost += result.bits / GMP_NUMB_BITS;
+      break;
+    case Operation::Multiply:
+      result.bits = left.bits + right.bits;
+      result.cost += CostModel::multiplicationCost(result.bits);
+      break;
+    case Operation::Divide:
+      result.bits = left.bits + right.bits;
+      result.cost += 2 * CostModel::multiplicationCost(result.bits);
+      break;
+    case Operation::Power:
+      // squarings double the size, their sum is about twice the last
+      result.bits = left.bits * exponentValue(right);
+      result.cost += 2 * CostModel::multiplicationCost(result.bits);
+      break;
+    case Operation::Modulo:
+      result.bits = right.bits;
+      result.cost += CostModel::multiplicationCost(left.bits);
+      break;
+  }
+  return result;
+}
+
+CostEstimate estimateRecursive(
+    const Expression& expression,
+    const SymbolTable& symbolTable,
+    unsigned int depth,
+    SubtreeCosts * subtrees)
+{
+  CostEstimate result = estimateNode(expression, symbolTable, depth, 
+      subtrees);
+  // nodes of variable contents are never evaluated, only clones
+  if (subtrees != nullptr && depth == 0)
+    subtrees->emplace(&expression, result.cost);
+  return result;
+}
+
+CostEstimate estimateNode(
+    const Expression& expression,
+    const SymbolTable& symbolTable,
+    unsigned int depth,
+    SubtreeCosts * subtrees)
+{
+  switch (expression.kind())
+  {
+    case ObjectKind::Number:
+    {
+      CostEstimate result;
+      result.bits = static_cast<const Number&>(
+          expression).number().bitSize();
+      return result;
+    }
+    case ObjectKind::Variable:
+    {
+      std::shared_ptr<const Expression> content = symbolTable.lookup(
+          std::string(static_cast<const Variable&>(expression).name()));
+      if (content != nullptr && depth < MaxVariableDepth)
+        return estimateRecursive(*content, symbolTable, depth + 1, 
+            subtrees);
+      return CostEstimate();
+    }
+    case ObjectKind::UnaryMinus:
+    {
+      CostEstimate result = estimateRecursive(
+          static_cast<const UnaryMinusExpression&>(expression).inner(),
+          symbolTable, depth, subtrees);
+      result.cost += result.bits / GMP_NUMB_BITS;
+      return result;
+    }
+    case ObjectKind::ArithmeticExpression:
+      return estimateArithmetic(
+          static_cast<const ArithmeticExpression&>(expression),
+          symbolTable, depth, subtrees);
+    default:
+      return CostEstimate();
+  }
+}
+
+} /* anonymous namespace */
+
+CostEstimate CostModel::estimate(
+    const Expression& expression,
+    const SymbolTable& symbolTable)
+{ return estimateRecursive(expression, symbolTable, 0, nullptr); }
+
+CostEstimate CostModel::estimate(
+    const Expression& expression,
+    const SymbolTable& symbolTable,
+    SubtreeCosts& subtrees)
+{ return estimateRecursive(expression, symbolTable, 0, &subtrees); }
+
+double CostModel::multiplicationCost(double bits)
+{
+  double limbs = bits / GMP_NUMB_BITS + 1;
+  return limbs * std::log2(limbs + 1);
+}
+
+} /* namespace kcalc */
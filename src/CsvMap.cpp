@@ -0,0 +1,412 @@
+#include "CsvMap.h"
+#include "Exceptions.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <sstream>
+
+namespace kcalc
+{
+
+namespace
+{
+
+// input per task, rounded up to the next line break
+constexpr std::size_t ChunkBytes = 1 << 16;
+
+// chunks in flight per thread, bounding the buffered output
+constexpr unsigned int ChunksPerThread = 4;
+
+std::string_view trim(std::string_view text)
+{
+  std::size_t start = text.find_first_not_of(" \t\r");
+  if (start == std::string_view::npos)
+    return std::string_view();
+  std::size_t end = text.find_last_not_of(" \t\r");
+  return text.substr(start, end - start + 1);
+}
+
+// fields up to index last, or fewer if the line has fewer; quotes
+// around a field are removed
+void split(std::string_view line, std::size_t last,
+    std::vector<std::string_view>& fields)
+{
+  fields.clear();
+  std::size_t position = 0;
+  while (fields.size() <= last && position <= line.size())
+  {
+    std::size_t start = line.find_first_not_of(" \t", position);
+    std::size_t end;
+    if (start != std::string_view::npos && line[start] == '"')
+    {
+      // "" inside a quoted field is an escaped quote
+      end = start + 1;
+      while ((end = line.find('"', end)) != std::string_view::npos &&
+          end + 1 < line.size() && line[end + 1] == '"')
+        end += 2;
+      if (end == std::string_view::npos)
+        end = line.size();
+      fields.push_back(line.substr(start + 1, end - start - 1));
+      end = line.find(',', end);
+    }
+    else
+    {
+      end = line.find(',', position);
+      fields.push_back(trim(line.substr(position, end - position)));
+    }
+    if (end == std::string_view::npos)
+      break;
+    position = end + 1;
+  }
+}
+
+// the syntax of number literals, with an optional sign and leading
+// zeros allowed
+bool isNumber(std::string_view text)
+{
+  std::size_t i = 0;
+  std::size_t size = text.size();
+  if (i < size && (text[i] == '+' || text[i] == '-'))
+    ++i;
+  if (i < size && text[size - 1] == 'i')
+    --size;
+  if (i == size)
+    return size < text.size();
+  auto digits = [&]() {
+    std::size_t start = i;
+    while (i < size && std::isdigit(static_cast<unsigned char>(text[i])))
+      ++i;
+    return i - start;
+  };
+  std::size_t mantissa = digits();
+  if (i < size && text[i] == '.')
+  {
+    ++i;
+    mantissa += digits();
+  }
+  if (mantissa == 0)
+    return false;
+  if (i < size && (text[i] == 'e' || text[i] == 'E'))
+  {
+    ++i;
+    if (i < size && (text[i] == '+' || text[i] == '-'))
+      ++i;
+    if (digits() == 0)
+      return false;
+  }
+  return i == size;
+}
+
+std::optional<std::complex<double>> parseDouble(std::string_view text)
+{
+  if (!isNumber(text))
+    return std::nullopt;
+  bool negative = text[0] == '-';
+  if (text[0] == '-' || text[0] == '+')
+    text.remove_prefix(1);
+  bool imaginary = text.back() == 'i';
+  if (imaginary)
+    text.remove_suffix(1);
+  double value = 1;
+  if (!text.empty() && std::from_chars(text.data(),
+        text.data() + text.size(), value).ec ==
+      std::errc::result_out_of_range)
+  {
+    // from_chars leaves the value alone, strtod overflows to infinity
+    // and underflows to zero
+    value = std::strtod(std::string(text).c_str(), nullptr);
+  }
+  if (negative)
+    value = -value;
+  return imaginary ? std::complex<double>(0, value) : value;
+}
+
+// the format of mpz_out_raw: the byte count, negated for negative
+// numbers, as four bytes and the magnitude, both most significant
+// byte first
+void appendRaw(std::string& out, mpz_srcptr value)
+{
+  std::size_t bytes = mpz_sgn(value) == 0 ? 0 :
+    (mpz_sizeinbase(value, 2) + 7) / 8;
+  std::uint32_t size = mpz_sgn(value) < 0 ?
+    -static_cast<std::uint32_t>(bytes) : bytes;
+  for (int shift = 24; shift >= 0; shift -= 8)
+    out.push_back(static_cast<char>(size >> shift));
+  std::size_t start = out.size();
+  out.resize(start + bytes);
+  mpz_export(out.data() + start, nullptr, 1, 1, 1, 0, value);
+}
+
+void appendRaw(std::string& out, double value)
+{
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void writeDouble(std::ostream& out, double value)
+{
+  char buffer[32];
+  auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  out.write(buffer, result.ptr - buffer);
+}
+
+// like the exact values: 1.5, -2i, 3 + 0.25i
+void writeComplex(std::ostream& out, std::complex<double> value)
+{
+  if (value.imag() == 0 || value.real() != 0)
+    writeDouble(out, value.real());
+  if (value.imag() == 0)
+    return;
+  if (value.real() != 0)
+  {
+    out << (std::signbit(value.imag()) ? " - " : " + ");
+    value.imag(std::abs(value.imag()));
+  }
+  writeDouble(out, value.imag());
+  out.put('i');
+}
+
+} /* anonymous namespace */
+
+struct CsvMap::Chunk
+{
+  explicit Chunk(ThreadPool& pool)
+    : group{pool}
+  { }
+
+  std::string_view text;
+  // line of each row, counting from 1 at the start of the chunk
+  std::vector<unsigned long> lines;
+  std::vector<char> failed;
+  std::vector<std::pair<unsigned long, std::string>> errors;
+  unsigned long lineCount = 0;
+  std::string output;
+  TaskGroup group;
+
+  void fail(std::size_t row, const std::string& message)
+  {
+    failed[row] = true;
+    errors.emplace_back(lines[row], message);
+  }
+};
+
+CsvMap::CsvMap(std::string_view expression, const Options& options)
+  : m_evaluator{expression}, m_options{options}
+{ }
+
+unsigned long CsvMap::run(std::string_view input, std::ostream& out,
+    const ErrorHandler& error, ThreadPool& pool) const
+{
+  std::size_t headerEnd = std::min(input.find('\n'), input.size());
+  std::vector<std::string_view> names;
+  split(input.substr(0, headerEnd), std::string_view::npos - 1, names);
+  std::vector<std::size_t> fields;
+  for (const std::string& variable : m_evaluator.variables())
+  {
+    auto name = std::find(names.begin(), names.end(), variable);
+    if (name == names.end())
+      throw UnboundVariableException(__FILE__, __LINE__, variable);
+    fields.push_back(name - names.begin());
+  }
+  std::string_view data = input.substr(
+      std::min(headerEnd + 1, input.size()));
+
+  unsigned long line = 1;
+  unsigned long failed = 0;
+  std::size_t position = 0;
+  std::deque<std::unique_ptr<Chunk>> window;
+  while (true)
+  {
+    while (window.size() < ChunksPerThread * pool.concurrency() &&
+        position < data.size())
+    {
+      std::size_t end = position + ChunkBytes < data.size() ?
+        data.find('\n', position + ChunkBytes) : std::string_view::npos;
+      end = end == std::string_view::npos ? data.size() : end + 1;
+      window.push_back(std::make_unique<Chunk>(pool));
+      Chunk& chunk = *window.back();
+      chunk.text = data.substr(position, end - position);
+      position = end;
+      chunk.group.run([this, &chunk, &fields, &pool]() {
+          process(chunk, fields, pool); });
+    }
+    if (window.empty())
+      break;
+    Chunk& chunk = *window.front();
+    chunk.group.wait();
+    out.write(chunk.output.data(), chunk.output.size());
+    for (const auto& [relative, message] : chunk.errors)
+      error(line + relative, message);
+    failed += chunk.errors.size();
+    line += chunk.lineCount;
+    window.pop_front();
+  }
+  return failed;
+}
+
+void CsvMap::process(Chunk& chunk, const std::vector<std::size_t>& fields,
+    ThreadPool& pool) const
+{
+  if (m_options.approximate)
+    approximate(chunk, parse<std::complex<double>>(chunk, fields,
+          parseDouble));
+  else
+    evaluate(chunk, parse<ComplexNumber>(chunk, fields,
+          [](std::string_view text) -> std::optional<ComplexNumber> {
+            if (!isNumber(text))
+              return std::nullopt;
+            return ComplexNumber(text);
+          }), pool);
+  std::sort(chunk.errors.begin(), chunk.errors.end(),
+      [](const auto& left, const auto& right) {
+        return left.first < right.first; });
+}
+
+// the fields of all rows that are not blank, a failed field is
+// replaced by 1
+template<typename Value, typename Parse>
+std::vector<std::vector<Value>> CsvMap::parse(Chunk& chunk,
+    const std::vector<std::size_t>& fields, Parse parseField) const
+{
+  const std::vector<std::string>& variables = m_evaluator.variables();
+  std::vector<std::vector<Value>> columns(fields.size());
+  std::size_t last = fields.empty() ? 0 :
+    *std::max_element(fields.begin(), fields.end());
+  std::vector<std::string_view> values;
+  std::string_view text = chunk.text;
+  while (!text.empty())
+  {
+    std::size_t end = std::min(text.find('\n'), text.size());
+    std::string_view line = text.substr(0, end);
+    text.remove_prefix(std::min(end + 1, text.size()));
+    ++chunk.lineCount;
+    if (trim(line).empty())
+      continue;
+    std::size_t row = chunk.lines.size();
+    chunk.lines.push_back(chunk.lineCount);
+    chunk.failed.push_back(false);
+    split(line, last, values);
+    for (std::size_t k = 0; k < fields.size(); ++k)
+    {
+      std::optional<Value> value;
+      try
+      {
+        if (fields[k] >= values.size())
+          throw InvalidFieldException(__FILE__, __LINE__, variables[k],
+              std::nullopt);
+        value = parseField(values[fields[k]]);
+        if (!value)
+          throw InvalidFieldException(__FILE__, __LINE__, variables[k],
+              values[fields[k]]);
+      }
+      catch (const Exception& e)
+      {
+        if (!chunk.failed[row])
+          chunk.fail(row, e.what());
+      }
+      columns[k].push_back(value ? std::move(*value) : Value(1));
+    }
+  }
+  return columns;
+}
+
+void CsvMap::evaluate(Chunk& chunk,
+    const std::vector<std::vector<ComplexNumber>>& columns,
+    ThreadPool& pool) const
+{
+  std::size_t rows = chunk.lines.size();
+  std::vector<const ComplexNumber *> pointers;
+  for (const std::vector<ComplexNumber>& column : columns)
+    pointers.push_back(column.data());
+  std::vector<ComplexNumber> results;
+  try
+  {
+    results = m_evaluator.evaluate(pointers, rows, pool);
+  }
+  catch (const Exception&)
+  {
+    // one row at a time, to find the failing ones
+    results.assign(rows, ComplexNumber(0));
+    std::vector<const ComplexNumber *> row(columns.size());
+    for (std::size_t i = 0; i < rows; ++i)
+    {
+      if (chunk.failed[i])
+        continue;
+      for (std::size_t k = 0; k < columns.size(); ++k)
+        row[k] = columns[k].data() + i;
+      try
+      {
+        results[i] = std::move(m_evaluator.evaluate(row, 1, pool)[0]);
+      }
+      catch (const Exception& e)
+      {
+        chunk.fail(i, e.what());
+      }
+    }
+  }
+
+  if (m_options.output == Output::Raw)
+  {
+    for (std::size_t i = 0; i < rows; ++i)
+    {
+      ComplexNumber& value = results[i];
+      if (chunk.failed[i])
+        chunk.output.append(16, '\0');
+      else
+      {
+        value.normalize();
+        appendRaw(chunk.output, value.real().get_num_mpz_t());
+        appendRaw(chunk.output, value.real().get_den_mpz_t());
+        appendRaw(chunk.output, value.imaginary().get_num_mpz_t());
+        appendRaw(chunk.output, value.imaginary().get_den_mpz_t());
+      }
+    }
+    return;
+  }
+  std::ostringstream out;
+  for (std::size_t i = 0; i < rows; ++i)
+  {
+    if (!chunk.failed[i])
+      results[i].write(out);
+    out.put('\n');
+  }
+  chunk.output = out.str();
+}
+
+void CsvMap::approximate(Chunk& chunk,
+    const std::vector<std::vector<std::complex<double>>>& columns) const
+{
+  std::size_t rows = chunk.lines.size();
+  std::vector<const std::complex<double> *> pointers;
+  for (const std::vector<std::complex<double>>& column : columns)
+    pointers.push_back(column.data());
+  std::vector<std::complex<double>> results =
+    m_evaluator.approximateComplex(pointers, rows);
+  if (m_options.output == Output::Raw)
+  {
+    for (std::size_t i = 0; i < rows; ++i)
+    {
+      std::complex<double> value = chunk.failed[i] ?
+        std::complex<double>(NAN, NAN) : results[i];
+      appendRaw(chunk.output, value.real());
+      appendRaw(chunk.output, value.imag());
+    }
+    return;
+  }
+  std::ostringstream out;
+  for (std::size_t i = 0; i < rows; ++i)
+  {
+    if (!chunk.failed[i])
+      writeComplex(out, results[i]);
+    out.put('\n');
+  }
+  chunk.output = out.str();
+}
+
+} /* namespace kcalc */
@@ -35,6 +35,60 @@ std::string DivisionByZeroException::what() const
   return "  Arithmetic error: Division by zero.";
 } 
 
+std::string PrecisionLossException::what() const   
+{
+  return (boost::format("  Arithmetic error: A precision of %1% bits is "
+        "too low for this result.") % m_precision).str();
+} 
+
+std::string ModuloResidueException::what() const   
+{
+  return (boost::format("  Arithmetic error: Modulo is not defined for "
+        "residues modulo %1%.") % m_modulus).str();
+} 
+
+std::string BudgetExceededException::what() const   
+{
+  switch (m_resource)
+  {
+    case Time:
+      return (boost::format("  Arithmetic error: Statement exceeds its "
+            "time budget of %1% seconds.") % m_limit).str();
+    case Memory:
+      return (boost::format("  Arithmetic error: Statement exceeds its "
+            "memory budget of %1% bytes.") % m_limit).str();
+    case Digits:
+      break;
+  }
+  return (boost::format("  Arithmetic error: Result exceeds the budget "
+        "of %1% digits.") % m_limit).str();
+} 
+
+std::string CancelledException::what() const   
+{
+  return "  Arithmetic error: Statement was cancelled.";
+} 
+
+std::string UnboundVariableException::what() const   
+{
+  return (boost::format("  Semantic error: Variable \"%1%\" has no value.")
+      % m_name).str();
+} 
+
+std::string PreparedAssignmentException::what() const   
+{
+  return "  Semantic error: Only expressions can be prepared.";
+} 
+
+std::string InvalidFieldException::what() const   
+{
+  if (!m_text)
+    return (boost::format("  Input error: Column \"%1%\" is missing.")
+        % m_column).str();
+  return (boost::format("  Input error: Column \"%1%\" holds \"%2%\", "
+        "which is no number.") % m_column % *m_text).str();
+} 
+
 std::string IllegalCharacter::what() const   
 {
   assert(m_token);
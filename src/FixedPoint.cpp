@@ -0,0 +1,275 @@
+#include "FixedPoint.h"
+#include "Exceptions.h"
+
+#include <array>
+#include <climits>
+#include <utility>
+
+namespace kcalc
+{
+
+namespace
+{
+
+// places whose power of ten fits into a word
+constexpr unsigned int WordPlaces = 18;
+
+constexpr std::array<long, WordPlaces + 1> powersOfTen()
+{
+  std::array<long, WordPlaces + 1> powers{};
+  powers[0] = 1;
+  for (unsigned int i = 1; i <= WordPlaces; ++i)
+    powers[i] = powers[i - 1] * 10;
+  return powers;
+}
+
+constexpr std::array<long, WordPlaces + 1> PowersOfTen = powersOfTen();
+
+mpz_class powerOfTen(unsigned long exponent)
+{
+  mpz_class power;
+  mpz_ui_pow_ui(power.get_mpz_t(), 10, exponent);
+  return power;
+}
+
+bool fits(__int128 value)
+{ return value >= LONG_MIN && value <= LONG_MAX; }
+
+// numerator / denominator rounded half to even
+__int128 divideRounded(__int128 numerator, __int128 denominator)
+{
+  if (denominator < 0)
+  {
+    numerator = -numerator;
+    denominator = -denominator;
+  }
+  __int128 quotient = numerator / denominator;
+  __int128 remainder = numerator - quotient * denominator;
+  if (remainder < 0)
+    remainder = -remainder;
+  if (2 * remainder > denominator ||
+      (2 * remainder == denominator && (quotient & 1) != 0))
+    quotient += numerator < 0 ? -1 : 1;
+  return quotient;
+}
+
+mpz_class divideRounded(const mpz_class& numerator,
+    const mpz_class& denominator)
+{
+  mpz_class quotient, remainder;
+  mpz_tdiv_qr(quotient.get_mpz_t(), remainder.get_mpz_t(),
+      numerator.get_mpz_t(), denominator.get_mpz_t());
+  remainder = abs(remainder) * 2;
+  int comparison = mpz_cmpabs(remainder.get_mpz_t(),
+      denominator.get_mpz_t());
+  if (comparison > 0 || (comparison == 0 && mpz_odd_p(quotient.get_mpz_t())))
+    quotient += sgn(numerator) * sgn(denominator);
+  return quotient;
+}
+
+} /* namespace */
+
+FixedPoint::FixedPoint(long value, unsigned int places)
+  : m_isWord{true}, m_word{value}, m_places{places}
+{
+  if (value == 0)
+    return;
+  if (places <= WordPlaces)
+  {
+    __int128 scaled = static_cast<__int128>(value) * PowersOfTen[places];
+    if (fits(scaled))
+    {
+      m_word = static_cast<long>(scaled);
+      return;
+    }
+  }
+  assign(mpz_class(value) * powerOfTen(places));
+}
+
+FixedPoint::FixedPoint(const mpq_class& value, long exponent,
+    unsigned int places)
+  : m_places{places}
+{
+  mpz_class numerator = value.get_num();
+  mpz_class denominator = value.get_den();
+  long shift = long(places) + exponent;
+  if (shift >= 0)
+    numerator *= powerOfTen(shift);
+  else
+    denominator *= powerOfTen(-shift);
+  assign(divideRounded(numerator, denominator));
+}
+
+FixedPoint::FixedPoint(mpz_class value, unsigned int places)
+  : m_places{places}
+{ assign(std::move(value)); }
+
+mpz_class FixedPoint::scaled() const
+{ return m_isWord ? mpz_class(m_word) : m_large; }
+
+void FixedPoint::assign(mpz_class value)
+{
+  m_isWord = value.fits_slong_p();
+  if (m_isWord)
+  {
+    m_word = value.get_si();
+    m_large = 0;
+  }
+  else
+    m_large = std::move(value);
+}
+
+FixedPoint FixedPoint::word(long value, unsigned int places)
+{
+  FixedPoint result(0, places);
+  result.m_word = value;
+  return result;
+}
+
+FixedPoint FixedPoint::operator-() const
+{
+  if (m_isWord && m_word != LONG_MIN)
+    return word(-m_word, m_places);
+  return FixedPoint(mpz_class(-scaled()), m_places);
+}
+
+FixedPoint FixedPoint::operator+(const FixedPoint& other) const
+{
+  long sum;
+  if (m_isWord && other.m_isWord &&
+      !__builtin_add_overflow(m_word, other.m_word, &sum))
+    return word(sum, m_places);
+  return FixedPoint(mpz_class(scaled() + other.scaled()), m_places);
+}
+
+FixedPoint FixedPoint::operator-(const FixedPoint& other) const
+{
+  long difference;
+  if (m_isWord && other.m_isWord &&
+      !__builtin_sub_overflow(m_word, other.m_word, &difference))
+    return word(difference, m_places);
+  return FixedPoint(mpz_class(scaled() - other.scaled()), m_places);
+}
+
+FixedPoint FixedPoint::operator*(const FixedPoint& other) const
+{
+  if (m_isWord && other.m_isWord && m_places <= WordPlaces)
+  {
+    __int128 product = divideRounded(
+        static_cast<__int128>(m_word) * other.m_word, 
+        PowersOfTen[m_places]);
+    if (fits(product))
+      return word(static_cast<long>(product), m_places);
+  }
+  return FixedPoint(divideRounded(scaled() * other.scaled(),
+        powerOfTen(m_places)), m_places);
+}
+
+FixedPoint FixedPoint::operator/(const FixedPoint& other) const
+{
+  if (other == 0)
+    throw DivisionByZeroException(__FILE__, __LINE__);
+  if (m_isWord && other.m_isWord && m_places <= WordPlaces)
+  {
+    __int128 quotient = divideRounded(
+        static_cast<__int128>(m_word) * PowersOfTen[m_places],
+        other.m_word);
+    if (fits(quotient))
+      return word(static_cast<long>(quotient), m_places);
+  }
+  return FixedPoint(divideRounded(scaled() * powerOfTen(m_places),
+        other.scaled()), m_places);
+}
+
+FixedPoint FixedPoint::operator%(const FixedPoint& other) const
+{
+  if (other == 0)
+    throw DivisionByZeroException(__FILE__, __LINE__);
+  if (m_isWord && other.m_isWord)
+  {
+    if (other.m_word == -1)
+      return word(0, m_places);
+    long remainder = m_word % other.m_word;
+    if (remainder != 0 && (remainder < 0) != (other.m_word < 0))
+      remainder += other.m_word;
+    return word(remainder, m_places);
+  }
+  mpz_class remainder;
+  mpz_fdiv_r(remainder.get_mpz_t(), scaled().get_mpz_t(),
+      other.scaled().get_mpz_t());
+  return FixedPoint(std::move(remainder), m_places);
+}
+
+std::pair<FixedPoint, FixedPoint> FixedPoint::multiply(
+    const FixedPoint& a, const FixedPoint& b,
+    const FixedPoint& c, const FixedPoint& d)
+{
+  unsigned int places = a.m_places;
+  mpz_class A = a.scaled(), B = b.scaled(), C = c.scaled(), 
+            D = d.scaled();
+  mpz_class scale = powerOfTen(places);
+  return { FixedPoint(divideRounded(A * C - B * D, scale), places),
+    FixedPoint(divideRounded(A * D + B * C, scale), places) };
+}
+
+std::pair<FixedPoint, FixedPoint> FixedPoint::divide(
+    const FixedPoint& a, const FixedPoint& b,
+    const FixedPoint& c, const FixedPoint& d)
+{
+  unsigned int places = a.m_places;
+  mpz_class A = a.scaled(), B = b.scaled(), C = c.scaled(), 
+            D = d.scaled();
+  // the scales of numerator and denominator cancel
+  mpz_class norm = C * C + D * D;
+  if (norm == 0)
+    throw DivisionByZeroException(__FILE__, __LINE__);
+  mpz_class scale = powerOfTen(places);
+  return { FixedPoint(divideRounded((A * C + B * D) * scale, norm), places),
+    FixedPoint(divideRounded((B * C - A * D) * scale, norm), places) };
+}
+
+bool FixedPoint::operator==(long value) const
+{
+  if (value == 0)
+    return m_isWord && m_word == 0;
+  return scaled() == mpz_class(value) * powerOfTen(m_places);
+}
+
+int FixedPoint::sign() const
+{ return m_isWord ? (m_word > 0) - (m_word < 0) : sgn(m_large); }
+
+bool FixedPoint::isInteger() const
+{
+  if (m_isWord && m_places <= WordPlaces)
+    return m_word % PowersOfTen[m_places] == 0;
+  return mpz_divisible_p(scaled().get_mpz_t(), 
+      powerOfTen(m_places).get_mpz_t()) != 0;
+}
+
+std::optional<long> FixedPoint::toLong() const
+{
+  if (!isInteger())
+    return std::nullopt;
+  if (m_isWord && m_places <= WordPlaces)
+    return m_word / PowersOfTen[m_places];
+  mpz_class value = scaled() / powerOfTen(m_places);
+  if (!value.fits_slong_p())
+    return std::nullopt;
+  return value.get_si();
+}
+
+std::string FixedPoint::to_string() const
+{
+  std::string digits = m_isWord ? std::to_string(m_word) : 
+    m_large.get_str();
+  bool negative = digits[0] == '-';
+  if (negative)
+    digits.erase(0, 1);
+  if (digits.size() <= m_places)
+    digits.insert(0, m_places + 1 - digits.size(), '0');
+  if (m_places > 0)
+    digits.insert(digits.size() - m_places, 1, '.');
+  return negative ? "-" + digits : digits;
+}
+
+} /* namespace kcalc */
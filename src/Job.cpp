@@ -0,0 +1,45 @@
+#include "Job.h"
+
+#include <cassert>
+
+namespace kcalc
+{
+
+Job::Job(const SymbolTable& symbolTable, 
+    std::optional<std::string> variable,
+    Evaluation evaluation) :
+  m_symbolTable{symbolTable}, m_variable{std::move(variable)}
+{
+  m_thread = std::thread([this, evaluation = std::move(evaluation)]() {
+      try
+      {
+        m_value = evaluation(m_symbolTable, m_cancelled);
+      }
+      catch (...)
+      {
+        m_exception = std::current_exception();
+      }
+      m_done.store(true, std::memory_order_release);
+    });
+}
+
+Job::~Job()
+{
+  cancel();
+  if (m_thread.joinable())
+    m_thread.join();
+}
+
+std::unique_ptr<Expression> Job::commit(SymbolTable& symbolTable)
+{
+  assert(done());
+  if (m_thread.joinable())
+    m_thread.join();
+  if (m_exception)
+    std::rethrow_exception(m_exception);
+  if (m_variable && m_value)
+    symbolTable.insert(*m_variable, *m_value);
+  return std::move(m_value);
+}
+
+} /* namespace kcalc */
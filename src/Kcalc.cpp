@@ -1,12 +1,36 @@
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "Parser.h" 
+#include "Allocator.h"
+#include "ApproximateEvaluator.h"
+#include "CostModel.h"
+#include "CsvMap.h"
 #include "Exceptions.h"
+#include "Job.h"
+#include "MultiModular.h"
+#include "Multiplication.h"
 #include "Repl.h"
+#include "Script.h"
+#include "Server.h"
 #include "SymbolTable.h"
 #include "SemanticAnalyzer.h"
+#include "SymbolUsage.h"
+#include "ThreadPool.h"
 
 static void renderError(
+    std::ostream& out,
     const kcalc::ParseError& e,
     unsigned int promptLength)
 {
@@ -15,57 +39,975 @@ static void renderError(
   for (unsigned int i = 0; i < (token ? 
         token->offset() : 0) + promptLength; ++i)
   {
-    std::cout << "_";
+    out << "_";
+  }
+  out << "^\n";
+  out << e.what() << "\n";
+}
+
+struct DisplayState
+{
+  kcalc::DisplayFormat format{kcalc::DisplayMode::Truncated, 200};
+  std::unique_ptr<kcalc::Expression> last;
+};
+
+// results with more digits are typos like 9^9^9 rather than intended
+static const unsigned long DefaultDigits = 100000000;
+
+struct Job;
+
+// state shared by all statements of a REPL or script run
+struct Session
+{
+  explicit Session(std::ostream& output)
+    : analyzer{symbolTable}, out{output}
+  { budget.digits = DefaultDigits; }
+
+  kcalc::SymbolTable symbolTable;
+  kcalc::SemanticAnalyzer analyzer;
+  DisplayState display;
+  kcalc::Approximation approximation;
+  // exact values of expensive statements by residues
+  bool multiModular = false;
+  kcalc::Budget budget;
+  // statements ending in & run as jobs, only in the interactive REPL
+  bool jobControl = false;
+  std::map<unsigned int, std::unique_ptr<Job>> jobs;
+  unsigned int nextJob = 1;
+  std::ostream& out;
+};
+
+static void printResult(
+    std::ostream& out,
+    const kcalc::Expression& result,
+    const kcalc::DisplayFormat& format)
+{
+  if (result.kind() == kcalc::ObjectKind::Number)
+    static_cast<const kcalc::Number&>(result).number().write(
+        out, format);
+  else
+    out << result.to_string();
+  out << "\n";
+}
+
+static const char * modeName(kcalc::DisplayMode mode)
+{
+  switch (mode)
+  {
+    case kcalc::DisplayMode::Full:
+      return "full";
+    case kcalc::DisplayMode::Truncated:
+      return "truncated";
+    case kcalc::DisplayMode::Scientific:
+      return "scientific";
+  }
+  return "";
+}
+
+static void displayCommand(
+    std::ostream& out,
+    DisplayState& display,
+    std::istringstream& stream)
+{
+  std::string mode;
+  stream >> mode;
+  unsigned int digits = display.format.digits;
+  if (mode.empty())
+  {
+    out << modeName(display.format.mode) << " " 
+      << digits << "\n";
+    return;
+  }
+  if (!(stream >> digits) && !stream.eof())
+  {
+    out << "Expected a digit count\n";
+    return;
+  }
+  if (mode == "full")
+    display.format.mode = kcalc::DisplayMode::Full;
+  else if (mode == "truncated")
+    display.format.mode = kcalc::DisplayMode::Truncated;
+  else if (mode == "scientific")
+    display.format.mode = kcalc::DisplayMode::Scientific;
+  else
+  {
+    out << "Unknown display mode " << mode << "\n";
+    return;
+  }
+  display.format.digits = std::max(1u, digits);
+}
+
+static void threadsCommand(std::ostream& out, std::istringstream& stream)
+{
+  unsigned int threads;
+  if (stream >> threads && threads > 0)
+    kcalc::ThreadPool::instance().resize(threads - 1);
+  else if (!stream.eof())
+    out << "Expected a thread count\n";
+  out << kcalc::ThreadPool::instance().concurrency() 
+    << " threads\n";
+}
+
+static void parallelCommand(std::ostream& out, std::istringstream& stream)
+{
+  std::string state;
+  stream >> state;
+  if (state == "on" || state == "off")
+    kcalc::Multiplication::setParallel(state == "on");
+  else if (!state.empty())
+    out << "Expected on or off\n";
+  out << "parallel multiplication " 
+    << (kcalc::Multiplication::parallel() ? "on" : "off") << "\n";
+}
+
+static void multiModularCommand(
+    std::ostream& out,
+    bool& multiModular,
+    std::istringstream& stream)
+{
+  std::string state;
+  stream >> state;
+  if (state == "on" || state == "off")
+    multiModular = state == "on";
+  else if (!state.empty())
+    out << "Expected on or off\n";
+  out << "multimodular " << (multiModular ? "on" : "off") << "\n";
+}
+
+static void budgetCommand(
+    std::ostream& out,
+    kcalc::Budget& budget,
+    std::istringstream& stream)
+{
+  std::string resource;
+  double limit = 0;
+  stream >> resource;
+  if (resource == "off")
+  {
+    budget.seconds = 0;
+    budget.bytes = 0;
+    budget.digits = 0;
+  }
+  else if (resource != "time" && resource != "memory" && 
+      resource != "digits")
+  {
+    if (!resource.empty())
+      out << "Expected time, memory, digits or off\n";
+  }
+  else if (!(stream >> limit) || limit < 0)
+    out << "Expected a limit\n";
+  else if (resource == "time")
+    budget.seconds = limit;
+  else if (resource == "memory")
+    budget.bytes = static_cast<std::size_t>(limit * 1024 * 1024);
+  else
+    budget.digits = static_cast<unsigned long>(limit);
+  auto print = [&out](auto value, const char * unit) {
+    if (value == 0)
+      out << "none";
+    else
+      out << value << unit;
+  };
+  out << "budget time ";
+  print(budget.seconds, " s");
+  out << ", memory ";
+  print(budget.bytes / (1024 * 1024), " MB");
+  out << ", digits ";
+  print(budget.digits, "");
+  out << "\n";
+}
+
+static void arithmeticCommand(
+    std::ostream& out,
+    kcalc::Approximation& approximation,
+    std::istringstream& stream)
+{
+  std::string mode;
+  stream >> mode;
+  if (mode == "exact")
+    approximation.precision = kcalc::Precision::Exact;
+  else if (mode == "double")
+    approximation.precision = kcalc::Precision::Double;
+  else if (mode == "long")
+    approximation.precision = kcalc::Precision::LongDouble;
+  else if (mode == "float" || mode == "ball")
+  {
+    unsigned long bits = approximation.bits;
+    unsigned int digits = 0;
+    if ((!(stream >> bits) && !stream.eof()) || 
+        (mode == "ball" && !(stream >> digits) && !stream.eof()))
+    {
+      out << "Expected a bit count\n";
+      return;
+    }
+    approximation.precision = mode == "ball" ? kcalc::Precision::Ball :
+      kcalc::Precision::Float;
+    approximation.bits = std::max(2ul, bits);
+    approximation.minimumDigits = digits;
+  }
+  else if (mode == "decimal")
+  {
+    unsigned int places = approximation.places;
+    if (!(stream >> places) && !stream.eof())
+    {
+      out << "Expected a number of places\n";
+      return;
+    }
+    approximation.precision = kcalc::Precision::Decimal;
+    approximation.places = places;
+  }
+  else if (mode == "mod")
+  {
+    std::string text;
+    mpz_class prime = approximation.modulus;
+    if ((stream >> text && prime.set_str(text, 10) != 0) ||
+        mpz_probab_prime_p(prime.get_mpz_t(), 25) == 0)
+    {
+      out << "Expected a prime\n";
+      return;
+    }
+    approximation.precision = kcalc::Precision::Modular;
+    approximation.modulus = prime;
+  }
+  else if (!mode.empty())
+  {
+    out << "Unknown arithmetic " << mode << "\n";
+    return;
+  }
+  switch (approximation.precision)
+  {
+    case kcalc::Precision::Exact:
+      out << "exact\n";
+      break;
+    case kcalc::Precision::Double:
+      out << "double\n";
+      break;
+    case kcalc::Precision::LongDouble:
+      out << "long double\n";
+      break;
+    case kcalc::Precision::Float:
+      out << "float " << approximation.bits << " bits\n";
+      break;
+    case kcalc::Precision::Ball:
+      out << "ball " << approximation.bits << " bits";
+      if (approximation.minimumDigits > 0)
+        out << ", exact below " << approximation.minimumDigits 
+          << " digits";
+      out << "\n";
+      break;
+    case kcalc::Precision::Decimal:
+      out << "decimal " << approximation.places << " places\n";
+      break;
+    case kcalc::Precision::Modular:
+      out << "mod " << approximation.modulus.get_str() << "\n";
+      break;
+  }
+}
+
+// the value of an expression in the arithmetic of approximation,
+// nothing if it is to be evaluated exactly
+static std::optional<std::string> approximate(
+    const kcalc::Approximation& approximation,
+    const kcalc::AstObject& expression,
+    const kcalc::SymbolTable& symbolTable)
+{
+  if (approximation.precision == kcalc::Precision::Exact)
+    return std::nullopt;
+  try
+  {
+    kcalc::ApproximateEvaluator evaluator(approximation);
+    return evaluator.evaluate(
+        static_cast<const kcalc::Expression&>(expression), symbolTable);
+  }
+  catch(const kcalc::PrecisionLossException&)
+  {
+    if (approximation.minimumDigits == 0)
+      throw;
+  }
+  return std::nullopt;
+}
+
+// estimated work below which exact evaluation is faster than by 
+// residues
+static const double MultiModularCost = 1e5;
+
+// the exact value by residues, see MultiModular; nothing if it is not
+// enabled, the statement is cheap or it cannot be evaluated that way
+static std::unique_ptr<kcalc::Expression> multiModular(
+    bool enabled,
+    const kcalc::AstObject& statement,
+    const kcalc::SymbolTable& symbolTable)
+{
+  if (!enabled || statement.kind() == kcalc::ObjectKind::Assignment)
+    return nullptr;
+  auto& expression = static_cast<const kcalc::Expression&>(statement);
+  if (kcalc::CostModel::estimate(expression, symbolTable).cost < 
+      MultiModularCost)
+    return nullptr;
+  std::optional<kcalc::ComplexNumber> value = 
+    kcalc::MultiModular::evaluate(expression, symbolTable);
+  if (!value)
+    return nullptr;
+  return std::make_unique<kcalc::Number>(*value);
+}
+
+static void startJob(Session& session, std::string_view statement);
+static void jobsCommand(Session& session, const std::string& command,
+    std::istringstream& stream);
+
+// :display [full | truncated [digits] | scientific [digits]]
+// :show prints the previous result with all digits
+// :threads [count]
+// :parallel [on | off] switches multiplication on the thread pool
+// :multimodular [on | off] evaluates expensive statements by residues
+// :budget [time seconds | memory megabytes | digits count | off] 
+//   limits each statement, see StatementBudget; 0 is no limit
+// :arithmetic [exact | double | long | float [bits] | 
+//   ball [bits [digits]] | decimal [places] | mod [prime]] evaluates
+//   the following statements in floating or fixed point or modulo a
+//   prime, see ApproximateEvaluator; ball results with fewer correct
+//   digits than given are evaluated exactly
+// :jobs lists the jobs, :wait [job] waits for one or all and :kill 
+//   [job] cancels one or all, see startJob
+static void replCommand(
+    Session& session,
+    std::string_view input)
+{
+  std::istringstream stream(std::string(input.substr(1)));
+  std::string command;
+  stream >> command;
+  if (command == "show")
+  {
+    if (session.display.last)
+      printResult(session.out, *session.display.last, 
+          kcalc::DisplayFormat());
+  }
+  else if (command == "display")
+    displayCommand(session.out, session.display, stream);
+  else if (command == "threads" && !session.jobs.empty())
+    session.out << "Wait for the jobs first\n";
+  else if (command == "threads")
+    threadsCommand(session.out, stream);
+  else if (command == "parallel")
+    parallelCommand(session.out, stream);
+  else if (command == "arithmetic")
+    arithmeticCommand(session.out, session.approximation, stream);
+  else if (command == "multimodular")
+    multiModularCommand(session.out, session.multiModular, stream);
+  else if (command == "budget")
+    budgetCommand(session.out, session.budget, stream);
+  else if (command == "jobs" || command == "wait" || command == "kill")
+    jobsCommand(session, command, stream);
+  else
+    session.out << "Unknown command :" << command << "\n";
+}
+
+// runs one statement or command; errors are thrown
+static void evaluate(
+    Session& session,
+    std::string_view input)
+{
+  if (input[0] == ':')
+  {
+    replCommand(session, input);
+    return;
+  }
+  std::size_t last = input.find_last_not_of(" \t");
+  if (session.jobControl && last != std::string_view::npos &&
+      input[last] == '&')
+  {
+    std::string_view statement = input.substr(0, last);
+    startJob(session, 
+        statement.substr(0, statement.find_last_not_of(" \t") + 1));
+    return;
+  }
+  kcalc::StatementArena arena;
+  kcalc::StatementBudget budget(session.budget);
+  kcalc::Lexer lexer(input);
+  kcalc::Parser parser(lexer);
+  std::unique_ptr<kcalc::AstObject> result =
+    parser.parse();
+  if (result)
+  {
+    // without the analyzer, which folds constants exactly
+    std::optional<std::string> value;
+    if (result->kind() == kcalc::ObjectKind::Assignment)
+    {
+      kcalc::ArenaSuspension persistent;
+      result->accept(session.analyzer);
+    }
+    else if ((value = approximate(session.approximation, *result, 
+            session.symbolTable)))
+    {
+      session.out << *value << "\n";
+      session.display.last.reset();
+    }
+    else
+    {
+      std::unique_ptr<kcalc::Expression> eval = multiModular(
+          session.multiModular, *result, session.symbolTable);
+      if (!eval)
+      {
+        result->accept(session.analyzer);
+        eval = result->eval(session.symbolTable); 
+      }
+      if (eval)
+      {
+        printResult(session.out, *eval, session.display.format);
+        kcalc::ArenaSuspension persistent;
+        session.display.last = eval->cloneExpression();
+      }
+    }
   }
-  std::cout << "^" << std::endl;
-  std::cout << e.what() << std::endl;
 }
 
 static void kcalcRepl(
-    kcalc::SymbolTable& symbolTable,
-    kcalc::SemanticAnalyzer& analyzer,
+    Session& session,
     kcalc::Prompt& prompt,
     const char * input)
 {
   try
   {
-    kcalc::Lexer lexer(input);
+    // Ctrl-C at the prompt does not cancel the next statement
+    kcalc::StatementBudget::clearInterrupt();
+    evaluate(session, input);
+  }
+  catch(const kcalc::ParseError& e)
+  {
+    renderError(session.out, e, prompt.length());
+  }
+  catch(const kcalc::Exception& e)
+  {
+    session.out << e.what() << "\n";
+  }
+  session.out.flush();
+}
+
+// error messages are indented for the REPL
+static std::string trimmed(const std::string& message)
+{
+  std::size_t start = message.find_first_not_of(" ");
+  return message.substr(start == std::string::npos ? 0 : start);
+}
+
+static void reportError(
+    Session& session,
+    const std::string& name,
+    unsigned int line,
+    unsigned int column,
+    const std::string& message)
+{
+  session.out.flush();
+  std::cerr << name << ":" << line << ":";
+  if (column > 0)
+    std::cerr << column << ":";
+  std::cerr << " " << trimmed(message) << std::endl;
+}
+
+static unsigned int errorColumn(const kcalc::ParseError& e)
+{
+  const std::optional<kcalc::Token> token = e.token();
+  return token ? token->offset() + 1 : 0;
+}
+
+// evaluates a script line, reporting errors; false if there was one
+static bool evaluateLine(
+    Session& session,
+    std::string_view line,
+    const std::string& name,
+    unsigned int number)
+{
+  try
+  {
+    evaluate(session, line);
+    return true;
+  }
+  catch(const kcalc::ParseError& e)
+  {
+    reportError(session, name, number, errorColumn(e), e.what());
+  }
+  catch(const kcalc::Exception& e)
+  {
+    reportError(session, name, number, 0, e.what());
+  }
+  return false;
+}
+
+// how a statement is evaluated and displayed
+struct Settings
+{
+  kcalc::DisplayFormat format;
+  kcalc::Approximation approximation;
+  bool multiModular = false;
+  kcalc::Budget budget;
+};
+
+static Settings currentSettings(const Session& session)
+{
+  return Settings{ session.display.format, session.approximation,
+    session.multiModular, session.budget };
+}
+
+static void evaluateBatchLine(
+    kcalc::SymbolTable& symbolTable,
+    const Settings& settings,
+    kcalc::BatchLine& line)
+{
+  try
+  {
+    kcalc::StatementArena arena;
+    kcalc::StatementBudget budget(settings.budget);
+    kcalc::Lexer lexer(line.text);
     kcalc::Parser parser(lexer);
     std::unique_ptr<kcalc::AstObject> result =
       parser.parse();
-    if (result)
+    if (!result)
+      return;
+    kcalc::SemanticAnalyzer analyzer(symbolTable);
+    if (result->kind() == kcalc::ObjectKind::Assignment)
     {
+      kcalc::ArenaSuspension persistent;
       result->accept(analyzer);
-      if (result->kind() != kcalc::ObjectKind::Assignment)
-      {
-        std::unique_ptr<kcalc::Expression> eval =
-          result->eval(symbolTable); 
-        if (eval)
-        {
-          std::cout 
-            << eval->to_string()
-            << std::endl;
-        }
-      }
+      return;
+    }
+    std::optional<std::string> value = 
+      approximate(settings.approximation, *result, symbolTable);
+    if (value)
+    {
+      line.output = *value + "\n";
+      return;
+    }
+    std::unique_ptr<kcalc::Expression> eval = 
+      multiModular(settings.multiModular, *result, symbolTable);
+    if (!eval)
+    {
+      result->accept(analyzer);
+      eval = result->eval(symbolTable);
+    }
+    if (eval)
+    {
+      std::ostringstream out;
+      printResult(out, *eval, settings.format);
+      line.output = out.str();
+      kcalc::ArenaSuspension persistent;
+      line.value = eval->cloneExpression();
     }
   }
   catch(const kcalc::ParseError& e)
   {
-    renderError(e, prompt.length());
+    line.error = e.what();
+    line.column = errorColumn(e);
   }
   catch(const kcalc::Exception& e)
   {
-    std::cout << e.what() << std::endl;
+    line.error = e.what();
+  }
+}
+
+// A statement of the REPL ending in &, evaluated by a kcalc::Job. Its
+// output is printed and an assigned value committed when the job is
+// delivered.
+struct Job
+{
+  std::string text;
+  bool assignment = false;
+  Settings settings;
+  kcalc::BatchLine line;
+  // last, the evaluation stops before the line goes away
+  std::unique_ptr<kcalc::Job> evaluation;
+};
+
+static void startJob(Session& session, std::string_view statement)
+{
+  std::optional<std::string> variable;
+  std::string_view expression = statement;
+  {
+    // syntax errors are reported right away
+    kcalc::StatementArena arena;
+    kcalc::Lexer lexer(statement);
+    kcalc::Parser parser(lexer);
+    std::unique_ptr<kcalc::AstObject> result = parser.parse();
+    if (!result)
+      return;
+    if (result->kind() == kcalc::ObjectKind::Assignment)
+    {
+      auto& assignment = static_cast<const kcalc::Assignment&>(*result);
+      variable = std::string(static_cast<const kcalc::Variable&>(
+            assignment.left()).name());
+      expression.remove_prefix(statement.find('=') + 1);
+    }
+  }
+  auto job = std::make_unique<Job>();
+  job->text = statement;
+  job->assignment = variable.has_value();
+  kcalc::BatchLine& line = job->line;
+  line.text = expression;
+  Settings& settings = job->settings;
+  settings = currentSettings(session);
+  // an approximation has no value to assign
+  if (variable)
+    settings.approximation = kcalc::Approximation();
+  settings.budget.interruptible = false;
+  job->evaluation = std::make_unique<kcalc::Job>(session.symbolTable,
+      std::move(variable), [&line, &settings](
+        kcalc::SymbolTable& symbolTable, 
+        const std::atomic<bool>& cancelled) {
+        settings.budget.cancelled = &cancelled;
+        evaluateBatchLine(symbolTable, settings, line);
+        return std::move(line.value); });
+  unsigned int number = session.nextJob++;
+  session.out << "[" << number << "] " << job->text << "\n";
+  session.jobs.emplace(number, std::move(job));
+}
+
+// prints the finished jobs and assigns their values
+static void deliverJobs(Session& session, std::ostream& out)
+{
+  for (auto it = session.jobs.begin(); it != session.jobs.end(); )
+  {
+    Job& job = *it->second;
+    if (!job.evaluation->done())
+    {
+      ++it;
+      continue;
+    }
+    std::unique_ptr<kcalc::Expression> value = 
+      job.evaluation->commit(session.symbolTable);
+    out << "[" << it->first << "] done " << job.text << "\n";
+    if (!job.line.error.empty())
+      out << job.line.error << "\n";
+    else if (!job.assignment)
+    {
+      out << job.line.output;
+      if (value)
+        session.display.last = std::move(value);
+    }
+    it = session.jobs.erase(it);
+  }
+}
+
+static void jobsCommand(
+    Session& session,
+    const std::string& command,
+    std::istringstream& stream)
+{
+  std::vector<Job *> selected;
+  unsigned int number;
+  if (stream >> number)
+  {
+    auto job = session.jobs.find(number);
+    if (job == session.jobs.end())
+    {
+      session.out << "No job " << number << "\n";
+      return;
+    }
+    selected.push_back(job->second.get());
   }
+  else
+  {
+    for (auto& job : session.jobs)
+      selected.push_back(job.second.get());
+  }
+  if (command == "jobs")
+  {
+    for (auto& job : session.jobs)
+      session.out << "[" << job.first << "] " << 
+        (job.second->evaluation->done() ? "done " : "running ") << 
+        job.second->text << "\n";
+    return;
+  }
+  for (Job * job : selected)
+  {
+    if (command == "kill")
+      job->evaluation->cancel();
+    // Ctrl-C stops waiting
+    while (!job->evaluation->done() && 
+        !kcalc::StatementBudget::interrupted())
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  deliverJobs(session, session.out);
 }
 
-int main()
+// evaluates the lines of a script on the pool in the order their 
+// dependencies allow, the results are printed in input order
+static bool runParallel(
+    Session& session,
+    kcalc::LineReader& reader,
+    const std::string& name)
+{
+  // commands run when no other line is in flight, so the settings
+  // only change between lines
+  Settings settings = currentSettings(session);
+  kcalc::ParallelScript script(kcalc::ThreadPool::instance(),
+      [&session, &settings](kcalc::BatchLine& line) {
+        evaluateBatchLine(session.symbolTable, settings, line); });
+  auto deliver = [&session, &settings, &name](kcalc::BatchLine& line) {
+    if (line.command)
+    {
+      bool success = evaluateLine(session, line.text, name, line.number);
+      settings = currentSettings(session);
+      return success;
+    }
+    if (!line.error.empty())
+    {
+      reportError(session, name, line.number, line.column, line.error);
+      return false;
+    }
+    if (!line.output.empty())
+    {
+      session.out << line.output;
+      session.display.last = std::move(line.value);
+    }
+    return true; };
+  return script.run(reader, deliver);
+}
+
+// runs all lines of a script; blank lines and lines starting with #
+// are skipped. An error is reported with its position and the script
+// continues, the result is false if there were any. Lines are 
+// evaluated in parallel if the thread pool has workers.
+static bool runScript(
+    Session& session,
+    kcalc::LineReader& reader,
+    const std::string& name)
+{
+  if (kcalc::ThreadPool::instance().workers() > 0)
+    return runParallel(session, reader, name);
+  bool success = true;
+  std::string_view line;
+  while (reader.next(line))
+  {
+    if (kcalc::isStatement(line))
+      success = evaluateLine(session, line, name, reader.lineNumber()) 
+        && success;
+  }
+  return success;
+}
+
+// limits of a request of kcalc --serve, which may come from anyone
+// with access to the socket
+static const kcalc::Budget ServerBudget{10, 1024 * 1024 * 1024, 10000000};
+
+// A connection of kcalc --serve with its own symbol table. Responses
+// are "ok", "ok <value>" or "error <message>"; commands affecting the
+// whole process or the budget are not available.
+class ConnectionSession : public kcalc::Server::Session
+{
+public:
+  ConnectionSession()
+    : m_session{m_out}
+  { 
+    m_session.display.format.mode = kcalc::DisplayMode::Full; 
+    m_session.budget = ServerBudget;
+  }
+
+  std::string handle(std::string_view request) override;
+
+private:
+  std::ostringstream m_out;
+  ::Session m_session;
+};
+
+std::string ConnectionSession::handle(std::string_view request)
+{
+  std::size_t start = request.find_first_not_of(" \t");
+  if (start == std::string_view::npos)
+    return "ok";
+  request.remove_prefix(start);
+  if (request[0] == ':' && request.compare(0, 5, ":show") != 0 &&
+      request.compare(0, 8, ":display") != 0 &&
+      request.compare(0, 11, ":arithmetic") != 0 &&
+      request.compare(0, 13, ":multimodular") != 0)
+    return "error command not available";
+  m_out.str(std::string());
+  try
+  {
+    evaluate(m_session, request);
+  }
+  catch(const kcalc::ParseError& e)
+  {
+    return "error " + std::to_string(errorColumn(e)) + ": " + 
+      trimmed(e.what());
+  }
+  catch(const kcalc::Exception& e)
+  {
+    return "error " + trimmed(e.what());
+  }
+  std::string output = m_out.str();
+  return output.empty() ? "ok" : "ok " + output;
+}
+
+static int serve(const char * path)
+{
+  try
+  {
+    kcalc::Server server(path, []() { 
+        return std::make_unique<ConnectionSession>(); });
+    std::cerr << "kcalc: serving on " << path << std::endl;
+    server.run();
+    std::cerr << "kcalc: " << server.statistics() << std::endl;
+  }
+  catch(const std::system_error& e)
+  {
+    std::cerr << "kcalc: " << e.what() << std::endl;
+    return 2;
+  }
+  return 0;
+}
+
+// the expression for every row of a CSV file, see CsvMap; rows that 
+// fail are reported and make the result 1
+static int mapFile(
+    std::ostream& out,
+    const char * expression,
+    const char * path,
+    const kcalc::CsvMap::Options& options)
+{
+  try
+  {
+    kcalc::CsvMap map(expression, options);
+    kcalc::MappedFile file(path);
+    unsigned long failed = map.run(file.contents(), out, 
+        [&out, path](unsigned long line, const std::string& message) {
+          out.flush();
+          std::cerr << path << ":" << line << ": " << trimmed(message) 
+            << std::endl;
+        });
+    out.flush();
+    return failed == 0 ? 0 : 1;
+  }
+  catch(const kcalc::ParseError& e)
+  {
+    std::cerr << "--map:1:" << errorColumn(e) << ": " << trimmed(e.what()) 
+      << std::endl;
+  }
+  catch(const kcalc::Exception& e)
+  {
+    out.flush();
+    std::cerr << path << ": " << trimmed(e.what()) << std::endl;
+  }
+  return 1;
+}
+
+struct FileDescriptor
+{
+  ~FileDescriptor()
+  {
+    if (fd >= 0)
+      ::close(fd);
+  }
+  int fd;
+};
+
+static int usage()
+{
+  std::cerr << "usage: kcalc [-j threads] [file | - | -e statements]...\n"
+    "       kcalc [-j threads] --serve socket\n"
+    "       kcalc [-j threads] [--double] [--raw] --map expression file"
+    << std::endl;
+  return 2;
+}
+
+// kcalc file... runs scripts, - reads one from standard input and 
+// -e its argument, -j sets the number of threads for the following
+// ones; without arguments kcalc is interactive unless standard input
+// is no terminal. --serve answers requests on a Unix domain socket,
+// --map evaluates an expression for the rows of a CSV file.
+static int runScripts(int argc, char ** argv)
+{
+  kcalc::OutputBuffer buffer(STDOUT_FILENO);
+  std::ostream out(&buffer);
+  Session session(out);
+  session.display.format.mode = kcalc::DisplayMode::Full;
+  kcalc::CsvMap::Options mapOptions;
+  bool success = true;
+  bool scripts = false;
+  try
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      if (std::strcmp(argv[i], "-e") == 0)
+      {
+        if (++i == argc)
+          return usage();
+        scripts = true;
+        kcalc::LineReader reader{std::string_view(argv[i])};
+        success = runScript(session, reader, "-e") && success;
+      }
+      else if (std::strncmp(argv[i], "-j", 2) == 0)
+      {
+        const char * count = argv[i][2] != '\0' ? argv[i] + 2 : 
+          ++i < argc ? argv[i] : "";
+        char * last = nullptr;
+        unsigned long threads = std::strtoul(count, &last, 10);
+        if (threads == 0 || *last != '\0')
+          return usage();
+        kcalc::ThreadPool::instance().resize(threads - 1);
+      }
+      else if (std::strcmp(argv[i], "--serve") == 0)
+        return ++i < argc ? serve(argv[i]) : usage();
+      else if (std::strcmp(argv[i], "--double") == 0)
+        mapOptions.approximate = true;
+      else if (std::strcmp(argv[i], "--raw") == 0)
+        mapOptions.output = kcalc::CsvMap::Output::Raw;
+      else if (std::strcmp(argv[i], "--map") == 0)
+        return i + 2 < argc ? 
+          mapFile(out, argv[i + 1], argv[i + 2], mapOptions) : usage();
+      else if (std::strcmp(argv[i], "-") == 0)
+      {
+        scripts = true;
+        kcalc::LineReader reader(STDIN_FILENO);
+        success = runScript(session, reader, "<stdin>") && success;
+      }
+      else if (argv[i][0] == '-')
+        return usage();
+      else
+      {
+        scripts = true;
+        FileDescriptor file{::open(argv[i], O_RDONLY)};
+        if (file.fd < 0)
+          throw std::system_error(errno, std::generic_category(), 
+              argv[i]);
+        kcalc::LineReader reader(file.fd);
+        success = runScript(session, reader, argv[i]) && success;
+      }
+    }
+    if (!scripts)
+    {
+      kcalc::LineReader reader(STDIN_FILENO);
+      success = runScript(session, reader, "<stdin>");
+    }
+  }
+  catch(const std::system_error& e)
+  {
+    out.flush();
+    std::cerr << "kcalc: " << e.what() << std::endl;
+    return 2;
+  }
+  out.flush();
+  return success ? 0 : 1;
+}
+
+static void interrupt(int)
+{ kcalc::StatementBudget::interrupt(); }
+
+int main(int argc, char ** argv)
 {
   using namespace std::placeholders;
-  kcalc::SymbolTable symbolTable;
-  kcalc::SemanticAnalyzer analyzer(symbolTable);
+  kcalc::GmpAllocator::install();
+  if (argc > 1 || !::isatty(STDIN_FILENO))
+    return runScripts(argc, argv);
+  Session session(std::cout);
+  // Ctrl-C cancels the running statement and keeps the session
+  session.budget.interruptible = true;
+  session.jobControl = true;
+  std::signal(SIGINT, &interrupt);
   kcalc::Repl repl;
-  repl.run(std::bind(&kcalcRepl, std::ref(symbolTable), 
-        std::ref(analyzer), _1, _2));
+  repl.run(std::bind(&kcalcRepl, std::ref(session), _1, _2), 
+      [&session]() {
+        std::ostringstream out;
+        deliverJobs(session, out);
+        return out.str();
+      });
   return 0;
 } 
@@ -1,6 +1,5 @@
 #include "Lexer.h"
 
-#include <regex>
 #include <cassert>
 
 namespace kcalc
@@ -68,7 +67,9 @@ TokenIterator::current() const
 #define DEFINE_TOKENKIND_SIMPLE(kind,chr)
 #define DEFINE_TOKENKIND_MANUAL(kind)
 #define DEFINE_TOKENKIND_COMPLEX(kind,rx)             \
-        m_current = matchRegex(TokenKind::kind, rx);  \
+        static const std::regex kind##Regex(rx);      \
+        m_current = matchRegex(TokenKind::kind,       \
+            kind##Regex);                             \
         if (m_current)                                \
           break;
 #include "TokenKind.h"
@@ -84,12 +85,12 @@ TokenIterator::current() const
 
 std::optional<TokenIterator::CurrentToken> 
 TokenIterator::matchRegex(TokenKind tokenKind,
-    const char * regex) const
+    const std::regex& regex) const
 {
   assert(base() != m_end);
   std::optional<TokenIterator::CurrentToken> token;  
   std::match_results<std::string_view::const_iterator> match; 
-  if (std::regex_search(base(), m_end, match,  std::regex(regex), 
+  if (std::regex_search(base(), m_end, match, regex, 
       std::regex_constants::match_continuous)) 
   { 
     SourcePosition after = m_pos;
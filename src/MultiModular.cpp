@@ -0,0 +1,595 @@
+#include "MultiModular.h"
+#include "Allocator.h"
+#include "Ast.h"
+#include "Exceptions.h"
+#include "Residue.h"
+#include "SymbolTable.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace kcalc
+{
+
+namespace
+{
+
+// primes below 2^62, each adds more than PrimeBits bits to the modulus
+constexpr unsigned int PrimeBits = 61;
+
+// the first count primes below 2^62, descending; found once and kept
+std::vector<unsigned long> primes(std::size_t count)
+{
+  static std::mutex mutex;
+  static std::vector<unsigned long> found;
+  std::lock_guard<std::mutex> lock(mutex);
+  mpz_class candidate = found.empty() ? (mpz_class(1) << 62) - 1 :
+    mpz_class(found.back() - 2);
+  while (found.size() < count)
+  {
+    if (mpz_probab_prime_p(candidate.get_mpz_t(), 25) != 0)
+      found.push_back(candidate.get_ui());
+    candidate -= 2;
+  }
+  return std::vector<unsigned long>(found.begin(), found.begin() + count);
+}
+
+// bits of |numerator| and denominator of a value (N + M i) / D, with
+// the N + M i taken as one complex numerator
+struct Height
+{
+  double numerator = 0;
+  double denominator = 0;
+  // the exact value is real, its quotients need no conjugate
+  bool real = true;
+};
+
+Height inverse(const Height& height)
+{
+  if (height.real)
+    return { height.denominator, height.numerator, true };
+  // D / N = D conj(N) / |N|^2
+  return { height.denominator + height.numerator, 2 * height.numerator,
+    false };
+}
+
+// The heights of an expression and its subexpressions, and the exact
+// exponents of its powers, which are not residues.
+class Bound
+{
+public:
+  explicit Bound(const SymbolTable& symbolTable)
+    : m_symbolTable{symbolTable}
+  { }
+
+  // nothing if the expression cannot be evaluated by residues
+  std::optional<Height> height(const Expression& expression);
+
+  const std::map<const Expression*, mpz_class>& exponents() const
+  { return m_exponents; }
+
+private:
+  std::optional<Height> arithmetic(const ArithmeticExpression& expression);
+  ComplexNumber exact(const Expression& expression);
+
+  const SymbolTable& m_symbolTable;
+  std::map<std::string, std::optional<Height>, std::less<>> m_variables;
+  std::map<std::string, ComplexNumber, std::less<>> m_exact;
+  std::map<const Expression*, mpz_class> m_exponents;
+};
+
+std::optional<Height> Bound::height(const Expression& expression)
+{
+  switch (expression.kind())
+  {
+    case ObjectKind::Number:
+    {
+      ComplexNumber number =
+        static_cast<const Number&>(expression).number();
+      number.normalize();
+      mpz_class denominator;
+      mpz_lcm(denominator.get_mpz_t(),
+          number.real().get_den_mpz_t(),
+          number.imaginary().get_den_mpz_t());
+      mpz_class real = abs(number.real().get_num()) *
+        (denominator / number.real().get_den());
+      mpz_class imag = abs(number.imaginary().get_num()) *
+        (denominator / number.imaginary().get_den());
+      // |N + M i| <= 2 max(|N|, |M|)
+      return Height{ double(mpz_sizeinbase(
+            std::max(real, imag).get_mpz_t(), 2)) + 1,
+        double(mpz_sizeinbase(denominator.get_mpz_t(), 2)),
+        number.imaginary() == 0 };
+    }
+    case ObjectKind::Variable:
+    {
+      auto& variable = static_cast<const Variable&>(expression);
+      auto known = m_variables.find(variable.name());
+      if (known != m_variables.end())
+        return known->second;
+      std::shared_ptr<const Expression> content =
+        m_symbolTable.lookup(std::string(variable.name()));
+      std::optional<Height> result;
+      if (content)
+        result = height(*content);
+      m_variables.emplace(variable.name(), result);
+      return result;
+    }
+    case ObjectKind::UnaryMinus:
+      return height(
+          static_cast<const UnaryMinusExpression&>(expression).inner());
+    case ObjectKind::ArithmeticExpression:
+      return arithmetic(
+          static_cast<const ArithmeticExpression&>(expression));
+    case ObjectKind::Assignment:
+      break;
+  }
+  return std::nullopt;
+}
+
+std::optional<Height> Bound::arithmetic(
+    const ArithmeticExpression& expression)
+{
+  if (expression.operation() == ArithmeticExpression::Modulo)
+    return std::nullopt;
+  std::optional<Height> a = height(expression.left());
+  if (!a)
+    return std::nullopt;
+  if (expression.operation() == ArithmeticExpression::Power)
+  {
+    // toLong() applies a pending scale; exponents beyond long are far
+    // beyond MaxBits anyway
+    std::optional<long> exponent = exact(expression.right()).toLong();
+    if (!exponent)
+      return std::nullopt;
+    mpz_class value(*exponent);
+    double times = std::fabs(value.get_d());
+    if (times * (a->numerator + a->denominator) > MultiModular::MaxBits)
+      return std::nullopt;
+    m_exponents.emplace(&expression, value);
+    Height base = value < 0 ? inverse(*a) : *a;
+    return Height{ base.numerator * times, base.denominator * times,
+      base.real };
+  }
+  std::optional<Height> b = height(expression.right());
+  if (!b)
+    return std::nullopt;
+  switch (expression.operation())
+  {
+    case ArithmeticExpression::Add:
+    case ArithmeticExpression::Subtract:
+      return Height{ std::max(a->numerator + b->denominator,
+          b->numerator + a->denominator) + 1,
+        a->denominator + b->denominator, a->real && b->real };
+    case ArithmeticExpression::Divide:
+      b = inverse(*b);
+      [[fallthrough]];
+    case ArithmeticExpression::Multiply:
+      return Height{ a->numerator + b->numerator,
+        a->denominator + b->denominator, a->real && b->real };
+    default:
+      break;
+  }
+  return std::nullopt;
+}
+
+// exponents may use remainders and exponents of their own
+ComplexNumber Bound::exact(const Expression& expression)
+{
+  switch (expression.kind())
+  {
+    case ObjectKind::Number:
+      return static_cast<const Number&>(expression).number();
+    case ObjectKind::Variable:
+    {
+      auto& variable = static_cast<const Variable&>(expression);
+      auto known = m_exact.find(variable.name());
+      if (known != m_exact.end())
+        return known->second;
+      std::shared_ptr<const Expression> content =
+        m_symbolTable.lookup(std::string(variable.name()));
+      if (!content)
+        throw UnboundVariableException(__FILE__, __LINE__,
+            variable.name());
+      ComplexNumber value = exact(*content);
+      m_exact.emplace(variable.name(), value);
+      return value;
+    }
+    case ObjectKind::UnaryMinus:
+      return exact(
+          static_cast<const UnaryMinusExpression&>(expression).inner())
+        .negate();
+    case ObjectKind::ArithmeticExpression:
+      break;
+    case ObjectKind::Assignment:
+      assert(false);
+  }
+  auto& arithmetic = static_cast<const ArithmeticExpression&>(expression);
+  ComplexNumber a = exact(arithmetic.left());
+  ComplexNumber b = exact(arithmetic.right());
+  switch (arithmetic.operation())
+  {
+    case ArithmeticExpression::Add:
+      return a + b;
+    case ArithmeticExpression::Subtract:
+      return a - b;
+    case ArithmeticExpression::Multiply:
+      return ComplexNumber(a * b);
+    case ArithmeticExpression::Divide:
+      return a / b;
+    case ArithmeticExpression::Modulo:
+      return a % b;
+    case ArithmeticExpression::Power:
+      return a ^ b;
+  }
+  assert(false);
+  return a;
+}
+
+// (real + imag i) / denominator modulo one prime; divisions multiply
+// denominators, so a prime needs a single inverse at the end
+struct Fraction
+{
+  Residue real;
+  Residue imag;
+  Residue denominator;
+};
+
+// One evaluation modulo a prime.
+class PrimeEvaluation
+{
+public:
+  PrimeEvaluation(const Modulus& modulus, const SymbolTable& symbolTable,
+      const std::map<const Expression*, mpz_class>& exponents)
+    : m_modulus{modulus}, m_symbolTable{symbolTable},
+      m_exponents{exponents}, m_zero(0, modulus), m_one(1, modulus)
+  { }
+
+  Fraction evaluate(const Expression& expression);
+
+private:
+  Fraction number(const ComplexNumber& number) const;
+  static Fraction multiply(const Fraction& a, const Fraction& b)
+  {
+    return { a.real * b.real - a.imag * b.imag,
+      a.real * b.imag + a.imag * b.real, a.denominator * b.denominator };
+  }
+  static Fraction inverse(const Fraction& value);
+  Fraction power(const Fraction& base, const mpz_class& exponent) const;
+
+  const Modulus& m_modulus;
+  const SymbolTable& m_symbolTable;
+  const std::map<const Expression*, mpz_class>& m_exponents;
+  Residue m_zero;
+  Residue m_one;
+  std::map<std::string, Fraction, std::less<>> m_variables;
+};
+
+Fraction PrimeEvaluation::evaluate(const Expression& expression)
+{
+  switch (expression.kind())
+  {
+    case ObjectKind::Number:
+      return number(static_cast<const Number&>(expression).number());
+    case ObjectKind::Variable:
+    {
+      auto& variable = static_cast<const Variable&>(expression);
+      auto known = m_variables.find(variable.name());
+      if (known != m_variables.end())
+        return known->second;
+      // the bound has found all variables
+      Fraction value = evaluate(
+          *m_symbolTable.lookup(std::string(variable.name())));
+      m_variables.emplace(variable.name(), value);
+      return value;
+    }
+    case ObjectKind::UnaryMinus:
+    {
+      Fraction value = evaluate(
+          static_cast<const UnaryMinusExpression&>(expression).inner());
+      return { -value.real, -value.imag, value.denominator };
+    }
+    case ObjectKind::ArithmeticExpression:
+      break;
+    case ObjectKind::Assignment:
+      assert(false);
+  }
+  auto& arithmetic = static_cast<const ArithmeticExpression&>(expression);
+  Fraction a = evaluate(arithmetic.left());
+  if (arithmetic.operation() == ArithmeticExpression::Power)
+    return power(a, m_exponents.at(&arithmetic));
+  Fraction b = evaluate(arithmetic.right());
+  switch (arithmetic.operation())
+  {
+    case ArithmeticExpression::Add:
+      return { a.real * b.denominator + b.real * a.denominator,
+        a.imag * b.denominator + b.imag * a.denominator,
+        a.denominator * b.denominator };
+    case ArithmeticExpression::Subtract:
+      return { a.real * b.denominator - b.real * a.denominator,
+        a.imag * b.denominator - b.imag * a.denominator,
+        a.denominator * b.denominator };
+    case ArithmeticExpression::Multiply:
+      return multiply(a, b);
+    case ArithmeticExpression::Divide:
+      return multiply(a, inverse(b));
+    default:
+      break;
+  }
+  assert(false);
+  return a;
+}
+
+Fraction PrimeEvaluation::number(const ComplexNumber& number) const
+{
+  if (!number.isScaled() && number.imaginary() == 0 &&
+      number.real().get_den() == 1)
+    return { Residue(number.real().get_num(), m_modulus), m_zero, m_one };
+  Residue real(number.realMantissa().get_num(), m_modulus);
+  Residue realDenominator(number.realMantissa().get_den(), m_modulus);
+  Residue imag(number.imaginaryMantissa().get_num(), m_modulus);
+  Residue imagDenominator(number.imaginaryMantissa().get_den(), m_modulus);
+  Fraction value{ real * imagDenominator, imag * realDenominator,
+    realDenominator * imagDenominator };
+  if (number.isScaled())
+  {
+    mpz_class power;
+    long scale = number.scale();
+    mpz_powm_ui(power.get_mpz_t(), mpz_class(10).get_mpz_t(),
+        scale < 0 ? 0ul - scale : scale, m_modulus.value().get_mpz_t());
+    Residue factor(power, m_modulus);
+    if (scale < 0)
+      value.denominator = value.denominator * factor;
+    else
+      value = { value.real * factor, value.imag * factor, 
+        value.denominator };
+  }
+  return value;
+}
+
+// d / (x + y i) = d (x - y i) / (x^2 + y^2)
+Fraction PrimeEvaluation::inverse(const Fraction& value)
+{
+  if (value.imag == 0)
+    return { value.denominator, value.imag, value.real };
+  return { value.denominator * value.real, -(value.denominator * value.imag),
+    value.real * value.real + value.imag * value.imag };
+}
+
+// left to right over the bits of the exponent
+Fraction PrimeEvaluation::power(const Fraction& base,
+    const mpz_class& exponent) const
+{
+  Fraction factor = exponent < 0 ? inverse(base) : base;
+  mpz_class bits = abs(exponent);
+  Fraction result{ m_one, m_zero, m_one };
+  for (std::size_t bit = mpz_sizeinbase(bits.get_mpz_t(), 2); bit-- > 0;)
+  {
+    StatementBudget::checkpoint();
+    result = multiply(result, result);
+    if (mpz_tstbit(bits.get_mpz_t(), bit))
+      result = multiply(result, factor);
+  }
+  return result;
+}
+
+// the residues of both parts modulo one prime
+struct PrimeResult
+{
+  unsigned long real;
+  unsigned long imag;
+};
+
+// throws a DivisionByZeroException if the denominator vanishes modulo
+// the prime, because the prime is unlucky or the exact value divides
+// by zero
+PrimeResult evaluateModulo(unsigned long prime, 
+    const Expression& expression, const SymbolTable& symbolTable,
+    const std::map<const Expression*, mpz_class>& exponents)
+{
+  Modulus modulus{mpz_class(prime)};
+  PrimeEvaluation evaluation(modulus, symbolTable, exponents);
+  Fraction value = evaluation.evaluate(expression);
+  Residue inverse = value.denominator.inverse();
+  return { (value.real * inverse).value().get_ui(),
+    (value.imag * inverse).value().get_ui() };
+}
+
+// value modulo the product of the primes, combined one at a time
+struct Combination
+{
+  mpz_class real;
+  mpz_class imag;
+  mpz_class modulus = 1;
+};
+
+void combine(Combination& combination, unsigned long prime,
+    const PrimeResult& result)
+{
+  // x + m ((r - x) m^-1 mod p) agrees with x modulo m and with r
+  // modulo p
+  mpz_class primeValue(prime);
+  mpz_class inverse(mpz_fdiv_ui(combination.modulus.get_mpz_t(), prime));
+  mpz_invert(inverse.get_mpz_t(), inverse.get_mpz_t(), 
+      primeValue.get_mpz_t());
+  for (auto [part, residue] : { std::make_pair(&combination.real,
+        result.real), std::make_pair(&combination.imag, result.imag) })
+  {
+    mpz_class factor = (mpz_class(residue) -
+      mpz_class(mpz_fdiv_ui(part->get_mpz_t(), prime))) * inverse;
+    mpz_fdiv_r(factor.get_mpz_t(), factor.get_mpz_t(),
+        primeValue.get_mpz_t());
+    *part += combination.modulus * factor;
+  }
+  combination.modulus *= prime;
+}
+
+// two combinations of coprime moduli into one
+Combination merge(const Combination& a, const Combination& b)
+{
+  if (b.modulus == 1)
+    return a;
+  if (a.modulus == 1)
+    return b;
+  mpz_class inverse;
+  mpz_invert(inverse.get_mpz_t(), a.modulus.get_mpz_t(),
+      b.modulus.get_mpz_t());
+  Combination result;
+  result.modulus = a.modulus * b.modulus;
+  auto part = [&](const mpz_class& x, const mpz_class& y) {
+    mpz_class factor = (y - x) * inverse;
+    mpz_fdiv_r(factor.get_mpz_t(), factor.get_mpz_t(),
+        b.modulus.get_mpz_t());
+    return mpz_class(x + a.modulus * factor); };
+  result.real = part(a.real, b.real);
+  result.imag = part(a.imag, b.imag);
+  return result;
+}
+
+// the residues modulo primes[first, last), one task per batch of
+// primes, each combining its own
+Combination evaluateBatches(const std::vector<unsigned long>& primes,
+    std::size_t first, std::size_t last, const Expression& expression,
+    const SymbolTable& symbolTable,
+    const std::map<const Expression*, mpz_class>& exponents)
+{
+  ThreadPool& pool = ThreadPool::instance();
+  std::size_t batches = std::min<std::size_t>(pool.concurrency(),
+      last - first);
+  std::vector<Combination> combinations(batches);
+  TaskGroup group(pool);
+  for (std::size_t batch = 0; batch < batches; ++batch)
+    group.run([&, batch]() {
+        for (std::size_t i = first + batch; i < last; i += batches)
+        {
+          StatementBudget::checkpoint();
+          combine(combinations[batch], primes[i], evaluateModulo(
+                primes[i], expression, symbolTable, exponents)); 
+        } });
+  group.wait();
+  Combination combination;
+  for (const Combination& batch : combinations)
+    combination = merge(combination, batch);
+  return combination;
+}
+
+// the fraction with a numerator of at most numeratorBits and a
+// denominator of at most denominatorBits that is value modulo modulus,
+// which is larger than twice their product
+std::optional<mpq_class> reconstruct(const mpz_class& value,
+    const mpz_class& modulus, unsigned long numeratorBits, 
+    unsigned long denominatorBits)
+{
+  mpz_class numeratorBound = mpz_class(1) << numeratorBits;
+  mpz_class denominatorBound = mpz_class(1) << denominatorBits;
+  mpz_class remainder = modulus, next = value;
+  mpz_class coefficient = 0, nextCoefficient = 1;
+  mpz_class quotient;
+  while (next > numeratorBound)
+  {
+    mpz_fdiv_q(quotient.get_mpz_t(), remainder.get_mpz_t(),
+        next.get_mpz_t());
+    remainder -= quotient * next;
+    std::swap(remainder, next);
+    coefficient -= quotient * nextCoefficient;
+    std::swap(coefficient, nextCoefficient);
+  }
+  if (nextCoefficient == 0 || abs(nextCoefficient) > denominatorBound ||
+      gcd(next, nextCoefficient) != 1)
+    return std::nullopt;
+  mpq_class fraction(next, nextCoefficient);
+  fraction.canonicalize();
+  return fraction;
+}
+
+// value modulo prime; nothing if its denominator vanishes
+std::optional<unsigned long> reduce(const mpq_class& value,
+    unsigned long prime)
+{
+  mpz_class primeValue(prime);
+  mpz_class inverse(mpz_fdiv_ui(value.get_den_mpz_t(), prime));
+  if (mpz_invert(inverse.get_mpz_t(), inverse.get_mpz_t(),
+        primeValue.get_mpz_t()) == 0)
+    return std::nullopt;
+  mpz_class result = value.get_num() * inverse;
+  return mpz_fdiv_ui(result.get_mpz_t(), prime);
+}
+
+} /* namespace */
+
+std::optional<ComplexNumber> MultiModular::evaluate(
+    const Expression& expression,
+    const SymbolTable& symbolTable)
+{
+  Bound bound(symbolTable);
+  std::optional<Height> height;
+  try
+  {
+    height = bound.height(expression);
+  }
+  catch (const Exception&)
+  {
+    return std::nullopt;
+  }
+  if (!height || height->numerator + height->denominator > MaxBits)
+    return std::nullopt;
+  // enough primes for a product above 2 N D, plus one to verify
+  auto numeratorBits = static_cast<unsigned long>(
+      std::ceil(height->numerator));
+  auto denominatorBits = static_cast<unsigned long>(
+      std::ceil(height->denominator));
+  std::size_t needed = (numeratorBits + denominatorBits + 2) / PrimeBits
+    + 1;
+  std::vector<unsigned long> moduli = primes(needed + 1);
+  try
+  {
+    PrimeResult check = evaluateModulo(moduli[needed], expression,
+        symbolTable, bound.exponents());
+    // bounds are rarely tight: the primes double until a balanced
+    // reconstruction agrees with the check, the bound is the last
+    // resort
+    Combination combination;
+    std::size_t count = 0;
+    std::size_t round = ThreadPool::instance().concurrency();
+    while (count < needed)
+    {
+      std::size_t last = std::min(needed, count + round);
+      combination = merge(combination, evaluateBatches(moduli, count,
+            last, expression, symbolTable, bound.exponents()));
+      count = last;
+      round *= 2;
+      unsigned long balanced = 
+        (mpz_sizeinbase(combination.modulus.get_mpz_t(), 2) - 2) / 2;
+      std::optional<mpq_class> real, imag;
+      if (count < needed)
+      {
+        real = reconstruct(combination.real, combination.modulus,
+            balanced, balanced);
+        imag = reconstruct(combination.imag, combination.modulus,
+            balanced, balanced);
+      }
+      else
+      {
+        real = reconstruct(combination.real, combination.modulus,
+            numeratorBits, denominatorBits);
+        imag = reconstruct(combination.imag, combination.modulus,
+            numeratorBits, denominatorBits);
+      }
+      if (real && imag && reduce(*real, moduli[needed]) == check.real &&
+          reduce(*imag, moduli[needed]) == check.imag)
+        return ComplexNumber(*real, *imag);
+    }
+  }
+  catch (const DivisionByZeroException&)
+  {
+  }
+  return std::nullopt;
+}
+
+} /* namespace kcalc */
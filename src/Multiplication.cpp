@@ -0,0 +1,135 @@
+#include "Multiplication.h"
+#include "Allocator.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace kcalc
+{
+
+namespace
+{
+
+// below this many limbs per operand mpz_mul beats the task overhead
+constexpr mp_size_t ParallelLimbs = 16384;
+
+std::atomic<bool> parallelEnabled{true};
+std::atomic<unsigned int> threadSetting{0};
+
+// x = high * B^split + low as read-only views into the limbs of |x|
+void splitLimbs(mpz_srcptr x, mp_size_t split, mpz_ptr low, mpz_ptr high)
+{
+  const mp_limb_t * limbs = mpz_limbs_read(x);
+  mp_size_t size = mpz_size(x);
+  mp_size_t lowSize = std::min(size, split);
+  mpz_roinit_n(low, limbs, lowSize);
+  mpz_roinit_n(high, limbs + lowSize, size - lowSize);
+}
+
+// result = a * b for non-negative a and b, result aliasing neither;
+// a == b squares
+void karatsuba(mpz_ptr result, mpz_srcptr a, mpz_srcptr b,
+    unsigned int tasks, ThreadPool& pool)
+{
+  StatementBudget::checkpoint();
+  mp_size_t sizeA = mpz_size(a);
+  mp_size_t sizeB = mpz_size(b);
+  if (tasks <= 1 || std::min(sizeA, sizeB) < ParallelLimbs)
+  {
+    mpz_mul(result, a, b);
+    return;
+  }
+  if (sizeA < sizeB)
+  {
+    std::swap(a, b);
+    std::swap(sizeA, sizeB);
+  }
+  mp_size_t half = (sizeA + 1) / 2;
+  mp_bitcnt_t shift = half * GMP_NUMB_BITS;
+  mpz_t a0, a1, b0, b1;
+  splitLimbs(a, half, a0, a1);
+  mpz_class z0, z1, z2;
+  if (sizeB <= half)
+  {
+    // b fits into one block: a * b == a1 b B + a0 b
+    unsigned int share = (tasks + 1) / 2;
+    TaskGroup group(pool);
+    group.run([&]() { karatsuba(z2.get_mpz_t(), a1, b, share, pool); });
+    karatsuba(z0.get_mpz_t(), a0, b, share, pool);
+    group.wait();
+    mpz_mul_2exp(result, z2.get_mpz_t(), shift);
+    mpz_add(result, result, z0.get_mpz_t());
+    return;
+  }
+  bool square = a == b;
+  splitLimbs(b, half, b0, b1);
+  mpz_class sumA, sumB;
+  mpz_add(sumA.get_mpz_t(), a0, a1);
+  if (!square)
+    mpz_add(sumB.get_mpz_t(), b0, b1);
+  unsigned int share = (tasks + 2) / 3;
+  TaskGroup group(pool);
+  group.run([&]() {
+      karatsuba(z0.get_mpz_t(), a0, square ? a0 : b0, share, pool); });
+  group.run([&]() {
+      karatsuba(z2.get_mpz_t(), a1, square ? a1 : b1, share, pool); });
+  karatsuba(z1.get_mpz_t(), sumA.get_mpz_t(),
+      square ? sumA.get_mpz_t() : sumB.get_mpz_t(), share, pool);
+  group.wait();
+  // a * b == z2 B^2 + (z1 - z0 - z2) B + z0
+  mpz_sub(z1.get_mpz_t(), z1.get_mpz_t(), z0.get_mpz_t());
+  mpz_sub(z1.get_mpz_t(), z1.get_mpz_t(), z2.get_mpz_t());
+  mpz_mul_2exp(result, z2.get_mpz_t(), 2 * shift);
+  mpz_mul_2exp(z1.get_mpz_t(), z1.get_mpz_t(), shift);
+  mpz_add(result, result, z1.get_mpz_t());
+  mpz_add(result, result, z0.get_mpz_t());
+}
+
+} /* anonymous namespace */
+
+void Multiplication::setParallel(bool parallel)
+{ parallelEnabled.store(parallel, std::memory_order_relaxed); }
+
+bool Multiplication::parallel()
+{ return parallelEnabled.load(std::memory_order_relaxed); }
+
+void Multiplication::setThreads(unsigned int threads)
+{ threadSetting.store(threads, std::memory_order_relaxed); }
+
+unsigned int Multiplication::threads()
+{
+  unsigned int threads = threadSetting.load(std::memory_order_relaxed);
+  return threads != 0 ? threads : ThreadPool::instance().concurrency();
+}
+
+bool Multiplication::worthParallel(mpz_srcptr a, mpz_srcptr b)
+{
+  return std::min(mpz_size(a), mpz_size(b)) >= std::size_t(ParallelLimbs) &&
+    parallel() && threads() > 1;
+}
+
+void Multiplication::multiply(mpz_ptr result, mpz_srcptr a, mpz_srcptr b)
+{
+  if (worthParallel(a, b))
+    multiply(result, a, b, ThreadPool::instance(), threads());
+  else
+    mpz_mul(result, a, b);
+}
+
+void Multiplication::multiply(mpz_ptr result, mpz_srcptr a, mpz_srcptr b,
+    ThreadPool& pool, unsigned int threads)
+{
+  int sign = mpz_sgn(a) * mpz_sgn(b);
+  mpz_t absA, absB;
+  mpz_roinit_n(absA, mpz_limbs_read(a), mpz_size(a));
+  mpz_roinit_n(absB, mpz_limbs_read(b), mpz_size(b));
+  mpz_class product;
+  karatsuba(product.get_mpz_t(), absA, a == b ? absA : absB,
+      threads, pool);
+  if (sign < 0)
+    mpz_neg(product.get_mpz_t(), product.get_mpz_t());
+  mpz_swap(result, product.get_mpz_t());
+}
+
+} /* namespace kcalc */
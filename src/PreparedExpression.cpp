@@ -0,0 +1,106 @@
+#include "PreparedExpression.h"
+#include "Allocator.h"
+#include "Ast.h"
+#include "Exceptions.h"
+#include "Parser.h"
+#include "SemanticAnalyzer.h"
+#include "SymbolTable.h"
+#include "SymbolUsage.h"
+
+namespace kcalc
+{
+
+struct PreparedExpression::Compiled
+{
+  std::unique_ptr<Expression> expression;
+  std::vector<std::string> variables;
+};
+
+PreparedExpression PreparedExpression::prepare(std::string_view text)
+{
+  Lexer lexer(text);
+  Parser parser(lexer);
+  std::unique_ptr<AstObject> statement = parser.parse();
+  if (!statement)
+    throw IllegalEndOfInput(__FILE__, __LINE__, std::nullopt, 
+        { TokenKind::LeftParen, TokenKind::Number, TokenKind::Identifier });
+  if (statement->kind() == ObjectKind::Assignment)
+    throw PreparedAssignmentException(__FILE__, __LINE__);
+  // constant subexpressions are folded here, once
+  SymbolTable empty;
+  SemanticAnalyzer analyzer(empty);
+  statement->accept(analyzer);
+  auto compiled = std::make_shared<Compiled>();
+  SymbolUsage usage(*statement);
+  compiled->variables.assign(usage.reads().begin(), usage.reads().end());
+  compiled->expression.reset(static_cast<Expression *>(statement.release()));
+  return PreparedExpression(std::move(compiled));
+}
+
+PreparedExpression::PreparedExpression(
+    std::shared_ptr<const Compiled> compiled)
+  : m_compiled{std::move(compiled)}, 
+    m_bindings{std::make_unique<SymbolTable>()}
+{ }
+
+PreparedExpression::PreparedExpression(const PreparedExpression& other)
+  : PreparedExpression(other.m_compiled)
+{
+  for (const std::string& name : m_compiled->variables)
+  {
+    std::unique_ptr<Expression> value = other.m_bindings->retrieve(name);
+    if (value)
+      m_bindings->insert(name, *value);
+  }
+}
+
+PreparedExpression::PreparedExpression(PreparedExpression&& other) noexcept
+  = default;
+
+PreparedExpression& PreparedExpression::operator=(
+    PreparedExpression other) noexcept
+{
+  std::swap(m_compiled, other.m_compiled);
+  std::swap(m_bindings, other.m_bindings);
+  return *this;
+}
+
+PreparedExpression::~PreparedExpression() = default;
+
+const std::vector<std::string>& PreparedExpression::variables() const
+{
+  return m_compiled->variables;
+}
+
+PreparedExpression& PreparedExpression::bind(const std::string& name, 
+    const ComplexNumber& value)
+{
+  m_bindings->insert(name, Number(value));
+  return *this;
+}
+
+ComplexNumber PreparedExpression::execute() const
+{
+  StatementArena arena;
+  std::unique_ptr<Expression> result = 
+    m_compiled->expression->eval(*m_bindings);
+  if (result->kind() != ObjectKind::Number)
+  {
+    for (const std::string& name : m_compiled->variables)
+      if (!m_bindings->lookup(name))
+        throw UnboundVariableException(__FILE__, __LINE__, name);
+    // a bound variable referring to one that is not; not possible
+    // with numeric bindings
+    throw UnboundVariableException(__FILE__, __LINE__, 
+        result->to_string());
+  }
+  ArenaSuspension persistent;
+  return static_cast<const Number&>(*result).number();
+}
+
+std::string PreparedExpression::to_string() const
+{
+  return m_compiled->expression->to_string();
+}
+
+} /* namespace kcalc */
@@ -0,0 +1,320 @@
+#include "RadixConversion.h"
+#include "Allocator.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+namespace kcalc
+{
+
+namespace
+{
+
+constexpr unsigned int MaxCachedPowers = 48;
+constexpr std::size_t DigitsPerChunk = 19;
+constexpr unsigned long TenToDigitsPerChunk = 10000000000000000000ul;
+constexpr std::size_t BaseCaseDigits = 2048;
+constexpr std::size_t OutputChunkDigits = 16384;
+constexpr std::size_t GuardDigits = 20;
+constexpr std::size_t ParallelDigits = 131072;
+
+class PowerCache
+{
+public:
+  const mpz_class& get(unsigned int k)
+  {
+    assert(k < MaxCachedPowers);
+    if (k >= m_size.load(std::memory_order_acquire))
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      unsigned int size = m_size.load(std::memory_order_relaxed);
+      ArenaSuspension persistent;
+      for (; size <= k; ++size)
+      {
+        auto power = std::make_unique<mpz_class>();
+        if (size == 0)
+          *power = 10;
+        else
+          mpz_mul(power->get_mpz_t(), m_powers[size - 1]->get_mpz_t(),
+              m_powers[size - 1]->get_mpz_t());
+        m_powers[size] = std::move(power);
+        m_size.store(size + 1, std::memory_order_release);
+      }
+    }
+    return *m_powers[k];
+  }
+
+private:
+  std::mutex m_mutex;
+  std::atomic<unsigned int> m_size{0};
+  std::array<std::unique_ptr<mpz_class>, MaxCachedPowers> m_powers;
+};
+
+PowerCache& powerCache()
+{
+  static PowerCache cache;
+  return cache;
+}
+
+void fromDigitsBaseCase(mpz_ptr result, const DigitSequence& digits,
+    std::size_t begin, std::size_t end)
+{
+  mpz_set_ui(result, 0);
+  std::size_t chunk = (end - begin) % DigitsPerChunk;
+  if (chunk == 0)
+    chunk = DigitsPerChunk;
+  for (std::size_t pos = begin; pos < end; )
+  {
+    unsigned long value = 0;
+    unsigned long scale = 1;
+    for (std::size_t i = 0; i < chunk; ++i, ++pos)
+    {
+      assert('0' <= digits[pos] && digits[pos] <= '9');
+      value = value * 10 + (digits[pos] - '0');
+      scale *= 10;
+    }
+    if (chunk == DigitsPerChunk)
+      mpz_mul_ui(result, result, TenToDigitsPerChunk);
+    else
+      mpz_mul_ui(result, result, scale);
+    mpz_add_ui(result, result, value);
+    chunk = DigitsPerChunk;
+  }
+}
+
+unsigned int splitExponent(std::size_t digits)
+{
+  unsigned int k = 0;
+  while ((std::size_t(2) << k) < digits)
+    ++k;
+  return k;
+}
+
+// fills [out, out + width) with the digits of value < 10^width
+void fillDigits(char * out, mpz_srcptr value, std::size_t width,
+    ThreadPool& pool)
+{
+  if (width <= OutputChunkDigits)
+  {
+    std::string buffer(mpz_sizeinbase(value, 10) + 2, '\0');
+    mpz_get_str(buffer.data(), 10, value);
+    std::size_t length = std::strlen(buffer.data());
+    assert(length <= width);
+    std::fill(out, out + width - length, '0');
+    std::copy(buffer.data(), buffer.data() + length, 
+        out + width - length);
+    return;
+  }
+  unsigned int k = splitExponent(width);
+  std::size_t lowWidth = std::size_t(1) << k;
+  mpz_class high, low;
+  mpz_tdiv_qr(high.get_mpz_t(), low.get_mpz_t(), value,
+      RadixConversion::tenToTwoPower(k).get_mpz_t());
+  if (width < ParallelDigits)
+  {
+    fillDigits(out, high.get_mpz_t(), width - lowWidth, pool);
+    fillDigits(out + width - lowWidth, low.get_mpz_t(), lowWidth, pool);
+    return;
+  }
+  TaskGroup group(pool);
+  group.run([&]() { 
+      fillDigits(out, high.get_mpz_t(), width - lowWidth, pool); });
+  fillDigits(out + width - lowWidth, low.get_mpz_t(), lowWidth, pool);
+  group.wait();
+}
+
+void writeDigitsRecursive(std::ostream& out, mpz_srcptr value,
+    std::size_t width, std::string& buffer)
+{
+  std::size_t estimate = mpz_sizeinbase(value, 10);
+  if (estimate <= OutputChunkDigits)
+  {
+    buffer.resize(estimate + 2);
+    mpz_get_str(buffer.data(), 10, value);
+    std::size_t length = std::strlen(buffer.data());
+    if (length < width)
+      RadixConversion::writeZeros(out, width - length);
+    out.write(buffer.data(), length);
+    return;
+  }
+  // value = high * 10^(2^k) + low, low printed with exactly 2^k 
+  // digits; the estimate may be one too large, keep 2^k below it
+  unsigned int k = splitExponent(estimate - 1);
+  std::size_t lowWidth = std::size_t(1) << k;
+  mpz_class high, low;
+  mpz_tdiv_qr(high.get_mpz_t(), low.get_mpz_t(), value,
+      RadixConversion::tenToTwoPower(k).get_mpz_t());
+  writeDigitsRecursive(out, high.get_mpz_t(), 
+      width > lowWidth ? width - lowWidth : 0, buffer);
+  high = 0;
+  writeDigitsRecursive(out, low.get_mpz_t(), lowWidth, buffer);
+}
+
+bool uniform(const std::string& digits, std::size_t from, char digit)
+{
+  return std::all_of(digits.begin() + from, digits.end(),
+      [digit](char c) { return c == digit; });
+}
+
+} /* anonymous namespace */
+
+const mpz_class& RadixConversion::tenToTwoPower(unsigned int k)
+{ return powerCache().get(k); }
+
+void RadixConversion::powerOfTen(mpz_ptr result, unsigned long exponent)
+{
+  if (exponent < DigitsPerChunk)
+  {
+    mpz_ui_pow_ui(result, 10, exponent);
+    return;
+  }
+  mpz_set_ui(result, 1);
+  for (unsigned int k = 0; exponent != 0; ++k, exponent >>= 1)
+  {
+    if (exponent & 1)
+      mpz_mul(result, result, tenToTwoPower(k).get_mpz_t());
+  }
+}
+
+void RadixConversion::fromDigits(mpz_ptr result, const DigitSequence& digits,
+    std::size_t begin, std::size_t end)
+{
+  assert(begin <= end && end <= digits.size());
+  std::size_t length = end - begin;
+  if (length <= BaseCaseDigits)
+  {
+    fromDigitsBaseCase(result, digits, begin, end);
+    return;
+  }
+  // split off the lowest 2^k digits: value = high * 10^(2^k) + low
+  unsigned int k = splitExponent(length);
+  std::size_t split = end - (std::size_t(1) << k);
+  mpz_class low;
+  fromDigits(result, digits, begin, split);
+  fromDigits(low.get_mpz_t(), digits, split, end);
+  mpz_mul(result, result, tenToTwoPower(k).get_mpz_t());
+  mpz_add(result, result, low.get_mpz_t());
+}
+
+void RadixConversion::writeDigits(std::ostream& out, mpz_srcptr value,
+    std::size_t width)
+{
+  assert(mpz_sgn(value) >= 0);
+  ThreadPool& pool = ThreadPool::instance();
+  if (pool.workers() != 0 && mpz_sizeinbase(value, 10) > ParallelDigits)
+  {
+    std::string digits = toString(value, pool);
+    if (digits.size() < width)
+      writeZeros(out, width - digits.size());
+    out << digits;
+    return;
+  }
+  std::string buffer;
+  writeDigitsRecursive(out, value, width, buffer);
+}
+
+std::string RadixConversion::toString(mpz_srcptr value, 
+    ThreadPool& pool)
+{
+  assert(mpz_sgn(value) >= 0);
+  // with the exact length both halves can be written in place
+  std::size_t width = digitCount(value);
+  std::string digits(width, '0');
+  fillDigits(digits.data(), value, width, pool);
+  return digits;
+}
+
+void RadixConversion::writeZeros(std::ostream& out, std::size_t count)
+{
+  static const char zeros[] = "0000000000000000000000000000000000000000"
+    "000000000000000000000000";
+  constexpr std::size_t chunk = sizeof(zeros) - 1;
+  for (; count > chunk; count -= chunk)
+    out.write(zeros, chunk);
+  out.write(zeros, count);
+}
+
+std::size_t RadixConversion::digitCount(mpz_srcptr value)
+{
+  assert(mpz_sgn(value) >= 0);
+  // exact or one too large
+  std::size_t estimate = mpz_sizeinbase(value, 10);
+  if (estimate > GuardDigits * 4)
+  {
+    long exponent;
+    std::string digits = significantDigits(value, nullptr, 
+        GuardDigits, exponent);
+    if (!uniform(digits, 0, '9') && !uniform(digits, 1, '0'))
+      return exponent;
+  }
+  mpz_class power;
+  powerOfTen(power.get_mpz_t(), estimate - 1);
+  return mpz_cmp(value, power.get_mpz_t()) < 0 ? 
+    estimate - 1 : estimate;
+}
+
+std::string RadixConversion::leadingDigits(mpz_srcptr value,
+    std::size_t count)
+{
+  assert(mpz_sgn(value) >= 0);
+  if (mpz_sizeinbase(value, 10) <= count + GuardDigits)
+    return mpz_class(value).get_str().substr(0, count);
+  long exponent;
+  std::string digits = significantDigits(value, nullptr, 
+      count + GuardDigits, exponent);
+  if (uniform(digits, count, '9') || uniform(digits, count, '0'))
+  {
+    // the rounded guard digits cannot tell, divide exactly
+    mpz_class power, quotient;
+    powerOfTen(power.get_mpz_t(), digitCount(value) - count);
+    mpz_tdiv_q(quotient.get_mpz_t(), value, power.get_mpz_t());
+    return quotient.get_str();
+  }
+  digits.resize(count);
+  return digits;
+}
+
+std::string RadixConversion::trailingDigits(mpz_srcptr value,
+    std::size_t count)
+{
+  assert(mpz_sgn(value) >= 0);
+  mpz_class power, remainder;
+  powerOfTen(power.get_mpz_t(), count);
+  mpz_tdiv_r(remainder.get_mpz_t(), value, power.get_mpz_t());
+  std::string digits = remainder.get_str();
+  if (digits.size() < count)
+    digits.insert(0, count - digits.size(), '0');
+  return digits;
+}
+
+std::string RadixConversion::significantDigits(mpz_srcptr numerator,
+    mpz_srcptr denominator, std::size_t count, long& exponent)
+{
+  assert(mpz_sgn(numerator) != 0 && count > 0);
+  // mpf_set_z only reads as many limbs as the precision needs
+  mp_bitcnt_t precision = 4 * count + 64;
+  mpf_class value(0.0, precision);
+  mpf_set_z(value.get_mpf_t(), numerator);
+  mpf_abs(value.get_mpf_t(), value.get_mpf_t());
+  if (denominator != nullptr && mpz_cmp_ui(denominator, 1) != 0)
+  {
+    mpf_class divisor(0.0, precision);
+    mpf_set_z(divisor.get_mpf_t(), denominator);
+    mpf_div(value.get_mpf_t(), value.get_mpf_t(), divisor.get_mpf_t());
+  }
+  std::string digits(count + 2, '\0');
+  mp_exp_t exp;
+  mpf_get_str(digits.data(), &exp, 10, count, value.get_mpf_t());
+  digits.resize(std::strlen(digits.data()));
+  digits.resize(count, '0');
+  exponent = exp;
+  return digits;
+}
+
+} /* namespace kcalc */
@@ -3,11 +3,41 @@
 #include <readline/readline.h>
 #include <readline/history.h> 
 
+#include <cstdio>
+#include <cstdlib>
 #include <sstream>
 
 namespace kcalc
 {
 
+namespace
+{
+
+const std::function<std::string ()> * idleCallBack;
+
+int idleHook()
+{
+  std::string output = (*idleCallBack)();
+  if (output.empty())
+    return 0;
+  // the line being edited moves below the output
+  int point = rl_point;
+  char * line = rl_copy_text(0, rl_end);
+  rl_save_prompt();
+  rl_replace_line("", 0);
+  rl_redisplay();
+  std::fputs(output.c_str(), stdout);
+  std::fflush(stdout);
+  rl_restore_prompt();
+  rl_replace_line(line, 0);
+  rl_point = point;
+  rl_redisplay();
+  std::free(line);
+  return 0;
+}
+
+} /* anonymous namespace */
+
 const std::string& Prompt::get()
 {
   std::stringstream stream; 
@@ -18,8 +48,14 @@ const std::string& Prompt::get()
 }  
 
 void Repl::run(const std::function<
-    void (Prompt&, const char *)>& callBack)
+    void (Prompt&, const char *)>& callBack,
+    const std::function<std::string ()>& idle)
 {
+  if (idle)
+  {
+    idleCallBack = &idle;
+    rl_event_hook = &idleHook;
+  }
   char * input;
   while ((input = readline(
           m_prompt.get().c_str()))
@@ -30,6 +66,7 @@ void Repl::run(const std::function<
     }
     free(input); 
   }
+  rl_event_hook = nullptr;
 }
 
 } /* namespace kcalc */
@@ -0,0 +1,198 @@
+#include "Residue.h"
+#include "Exceptions.h"
+
+#include <utility>
+
+namespace kcalc
+{
+
+Modulus::Modulus(const mpz_class& modulus)
+  : m_value{modulus}, 
+    m_isWord{mpz_odd_p(modulus.get_mpz_t()) && 
+      mpz_sizeinbase(modulus.get_mpz_t(), 2) <= 63}
+{
+  if (!m_isWord)
+    return;
+  m_word = modulus.get_ui();
+  // Newton's iteration doubles the correct low bits, an odd number is
+  // its own inverse modulo 8
+  unsigned long inverse = m_word;
+  for (int i = 0; i < 5; ++i)
+    inverse *= 2 - m_word * inverse;
+  m_negativeInverse = -inverse;
+  mpz_class rSquared;
+  mpz_ui_pow_ui(rSquared.get_mpz_t(), 2, 128);
+  m_rSquared = mpz_fdiv_ui(rSquared.get_mpz_t(), m_word);
+}
+
+unsigned long Modulus::reduce(unsigned __int128 product) const
+{
+  // the sum is below 2 * modulus * R < 2^128 for moduli below 2^63
+  unsigned long factor = static_cast<unsigned long>(product) * 
+    m_negativeInverse;
+  unsigned long result = static_cast<unsigned long>(
+      (product + static_cast<unsigned __int128>(factor) * m_word) >> 64);
+  return result >= m_word ? result - m_word : result;
+}
+
+unsigned long Modulus::toMontgomery(unsigned long value) const
+{ return reduce(static_cast<unsigned __int128>(value) * m_rSquared); }
+
+Residue::Residue(long value, const Modulus& modulus)
+  : m_modulus{&modulus}
+{
+  if (!modulus.m_isWord)
+  {
+    m_large = mpz_class(value);
+    mpz_fdiv_r(m_large->get_mpz_t(), m_large->get_mpz_t(), 
+        modulus.m_value.get_mpz_t());
+    return;
+  }
+  long remainder = value % static_cast<long>(modulus.m_word);
+  if (remainder < 0)
+    remainder += modulus.m_word;
+  m_word = modulus.toMontgomery(remainder);
+}
+
+Residue::Residue(const mpz_class& value, const Modulus& modulus)
+  : m_modulus{&modulus}
+{
+  if (modulus.m_isWord)
+    m_word = modulus.toMontgomery(
+        mpz_fdiv_ui(value.get_mpz_t(), modulus.m_word));
+  else
+    mpz_fdiv_r(m_large.emplace().get_mpz_t(), value.get_mpz_t(), 
+        modulus.m_value.get_mpz_t());
+}
+
+Residue::Residue(const mpq_class& value, long exponent, 
+    const Modulus& modulus)
+  : m_modulus{&modulus}
+{
+  if (exponent < 0)
+  {
+    // reduced first, 0.5 is 1/2 also modulo 5
+    mpz_class power;
+    mpz_ui_pow_ui(power.get_mpz_t(), 10, 0ul - exponent);
+    *this = Residue(mpq_class(value / power), 0, modulus);
+    return;
+  }
+  Residue numerator(value.get_num(), modulus);
+  if (exponent > 0)
+  {
+    mpz_class power;
+    mpz_powm_ui(power.get_mpz_t(), mpz_class(10).get_mpz_t(), exponent,
+        modulus.m_value.get_mpz_t());
+    numerator = numerator * Residue(power, modulus);
+  }
+  *this = numerator / Residue(value.get_den(), modulus);
+}
+
+Residue Residue::word(unsigned long montgomery, const Modulus& modulus)
+{ return Residue(modulus, montgomery); }
+
+Residue Residue::large(mpz_class value, const Modulus& modulus)
+{
+  Residue result(modulus, 0);
+  result.m_large = std::move(value);
+  return result;
+}
+
+Residue Residue::operator-() const
+{
+  if (m_modulus->m_isWord)
+    return word(m_word == 0 ? 0 : m_modulus->m_word - m_word, *m_modulus);
+  if (*m_large == 0)
+    return *this;
+  return large(m_modulus->m_value - *m_large, *m_modulus);
+}
+
+Residue Residue::operator+(const Residue& other) const
+{
+  if (m_modulus->m_isWord)
+  {
+    // no overflow below 2^63
+    unsigned long sum = m_word + other.m_word;
+    return word(sum >= m_modulus->m_word ? sum - m_modulus->m_word : sum,
+        *m_modulus);
+  }
+  mpz_class sum = *m_large + *other.m_large;
+  if (sum >= m_modulus->m_value)
+    sum -= m_modulus->m_value;
+  return large(std::move(sum), *m_modulus);
+}
+
+Residue Residue::operator-(const Residue& other) const
+{
+  if (m_modulus->m_isWord)
+    return word(m_word >= other.m_word ? m_word - other.m_word :
+        m_word + (m_modulus->m_word - other.m_word), *m_modulus);
+  mpz_class difference = *m_large - *other.m_large;
+  if (difference < 0)
+    difference += m_modulus->m_value;
+  return large(std::move(difference), *m_modulus);
+}
+
+Residue Residue::operator*(const Residue& other) const
+{
+  if (m_modulus->m_isWord)
+    return word(m_modulus->reduce(
+          static_cast<unsigned __int128>(m_word) * other.m_word), 
+        *m_modulus);
+  mpz_class product = *m_large * *other.m_large;
+  mpz_fdiv_r(product.get_mpz_t(), product.get_mpz_t(), 
+      m_modulus->m_value.get_mpz_t());
+  return large(std::move(product), *m_modulus);
+}
+
+Residue Residue::operator/(const Residue& other) const
+{ return *this * other.inverse(); }
+
+Residue Residue::inverse() const
+{
+  if (!m_modulus->m_isWord)
+  {
+    mpz_class inverse;
+    if (mpz_invert(inverse.get_mpz_t(), m_large->get_mpz_t(), 
+          m_modulus->m_value.get_mpz_t()) == 0)
+      throw DivisionByZeroException(__FILE__, __LINE__);
+    return large(std::move(inverse), *m_modulus);
+  }
+  // extended Euclid on the plain value, the coefficients stay below
+  // the modulus
+  unsigned long remainder = m_modulus->m_word;
+  unsigned long next = m_modulus->reduce(m_word);
+  long coefficient = 0, nextCoefficient = 1;
+  while (next != 0)
+  {
+    unsigned long quotient = remainder / next;
+    long previous = coefficient;
+    coefficient = nextCoefficient;
+    nextCoefficient = previous - static_cast<long>(quotient) * 
+      nextCoefficient;
+    unsigned long rest = remainder - quotient * next;
+    remainder = next;
+    next = rest;
+  }
+  if (remainder != 1)
+    throw DivisionByZeroException(__FILE__, __LINE__);
+  if (coefficient < 0)
+    coefficient += m_modulus->m_word;
+  return word(m_modulus->toMontgomery(coefficient), *m_modulus);
+}
+
+bool Residue::operator==(long value) const
+{
+  Residue other(value, *m_modulus);
+  return m_modulus->m_isWord ? m_word == other.m_word : 
+    *m_large == *other.m_large;
+}
+
+mpz_class Residue::value() const
+{
+  if (m_modulus->m_isWord)
+    return mpz_class(m_modulus->reduce(m_word));
+  return *m_large;
+}
+
+} /* namespace kcalc */
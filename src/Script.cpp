@@ -0,0 +1,373 @@
+#include "Script.h"
+#include "Allocator.h"
+#include "Ast.h"
+#include "Exceptions.h"
+#include "Parser.h"
+#include "SymbolUsage.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace kcalc
+{
+
+namespace
+{
+
+constexpr std::size_t BlockSize = 1 << 20;
+
+bool writeAll(int fd, const char * data, std::size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t written = ::write(fd, data, size);
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+// false only if line certainly has no identifiers, which saves 
+// parsing it on the reading thread: letters are allowed as exponent 
+// marks after digits and as the imaginary unit
+bool mayUseSymbols(std::string_view line)
+{
+  auto identifier = [](char c) { 
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+  for (std::size_t i = 0; i < line.size(); ++i)
+  {
+    char c = line[i];
+    if (!identifier(c) || std::isdigit(static_cast<unsigned char>(c)))
+      continue;
+    bool afterDigit = i > 0 && 
+      std::isdigit(static_cast<unsigned char>(line[i - 1]));
+    if ((c == 'e' || c == 'E') && afterDigit)
+      continue;
+    if (c == 'i' && (i + 1 == line.size() || !identifier(line[i + 1])))
+      continue;
+    return true;
+  }
+  return false;
+}
+
+} /* anonymous namespace */
+
+LineReader::LineReader(int fd)
+  : m_fd{fd}, m_buffer(BlockSize), m_begin{0}, m_end{0},
+    m_eof{false}, m_line{0}
+{ }
+
+LineReader::LineReader(std::string_view text)
+  : m_fd{-1}, m_buffer(text.begin(), text.end()), m_begin{0},
+    m_end{text.size()}, m_eof{true}, m_line{0}
+{ }
+
+bool LineReader::next(std::string_view& line)
+{
+  std::size_t scanned = m_begin;
+  for (;;)
+  {
+    const char * begin = m_buffer.data() + m_begin;
+    const void * newline = std::memchr(m_buffer.data() + scanned, '\n',
+        m_end - scanned);
+    std::size_t length;
+    if (newline != nullptr)
+    {
+      length = static_cast<const char *>(newline) - begin;
+      m_begin += length + 1;
+    }
+    else if (m_eof)
+    {
+      if (m_begin == m_end)
+        return false;
+      length = m_end - m_begin;
+      m_begin = m_end;
+    }
+    else
+    {
+      scanned = m_end - m_begin;
+      fill();
+      scanned += m_begin;
+      continue;
+    }
+    if (length > 0 && begin[length - 1] == '\r')
+      --length;
+    line = std::string_view(begin, length);
+    ++m_line;
+    return true;
+  }
+}
+
+// moves the unread rest to the front and appends the next block
+void LineReader::fill()
+{
+  std::size_t rest = m_end - m_begin;
+  std::memmove(m_buffer.data(), m_buffer.data() + m_begin, rest);
+  m_begin = 0;
+  m_end = rest;
+  if (m_end == m_buffer.size())
+    m_buffer.resize(2 * m_buffer.size());
+  ssize_t count;
+  do
+    count = ::read(m_fd, m_buffer.data() + m_end, m_buffer.size() - m_end);
+  while (count < 0 && errno == EINTR);
+  if (count < 0)
+    throw std::system_error(errno, std::generic_category(), "read");
+  if (count == 0)
+    m_eof = true;
+  m_end += count;
+}
+
+OutputBuffer::OutputBuffer(int fd)
+  : m_fd{fd}, m_buffer(BlockSize)
+{
+  setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+}
+
+OutputBuffer::~OutputBuffer()
+{
+  flush();
+}
+
+OutputBuffer::int_type OutputBuffer::overflow(int_type c)
+{
+  if (!flush())
+    return traits_type::eof();
+  if (!traits_type::eq_int_type(c, traits_type::eof()))
+  {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+// blocks at least as large as the buffer bypass it
+std::streamsize OutputBuffer::xsputn(const char * data, std::streamsize size)
+{
+  if (static_cast<std::size_t>(size) < m_buffer.size())
+    return std::streambuf::xsputn(data, size);
+  if (!flush() || !writeAll(m_fd, data, size))
+    return 0;
+  return size;
+}
+
+int OutputBuffer::sync()
+{
+  return flush() ? 0 : -1;
+}
+
+bool OutputBuffer::flush()
+{
+  bool written = writeAll(m_fd, pbase(), pptr() - pbase());
+  setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+  return written;
+}
+
+MappedFile::MappedFile(const std::string& path)
+  : m_map{nullptr}, m_size{0}
+{
+  int fd = path == "-" ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::system_error(errno, std::generic_category(), path);
+  struct stat status;
+  if (::fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && 
+      status.st_size > 0)
+  {
+    void * map = ::mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE,
+        fd, 0);
+    if (map != MAP_FAILED)
+    {
+      ::madvise(map, status.st_size, MADV_SEQUENTIAL);
+      m_map = map;
+      m_size = status.st_size;
+    }
+  }
+  while (m_map == nullptr)
+  {
+    std::size_t size = m_buffer.size();
+    m_buffer.resize(std::max(2 * size, BlockSize));
+    ssize_t count = ::read(fd, m_buffer.data() + size, 
+        m_buffer.size() - size);
+    if (count < 0 && errno == EINTR)
+    {
+      m_buffer.resize(size);
+      continue;
+    }
+    if (count < 0)
+    {
+      int error = errno;
+      if (fd != STDIN_FILENO)
+        ::close(fd);
+      throw std::system_error(error, std::generic_category(), path);
+    }
+    m_buffer.resize(size + count);
+    if (count == 0)
+      break;
+  }
+  if (fd != STDIN_FILENO)
+    ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+  if (m_map != nullptr)
+    ::munmap(m_map, m_size);
+}
+
+bool isStatement(std::string_view line)
+{
+  std::size_t start = line.find_first_not_of(" \t");
+  return start != std::string_view::npos && line[start] != '#';
+}
+
+BatchLine::BatchLine() = default;
+
+BatchLine::~BatchLine() = default;
+
+ParallelScript::ParallelScript(ThreadPool& pool, Evaluate evaluate)
+  : m_pool{pool}, m_evaluate{std::move(evaluate)}, m_group{pool}
+{ }
+
+bool ParallelScript::run(LineReader& reader, const Deliver& deliver)
+{
+  std::deque<LinePtr> window;
+  BatchDependencies dependencies;
+  bool success = true;
+  bool end = false;
+  // a command at the back of the window
+  bool barrier = false;
+  for (;;)
+  {
+    std::string_view text;
+    while (!end && !barrier &&
+        window.size() < WindowLinesPerThread * m_pool.concurrency())
+    {
+      if (!reader.next(text))
+      {
+        end = true;
+        break;
+      }
+      if (!isStatement(text))
+        continue;
+      auto line = std::make_shared<BatchLine>();
+      line->text = text;
+      line->number = reader.lineNumber();
+      window.push_back(line);
+      if (text[text.find_first_not_of(" \t")] == ':')
+      {
+        line->command = true;
+        line->done = true;
+        barrier = true;
+        continue;
+      }
+      std::vector<LinePtr> predecessors;
+      if (mayUseSymbols(text))
+      {
+        try
+        {
+          StatementArena arena;
+          Lexer lexer(line->text);
+          Parser parser(lexer);
+          std::unique_ptr<AstObject> statement = parser.parse();
+          if (statement)
+          {
+            // lines not in the window any more have finished
+            for (unsigned int number : dependencies.add(line->number,
+                  SymbolUsage(*statement)))
+            {
+              auto predecessor = std::lower_bound(window.begin(), 
+                  window.end(), number, 
+                  [](const LinePtr& waiting, unsigned int number) {
+                    return waiting->number < number; });
+              if (predecessor != window.end() && 
+                  (*predecessor)->number == number)
+                predecessors.push_back(*predecessor);
+            }
+          }
+        }
+        catch(const Exception&)
+        {
+          // reported when the line runs
+        }
+      }
+      schedule(line, predecessors);
+    }
+    if (window.empty())
+      break;
+    BatchLine& front = *window.front();
+    wait(front);
+    if (front.command)
+      barrier = false;
+    success = deliver(front) && success;
+    dependencies.finishedBefore(front.number + 1);
+    window.pop_front();
+  }
+  return success;
+}
+
+void ParallelScript::schedule(
+    const LinePtr& line,
+    const std::vector<LinePtr>& predecessors)
+{
+  for (const LinePtr& predecessor : predecessors)
+  {
+    std::lock_guard<std::mutex> lock(predecessor->mutex);
+    if (!predecessor->done.load(std::memory_order_relaxed))
+    {
+      predecessor->successors.push_back(line);
+      line->predecessors.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  release(line);
+}
+
+void ParallelScript::release(const LinePtr& line)
+{
+  if (line->predecessors.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    m_group.run([this, line]() { execute(line); });
+}
+
+void ParallelScript::execute(const LinePtr& line)
+{
+  m_evaluate(*line);
+  std::vector<LinePtr> successors;
+  {
+    std::lock_guard<std::mutex> lock(line->mutex);
+    line->done.store(true, std::memory_order_release);
+    successors.swap(line->successors);
+  }
+  for (const LinePtr& successor : successors)
+    release(successor);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_finished.notify_all();
+}
+
+void ParallelScript::wait(BatchLine& line)
+{
+  while (!line.done.load(std::memory_order_acquire))
+  {
+    if (m_pool.runPending())
+      continue;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_finished.wait_for(lock, std::chrono::microseconds(200), 
+        [&line]() { return line.done.load(); });
+  }
+}
+
+} /* namespace kcalc */
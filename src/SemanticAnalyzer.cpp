@@ -2,6 +2,7 @@
 #include "Ast.h"
 #include "SymbolTable.h" 
 
+#include <array>
 #include <numeric>
 
 namespace kcalc
@@ -163,7 +164,10 @@ void SemanticAnalyzer::balanceVariablesPlusMinus(
                 (op2.m_expr == nullptr || op2.m_expr->kind() == ObjectKind::Number)) ||
                 (op1.m_expr == nullptr && op2.m_expr != nullptr));
       });
-      expression.replaceLeft(createArithmeticExpression(exprs[0], exprs[1]));
+      // the operands may point into either old side, so both new 
+      // sides are built before replacing one
+      std::unique_ptr<Expression> newLeft 
+        = createArithmeticExpression(exprs[0], exprs[1]);
       if (exprs[2].m_sign == ArithmeticExpression::Subtract &&
           exprs[3].m_sign == ArithmeticExpression::Subtract) 
       {
@@ -175,6 +179,7 @@ void SemanticAnalyzer::balanceVariablesPlusMinus(
         expression.operation(ArithmeticExpression::Add);
       std::unique_ptr<Expression> newRight 
         = createArithmeticExpression(exprs[2], exprs[3])->eval(m_symbolTable); 
+      expression.replaceLeft(std::move(newLeft));
       expression.replaceRight(std::move(newRight));
     }
   }
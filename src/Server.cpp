@@ -0,0 +1,483 @@
+#include "Server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <sstream>
+#include <system_error>
+#include <thread>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace kcalc
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+// a longer request closes the connection
+constexpr std::size_t MaxRequestBytes = 1 << 20;
+// per connection: requests received but not handled and responses
+// not yet sent, above these the connection is not read from
+constexpr std::size_t MaxQueuedRequests = 1024;
+constexpr std::size_t MaxPendingOutput = 4 << 20;
+constexpr std::size_t ReceiveBlock = 64 << 10;
+constexpr int MaxEvents = 64;
+
+std::atomic<int> signalWake{-1};
+volatile std::sig_atomic_t signalStop = 0;
+
+void wake(int fd)
+{
+  std::uint64_t one = 1;
+  ssize_t written = ::write(fd, &one, sizeof(one));
+  (void)written;
+}
+
+extern "C" void onStopSignal(int)
+{
+  signalStop = 1;
+  int fd = signalWake.load();
+  if (fd >= 0)
+    wake(fd);
+}
+
+[[noreturn]] void throwError(const char * what)
+{
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+std::string flatten(std::string text)
+{
+  while (!text.empty() && (text.back() == '\n' || text.back() == ' '))
+    text.pop_back();
+  std::replace(text.begin(), text.end(), '\n', ' ');
+  std::replace(text.begin(), text.end(), '\r', ' ');
+  return text;
+}
+
+struct Request
+{
+  std::string text;
+  Clock::time_point received;
+  bool tooLong = false;
+};
+
+} /* anonymous namespace */
+
+void LatencyHistogram::record(double microseconds)
+{
+  ++m_count;
+  m_sum += microseconds;
+  m_max = std::max(m_max, microseconds);
+  // bucket k covers [2^(k/4), 2^((k+1)/4)) microseconds
+  double position = microseconds > 1 ?
+    std::log2(microseconds) * SubBuckets : 0;
+  std::size_t bucket = std::min<std::size_t>(
+      static_cast<std::size_t>(position), m_buckets.size() - 1);
+  ++m_buckets[bucket];
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+  for (std::size_t i = 0; i < m_buckets.size(); ++i)
+    m_buckets[i] += other.m_buckets[i];
+  m_count += other.m_count;
+  m_sum += other.m_sum;
+  m_max = std::max(m_max, other.m_max);
+}
+
+double LatencyHistogram::percentile(double fraction) const
+{
+  double target = fraction * m_count;
+  unsigned long seen = 0;
+  for (std::size_t i = 0; i < m_buckets.size(); ++i)
+  {
+    seen += m_buckets[i];
+    if (seen > 0 && seen >= target)
+      return std::min(m_max, std::exp2(double(i + 1) / SubBuckets));
+  }
+  return m_max;
+}
+
+struct Server::Connection
+{
+  explicit Connection(int descriptor)
+    : fd{descriptor}
+  { }
+
+  ~Connection()
+  { ::close(fd); }
+
+  int fd;
+  std::unique_ptr<Session> session;
+  std::string input;
+  std::deque<Request> requests;
+  std::string output;
+  std::size_t written = 0;
+  std::uint32_t events = 0;
+  // a request of this connection is being handled by a task
+  bool busy = false;
+  // the peer finished sending, pending requests are still answered
+  bool finished = false;
+  // nothing more can be sent
+  bool broken = false;
+
+  // handed from the task to the loop
+  std::string response;
+  Clock::time_point received;
+};
+
+Server::Server(const std::string& path, SessionFactory factory,
+    ThreadPool& pool)
+  : m_path{path}, m_factory{std::move(factory)}, m_pool{pool},
+    m_listener{-1}, m_epoll{-1}, m_wake{-1}, m_running{0},
+    m_stopping{false}, m_stop{false}
+{
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+  {
+    errno = ENAMETOOLONG;
+    throwError(path.c_str());
+  }
+  std::strcpy(address.sun_path, path.c_str());
+  struct stat status;
+  if (::stat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+    ::unlink(path.c_str());
+  try
+  {
+    m_listener = ::socket(AF_UNIX,
+        SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listener < 0)
+      throwError("socket");
+    if (::bind(m_listener, reinterpret_cast<sockaddr *>(&address),
+          sizeof(address)) < 0)
+      throwError(path.c_str());
+    if (::listen(m_listener, SOMAXCONN) < 0)
+      throwError("listen");
+    m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll < 0)
+      throwError("epoll_create1");
+    m_wake = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wake < 0)
+      throwError("eventfd");
+    for (int fd : { m_listener, m_wake })
+    {
+      epoll_event event{};
+      event.events = EPOLLIN;
+      event.data.fd = fd;
+      if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) < 0)
+        throwError("epoll_ctl");
+    }
+  }
+  catch (...)
+  {
+    for (int fd : { m_listener, m_epoll, m_wake })
+      if (fd >= 0)
+        ::close(fd);
+    throw;
+  }
+}
+
+Server::~Server()
+{
+  m_connections.clear();
+  ::close(m_listener);
+  ::close(m_epoll);
+  ::close(m_wake);
+  ::unlink(m_path.c_str());
+}
+
+void Server::stop()
+{
+  m_stop = true;
+  wake(m_wake);
+}
+
+std::string Server::statistics() const
+{
+  std::ostringstream line;
+  line.precision(1);
+  line << std::fixed << "requests " << m_latency.count()
+    << " mean " << m_latency.mean() << "us"
+    << " p50 " << m_latency.percentile(0.5) << "us"
+    << " p99 " << m_latency.percentile(0.99) << "us"
+    << " max " << m_latency.max() << "us";
+  return line.str();
+}
+
+void Server::run()
+{
+  struct sigaction action{};
+  action.sa_handler = onStopSignal;
+  sigemptyset(&action.sa_mask);
+  struct sigaction previousInterrupt, previousTerminate;
+  signalStop = 0;
+  signalWake = m_wake;
+  m_stopping = false;
+  ::sigaction(SIGINT, &action, &previousInterrupt);
+  ::sigaction(SIGTERM, &action, &previousTerminate);
+  std::array<epoll_event, MaxEvents> events;
+  while (!m_stop && !signalStop)
+  {
+    // without workers the loop runs the tasks itself
+    if (m_pool.workers() == 0)
+      while (m_pool.runPending())
+        ;
+    int count = ::epoll_wait(m_epoll, events.data(), events.size(), -1);
+    if (count < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      throwError("epoll_wait");
+    }
+    for (int i = 0; i < count; ++i)
+    {
+      int fd = events[i].data.fd;
+      if (fd == m_listener)
+        accept();
+      else if (fd == m_wake)
+      {
+        std::uint64_t value;
+        ssize_t result = ::read(m_wake, &value, sizeof(value));
+        (void)result;
+      }
+      else
+      {
+        auto it = m_connections.find(fd);
+        if (it == m_connections.end())
+          continue;
+        ConnectionPtr connection = it->second;
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+          receive(connection);
+        if (events[i].events & EPOLLOUT)
+          send(connection);
+        update(connection);
+      }
+    }
+    complete();
+  }
+  m_stopping = true;
+  while (m_running > 0)
+  {
+    if (!m_pool.runPending())
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    complete();
+  }
+  signalWake = -1;
+  ::sigaction(SIGINT, &previousInterrupt, nullptr);
+  ::sigaction(SIGTERM, &previousTerminate, nullptr);
+  while (!m_connections.empty())
+    close(m_connections.begin()->second);
+}
+
+void Server::accept()
+{
+  for (;;)
+  {
+    int fd = ::accept4(m_listener, nullptr, nullptr,
+        SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      // out of descriptors and the like: retried on the next event
+      return;
+    }
+    auto connection = std::make_shared<Connection>(fd);
+    connection->session = m_factory();
+    m_connections.emplace(fd, connection);
+    update(connection);
+  }
+}
+
+void Server::receive(const ConnectionPtr& connection)
+{
+  if (connection->finished || connection->broken)
+    return;
+  std::size_t size = connection->input.size();
+  connection->input.resize(size + ReceiveBlock);
+  ssize_t count;
+  do
+    count = ::recv(connection->fd, &connection->input[size],
+        ReceiveBlock, 0);
+  while (count < 0 && errno == EINTR);
+  if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    count = 0;
+  else if (count <= 0)
+  {
+    connection->finished = true;
+    connection->broken = count < 0;
+    count = 0;
+  }
+  connection->input.resize(size + count);
+  Clock::time_point now = Clock::now();
+  std::size_t begin = 0;
+  for (;;)
+  {
+    std::size_t end = connection->input.find('\n',
+        std::max(begin, size));
+    if (end == std::string::npos)
+      break;
+    std::size_t length = end - begin;
+    if (length > 0 && connection->input[end - 1] == '\r')
+      --length;
+    connection->requests.push_back(
+        Request{connection->input.substr(begin, length), now});
+    begin = end + 1;
+  }
+  connection->input.erase(0, begin);
+  if (connection->input.size() > MaxRequestBytes)
+  {
+    connection->input.clear();
+    connection->requests.push_back(Request{std::string(), now, true});
+    connection->finished = true;
+  }
+  dispatch(connection);
+}
+
+void Server::send(const ConnectionPtr& connection)
+{
+  while (connection->written < connection->output.size() &&
+      !connection->broken)
+  {
+    ssize_t count = ::send(connection->fd,
+        connection->output.data() + connection->written,
+        connection->output.size() - connection->written, MSG_NOSIGNAL);
+    if (count < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        connection->broken = true;
+      break;
+    }
+    connection->written += count;
+  }
+  if (connection->written == connection->output.size() ||
+      connection->broken)
+  {
+    connection->output.clear();
+    connection->written = 0;
+  }
+  dispatch(connection);
+}
+
+// hands the next request to a task unless one is running or the
+// responses are not being read
+void Server::dispatch(const ConnectionPtr& connection)
+{
+  while (!m_stopping && !connection->busy &&
+      !connection->requests.empty() &&
+      connection->output.size() - connection->written < MaxPendingOutput)
+  {
+    Request request = std::move(connection->requests.front());
+    connection->requests.pop_front();
+    if (connection->broken)
+      continue;
+    if (request.tooLong)
+    {
+      connection->output += "error request too long\n";
+      continue;
+    }
+    if (request.text == ":stats")
+    {
+      connection->output += statistics() + "\n";
+      continue;
+    }
+    connection->busy = true;
+    ++m_running;
+    m_pool.submit([this, connection, request = std::move(request)]() {
+        std::string response;
+        try
+        {
+          response = connection->session->handle(request.text);
+        }
+        catch (const std::exception& e)
+        {
+          response = std::string("error ") + e.what();
+        }
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          connection->response = flatten(std::move(response));
+          connection->received = request.received;
+          m_completed.push_back(connection);
+        }
+        wake(m_wake); });
+  }
+}
+
+// takes the responses of finished tasks
+void Server::complete()
+{
+  std::vector<ConnectionPtr> completed;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    completed.swap(m_completed);
+  }
+  Clock::time_point now = Clock::now();
+  for (const ConnectionPtr& connection : completed)
+  {
+    --m_running;
+    connection->busy = false;
+    m_latency.record(std::chrono::duration<double, std::micro>(
+          now - connection->received).count());
+    connection->output += connection->response;
+    connection->output += '\n';
+    connection->response.clear();
+    send(connection);
+    update(connection);
+  }
+}
+
+// registers the events the connection waits for, closes it once
+// everything is answered after the peer finished
+void Server::update(const ConnectionPtr& connection)
+{
+  if (connection->finished && !connection->busy &&
+      (connection->broken || (connection->requests.empty() &&
+        connection->output.empty())))
+  {
+    close(connection);
+    return;
+  }
+  std::uint32_t events = 0;
+  if (!connection->finished &&
+      connection->requests.size() < MaxQueuedRequests &&
+      connection->output.size() - connection->written < MaxPendingOutput)
+    events |= EPOLLIN;
+  if (connection->written < connection->output.size())
+    events |= EPOLLOUT;
+  if (events == connection->events)
+    return;
+  epoll_event event{};
+  event.events = events;
+  event.data.fd = connection->fd;
+  int operation = connection->events == 0 ? EPOLL_CTL_ADD :
+    events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+  if (::epoll_ctl(m_epoll, operation, connection->fd, &event) < 0)
+    throwError("epoll_ctl");
+  connection->events = events;
+}
+
+void Server::close(const ConnectionPtr& connection)
+{
+  if (connection->events != 0)
+    ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, connection->fd, nullptr);
+  connection->events = 0;
+  m_connections.erase(connection->fd);
+}
+
+} /* namespace kcalc */
@@ -0,0 +1,90 @@
+#include "SymbolUsage.h"
+#include "Ast.h"
+
+#include <algorithm>
+
+namespace kcalc
+{
+
+SymbolUsage::SymbolUsage(AstObject& statement)
+  : Visitor{VisitorOrdering::PreOrder, ParentHandling::BeforeParent}
+{
+  if (statement.kind() == ObjectKind::Assignment)
+  {
+    Assignment& assignment = static_cast<Assignment&>(statement);
+    assert(assignment.left().kind() == ObjectKind::Variable);
+    m_write = std::string(
+        static_cast<const Variable&>(assignment.left()).name());
+    assignment.right().accept(*this);
+  }
+  else
+    statement.accept(*this);
+}
+
+void SymbolUsage::visit(Variable& variable)
+{
+  m_reads.emplace(variable.name());
+}
+
+std::set<std::string> BatchDependencies::closure(
+    std::set<std::string> reads) const
+{
+  std::vector<std::string> pending(reads.begin(), reads.end());
+  while (!pending.empty())
+  {
+    std::string name = std::move(pending.back());
+    pending.pop_back();
+    auto references = m_references.find(name);
+    if (references == m_references.end())
+      continue;
+    for (const std::string& reference : references->second)
+      if (reads.insert(reference).second)
+        pending.push_back(reference);
+  }
+  return reads;
+}
+
+std::vector<unsigned int> BatchDependencies::add(
+    unsigned int line, 
+    const SymbolUsage& usage)
+{
+  std::set<std::string> reads = closure(usage.reads());
+  std::vector<unsigned int> predecessors;
+  auto finished = [this](unsigned int reader) { 
+    return reader < m_unfinished; };
+  for (const std::string& name : reads)
+  {
+    auto writer = m_writers.find(name);
+    if (writer != m_writers.end() && !finished(writer->second))
+      predecessors.push_back(writer->second);
+    std::vector<unsigned int>& readers = m_readers[name];
+    // drop finished readers before the vector grows
+    if (readers.size() == readers.capacity())
+      readers.erase(std::remove_if(readers.begin(), readers.end(),
+            finished), readers.end());
+    readers.push_back(line);
+  }
+  if (usage.write())
+  {
+    const std::string& name = *usage.write();
+    auto writer = m_writers.find(name);
+    if (writer != m_writers.end() && !finished(writer->second))
+      predecessors.push_back(writer->second);
+    auto readers = m_readers.find(name);
+    if (readers != m_readers.end())
+    {
+      for (unsigned int reader : readers->second)
+        if (reader != line && !finished(reader))
+          predecessors.push_back(reader);
+      readers->second.clear();
+    }
+    m_writers[name] = line;
+    m_references[name] = reads;
+  }
+  std::sort(predecessors.begin(), predecessors.end());
+  predecessors.erase(std::unique(predecessors.begin(), 
+        predecessors.end()), predecessors.end());
+  return predecessors;
+}
+
+} /* namespace kcalc */
@@ -0,0 +1,241 @@
+#include "ThreadPool.h"
+#include "Allocator.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace kcalc
+{
+
+namespace
+{
+
+// the pool and queue index of the current thread if it is a worker
+struct WorkerIdentity
+{
+  const ThreadPool * pool = nullptr;
+  unsigned int index = 0;
+};
+
+thread_local WorkerIdentity currentWorker;
+
+} /* anonymous namespace */
+
+ThreadPool::ThreadPool(unsigned int workers)
+  : m_queued{0}, m_stop{false}
+{ start(workers); }
+
+ThreadPool::~ThreadPool()
+{ stop(); }
+
+void ThreadPool::start(unsigned int workers)
+{
+  m_stop = false;
+  m_queues.clear();
+  for (unsigned int i = 0; i < workers; ++i)
+    m_queues.push_back(std::make_unique<WorkerQueue>());
+  m_threads.reserve(workers);
+  for (unsigned int i = 0; i < workers; ++i)
+    m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+void ThreadPool::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_condition.notify_all();
+  for (std::thread& thread : m_threads)
+    thread.join();
+  m_threads.clear();
+}
+
+void ThreadPool::resize(unsigned int workers)
+{
+  if (workers == m_threads.size())
+    return;
+  stop();
+  start(workers);
+}
+
+ThreadPool& ThreadPool::instance()
+{
+  static ThreadPool pool(std::max(1u,
+        std::thread::hardware_concurrency()) - 1);
+  return pool;
+}
+
+void ThreadPool::submit(Task task)
+{
+  bool worker = currentWorker.pool == this;
+  {
+    // counted before it is visible, so a worker that finds the
+    // count at zero under the mutex may safely sleep
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queued.fetch_add(1, std::memory_order_release);
+    if (!worker)
+      m_tasks.push_back(std::move(task));
+  }
+  if (worker)
+  {
+    WorkerQueue& queue = *m_queues[currentWorker.index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  m_condition.notify_one();
+}
+
+bool ThreadPool::take(Task& task)
+{
+  if (m_queued.load(std::memory_order_acquire) == 0)
+    return false;
+  unsigned int queues = m_queues.size();
+  unsigned int first = 0;
+  if (currentWorker.pool == this)
+  {
+    // newest own task first, it is the hottest in cache
+    WorkerQueue& queue = *m_queues[currentWorker.index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty())
+    {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+      m_queued.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+    first = currentWorker.index + 1;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_tasks.empty())
+    {
+      task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+      m_queued.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  // steal the oldest task, usually the largest piece of work
+  for (unsigned int i = 0; i < queues; ++i)
+  {
+    WorkerQueue& queue = *m_queues[(first + i) % queues];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty())
+    {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      m_queued.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadPool::runPending()
+{
+  Task task;
+  if (!take(task))
+    return false;
+  // the task may belong to another statement, on a worker as well as
+  // on a foreign thread; keep its results out of our arena
+  ArenaSuspension suspension;
+  task();
+  return true;
+}
+
+void ThreadPool::workerLoop(unsigned int index)
+{
+  currentWorker.pool = this;
+  currentWorker.index = index;
+  for (;;)
+  {
+    Task task;
+    if (take(task))
+    {
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_stop && m_queued.load(std::memory_order_acquire) == 0)
+      break;
+    if (m_queued.load(std::memory_order_acquire) == 0)
+      m_condition.wait_for(lock, std::chrono::milliseconds(100));
+  }
+  currentWorker = WorkerIdentity();
+}
+
+TaskGroup::~TaskGroup()
+{
+  try
+  {
+    wait();
+  }
+  catch (...)
+  { }
+}
+
+void TaskGroup::run(std::function<void ()> task)
+{
+  if (m_pool.workers() == 0)
+  {
+    try
+    {
+      task();
+    }
+    catch (...)
+    {
+      if (!m_exception)
+        m_exception = std::current_exception();
+    }
+    return;
+  }
+  m_pending.fetch_add(1, std::memory_order_relaxed);
+  // tasks are joined before the budget of the statement ends
+  m_pool.submit([this, task = std::move(task), 
+      budget = StatementBudget::current()]() {
+      try
+      {
+        StatementBudget::Scope scope(budget);
+        task();
+      }
+      catch (...)
+      {
+        finish(std::current_exception());
+        return;
+      }
+      finish(nullptr);
+    });
+}
+
+void TaskGroup::finish(std::exception_ptr exception)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (exception && !m_exception)
+    m_exception = exception;
+  if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    m_done.notify_all();
+}
+
+void TaskGroup::wait()
+{
+  while (m_pending.load(std::memory_order_acquire) != 0)
+  {
+    if (!m_pool.runPending())
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_done.wait_for(lock, std::chrono::microseconds(200), [this]() {
+          return m_pending.load(std::memory_order_acquire) == 0; });
+    }
+  }
+  // the last task may still hold the mutex
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_exception)
+  {
+    std::exception_ptr exception = m_exception;
+    m_exception = nullptr;
+    std::rethrow_exception(exception);
+  }
+}
+
+} /* namespace kcalc */
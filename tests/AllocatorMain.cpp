@@ -0,0 +1,12 @@
+#include <gtest/gtest.h>
+
+#include "Allocator.h"
+
+// GMP cannot free memory across allocators, so the allocator is 
+// installed before any test allocates
+int main(int argc, char *argv[])
+{
+  kcalc::GmpAllocator::install();
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
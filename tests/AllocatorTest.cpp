@@ -0,0 +1,326 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Allocator.h"
+#include "Arithmetic.h"
+#include "Ast.h"
+#include "Exceptions.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "SemanticAnalyzer.h"
+#include "SymbolTable.h"
+#include "ThreadPool.h"
+
+class AllocatorTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  { kcalc::GmpAllocator::resetStatistics(); }
+};
+
+TEST_F(AllocatorTest, Counters)
+{
+  ASSERT_TRUE(kcalc::GmpAllocator::installed());
+  unsigned long total = kcalc::GmpAllocator::totalAllocations();
+  {
+    mpz_class number("123456789012345678901234567890");
+    number *= number;
+    kcalc::AllocationStatistics stats = 
+      kcalc::GmpAllocator::statistics();
+    ASSERT_LE(1ul, stats.allocations);
+    ASSERT_LE(16ul, stats.bytes);
+    ASSERT_LT(0, stats.liveBytes);
+    ASSERT_LE(stats.liveBytes, stats.peakBytes);
+  }
+  ASSERT_EQ(0, kcalc::GmpAllocator::statistics().liveBytes);
+  ASSERT_LT(total, kcalc::GmpAllocator::totalAllocations());
+}
+
+TEST_F(AllocatorTest, PoolReuse)
+{
+  void * first;
+  {
+    mpz_class number;
+    mpz_realloc2(number.get_mpz_t(), 1000);
+    first = mpz_limbs_modify(number.get_mpz_t(), 1);
+  }
+  mpz_class number;
+  mpz_realloc2(number.get_mpz_t(), 1000);
+  ASSERT_EQ(first, mpz_limbs_modify(number.get_mpz_t(), 1));
+}
+
+TEST_F(AllocatorTest, Arithmetic)
+{
+  kcalc::ComplexNumber number("123.456");
+  number += kcalc::ComplexNumber("-7.5i");
+  kcalc::ComplexNumber result = 
+    number ^ kcalc::ComplexNumber(40);
+  result /= number ^ kcalc::ComplexNumber(39);
+  ASSERT_TRUE(result == number);
+}
+
+TEST_F(AllocatorTest, Arena)
+{
+  kcalc::AllocationStatistics before = 
+    kcalc::GmpAllocator::statistics();
+  mpz_class persistent(17);
+  std::string text;
+  {
+    kcalc::StatementArena arena;
+    mpz_class temporary(3);
+    for (int i = 0; i < 10; ++i)
+    {
+      mpz_class square = temporary * temporary;
+      temporary = square + persistent;
+    }
+    mpz_pow_ui(persistent.get_mpz_t(), persistent.get_mpz_t(), 200);
+    ASSERT_LT(0u, arena.capacity());
+    {
+      kcalc::ArenaSuspension suspension;
+      mpz_class kept(temporary);
+      persistent.swap(kept);
+    }
+    text = temporary.get_str().substr(0, 10);
+  }
+  ASSERT_EQ(10u, text.size());
+  ASSERT_STREQ(text.c_str(), persistent.get_str().substr(0, 10).c_str());
+  persistent *= persistent;
+  ASSERT_LE(before.liveBytes, kcalc::GmpAllocator::statistics().liveBytes);
+}
+
+TEST_F(AllocatorTest, NestedArena)
+{
+  kcalc::StatementArena outer;
+  mpz_class outerNumber(5);
+  {
+    kcalc::StatementArena inner;
+    mpz_class innerNumber(7);
+    mpz_pow_ui(outerNumber.get_mpz_t(), outerNumber.get_mpz_t(), 1000);
+    ASSERT_TRUE(outer.owns(mpz_limbs_read(outerNumber.get_mpz_t())));
+    ASSERT_TRUE(inner.owns(mpz_limbs_read(innerNumber.get_mpz_t())));
+    outerNumber = innerNumber;
+  }
+  ASSERT_EQ(7, outerNumber.get_si());
+}
+
+TEST_F(AllocatorTest, CrossThreadFree)
+{
+  std::vector<mpz_class> numbers;
+  std::thread producer([&numbers]() {
+      for (int i = 0; i < 1000; ++i)
+        numbers.emplace_back(mpz_class(i) << (i % 200));
+    });
+  producer.join();
+  for (int i = 0; i < 1000; ++i)
+    ASSERT_EQ(0, mpz_cmp(numbers[i].get_mpz_t(), 
+          mpz_class(mpz_class(i) << (i % 200)).get_mpz_t()));
+  numbers.clear();
+}
+
+TEST_F(AllocatorTest, BudgetRejectsLargePowers)
+{
+  kcalc::StatementArena arena;
+  kcalc::Budget limits;
+  limits.digits = 1000;
+  kcalc::StatementBudget budget(limits);
+  ASSERT_EQ(&budget, kcalc::StatementBudget::current());
+  // 9^9^9 has about 3.7 * 10^8 digits
+  kcalc::ComplexNumber nine(9);
+  try
+  {
+    nine ^ (nine ^ nine);
+    FAIL();
+  }
+  catch (const kcalc::BudgetExceededException& e)
+  {
+    ASSERT_EQ(kcalc::BudgetExceededException::Digits, e.resource());
+    ASSERT_EQ("1000", e.limit());
+  }
+  ASSERT_TRUE((kcalc::ComplexNumber(1) ^ kcalc::ComplexNumber(1000000)) 
+      == kcalc::ComplexNumber(1));
+  kcalc::ComplexNumber large = nine ^ kcalc::ComplexNumber(900);
+  ASSERT_THROW(kcalc::ComplexNumber(large * large),
+      kcalc::BudgetExceededException);
+}
+
+TEST_F(AllocatorTest, BudgetLimitsMemory)
+{
+  auto freed = std::make_unique<mpz_class>();
+  mpz_ui_pow_ui(freed->get_mpz_t(), 3, 10000000);
+  mpz_class shrunk(*freed);
+  kcalc::Budget limits;
+  limits.bytes = 1 << 20;
+  kcalc::StatementBudget budget(limits);
+  try
+  {
+    // rejected before it is computed
+    kcalc::ComplexNumber(3) ^ kcalc::ComplexNumber(100000000);
+    FAIL();
+  }
+  catch (const kcalc::BudgetExceededException& e)
+  {
+    ASSERT_EQ(kcalc::BudgetExceededException::Memory, e.resource());
+  }
+  // memory from before the budget makes no room when it is released
+  freed.reset();
+  mpz_realloc2(shrunk.get_mpz_t(), 64);
+  // values of about 40 kB kept by the statement, the checkpoint after
+  // the limit throws
+  std::vector<kcalc::ComplexNumber> values;
+  auto keep = [&values]() {
+    for (unsigned int i = 0; i < 100; ++i)
+      values.push_back(
+          kcalc::ComplexNumber(3) ^ kcalc::ComplexNumber(200000 + i)); };
+  ASSERT_THROW(keep(), kcalc::BudgetExceededException);
+  ASSERT_LT(values.size(), 30u);
+  values.clear();
+  ASSERT_TRUE((kcalc::ComplexNumber(3) ^ kcalc::ComplexNumber(4)) ==
+      kcalc::ComplexNumber(81));
+}
+
+TEST_F(AllocatorTest, BudgetLimitsTime)
+{
+  kcalc::Budget limits;
+  limits.seconds = 0.001;
+  kcalc::StatementBudget budget(limits);
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  // the checkpoint after a large allocation reads the clock
+  ASSERT_THROW(kcalc::ComplexNumber(3) ^ kcalc::ComplexNumber(100000),
+      kcalc::BudgetExceededException);
+}
+
+TEST_F(AllocatorTest, BudgetOfTasks)
+{
+  kcalc::ThreadPool pool(2);
+  kcalc::StatementBudget budget(kcalc::Budget{});
+  std::atomic<unsigned int> inherited{0};
+  kcalc::TaskGroup group(pool);
+  for (int i = 0; i < 8; ++i)
+    group.run([&]() { 
+        if (kcalc::StatementBudget::current() == &budget)
+          ++inherited;
+      });
+  group.wait();
+  ASSERT_EQ(8u, inherited.load());
+}
+
+TEST_F(AllocatorTest, BudgetOfTaskMemory)
+{
+  ASSERT_EQ(0u, kcalc::StatementBudget(kcalc::Budget{}).blockTag());
+  kcalc::Budget limits;
+  limits.bytes = 1 << 20;
+  kcalc::StatementBudget budget(limits);
+  ASSERT_NE(0u, budget.blockTag());
+  kcalc::ThreadPool pool(2);
+  // values of about 40 kB computed by tasks make room once this
+  // thread releases them, 3 MB in all
+  for (int round = 0; round < 20; ++round)
+  {
+    std::vector<kcalc::ComplexNumber> values(4, kcalc::ComplexNumber(0));
+    kcalc::TaskGroup group(pool);
+    for (kcalc::ComplexNumber& value : values)
+      group.run([&value]() {
+          value = kcalc::ComplexNumber(3) ^ kcalc::ComplexNumber(200000);
+        });
+    group.wait();
+    kcalc::StatementBudget::checkpoint();
+  }
+}
+
+TEST_F(AllocatorTest, Interrupt)
+{
+  kcalc::StatementArena arena;
+  kcalc::Budget limits;
+  kcalc::StatementBudget uninterruptible(limits);
+  kcalc::StatementBudget::interrupt();
+  kcalc::StatementBudget::checkpoint();
+  limits.interruptible = true;
+  {
+    kcalc::StatementBudget budget(limits);
+    ASSERT_THROW(kcalc::StatementBudget::checkpoint(), 
+        kcalc::CancelledException);
+    ASSERT_THROW(kcalc::ComplexNumber(3) ^ kcalc::ComplexNumber(100),
+        kcalc::CancelledException);
+    kcalc::StatementBudget::clearInterrupt();
+    kcalc::StatementBudget::checkpoint();
+    ASSERT_TRUE((kcalc::ComplexNumber(3) ^ kcalc::ComplexNumber(4)) ==
+        kcalc::ComplexNumber(81));
+  }
+}
+
+TEST_F(AllocatorTest, Cancel)
+{
+  std::atomic<bool> cancelled{false};
+  kcalc::Budget limits;
+  limits.cancelled = &cancelled;
+  kcalc::StatementBudget budget(limits);
+  kcalc::ThreadPool pool(2);
+  kcalc::TaskGroup group(pool);
+  group.run([]() {
+      for (;;)
+        kcalc::StatementBudget::checkpoint();
+    });
+  cancelled = true;
+  ASSERT_THROW(group.wait(), kcalc::CancelledException);
+}
+
+// a statement as the REPL runs it: interruptible, in an arena, with
+// the assigned expression kept outside of it
+static std::string runStatement(kcalc::SymbolTable& symbolTable,
+    const std::string& text)
+{
+  kcalc::StatementArena arena;
+  kcalc::Budget limits;
+  limits.interruptible = true;
+  kcalc::StatementBudget budget(limits);
+  kcalc::SemanticAnalyzer analyzer(symbolTable);
+  kcalc::Lexer lexer(text);
+  kcalc::Parser parser(lexer);
+  std::unique_ptr<kcalc::AstObject> statement = parser.parse();
+  if (statement->kind() == kcalc::ObjectKind::Assignment)
+  {
+    kcalc::ArenaSuspension persistent;
+    statement->accept(analyzer);
+    return std::string();
+  }
+  statement->accept(analyzer);
+  return statement->eval(symbolTable)->to_string();
+}
+
+TEST_F(AllocatorTest, InterruptStatement)
+{
+  kcalc::ThreadPool& pool = kcalc::ThreadPool::instance();
+  unsigned int workers = pool.workers();
+  kcalc::SymbolTable symbolTable;
+  runStatement(symbolTable, "x = 5");
+  runStatement(symbolTable, "y = 3^1000000000");
+  // sequential and with the operands and products in tasks
+  for (unsigned int threads : { 0u, 3u })
+  {
+    pool.resize(threads);
+    for (const char * text : { "x * 3^1000000000", "y - 7^900000000" })
+    {
+      kcalc::StatementBudget::clearInterrupt();
+      // as the SIGINT handler does, while the statement runs
+      std::thread interrupter([]() {
+          std::this_thread::sleep_for(std::chrono::milliseconds(50));
+          kcalc::StatementBudget::interrupt(); });
+      auto start = std::chrono::steady_clock::now();
+      EXPECT_THROW(runStatement(symbolTable, text), 
+          kcalc::CancelledException) << text;
+      interrupter.join();
+      ASSERT_LT(std::chrono::steady_clock::now() - start, 
+          std::chrono::seconds(5)) << text;
+    }
+    // the variables are unchanged and the next statement runs
+    kcalc::StatementBudget::clearInterrupt();
+    ASSERT_EQ("3 ^ 1000000000", symbolTable.lookup("y")->to_string());
+    ASSERT_EQ("10", runStatement(symbolTable, "x * 2"));
+    ASSERT_EQ("6", runStatement(symbolTable, "x + 1"));
+  }
+  pool.resize(workers);
+}
@@ -0,0 +1,216 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "ApproximateEvaluator.h"
+#include "Exceptions.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "SemanticAnalyzer.h"
+
+// runs the statements of a script, the result is that of the last;
+// bits are the places of decimals
+static std::string approximate(const char * script,
+    kcalc::Precision precision, unsigned long bits = 256)
+{
+  kcalc::SymbolTable symbolTable;
+  kcalc::SemanticAnalyzer analyzer(symbolTable);
+  kcalc::Approximation approximation{ precision, bits };
+  approximation.places = static_cast<unsigned int>(bits);
+  kcalc::ApproximateEvaluator evaluator(approximation);
+  std::string result;
+  std::string_view rest = script;
+  while (!rest.empty())
+  {
+    std::size_t end = std::min(rest.find(';'), rest.size());
+    kcalc::Lexer lexer(rest.substr(0, end));
+    kcalc::Parser parser(lexer);
+    std::unique_ptr<kcalc::AstObject> statement = parser.parse();
+    if (statement->kind() == kcalc::ObjectKind::Assignment)
+      statement->accept(analyzer);
+    else
+      result = evaluator.evaluate(
+          static_cast<const kcalc::Expression&>(*statement), symbolTable);
+    rest.remove_prefix(std::min(end + 1, rest.size()));
+  }
+  return result;
+}
+
+TEST(ApproximateEvaluatorTest, Double)
+{
+  using kcalc::Precision;
+  ASSERT_EQ("3.33333333333333e-1", approximate("1/3", Precision::Double));
+  ASSERT_EQ("3.00000000000000e-1",
+      approximate("0.1 + 0.2", Precision::Double));
+  ASSERT_EQ("-1.50000000000000e+0 + 3.50000000000000e+0i",
+      approximate("x = 1.5i; x*x/x + 2i + x*1i", Precision::Double));
+  ASSERT_EQ("1.41421356237310e+0", approximate("2^0.5", Precision::Double));
+  // principal values, with the rounding errors of pow
+  ASSERT_EQ("6.12323399573677e-17 + 1.00000000000000e+0i",
+      approximate("(-1)^0.5", Precision::Double));
+  ASSERT_EQ("inf", approximate("10^400", Precision::Double));
+  ASSERT_EQ("1.00000000000000e-20", approximate("1e-20", Precision::Double));
+  ASSERT_EQ("2.00000000000000e+0 + 4.00000000000000e+0i",
+      approximate("(7 - 1i) % 5", Precision::Double));
+  ASSERT_EQ("0", approximate("x = 3; x - 3", Precision::Double));
+  ASSERT_EQ("1.90000000000000000e+1",
+      approximate("19", Precision::LongDouble));
+  ASSERT_EQ("3.33333333333333333e-1",
+      approximate("1/3", Precision::LongDouble));
+
+  // literals beyond the range of double
+  ASSERT_EQ("inf", approximate("1e400", Precision::Double));
+  ASSERT_EQ("-inf", approximate("x = -1e400; x", Precision::Double));
+  ASSERT_EQ("0", approximate("1e-400", Precision::Double));
+  ASSERT_EQ("1.00000000000000000e+400",
+      approximate("1e400", Precision::LongDouble));
+  ASSERT_EQ("1.00000000000000000e-400",
+      approximate("x = 1e-400; x", Precision::LongDouble));
+  ASSERT_EQ("inf", approximate("1e5000", Precision::LongDouble));
+  // complex quotients whose divisor squared leaves the range
+  for (Precision precision : { Precision::Double, Precision::LongDouble })
+  {
+    ASSERT_EQ(approximate("-1e200i", precision),
+        approximate("1/(1e-200i)", precision));
+    ASSERT_EQ(approximate("1", precision), approximate(
+          "(1e160 + 1e160i)/(1e160 + 1e160i)", precision));
+    ASSERT_EQ(approximate("1e300 + 1e300i", precision), approximate(
+          "(2e300i)/(1 + 1i)", precision));
+  }
+}
+
+TEST(ApproximateEvaluatorTest, Float)
+{
+  using kcalc::Precision;
+  ASSERT_EQ("3.3333333333333333333333333333333333333e-1",
+      approximate("1/3", Precision::Float, 128));
+  ASSERT_EQ("1.2676506002282294014967032053760000000e+30",
+      approximate("2^100", Precision::Float, 128));
+  ASSERT_EQ("-1.2345e+1", approximate("-12.345", Precision::Float, 17));
+  ASSERT_EQ("1.2345e+100001", approximate("1.2345e100001",
+        Precision::Float, 17));
+  ASSERT_EQ("9.77e-4", approximate("2^-10", Precision::Float, 12));
+}
+
+TEST(ApproximateEvaluatorTest, Ball)
+{
+  using kcalc::Precision;
+  ASSERT_EQ("3.33333333333333333e-1", approximate("1/3", Precision::Ball, 64));
+  ASSERT_EQ("1.428571428571428571e-1 - 1.428571428571428571e-1i",
+      approximate("(1 - 1i)/7", Precision::Ball, 64));
+  ASSERT_EQ("[+/- 2.17e-19]",
+      approximate("x = 1/3; 3*x - 1", Precision::Ball, 64));
+  ASSERT_EQ("3.33333333333333333e+100000",
+      approximate("1e100001/3", Precision::Ball, 64));
+  ASSERT_EQ("1.000000000000000000e+0", approximate("10 % 3", 
+        Precision::Ball, 64));
+  ASSERT_EQ("8.00e-3", approximate("5^-3", Precision::Ball, 16));
+  ASSERT_THROW(approximate("x = 1/3; 1/(3*x - 1)", Precision::Ball, 64),
+      kcalc::PrecisionLossException);
+  ASSERT_THROW(approximate("0.1 % 0.05", Precision::Ball, 64),
+      kcalc::PrecisionLossException);
+  // with a minimum of correct digits
+  kcalc::SymbolTable symbolTable;
+  kcalc::ApproximateEvaluator evaluator({ Precision::Ball, 64, 18 });
+  kcalc::Lexer lexer("1/3 - 333333/1000000");
+  kcalc::Parser parser(lexer);
+  std::unique_ptr<kcalc::AstObject> statement = parser.parse();
+  ASSERT_THROW(evaluator.evaluate(
+        static_cast<const kcalc::Expression&>(*statement), symbolTable),
+      kcalc::PrecisionLossException);
+}
+
+TEST(ApproximateEvaluatorTest, Decimal)
+{
+  using kcalc::Precision;
+  ASSERT_EQ("0.33", approximate("1/3", Precision::Decimal, 2));
+  ASSERT_EQ("0.67", approximate("2/3", Precision::Decimal, 2));
+  ASSERT_EQ("0.00", approximate("x = 3; x - 3", Precision::Decimal, 2));
+  // half to even
+  ASSERT_EQ("0.12", approximate("0.125", Precision::Decimal, 2));
+  ASSERT_EQ("0.38", approximate("0.375", Precision::Decimal, 2));
+  ASSERT_EQ("-2.5", approximate("-5/2", Precision::Decimal, 1));
+  ASSERT_EQ("10", approximate("10", Precision::Decimal, 0));
+  // every operation rounds, unlike exact arithmetic
+  ASSERT_EQ("0.99", approximate("(1/3) * 3", Precision::Decimal, 2));
+  ASSERT_EQ("1.10 + 4.90i", approximate("(7 - 1i) % 5.9", 
+        Precision::Decimal, 2));
+  ASSERT_EQ("0.14 - 0.14i", approximate("(1 - 1i)/7", 
+        Precision::Decimal, 2));
+  ASSERT_EQ("-1.50 + 3.50i",
+      approximate("x = 1.5i; x*x/x + 2i + x*1i", Precision::Decimal, 2));
+  ASSERT_EQ("1267650600228229401496703205376.000",
+      approximate("2^100", Precision::Decimal, 3));
+  ASSERT_EQ("0.0010", approximate("10^-3", Precision::Decimal, 4));
+  ASSERT_EQ("120000000000.00", approximate("1.2e11", Precision::Decimal, 2));
+  ASSERT_THROW(approximate("2^0.5", Precision::Decimal, 2),
+      kcalc::PowerIllegalExponentException);
+}
+
+TEST(ApproximateEvaluatorTest, Modular)
+{
+  auto modular = [](const char * script, const char * prime) {
+    kcalc::SymbolTable symbolTable;
+    kcalc::Approximation approximation;
+    approximation.precision = kcalc::Precision::Modular;
+    approximation.modulus = mpz_class(prime);
+    kcalc::ApproximateEvaluator evaluator(approximation);
+    kcalc::Lexer lexer(script);
+    kcalc::Parser parser(lexer);
+    std::unique_ptr<kcalc::AstObject> statement = parser.parse();
+    return evaluator.evaluate(
+        static_cast<const kcalc::Expression&>(*statement), symbolTable);
+  };
+  ASSERT_EQ("333333336", modular("1/3", "1000000007"));
+  ASSERT_EQ("976371285", modular("2^100", "1000000007"));
+  ASSERT_EQ("500000004", modular("2^-1", "1000000007"));
+  // 2^(p - 1) = 1, exponents are not reduced modulo p
+  ASSERT_EQ("1", modular("2^(1000000007 - 1)", "1000000007"));
+  ASSERT_EQ("1", modular("2^(10^30 * (1000000007 - 1))", "1000000007"));
+  ASSERT_EQ("700000005 + 900000007i",
+      modular("(1 + 2i)/(3 - 1i)", "1000000007"));
+  ASSERT_EQ("3", modular("0.5 + 1e3", "7"));
+  ASSERT_EQ("85070591730234615865843651857942052864",
+      modular("1/2", "170141183460469231731687303715884105727"));
+  ASSERT_THROW(modular("1/7", "7"), kcalc::DivisionByZeroException);
+  // 1 + 2i has the norm 5
+  ASSERT_THROW(modular("1/(1 + 2i)", "5"), kcalc::DivisionByZeroException);
+  ASSERT_THROW(modular("5 % 3", "7"), kcalc::ModuloResidueException);
+  ASSERT_THROW(modular("2^(1/2)", "7"),
+      kcalc::PowerIllegalExponentException);
+  ASSERT_THROW(modular("2^x", "7"), kcalc::UnboundVariableException);
+}
+
+TEST(ApproximateEvaluatorTest, SharedVariables)
+{
+  // each variable is evaluated once, the chain would take 2^60
+  // evaluations otherwise
+  std::string script = "x0 = 1.5";
+  for (int i = 1; i <= 60; ++i)
+    script += "; x" + std::to_string(i) + " = (x" + std::to_string(i - 1)
+      + " + x" + std::to_string(i - 1) + ") / 2";
+  script += "; x60";
+  ASSERT_EQ("1.50000000000000e+0",
+      approximate(script.c_str(), kcalc::Precision::Double));
+}
+
+TEST(ApproximateEvaluatorTest, Errors)
+{
+  using kcalc::Precision;
+  for (Precision precision : { Precision::Double, Precision::LongDouble,
+      Precision::Float, Precision::Ball, Precision::Decimal })
+  {
+    ASSERT_THROW(approximate("1/0", precision),
+        kcalc::DivisionByZeroException);
+    ASSERT_THROW(approximate("5 % 0", precision),
+        kcalc::DivisionByZeroException);
+    ASSERT_THROW(approximate("5 % 2i", precision),
+        kcalc::ModuloComplexNumberException);
+    ASSERT_THROW(approximate("x + 1", precision),
+        kcalc::UnboundVariableException);
+  }
+  ASSERT_THROW(approximate("2^0.5", Precision::Float),
+      kcalc::PowerIllegalExponentException);
+  ASSERT_THROW(approximate("2^1i", Precision::Float),
+      kcalc::PowerIllegalExponentException);
+}
@@ -50,6 +50,18 @@ TEST(ArithTest, TestInverse)
   TEST_INVERSE("2", "0", "1/2");
   TEST_INVERSE("-2", "0", "-1/2"); 
   TEST_INVERSE("-5", "2i", "-5/29 - 2i/29");
+  TEST_INVERSE("0.5", "0.5i", "1 - i");
+  TEST_INVERSE("0", "0.25i", "-4i");
+}
+
+TEST(ArithTest, TestSelfAssignment)
+{
+  kcalc::ComplexNumber a = construct("1.5", "-2i");
+  a /= a;
+  ASSERT_STREQ("1", a.to_string().c_str());
+  kcalc::ComplexNumber b("-7.5");
+  b %= b;
+  ASSERT_STREQ("0", b.to_string().c_str());
 }
 
 TEST(ArithTest, TestInverseException)
@@ -80,6 +92,8 @@ TEST(ArithTest, TestFloor)
   TEST_FLOOR("0.00001", "0", "0");
   TEST_FLOOR("-2", "0", "-2");
   TEST_FLOOR("2", "0", "2");   
+  TEST_FLOOR("-7.25", "7.25i", "-8 + 7i");
+  TEST_FLOOR("1e-30", "-1e-30i", "-i");
 } 
 
 #define TEST_MOD(re,im,re2,im2,result) \
@@ -103,6 +117,11 @@ TEST(ArithTest, TestMod)
   TEST_MOD("3", "3i", "-2", "0", "-1 - i");  
   TEST_MOD("3", "3i", "2", "0", "1 + i");   
   TEST_MOD("-3", "-3i", "2", "0", "1 + i");  
+
+  TEST_MOD("7.5", "-0.25i", "0.4", "0", "3/10 + 3i/20");
+  TEST_MOD("7.5", "-0.25i", "-0.4", "0", "-1/10 - i/4");
+  TEST_MOD("-7", "5i", "1.5", "0", "1/2 + i/2");
+  TEST_MOD("2.5", "0", "0.75", "0", "1/4");
 }
 
 TEST(ArithTest, TestModException)
@@ -210,6 +229,10 @@ TEST(ArithTest, TestDiv)
   TEST_DIV("-5", "0i", "8", "-1i", "-8/13 - i/13");    
   TEST_DIV("-5", "1i", "8", "-1i", "-41/65 + 3i/65");     
   TEST_DIV("-5", "1i", "8", "i", "-3/5 + i/5");      
+
+  TEST_DIV("-5", "1i", "0.5", "0", "-10 + 2i");
+  TEST_DIV("1.5", "0.5i", "0.5", "-0.25i", "2 + 2i");
+  TEST_DIV("3", "4i", "3", "4i", "1");
 }
 
 TEST(ArithTest, TestDivException)
@@ -311,3 +334,195 @@ TEST(ArithTest, TestPowRationalExponent)
   }
   ASSERT_TRUE(exceptionThrown); 
 } 
+
+std::string testPowMod(const char * re, const char * im,
+                       const char * exp, const char * mod)
+{
+  kcalc::ComplexNumber base = construct(re, im);
+  kcalc::ComplexNumber exponent(exp);
+  kcalc::ComplexNumber modulus(mod);
+  EXPECT_TRUE(base.canPowMod(exponent, modulus));
+  kcalc::ComplexNumber expected = (base ^ exponent) % modulus;
+  base.powMod(exponent, modulus);
+  EXPECT_TRUE(expected == base);
+  return base.to_string();
+}
+
+#define TEST_POWMOD(re,im,exp,mod,result) \
+  do { EXPECT_STREQ(result, testPowMod(re,im,exp,mod).c_str()); } while(0)
+
+TEST(ArithTest, TestPowMod)
+{
+  TEST_POWMOD("2", "0", "10", "1000", "24");
+  TEST_POWMOD("2", "0", "0", "7", "1");
+  TEST_POWMOD("2", "0", "0", "1", "0");
+  TEST_POWMOD("0", "0", "0", "7", "1");
+  TEST_POWMOD("-3", "0", "3", "5", "3");
+  TEST_POWMOD("-3", "0", "3", "-5", "-2");
+  TEST_POWMOD("3", "0", "2", "-5", "-1");
+  TEST_POWMOD("5", "0", "2", "-5", "0");
+
+  TEST_POWMOD("1", "i", "2", "3", "2i");
+  TEST_POWMOD("1", "i", "10", "7", "4i");
+  TEST_POWMOD("2", "3i", "5", "11", "1 + 8i");
+  TEST_POWMOD("2", "3i", "5", "-11", "-10 - 3i");
+  TEST_POWMOD("0", "-1i", "3", "4", "i");
+}
+
+TEST(ArithTest, TestPowModHugeExponent)
+{
+  kcalc::ComplexNumber base("3");
+  base.powMod(kcalc::ComplexNumber("1e30"), kcalc::ComplexNumber("1000003"));
+  kcalc::ComplexNumber gaussian = construct("1", "i");
+  gaussian.powMod(kcalc::ComplexNumber("1e30"), kcalc::ComplexNumber("97"));
+  mpz_class expected;
+  mpz_powm(expected.get_mpz_t(), mpz_class(3).get_mpz_t(),
+      mpz_class("1000000000000000000000000000000").get_mpz_t(),
+      mpz_class(1000003).get_mpz_t());
+  ASSERT_STREQ(expected.get_str().c_str(), base.to_string().c_str());
+  // (1+i)^4 = -4, so (1+i)^(10^30) = (-4)^(25 * 10^28) = 4^(25 * 10^28)
+  mpz_class gaussianExpected;
+  mpz_powm(gaussianExpected.get_mpz_t(), mpz_class(4).get_mpz_t(),
+      mpz_class("250000000000000000000000000000").get_mpz_t(),
+      mpz_class(97).get_mpz_t());
+  ASSERT_STREQ(gaussianExpected.get_str().c_str(), gaussian.to_string().c_str());
+}
+
+TEST(ArithTest, TestCanPowMod)
+{
+  kcalc::ComplexNumber integer("3");
+  ASSERT_FALSE(integer.canPowMod(kcalc::ComplexNumber("-1"), kcalc::ComplexNumber("5")));
+  ASSERT_FALSE(integer.canPowMod(kcalc::ComplexNumber("0.5"), kcalc::ComplexNumber("5")));
+  ASSERT_FALSE(integer.canPowMod(kcalc::ComplexNumber("2"), kcalc::ComplexNumber("0")));
+  ASSERT_FALSE(integer.canPowMod(kcalc::ComplexNumber("2"), kcalc::ComplexNumber("5i")));
+  ASSERT_FALSE(integer.canPowMod(kcalc::ComplexNumber("2"), kcalc::ComplexNumber("2.5")));
+  ASSERT_FALSE(kcalc::ComplexNumber("1.5").canPowMod(
+        kcalc::ComplexNumber("2"), kcalc::ComplexNumber("5")));
+  ASSERT_TRUE(integer.canPowMod(kcalc::ComplexNumber("2"), kcalc::ComplexNumber("-5")));
+}
+
+TEST(ArithTest, TestFusedProduct)
+{
+  kcalc::ComplexNumber a = construct("3", "-2i");
+  kcalc::ComplexNumber b = construct("-5", "7i");
+  kcalc::ComplexNumber c = construct("1.5", "0.5i");
+  kcalc::ComplexNumber d = construct("4", "0");
+  kcalc::ComplexNumber sum = a * b + c * d;
+  ASSERT_STREQ("5 + 33i", sum.to_string().c_str());
+  kcalc::ComplexNumber difference = a * b - c * d;
+  ASSERT_STREQ("-7 + 29i", difference.to_string().c_str());
+  kcalc::ComplexNumber accumulator = construct("1", "i");
+  accumulator.addProduct(a, b);
+  accumulator.subProduct(c, d);
+  ASSERT_STREQ("-6 + 30i", accumulator.to_string().c_str());
+  accumulator.addProduct(accumulator, a);
+  ASSERT_STREQ("36 + 132i", accumulator.to_string().c_str());
+  kcalc::ComplexNumber product = a * b * c;
+  ASSERT_STREQ("-17 + 46i", product.to_string().c_str());
+}
+
+TEST(ArithTest, TestRvalueOperators)
+{
+  kcalc::ComplexNumber a = construct("2", "i");
+  kcalc::ComplexNumber result = (a + a) * a - kcalc::ComplexNumber(1) / a;
+  ASSERT_STREQ("28/5 + 41i/5", result.to_string().c_str());
+  kcalc::ComplexNumber power = (a - kcalc::ComplexNumber(1)) ^ kcalc::ComplexNumber(4);
+  ASSERT_STREQ("-4", power.to_string().c_str());
+  kcalc::ComplexNumber modulo = kcalc::ComplexNumber(17) % kcalc::ComplexNumber(5);
+  ASSERT_STREQ("2", modulo.to_string().c_str());
+  kcalc::ComplexNumber assigned(0);
+  assigned = a * a;
+  ASSERT_STREQ("3 + 4i", assigned.to_string().c_str());
+  // the product owns its value, the temporary factor is gone
+  auto doubled = a * kcalc::ComplexNumber(2);
+  ASSERT_STREQ("4 + 2i", doubled.to_string().c_str());
+  ASSERT_STREQ("2 + i", a.to_string().c_str());
+}
+
+TEST(ArithTest, TestScaledNumbers)
+{
+  kcalc::ComplexNumber big("1e10000");
+  kcalc::ComplexNumber tiny("-3e-10000");
+  ASSERT_TRUE(big.isScaled());
+  ASSERT_TRUE(big.isInteger());
+  ASSERT_FALSE(tiny.isInteger());
+  ASSERT_STREQ("-3", kcalc::ComplexNumber(big * tiny).to_string().c_str());
+  ASSERT_STREQ("-1/3", (tiny / big / tiny / tiny).to_string().c_str());
+  ASSERT_TRUE((big ^ kcalc::ComplexNumber(-2)) == 
+      kcalc::ComplexNumber("1e-20000"));
+  ASSERT_TRUE(big + tiny == tiny + big);
+  ASSERT_STREQ("4", (big % kcalc::ComplexNumber(7)).to_string().c_str());
+  kcalc::ComplexNumber floor = tiny;
+  floor.floor();
+  ASSERT_STREQ("-1", floor.to_string().c_str());
+  // a positive scale cancels the denominator of the mantissa
+  kcalc::ComplexNumber half = kcalc::ComplexNumber("1e4096") /
+    kcalc::ComplexNumber(2) / kcalc::ComplexNumber("1e4090");
+  ASSERT_TRUE(half.isInteger());
+  ASSERT_TRUE(half.isGaussianInteger());
+  ASSERT_EQ(500000, *half.toLong());
+  ASSERT_TRUE((half * construct("0", "i")).isGaussianInteger());
+  ASSERT_FALSE((half * construct("0", "i")).isInteger());
+  kcalc::ComplexNumber normalized = half;
+  normalized.normalize();
+  ASSERT_TRUE(normalized.real() == 500000);
+}
+
+TEST(ArithTest, TestDisplayModes)
+{
+  kcalc::ComplexNumber power = kcalc::ComplexNumber(3) ^ 
+    kcalc::ComplexNumber(100000);
+  mpz_class expected;
+  mpz_ui_pow_ui(expected.get_mpz_t(), 3, 100000);
+  std::string digits = expected.get_str();
+  ASSERT_EQ(digits, power.to_string());
+
+  kcalc::DisplayFormat truncated{kcalc::DisplayMode::Truncated, 10};
+  ASSERT_EQ(digits.substr(0, 10) + "..." + 
+      digits.substr(digits.size() - 10) + " (47713 digits)", 
+      power.to_string(truncated));
+  ASSERT_STREQ("-3/4 + 1234567i/8", 
+      construct("-0.75", "154320.875i").to_string(truncated).c_str());
+  kcalc::ComplexNumber nines = kcalc::ComplexNumber("1e50000") - 
+    kcalc::ComplexNumber(1);
+  ASSERT_STREQ("9999999999...9999999999 (50000 digits)",
+      nines.to_string(truncated).c_str());
+  nines += kcalc::ComplexNumber(1);
+  ASSERT_STREQ("1000000000...0000000000 (50001 digits)",
+      nines.to_string(truncated).c_str());
+  ASSERT_STREQ("2500000000...0000000000 (1000001 digits)i",
+      kcalc::ComplexNumber("2.5e1000000i").to_string(truncated).c_str());
+
+  kcalc::DisplayFormat scientific{kcalc::DisplayMode::Scientific, 5};
+  ASSERT_EQ("1.3350e+47712", power.to_string(scientific));
+  ASSERT_STREQ("-2.5000e+1000000 - 1.0000e-7i", 
+      construct("-2.5e1000000", "-1e-7i").to_string(scientific).c_str());
+  ASSERT_STREQ("3.3333e-1i", 
+      (kcalc::ComplexNumber("i") / kcalc::ComplexNumber(3))
+      .to_string(scientific).c_str());
+}
+
+TEST(ArithTest, TestChainSumProduct)
+{
+  std::vector<kcalc::ComplexNumber> terms;
+  terms.push_back(construct("1.5", "2i"));
+  terms.push_back(kcalc::ComplexNumber("1e5000"));
+  terms.push_back(construct("0.3", "-0.25i"));
+  terms.push_back(kcalc::ComplexNumber("-7"));
+  terms.push_back(construct(nullptr, "0.125i"));
+  kcalc::ComplexNumber expected(0);
+  for (const auto& term : terms)
+    expected += term;
+  std::vector<kcalc::ComplexNumber> copy = terms;
+  ASSERT_EQ(expected.to_string(), 
+      kcalc::ComplexNumber::sum(copy).to_string());
+  ASSERT_TRUE(copy.empty());
+
+  expected = kcalc::ComplexNumber(1);
+  for (const auto& term : terms)
+    expected *= term;
+  copy = terms;
+  ASSERT_EQ(expected.to_string(), 
+      kcalc::ComplexNumber::product(copy).to_string());
+  ASSERT_TRUE(copy.empty());
+}
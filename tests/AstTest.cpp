@@ -1,7 +1,12 @@
 #include <gtest/gtest.h>
 
+#include <functional>
+
 #include "Ast.h"
+#include "CostModel.h"
 #include "Exceptions.h"
+#include "SymbolTable.h"
+#include "ThreadPool.h"
 
 TEST(AstTest, SimplePositive)
 {
@@ -128,3 +133,205 @@ TEST(AstTest, Complex4)
   std::string result = num.to_string();
   ASSERT_STREQ("i", result.c_str());
 } 
+
+TEST(AstTest, PowerModuloEval)
+{
+  using namespace kcalc;
+  SymbolTable symbolTable;
+  auto power = std::make_unique<ArithmeticExpression>(
+      ArithmeticExpression::Power, 
+      std::make_unique<Number>("7"),
+      std::make_unique<Number>("1e20"));
+  ArithmeticExpression modulo(ArithmeticExpression::Modulo,
+      std::move(power), std::make_unique<Number>("-13"));
+  std::unique_ptr<Expression> result = modulo.eval(symbolTable);
+  ASSERT_STREQ("-4", result->to_string().c_str());
+} 
+
+TEST(AstTest, PowerModuloEvalFallback)
+{
+  using namespace kcalc;
+  SymbolTable symbolTable;
+  auto power = std::make_unique<ArithmeticExpression>(
+      ArithmeticExpression::Power, 
+      std::make_unique<Number>("1.5"),
+      std::make_unique<Number>("2"));
+  ArithmeticExpression modulo(ArithmeticExpression::Modulo,
+      std::move(power), std::make_unique<Number>("2"));
+  std::unique_ptr<Expression> result = modulo.eval(symbolTable);
+  ASSERT_STREQ("1/4", result->to_string().c_str());
+
+  auto symbolic = std::make_unique<ArithmeticExpression>(
+      ArithmeticExpression::Power, 
+      std::make_unique<Number>("2"),
+      std::make_unique<Number>("3"));
+  ArithmeticExpression modVar(ArithmeticExpression::Modulo,
+      std::move(symbolic), std::make_unique<Variable>("x"));
+  result = modVar.eval(symbolTable);
+  ASSERT_STREQ("8 % x", result->to_string().c_str());
+} 
+
+TEST(AstTest, SymbolTableCopy)
+{
+  using namespace kcalc;
+  SymbolTable symbolTable;
+  symbolTable.insert("x", Number("7"));
+  SymbolTable copy(symbolTable);
+  symbolTable.insert("x", Number("1"));
+  copy.insert("y", Number("2"));
+  ASSERT_STREQ("7", copy.lookup("x")->to_string().c_str());
+  ASSERT_STREQ("1", symbolTable.lookup("x")->to_string().c_str());
+  ASSERT_EQ(nullptr, symbolTable.lookup("y"));
+
+  // a looked up expression outlives its replacement
+  std::shared_ptr<const Expression> seven = copy.lookup("x");
+  copy.insert("x", Number("8"));
+  ASSERT_STREQ("7", seven->to_string().c_str());
+}
+
+TEST(AstTest, LongLiteral)
+{
+  using namespace kcalc;
+  std::string digits;
+  for (int i = 0; i < 5000; ++i)
+    digits.push_back('0' + (i * 7 + i / 13) % 10);
+  std::string number = digits + "." + digits + "000";
+  kcalc::Number num((std::string_view(number)));
+  mpq_class expected(mpz_class(digits + digits, 10));
+  expected /= mpq_class(mpz_class("1" + std::string(5000, '0')));
+  ASSERT_EQ(expected.get_str(), num.to_string());
+}
+
+TEST(AstTest, ScaledLiteral)
+{
+  using namespace kcalc;
+  kcalc::Number big((std::string_view("2.5e1000000")));
+  kcalc::Number small((std::string_view("4e-1000000i")));
+  ASSERT_TRUE(big.number().isScaled());
+  ComplexNumber product = big.number() * small.number();
+  ASSERT_STREQ("10i", product.to_string().c_str());
+  ASSERT_TRUE(big.number() == ComplexNumber("25e999999"));
+  kcalc::Number medium((std::string_view("-1.5e-5000")));
+  ASSERT_EQ("-3/2" + std::string(5000, '0'), medium.to_string());
+}
+
+static std::unique_ptr<kcalc::Expression> binary(
+    kcalc::ArithmeticExpression::Operation operation,
+    std::unique_ptr<kcalc::Expression> left,
+    std::unique_ptr<kcalc::Expression> right)
+{
+  return std::make_unique<kcalc::ArithmeticExpression>(
+      operation, std::move(left), std::move(right));
+}
+
+static std::unique_ptr<kcalc::Expression> power(
+    const char * base, const char * exponent)
+{
+  return binary(kcalc::ArithmeticExpression::Power,
+      std::make_unique<kcalc::Number>(base),
+      std::make_unique<kcalc::Number>(exponent));
+}
+
+TEST(AstTest, CostEstimate)
+{
+  using namespace kcalc;
+  SymbolTable symbolTable;
+  symbolTable.insert("x", *power("3", "1000000"));
+  CostEstimate small = CostModel::estimate(*power("3", "10"), symbolTable);
+  CostEstimate big = CostModel::estimate(Variable("x"), symbolTable);
+  ASSERT_LT(small.cost, 1e3);
+  ASSERT_GT(big.cost, 1e5);
+  ASSERT_NEAR(1584963, big.bits, 1584963 / 2);
+  CostEstimate unknown = CostModel::estimate(Variable("y"), symbolTable);
+  ASSERT_EQ(0, unknown.cost);
+
+  std::unique_ptr<Expression> sum = binary(ArithmeticExpression::Add,
+      power("3", "10"), std::make_unique<Variable>("x"));
+  SubtreeCosts subtrees;
+  CostEstimate total = CostModel::estimate(*sum, symbolTable, subtrees);
+  auto& add = static_cast<const ArithmeticExpression&>(*sum);
+  ASSERT_EQ(5u, subtrees.size());
+  ASSERT_EQ(total.cost, subtrees.at(sum.get()));
+  ASSERT_LT(subtrees.at(&add.left()), 1e3);
+  ASSERT_EQ(big.cost, subtrees.at(&add.right()));
+}
+
+TEST(AstTest, ParallelEval)
+{
+  using namespace kcalc;
+  SymbolTable symbolTable;
+  std::unique_ptr<Expression> expression = binary(
+      ArithmeticExpression::Multiply,
+      binary(ArithmeticExpression::Add, power("3", "300000"),
+        std::make_unique<Number>("1")),
+      binary(ArithmeticExpression::Subtract, power("7", "200000"),
+        power("5", "250000")));
+  ThreadPool::instance().resize(0);
+  std::string sequential = expression->eval(symbolTable)->to_string();
+  ThreadPool::instance().resize(3);
+  std::string parallel = expression->eval(symbolTable)->to_string();
+  ASSERT_EQ(sequential, parallel);
+
+  // both operands fail, the left exception is reported as it would be
+  // without tasks
+  std::unique_ptr<Expression> failing = binary(
+      ArithmeticExpression::Add,
+      binary(ArithmeticExpression::Divide, power("3", "300000"),
+        std::make_unique<Number>("0")),
+      binary(ArithmeticExpression::Power, power("7", "300000"),
+        std::make_unique<Number>("0.5")));
+  for (int i = 0; i < 5; ++i)
+    ASSERT_THROW(failing->eval(symbolTable), DivisionByZeroException);
+  ThreadPool::instance().resize(0);
+}
+
+static std::unique_ptr<kcalc::Expression> chain(
+    kcalc::ArithmeticExpression::Operation operation, unsigned int count,
+    std::function<std::unique_ptr<kcalc::Expression> (unsigned int)> operand)
+{
+  std::unique_ptr<kcalc::Expression> result = operand(1);
+  for (unsigned int i = 2; i <= count; ++i)
+    result = binary(operation, std::move(result), operand(i));
+  return result;
+}
+
+TEST(AstTest, ChainEval)
+{
+  using namespace kcalc;
+  SymbolTable symbolTable;
+  auto integer = [](unsigned int i) { 
+    return std::make_unique<Number>(std::to_string(i).c_str()); };
+  mpz_class factorial;
+  mpz_fac_ui(factorial.get_mpz_t(), 2000);
+  ASSERT_EQ(factorial.get_str(), chain(ArithmeticExpression::Multiply, 
+        2000, integer)->eval(symbolTable)->to_string());
+
+  mpq_class harmonic;
+  for (unsigned int i = 1; i <= 500; ++i)
+    harmonic += mpq_class(1, i);
+  auto reciprocal = [](unsigned int i) { 
+    return binary(ArithmeticExpression::Divide, 
+        std::make_unique<Number>("1"), 
+        std::make_unique<Number>(std::to_string(i).c_str())); };
+  ASSERT_EQ(harmonic.get_str(), chain(ArithmeticExpression::Add, 
+        500, reciprocal)->eval(symbolTable)->to_string());
+  ASSERT_EQ("-526", chain(ArithmeticExpression::Subtract, 
+        32, integer)->eval(symbolTable)->to_string());
+
+  // symbolic operands keep the shape the binary nodes produce
+  symbolTable.insert("x", Number("2"));
+  auto mixed = [&integer](unsigned int i) -> std::unique_ptr<Expression> {
+    if (i == 3) 
+      return std::make_unique<Variable>("y");
+    return integer(i); };
+  auto expected = [&]() {
+    std::unique_ptr<Expression> left = binary(ArithmeticExpression::Add,
+        integer(1), integer(2));
+    left = binary(ArithmeticExpression::Add, std::move(left), 
+        std::make_unique<Variable>("y"));
+    for (unsigned int i = 4; i <= 6; ++i)
+      left = binary(ArithmeticExpression::Add, std::move(left), integer(i));
+    return left->eval(symbolTable)->to_string(); };
+  ASSERT_EQ(expected(), chain(ArithmeticExpression::Add, 6, mixed)
+      ->eval(symbolTable)->to_string());
+}
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "Ball.h"
+#include "Exceptions.h"
+
+// the exact value lies within the ball
+static bool contains(const kcalc::Ball& ball, const mpq_class& value)
+{ return (ball - kcalc::Ball(value, 4096)).sign() == 0; }
+
+TEST(BallTest, Exact)
+{
+  kcalc::Ball three(3, 64);
+  ASSERT_TRUE(three.isExact());
+  ASSERT_TRUE(three == 3);
+  ASSERT_EQ(3, *three.toLong());
+  ASSERT_EQ("3.000e+0", three.to_string(4));
+  ASSERT_EQ("-7.5e-1", kcalc::Ball(mpq_class(-3, 4), 64).to_string(2));
+  ASSERT_EQ("0", (three - three).to_string(4));
+  ASSERT_EQ("1.0e+3", kcalc::Ball::powerOfTen(3, 64).to_string(2));
+  ASSERT_TRUE((three * three) == 9);
+  ASSERT_TRUE(floor(kcalc::Ball(mpq_class(-7, 2), 64)) == -4);
+}
+
+TEST(BallTest, Rounding)
+{
+  kcalc::Ball third(mpq_class(1, 3), 64);
+  ASSERT_FALSE(third.isExact());
+  ASSERT_EQ("3.33333333333333333e-1", third.to_string(19));
+  ASSERT_EQ(1, third.sign());
+  // 3 * (1/3) - 1 is zero up to the rounding error
+  kcalc::Ball zero = third * kcalc::Ball(3, 64) - kcalc::Ball(1, 64);
+  ASSERT_EQ(0, zero.sign());
+  ASSERT_EQ(0u, zero.correctDigits(19));
+  ASSERT_EQ("[+/- 2.17e-19]", zero.to_string(19));
+  ASSERT_THROW(kcalc::Ball(1, 64) / zero, kcalc::PrecisionLossException);
+  ASSERT_THROW(floor(zero), kcalc::PrecisionLossException);
+  ASSERT_THROW(kcalc::Ball(1, 64) / kcalc::Ball(0, 64),
+      kcalc::DivisionByZeroException);
+  // 9.5 - 10^-30 rounds to 9 but the ball reaches beyond 9.5
+  kcalc::Ball half = kcalc::Ball(mpq_class(19, 2), 64) -
+    kcalc::Ball::powerOfTen(-30, 64);
+  ASSERT_EQ(0u, half.correctDigits(1));
+  ASSERT_EQ("9.5e+0", half.to_string(2));
+}
+
+TEST(BallTest, ContainsExactValue)
+{
+  std::mt19937 random(44);
+  std::uniform_int_distribution<long> values(-100000, 100000);
+  for (int i = 0; i < 200; ++i)
+  {
+    mpq_class exact(values(random), values(random) | 1);
+    exact.canonicalize();
+    kcalc::Ball ball(exact, 53);
+    // a chain of divisions and products without rational growth
+    for (int j = 0; j < 20; ++j)
+    {
+      mpq_class operand(values(random) | 1, (values(random) & 0xfff) + 1);
+      operand.canonicalize();
+      kcalc::Ball other(operand, 53);
+      switch (j % 4)
+      {
+        case 0:
+          exact /= operand;
+          ball = ball / other;
+          break;
+        case 1:
+          exact *= operand;
+          ball = ball * other;
+          break;
+        case 2:
+          exact += operand;
+          ball = ball + other;
+          break;
+        default:
+          exact -= operand;
+          ball = ball - other;
+          break;
+      }
+      ASSERT_TRUE(contains(ball, exact)) << i << " " << j;
+    }
+    ASSERT_GE(ball.correctDigits(15), 8u) << ball.to_string(15);
+  }
+}
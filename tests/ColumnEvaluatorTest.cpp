@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <complex>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "ColumnEvaluator.h"
+#include "ColumnKernels.h"
+#include "Exceptions.h"
+#include "PreparedExpression.h"
+
+static bool near(std::complex<double> actual, std::complex<double> expected)
+{
+  return std::abs(actual - expected) <= 1e-9 * (1 + std::abs(expected));
+}
+
+TEST(ColumnEvaluatorTest, Kernels)
+{
+  const kcalc::ColumnKernels& scalar = kcalc::ColumnKernels::scalar();
+  const kcalc::ColumnKernels& best = kcalc::ColumnKernels::best();
+  std::mt19937 random(41);
+  std::uniform_real_distribution<double> values(-100, 100);
+  const std::size_t n = 1027;
+  std::vector<double> a(n), b(n), c(n), d(n);
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    a[i] = values(random);
+    b[i] = values(random);
+    c[i] = values(random);
+    d[i] = values(random);
+  }
+  std::vector<double> expected(n), actual(n);
+  std::vector<double> expectedImag(n), actualImag(n);
+  for (auto kernel : { &kcalc::ColumnKernels::add,
+      &kcalc::ColumnKernels::subtract, &kcalc::ColumnKernels::multiply,
+      &kcalc::ColumnKernels::divide })
+  {
+    (scalar.*kernel)(a.data(), b.data(), expected.data(), n);
+    (best.*kernel)(a.data(), b.data(), actual.data(), n);
+    ASSERT_EQ(expected, actual);
+  }
+  scalar.negate(a.data(), expected.data(), n);
+  best.negate(a.data(), actual.data(), n);
+  ASSERT_EQ(expected, actual);
+  for (auto kernel : { &kcalc::ColumnKernels::complexMultiply,
+      &kcalc::ColumnKernels::complexDivide })
+  {
+    (scalar.*kernel)(a.data(), b.data(), c.data(), d.data(),
+        expected.data(), expectedImag.data(), n);
+    // in place on the first operand
+    actual = a;
+    actualImag = b;
+    (best.*kernel)(actual.data(), actualImag.data(), c.data(), d.data(),
+        actual.data(), actualImag.data(), n);
+    ASSERT_EQ(expected, actual);
+    ASSERT_EQ(expectedImag, actualImag);
+  }
+}
+
+TEST(ColumnEvaluatorTest, ComplexDivideScales)
+{
+  // divisors whose squared magnitude overflows or underflows
+  std::vector<double> aReal = { 1, 1e160, 3, -2, 1, 1e-300, 5, 1e300 };
+  std::vector<double> aImag = { 0, 1e160, 4, 7, 1, 1e-300, -5, 1e300 };
+  std::vector<double> bReal = { 0, 1e160, 1e-200, 1e200, 2, 1e-300, 0, 0 };
+  std::vector<double> bImag = { 1e-200, 1e160, 1e-200, -1e200, 0, 1e-300,
+    1e300, 1e300 };
+  const std::size_t n = aReal.size();
+  for (const kcalc::ColumnKernels * kernels :
+      { &kcalc::ColumnKernels::scalar(), &kcalc::ColumnKernels::best() })
+  {
+    std::vector<double> real(n), imag(n);
+    kernels->complexDivide(aReal.data(), aImag.data(), bReal.data(),
+        bImag.data(), real.data(), imag.data(), n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      std::complex<double> expected = std::complex<double>(aReal[i], aImag[i])
+        / std::complex<double>(bReal[i], bImag[i]);
+      ASSERT_TRUE(near({ real[i], imag[i] }, expected)) << i;
+    }
+  }
+}
+
+TEST(ColumnEvaluatorTest, ExactMatchesPrepared)
+{
+  std::vector<kcalc::ComplexNumber> x, y;
+  for (long i = 0; i < 300; ++i)
+  {
+    x.emplace_back(i - 150, i % 7 == 0 ? i : 0);
+    y.emplace_back(i % 11 + 1);
+  }
+  kcalc::ThreadPool pool(3);
+  for (const char * text : { "x^3 - 2*x*y + y/3", "(x + 2i) * y % 5",
+      "-(x - y - 0.5)^-2 + y^y", "x", "6 * 7" })
+  {
+    kcalc::ColumnEvaluator evaluator(text);
+    kcalc::PreparedExpression prepared =
+      kcalc::PreparedExpression::prepare(text);
+    ASSERT_EQ(prepared.variables(), evaluator.variables());
+    std::vector<const kcalc::ComplexNumber *> columns;
+    for (const std::string& name : evaluator.variables())
+      columns.push_back(name == "x" ? x.data() : y.data());
+    std::vector<kcalc::ComplexNumber> values =
+      evaluator.evaluate(columns, x.size(), pool);
+    ASSERT_EQ(x.size(), values.size());
+    for (std::size_t i = 0; i < x.size(); ++i)
+    {
+      for (const std::string& name : prepared.variables())
+        prepared.bind(name, name == "x" ? x[i] : y[i]);
+      ASSERT_TRUE(prepared.execute() == values[i]) << text << " row " << i;
+    }
+  }
+}
+
+TEST(ColumnEvaluatorTest, LargeProducts)
+{
+  // the products fork inside the block tasks, blocks waiting for them
+  // run tasks of other blocks
+  kcalc::ComplexNumber a = 
+    kcalc::PreparedExpression::prepare("3^800000").execute();
+  kcalc::ComplexNumber b = 
+    kcalc::PreparedExpression::prepare("7^500000").execute();
+  std::vector<kcalc::ComplexNumber> x, y;
+  for (long i = 0; i < 48; ++i)
+  {
+    x.push_back(a + kcalc::ComplexNumber(i));
+    y.push_back(b - kcalc::ComplexNumber(i));
+  }
+  kcalc::ThreadPool& pool = kcalc::ThreadPool::instance();
+  unsigned int workers = pool.workers();
+  pool.resize(3);
+  kcalc::ColumnEvaluator evaluator("x * y");
+  std::vector<kcalc::ComplexNumber> values =
+    evaluator.evaluate({ x.data(), y.data() }, x.size(), pool);
+  pool.resize(workers);
+  for (std::size_t i = 0; i < x.size(); ++i)
+    ASSERT_TRUE(x[i] * y[i] == values[i]) << "row " << i;
+}
+
+TEST(ColumnEvaluatorTest, ApproximateMatchesExact)
+{
+  std::mt19937 random(7);
+  std::uniform_int_distribution<long> values(-1000, 1000);
+  const std::size_t rows = 2500;
+  std::vector<kcalc::ComplexNumber> exactX, exactY;
+  std::vector<std::complex<double>> x, y;
+  std::vector<double> realX, realY;
+  for (std::size_t i = 0; i < rows; ++i)
+  {
+    long a = values(random) | 1, b = values(random) | 1;
+    long c = i < 1500 ? 0 : values(random);
+    exactX.emplace_back(a, c);
+    exactY.emplace_back(b);
+    x.emplace_back(a, c);
+    y.emplace_back(b);
+    realX.push_back(a);
+    realY.push_back(b);
+  }
+  for (const char * text : { "x^3 - 2*x*y + y/3", "(x - y) / (x*y + 1i)",
+      "-x^-2 * 1.5", "x % y", "x^2 - y^2" })
+  {
+    kcalc::ColumnEvaluator evaluator(text);
+    std::vector<const kcalc::ComplexNumber *> exactColumns;
+    std::vector<const std::complex<double> *> complexColumns;
+    std::vector<const double *> realColumns;
+    for (const std::string& name : evaluator.variables())
+    {
+      bool isX = name == "x";
+      exactColumns.push_back(isX ? exactX.data() : exactY.data());
+      complexColumns.push_back(isX ? x.data() : y.data());
+      realColumns.push_back(isX ? realX.data() : realY.data());
+    }
+    std::vector<kcalc::ComplexNumber> exact =
+      evaluator.evaluate(exactColumns, rows);
+    std::vector<std::complex<double>> approximate =
+      evaluator.approximateComplex(complexColumns, rows);
+    std::vector<std::complex<double>> real =
+      evaluator.approximate(realColumns, rows);
+    for (std::size_t i = 0; i < rows; ++i)
+    {
+      ASSERT_TRUE(near(approximate[i], exact[i].approximate()))
+        << text << " row " << i;
+      if (i < 1500)
+      {
+        ASSERT_TRUE(near(real[i], exact[i].approximate()))
+          << text << " row " << i;
+      }
+    }
+  }
+}
+
+TEST(ColumnEvaluatorTest, Errors)
+{
+  ASSERT_THROW(kcalc::ColumnEvaluator("x = 1"),
+      kcalc::PreparedAssignmentException);
+  kcalc::ColumnEvaluator ratio("a / b");
+  std::vector<kcalc::ComplexNumber> a(100, kcalc::ComplexNumber(1));
+  std::vector<kcalc::ComplexNumber> b(100, kcalc::ComplexNumber(2));
+  b[57] = kcalc::ComplexNumber(0);
+  ASSERT_THROW(ratio.evaluate({ a.data(), b.data() }, a.size()),
+      kcalc::DivisionByZeroException);
+  ASSERT_THROW(ratio.evaluate({ a.data() }, a.size()),
+      std::invalid_argument);
+  std::vector<double> one(4, 1.0), zero(4, 0.0);
+  std::vector<std::complex<double>> values =
+    ratio.approximate({ one.data(), zero.data() }, 4);
+  ASSERT_TRUE(std::isinf(values[3].real()));
+  ASSERT_TRUE(ratio.approximate(std::vector<const double *>(2), 0).empty());
+}
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CsvMap.h"
+#include "Exceptions.h"
+
+static std::string map(const char * expression, const std::string& input,
+    std::vector<unsigned long>& errors,
+    kcalc::CsvMap::Options options = kcalc::CsvMap::Options(),
+    kcalc::ThreadPool& pool = kcalc::ThreadPool::instance())
+{
+  errors.clear();
+  std::ostringstream out;
+  kcalc::CsvMap map(expression, options);
+  unsigned long failed = map.run(input, out,
+      [&errors](unsigned long line, const std::string&) {
+        errors.push_back(line); }, pool);
+  EXPECT_EQ(errors.size(), failed);
+  return out.str();
+}
+
+TEST(CsvMapTest, Text)
+{
+  std::vector<unsigned long> errors;
+  ASSERT_EQ("3\n13\n1 - 3i\n", map("x*y + 1",
+        "x, name ,y\n1,a,2\n3,\"b, c\",4\r\n\n-1.5,\"c\",2i\n", errors));
+  ASSERT_TRUE(errors.empty());
+  ASSERT_EQ("42\n42\n", map("6 * 7", "a\n1\n2\n", errors));
+
+  kcalc::CsvMap::Options options;
+  options.approximate = true;
+  ASSERT_EQ("1.125\n1.5\n-0.5i\n\n", map("x^2 / y",
+        "y,x\n2,1.5\n-1.5,1.5i\n2i,1\n1,0.5 + 0.5i\n", errors, options));
+  ASSERT_EQ((std::vector<unsigned long>{ 5 }), errors);
+  ASSERT_EQ("0.5 - 0.25i\n", map("x - 0.25i", "x\n0.5\n", errors, 
+        options));
+  // out of range fields overflow and underflow like strtod
+  ASSERT_EQ("inf\n-inf\n0\n-infi\n", map("x*2",
+        "x\n1e400\n-1e400\n1e-400\n-1e400i\n", errors, options));
+  ASSERT_TRUE(errors.empty());
+}
+
+TEST(CsvMapTest, Errors)
+{
+  std::vector<unsigned long> errors;
+  ASSERT_EQ("\n\n\n2\n", map("x / y", "x,y\n1,0\n2,abc\n3\n4,2\n",
+        errors));
+  ASSERT_EQ((std::vector<unsigned long>{ 2, 3, 4 }), errors);
+  ASSERT_THROW(map("x + z", "x,y\n1,2\n", errors),
+      kcalc::UnboundVariableException);
+  ASSERT_THROW(map("x +", "x\n1\n", errors), kcalc::ParseError);
+}
+
+TEST(CsvMapTest, Raw)
+{
+  std::vector<unsigned long> errors;
+  kcalc::CsvMap::Options options;
+  options.output = kcalc::CsvMap::Output::Raw;
+  std::string raw = map("x/3 - y*1i", "x,y\n2,123456789012345678901\n"
+      "-6,0\nfoo,1\n", errors, options);
+  FILE * file = fmemopen(raw.data(), raw.size(), "rb");
+  ASSERT_TRUE(file != nullptr);
+  std::vector<std::string> values;
+  mpz_class value;
+  while (mpz_inp_raw(value.get_mpz_t(), file) != 0)
+    values.push_back(value.get_str());
+  std::fclose(file);
+  ASSERT_EQ((std::vector<std::string>{ "2", "3", "-123456789012345678901",
+        "1", "-2", "1", "0", "1", "0", "0", "0", "0" }), values);
+}
+
+TEST(CsvMapTest, Chunks)
+{
+  std::string input = "a,b\n";
+  std::string expected;
+  for (long i = 0; i < 30000; ++i)
+  {
+    input += std::to_string(i) + "," + std::to_string(i + 1) + "\n";
+    expected += std::to_string(i * (i + 1) - i) + "\n";
+  }
+  kcalc::ThreadPool pool(3);
+  std::vector<unsigned long> errors;
+  // large outputs are compared without a diff
+  ASSERT_TRUE(expected == map("a*b - a", input, errors,
+        kcalc::CsvMap::Options(), pool));
+  ASSERT_TRUE(errors.empty());
+  // doubles are written in their shortest form, like 1e+08
+  kcalc::CsvMap::Options options;
+  options.approximate = true;
+  std::istringstream values(map("a*b - a", input, errors, options, pool));
+  std::string value;
+  long row = 0;
+  for (; std::getline(values, value); ++row)
+    ASSERT_EQ(double(row * row), std::stod(value));
+  ASSERT_EQ(30000, row);
+  ASSERT_TRUE(errors.empty());
+}
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include <climits>
+#include <random>
+
+#include "Exceptions.h"
+#include "FixedPoint.h"
+
+TEST(FixedPointTest, Exact)
+{
+  kcalc::FixedPoint a(mpq_class(-1, 2), 0, 2);
+  ASSERT_EQ("-0.50", a.to_string());
+  ASSERT_EQ("12.34", kcalc::FixedPoint(1234, -2, 2).to_string());
+  ASSERT_EQ("7", kcalc::FixedPoint(7, 0).to_string());
+  ASSERT_EQ("0.000", kcalc::FixedPoint(0, 3).to_string());
+  kcalc::FixedPoint three(3, 2);
+  ASSERT_TRUE(three == 3);
+  ASSERT_TRUE(three.isInteger());
+  ASSERT_EQ(3, *three.toLong());
+  ASSERT_FALSE(a.isInteger());
+  ASSERT_EQ(-1, a.sign());
+  ASSERT_EQ("2.50", (three + a).to_string());
+  ASSERT_EQ("3.50", (three - a).to_string());
+  ASSERT_EQ("-1.50", (three * a).to_string());
+  ASSERT_EQ("-6.00", (three / a).to_string());
+  // remainders have the sign of the divisor
+  ASSERT_EQ("0.50", (-three % kcalc::FixedPoint(7, -1, 2)).to_string());
+  ASSERT_EQ("-0.20", (three % kcalc::FixedPoint(-4, -1, 2)).to_string());
+  ASSERT_THROW(three / kcalc::FixedPoint(0, 2),
+      kcalc::DivisionByZeroException);
+  ASSERT_THROW(three % kcalc::FixedPoint(0, 2),
+      kcalc::DivisionByZeroException);
+}
+
+TEST(FixedPointTest, Rounding)
+{
+  // half to even, in both directions
+  ASSERT_EQ("0.12", kcalc::FixedPoint(125, -3, 2).to_string());
+  ASSERT_EQ("0.14", kcalc::FixedPoint(135, -3, 2).to_string());
+  ASSERT_EQ("-0.12", kcalc::FixedPoint(-125, -3, 2).to_string());
+  ASSERT_EQ("0.13", kcalc::FixedPoint(mpq_class(1251, 10000), 0, 2)
+      .to_string());
+  kcalc::FixedPoint third = kcalc::FixedPoint(1, 4) / 
+    kcalc::FixedPoint(3, 4);
+  ASSERT_EQ("0.3333", third.to_string());
+  ASSERT_EQ("0.1111", (third * third).to_string());
+  ASSERT_EQ("0.9999", (third * kcalc::FixedPoint(3, 4)).to_string());
+  auto [real, imag] = kcalc::FixedPoint::divide(kcalc::FixedPoint(1, 2),
+      kcalc::FixedPoint(-1, 2), kcalc::FixedPoint(7, 2), 
+      kcalc::FixedPoint(0, 2));
+  ASSERT_EQ("0.14", real.to_string());
+  ASSERT_EQ("-0.14", imag.to_string());
+}
+
+// the word and mpz representations agree around the limits of a word
+TEST(FixedPointTest, LargeValues)
+{
+  kcalc::FixedPoint max(mpq_class(LONG_MAX), -2, 2);
+  kcalc::FixedPoint one(1, -2, 2);
+  ASSERT_EQ("92233720368547758.07", max.to_string());
+  ASSERT_EQ("92233720368547758.08", (max + one).to_string());
+  ASSERT_EQ("92233720368547758.07", (max + one - one).to_string());
+  ASSERT_EQ("-92233720368547758.08", (-(max + one)).to_string());
+  ASSERT_EQ("184467440737095516.14", (max * kcalc::FixedPoint(2, 2))
+      .to_string());
+  ASSERT_EQ("0.00", ((max + one) % kcalc::FixedPoint(mpq_class(-1, 100),
+          0, 2)).to_string());
+  ASSERT_EQ("1" + std::string(40, '0') + ".0",
+      kcalc::FixedPoint(mpq_class(1), 40, 1).to_string());
+  std::mt19937 random(45);
+  std::uniform_int_distribution<long> values(LONG_MIN / 4, LONG_MAX / 4);
+  for (int i = 0; i < 1000; ++i)
+  {
+    long x = values(random), y = values(random) | 1;
+    mpq_class a(x, 1000), b(y, 1000);
+    kcalc::FixedPoint fa(a, 0, 3), fb(b, 0, 3);
+    ASSERT_EQ(kcalc::FixedPoint(mpq_class(a + b), 0, 3).to_string(),
+        (fa + fb).to_string());
+    ASSERT_EQ(kcalc::FixedPoint(mpq_class(a * b), 0, 3).to_string(),
+        (fa * fb).to_string());
+    ASSERT_EQ(kcalc::FixedPoint(mpq_class(a / b), 0, 3).to_string(),
+        (fa / fb).to_string());
+  }
+}
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "Allocator.h"
+#include "Ast.h"
+#include "CostModel.h"
+#include "Exceptions.h"
+#include "Job.h"
+#include "SymbolTable.h"
+
+static std::unique_ptr<kcalc::Expression> binary(
+    kcalc::ArithmeticExpression::Operation operation,
+    std::unique_ptr<kcalc::Expression> left,
+    std::unique_ptr<kcalc::Expression> right)
+{
+  return std::make_unique<kcalc::ArithmeticExpression>(
+      operation, std::move(left), std::move(right));
+}
+
+// evaluates expression with a budget cancelled by the job
+static kcalc::Job::Evaluation evaluation(
+    std::shared_ptr<const kcalc::Expression> expression)
+{
+  return [expression](kcalc::SymbolTable& symbolTable, 
+      const std::atomic<bool>& cancelled) {
+    kcalc::Budget limits;
+    limits.cancelled = &cancelled;
+    kcalc::StatementBudget budget(limits);
+    return expression->eval(symbolTable); };
+}
+
+static void waitFor(const kcalc::Job& job)
+{
+  while (!job.done())
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+TEST(JobTest, Completion)
+{
+  using namespace kcalc;
+  SymbolTable symbolTable;
+  symbolTable.insert("x", Number("5"));
+  Job job(symbolTable, std::nullopt, evaluation(binary(
+          ArithmeticExpression::Multiply, std::make_unique<Variable>("x"),
+          std::make_unique<Number>("2"))));
+  // later statements do not disturb the job
+  symbolTable.insert("x", Number("7"));
+  waitFor(job);
+  std::unique_ptr<Expression> value = job.commit(symbolTable);
+  ASSERT_EQ("10", value->to_string());
+  ASSERT_EQ("7", symbolTable.lookup("x")->to_string());
+
+  Job assignment(symbolTable, std::string("y"), evaluation(binary(
+          ArithmeticExpression::Add, std::make_unique<Variable>("x"),
+          std::make_unique<Number>("1"))));
+  waitFor(assignment);
+  ASSERT_EQ(nullptr, symbolTable.lookup("y"));
+  ASSERT_EQ("8", assignment.commit(symbolTable)->to_string());
+  ASSERT_EQ("8", symbolTable.lookup("y")->to_string());
+}
+
+TEST(JobTest, Cancel)
+{
+  using namespace kcalc;
+  SymbolTable symbolTable;
+  symbolTable.insert("y", Number("1"));
+  Job job(symbolTable, std::string("y"), evaluation(binary(
+          ArithmeticExpression::Power, std::make_unique<Number>("3"),
+          std::make_unique<Number>("1000000000"))));
+  job.cancel();
+  waitFor(job);
+  ASSERT_THROW(job.commit(symbolTable), CancelledException);
+  ASSERT_EQ("1", symbolTable.lookup("y")->to_string());
+}
+
+TEST(JobTest, CommitWhileReading)
+{
+  // assignments of jobs are committed while a statement reads the
+  // variable on another thread
+  using namespace kcalc;
+  SymbolTable symbolTable;
+  symbolTable.insert("y", Number("0"));
+  std::atomic<bool> stop{false};
+  std::thread reader([&]() {
+      Variable y("y");
+      while (!stop)
+      {
+        std::shared_ptr<const Expression> value = symbolTable.lookup("y");
+        ASSERT_FALSE(value->to_string().empty());
+        CostModel::estimate(y, symbolTable);
+      } });
+  for (unsigned int i = 1; i <= 50; ++i)
+  {
+    Job job(symbolTable, std::string("y"), evaluation(binary(
+            ArithmeticExpression::Power, std::make_unique<Number>("3"),
+            std::make_unique<Number>(std::to_string(1000 + i)))));
+    waitFor(job);
+    job.commit(symbolTable);
+  }
+  stop = true;
+  reader.join();
+  ASSERT_TRUE((ComplexNumber(3) ^ ComplexNumber(1050)) == 
+      static_cast<const Number&>(*symbolTable.lookup("y")).number());
+}
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "Exceptions.h"
+#include "Lexer.h"
+#include "MultiModular.h"
+#include "Parser.h"
+#include "SemanticAnalyzer.h"
+#include "SymbolTable.h"
+
+// runs the assignments of a script; the last statement is evaluated
+// by residues and, if that works, exactly as well
+static std::optional<std::string> multiModular(const std::string& script,
+    std::string* exact = nullptr)
+{
+  kcalc::SymbolTable symbolTable;
+  kcalc::SemanticAnalyzer analyzer(symbolTable);
+  std::string_view rest = script;
+  while (true)
+  {
+    std::size_t end = std::min(rest.find(';'), rest.size());
+    kcalc::Lexer lexer(rest.substr(0, end));
+    kcalc::Parser parser(lexer);
+    std::unique_ptr<kcalc::AstObject> statement = parser.parse();
+    if (end == rest.size())
+    {
+      auto& expression = static_cast<const kcalc::Expression&>(*statement);
+      std::optional<kcalc::ComplexNumber> value = 
+        kcalc::MultiModular::evaluate(expression, symbolTable);
+      if (!value)
+        return std::nullopt;
+      if (exact)
+        *exact = expression.eval(symbolTable)->to_string();
+      return kcalc::Number(*value).to_string();
+    }
+    statement->accept(analyzer);
+    rest.remove_prefix(end + 1);
+  }
+}
+
+TEST(MultiModularTest, MatchesExact)
+{
+  std::string harmonic = "0";
+  for (int k = 1; k <= 200; ++k)
+    harmonic += " + 1/" + std::to_string(k);
+  std::string product = "1";
+  for (int k = 1; k <= 100; ++k)
+    product += " * (" + std::to_string(k) + " - 1/" + 
+      std::to_string(k + 1) + "i)";
+  for (const std::string& script : { std::string("2^100 - 3^70"),
+      std::string("-(7/3)^-5 * 0.25"), std::string("(3 + 4i)^40 / (1 - 2i)^30"),
+      std::string("1e40 / 3 - 1e-5"), std::string("x = 2/3; y = x*x - 1; y^7 / x"),
+      std::string("5 - 5"), harmonic, product })
+  {
+    std::string exact;
+    std::optional<std::string> value = multiModular(script, &exact);
+    ASSERT_TRUE(value) << script;
+    ASSERT_EQ(exact, *value) << script;
+  }
+}
+
+TEST(MultiModularTest, NotApplicable)
+{
+  // exact evaluation gives the value or the error
+  ASSERT_FALSE(multiModular("7 % 4"));
+  ASSERT_FALSE(multiModular("4^(1/2)"));
+  ASSERT_FALSE(multiModular("x + 1"));
+  ASSERT_FALSE(multiModular("1/(2 - 2)"));
+  ASSERT_FALSE(multiModular("0^-1"));
+  ASSERT_FALSE(multiModular("2^(10^30)"));
+  ASSERT_FALSE(multiModular("2^(1e5000)"));
+  ASSERT_FALSE(multiModular("2^(-1e5000)"));
+  // the scale of an exponent applies
+  ASSERT_EQ("1024", *multiModular("2^(1e1)"));
+  ASSERT_EQ("8", *multiModular("2^((1e4096/2)/1e4090 - 499997)"));
+  // exponents themselves may have remainders
+  ASSERT_EQ("8", *multiModular("2^(7 % 4)"));
+}
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include "Arithmetic.h"
+#include "Multiplication.h"
+#include "ThreadPool.h"
+
+static mpz_class randomNumber(gmp_randclass& random, mp_bitcnt_t bits)
+{ return random.get_z_bits(bits); }
+
+TEST(MultiplicationTest, MatchesMpzMul)
+{
+  kcalc::ThreadPool pool(3);
+  gmp_randclass random(gmp_randinit_default);
+  random.seed(42);
+  const mp_bitcnt_t limb = GMP_NUMB_BITS;
+  std::pair<mp_bitcnt_t, mp_bitcnt_t> sizes[] = {
+    { 100 * limb, 100 * limb },
+    { 40000 * limb, 40000 * limb },
+    { 70001 * limb, 33000 * limb },
+    { 20000 * limb, 90000 * limb },
+    { 150000 * limb, 17000 * limb }
+  };
+  for (auto [bitsA, bitsB] : sizes)
+  {
+    mpz_class a = randomNumber(random, bitsA);
+    mpz_class b = -randomNumber(random, bitsB);
+    mpz_class expected = a * b;
+    for (unsigned int threads : { 1u, 2u, 4u, 9u })
+    {
+      mpz_class product;
+      kcalc::Multiplication::multiply(product.get_mpz_t(), 
+          a.get_mpz_t(), b.get_mpz_t(), pool, threads);
+      ASSERT_TRUE(expected == product);
+      kcalc::Multiplication::multiply(product.get_mpz_t(), 
+          b.get_mpz_t(), b.get_mpz_t(), pool, threads);
+      ASSERT_TRUE(b * b == product);
+      product = a;
+      kcalc::Multiplication::multiply(product.get_mpz_t(), 
+          product.get_mpz_t(), b.get_mpz_t(), pool, threads);
+      ASSERT_TRUE(expected == product);
+    }
+  }
+}
+
+TEST(MultiplicationTest, Settings)
+{
+  kcalc::Multiplication::setThreads(4);
+  ASSERT_EQ(4u, kcalc::Multiplication::threads());
+  mpz_class big = mpz_class(1) << (20000 * GMP_NUMB_BITS);
+  ASSERT_TRUE(kcalc::Multiplication::worthParallel(
+        big.get_mpz_t(), big.get_mpz_t()));
+  kcalc::Multiplication::setParallel(false);
+  ASSERT_FALSE(kcalc::Multiplication::worthParallel(
+        big.get_mpz_t(), big.get_mpz_t()));
+  kcalc::Multiplication::setParallel(true);
+  kcalc::Multiplication::setThreads(0);
+}
+
+TEST(MultiplicationTest, GaussianPower)
+{
+  kcalc::Multiplication::setThreads(4);
+  kcalc::ComplexNumber base = kcalc::ComplexNumber("12345678901") + 
+    kcalc::ComplexNumber("98765432109i");
+  kcalc::ComplexNumber exponent(40000);
+  kcalc::ComplexNumber parallel = base ^ exponent;
+  kcalc::Multiplication::setParallel(false);
+  kcalc::ComplexNumber sequential = base ^ exponent;
+  kcalc::Multiplication::setParallel(true);
+  kcalc::Multiplication::setThreads(0);
+  ASSERT_TRUE(parallel == sequential);
+}
@@ -2,6 +2,7 @@
 
 #include "Parser.h"
 #include "Exceptions.h"
+#include "SymbolUsage.h"
 
 std::unique_ptr<kcalc::AstObject> testParse(const char * input)
 {
@@ -234,3 +235,62 @@ TEST(ParserTest, Modulo4)
   ASSERT_TRUE(object->equals(*outer.get()));
 } 
 
+
+TEST(ParserTest, SymbolUsage)
+{
+  auto usage = [](const char * input) {
+    return kcalc::SymbolUsage(*testParse(input)); };
+  ASSERT_TRUE(usage("2^10 * (3 - 1i)").independent());
+  kcalc::SymbolUsage expression = usage("x * (y - x) + 1");
+  ASSERT_EQ(std::set<std::string>({"x", "y"}), expression.reads());
+  ASSERT_FALSE(expression.write());
+  kcalc::SymbolUsage assignment = usage("x = x + z");
+  ASSERT_EQ(std::set<std::string>({"x", "z"}), assignment.reads());
+  ASSERT_EQ("x", assignment.write().value());
+  kcalc::SymbolUsage constant = usage("x = 5");
+  ASSERT_TRUE(constant.reads().empty());
+  ASSERT_FALSE(constant.independent());
+}
+
+TEST(ParserTest, BatchDependencies)
+{
+  using Lines = std::vector<unsigned int>;
+  kcalc::BatchDependencies dependencies;
+  auto add = [&dependencies](unsigned int line, const char * input) {
+    return dependencies.add(line, kcalc::SymbolUsage(*testParse(input))); };
+  ASSERT_EQ(Lines(), add(1, "x = 2"));
+  ASSERT_EQ(Lines(), add(2, "y = 3"));
+  ASSERT_EQ(Lines({ 1 }), add(3, "x + 1"));
+  ASSERT_EQ(Lines({ 1, 2 }), add(4, "x * y"));
+  // an assignment waits for the previous one and the lines reading it
+  ASSERT_EQ(Lines({ 1, 3, 4 }), add(5, "x = 7"));
+  // the last writer wins
+  ASSERT_EQ(Lines({ 5 }), add(6, "x - 1"));
+  // reading and reassigning
+  ASSERT_EQ(Lines({ 5, 6 }), add(7, "x = x + 1"));
+  ASSERT_EQ(Lines({ 7 }), add(8, "x"));
+}
+
+TEST(ParserTest, TransitiveBatchDependencies)
+{
+  using Lines = std::vector<unsigned int>;
+  kcalc::BatchDependencies dependencies;
+  auto add = [&dependencies](unsigned int line, const char * input) {
+    return dependencies.add(line, kcalc::SymbolUsage(*testParse(input))); };
+  ASSERT_EQ(Lines(), add(1, "a = b + 1"));
+  // the assignment of a has read b
+  ASSERT_EQ(Lines({ 1 }), add(2, "b = c"));
+  ASSERT_EQ(Lines({ 2 }), add(3, "c = 5"));
+  // a reads c through b as both are defined now
+  ASSERT_EQ(Lines({ 1, 2, 3 }), add(4, "a"));
+  // overwriting c waits for the line that read it through a and b
+  ASSERT_EQ(Lines({ 3, 4 }), add(5, "c = 6"));
+  ASSERT_EQ(Lines({ 1, 2, 5 }), add(6, "2 * a"));
+  // b no longer refers to c
+  ASSERT_EQ(Lines({ 2, 4, 6 }), add(7, "b = 1"));
+  ASSERT_EQ(Lines({ 1, 7 }), add(8, "a"));
+  // finished lines are not waited for
+  dependencies.finishedBefore(8);
+  ASSERT_EQ(Lines(), add(9, "a + b + c"));
+  ASSERT_EQ(Lines({ 8, 9 }), add(10, "a = 0"));
+}
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include "Exceptions.h"
+#include "PreparedExpression.h"
+
+TEST(PreparedExpressionTest, BindAndExecute)
+{
+  using kcalc::ComplexNumber;
+  kcalc::PreparedExpression area = 
+    kcalc::PreparedExpression::prepare("pi * r^2 + (2^10 - 24)");
+  ASSERT_EQ(std::vector<std::string>({"pi", "r"}), area.variables());
+  area.bind("pi", ComplexNumber("3.14")).bind("r", ComplexNumber(2));
+  ASSERT_EQ("25314/25", area.execute().to_string());
+  area.bind("r", ComplexNumber("1i"));
+  ASSERT_EQ("49843/50", area.execute().to_string());
+
+  // copies keep the bindings, but bind independently
+  kcalc::PreparedExpression copy = area;
+  copy.bind("pi", ComplexNumber(3));
+  ASSERT_EQ("997", copy.execute().to_string());
+  ASSERT_EQ("49843/50", area.execute().to_string());
+
+  kcalc::PreparedExpression constant = 
+    kcalc::PreparedExpression::prepare("7 % 4");
+  ASSERT_TRUE(constant.variables().empty());
+  ASSERT_EQ("3", constant.execute().to_string());
+}
+
+TEST(PreparedExpressionTest, Errors)
+{
+  ASSERT_THROW(kcalc::PreparedExpression::prepare("x = 1"),
+      kcalc::PreparedAssignmentException);
+  ASSERT_THROW(kcalc::PreparedExpression::prepare("1 +"),
+      kcalc::IllegalEndOfInput);
+  kcalc::PreparedExpression ratio = 
+    kcalc::PreparedExpression::prepare("a / b");
+  ratio.bind("a", kcalc::ComplexNumber(1));
+  try
+  {
+    ratio.execute();
+    FAIL();
+  }
+  catch (const kcalc::UnboundVariableException& e)
+  {
+    ASSERT_EQ("b", e.name());
+  }
+  ratio.bind("b", kcalc::ComplexNumber(0));
+  ASSERT_THROW(ratio.execute(), kcalc::DivisionByZeroException);
+}
+
+TEST(PreparedExpressionTest, Concurrent)
+{
+  kcalc::PreparedExpression shared = 
+    kcalc::PreparedExpression::prepare("x^3 - 2*x + y");
+  shared.bind("x", kcalc::ComplexNumber(5)).bind("y", kcalc::ComplexNumber(1));
+  std::vector<std::thread> threads;
+  std::vector<char> correct(4, true);
+  for (unsigned int t = 0; t < correct.size(); ++t)
+    threads.emplace_back([&, t]() {
+        kcalc::PreparedExpression own = shared;
+        for (long i = 0; i < 2000; ++i)
+        {
+          own.bind("x", kcalc::ComplexNumber(i + t));
+          long x = i + t;
+          correct[t] = correct[t] && own.execute().to_string() == 
+            std::to_string(x * x * x - 2 * x + 1);
+          correct[t] = correct[t] && 
+            shared.execute().to_string() == "116";
+        } });
+  for (std::thread& thread : threads)
+    thread.join();
+  for (char result : correct)
+    ASSERT_TRUE(result);
+}
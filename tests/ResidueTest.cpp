@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "Exceptions.h"
+#include "Residue.h"
+
+TEST(ResidueTest, Word)
+{
+  kcalc::Modulus seven(7);
+  ASSERT_TRUE(seven.isWord());
+  kcalc::Residue three(3, seven);
+  ASSERT_EQ("3", three.to_string());
+  ASSERT_EQ("4", (-three).to_string());
+  ASSERT_EQ("4", kcalc::Residue(-3, seven).to_string());
+  ASSERT_EQ("2", (three * three).to_string());
+  ASSERT_EQ("5", three.inverse().to_string());
+  ASSERT_TRUE((three / three) == 1);
+  ASSERT_TRUE((three - three) == 0);
+  ASSERT_TRUE((three + kcalc::Residue(4, seven)) == 0);
+  // 1/2 * 10^1 and 5 * 10^-1
+  ASSERT_EQ("5", kcalc::Residue(mpq_class(1, 2), 1, seven).to_string());
+  ASSERT_EQ("4", kcalc::Residue(mpq_class(5), -1, seven).to_string());
+  ASSERT_THROW(three / kcalc::Residue(14, seven),
+      kcalc::DivisionByZeroException);
+  ASSERT_THROW(kcalc::Residue(mpq_class(1, 7), 0, seven),
+      kcalc::DivisionByZeroException);
+}
+
+TEST(ResidueTest, Large)
+{
+  // even and beyond 63 bits
+  kcalc::Modulus two(2);
+  ASSERT_FALSE(two.isWord());
+  ASSERT_EQ("1", kcalc::Residue(mpq_class(3, 5), 0, two).to_string());
+  ASSERT_THROW(kcalc::Residue(1, two) / kcalc::Residue(4, two),
+      kcalc::DivisionByZeroException);
+  // 0.5 is 1/2, not 5/10 with a multiple of 5 in the denominator
+  kcalc::Modulus five(5);
+  ASSERT_EQ("3", kcalc::Residue(mpq_class(5), -1, five).to_string());
+  mpz_class prime("170141183460469231731687303715884105727");
+  kcalc::Modulus mersenne(prime);
+  ASSERT_FALSE(mersenne.isWord());
+  kcalc::Residue minusOne(-1, mersenne);
+  ASSERT_TRUE(minusOne.value() == prime - 1);
+  ASSERT_TRUE((minusOne * minusOne) == 1);
+  ASSERT_TRUE((minusOne.inverse() * minusOne) == 1);
+}
+
+// Montgomery arithmetic agrees with mpz, also for moduli close to 2^63
+TEST(ResidueTest, MatchesMpz)
+{
+  std::mt19937_64 random(46);
+  for (mpz_class prime : { mpz_class(1000000007), 
+      mpz_class("9223372036854775783"), mpz_class("4294967311") })
+  {
+    kcalc::Modulus modulus(prime);
+    ASSERT_TRUE(modulus.isWord());
+    std::uniform_int_distribution<long> values;
+    for (int i = 0; i < 1000; ++i)
+    {
+      long x = values(random), y = values(random) | 1;
+      mpz_class a = mpz_class(x) % prime, b = mpz_class(y) % prime;
+      kcalc::Residue ra(x, modulus), rb(y, modulus);
+      ASSERT_TRUE(ra.value() == a);
+      mpz_class sum = (a + b) % prime, difference = (a - b + prime) % prime,
+                product = (a * b) % prime;
+      ASSERT_TRUE((ra + rb).value() == sum);
+      ASSERT_TRUE((ra - rb).value() == difference);
+      ASSERT_TRUE((ra * rb).value() == product);
+      ASSERT_TRUE((ra / rb * rb).value() == a);
+    }
+  }
+}
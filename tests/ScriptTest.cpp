@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Script.h"
+
+static std::vector<std::string> readAll(kcalc::LineReader& reader)
+{
+  std::vector<std::string> lines;
+  std::string_view line;
+  while (reader.next(line))
+  {
+    lines.emplace_back(line);
+    EXPECT_EQ(lines.size(), reader.lineNumber());
+  }
+  return lines;
+}
+
+TEST(ScriptTest, LinesFromString)
+{
+  kcalc::LineReader reader(std::string_view("a = 1\r\n\nb\nc"));
+  std::vector<std::string> expected{"a = 1", "", "b", "c"};
+  ASSERT_EQ(expected, readAll(reader));
+  std::string_view line;
+  ASSERT_FALSE(reader.next(line));
+
+  kcalc::LineReader empty(std::string_view(""));
+  ASSERT_TRUE(readAll(empty).empty());
+}
+
+TEST(ScriptTest, LinesFromPipe)
+{
+  // lines longer than the read block and many short ones
+  std::string text;
+  std::vector<std::string> expected;
+  expected.push_back(std::string(3 << 20, '7'));
+  for (unsigned int i = 0; i < 100000; ++i)
+    expected.push_back(std::to_string(i) + " * 2");
+  expected.push_back(std::string(1 << 20, '1'));
+  for (const auto& line : expected)
+    text += line + "\n";
+  int fds[2];
+  ASSERT_EQ(0, ::pipe(fds));
+  std::thread writer([&]() {
+      kcalc::OutputBuffer buffer(fds[1]);
+      std::ostream out(&buffer);
+      for (std::size_t i = 0; i < text.size(); i += 4096)
+        out << text.substr(i, 4096);
+      out.flush();
+      ::close(fds[1]); });
+  kcalc::LineReader reader(fds[0]);
+  std::vector<std::string> lines = readAll(reader);
+  writer.join();
+  ::close(fds[0]);
+  ASSERT_EQ(expected.size(), lines.size());
+  ASSERT_TRUE(expected == lines);
+}
+
+TEST(ScriptTest, OutputBuffer)
+{
+  int fds[2];
+  ASSERT_EQ(0, ::pipe(fds));
+  {
+    kcalc::OutputBuffer buffer(fds[1]);
+    std::ostream out(&buffer);
+    out << "1" << '\n' << 23 << "\n";
+  }
+  ::close(fds[1]);
+  char data[16];
+  ssize_t count = ::read(fds[0], data, sizeof(data));
+  ::close(fds[0]);
+  ASSERT_EQ("1\n23\n", std::string(data, count));
+}
+
+TEST(ScriptTest, MappedFile)
+{
+  std::string text = "a,b\n1,2\n";
+  for (unsigned int i = 0; i < 200000; ++i)
+    text += std::to_string(i) + ",7\n";
+  char path[] = "/tmp/kcalc_mapped_XXXXXX";
+  int fd = ::mkstemp(path);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(ssize_t(text.size()), ::write(fd, text.data(), text.size()));
+  ::close(fd);
+  {
+    kcalc::MappedFile file(path);
+    ASSERT_TRUE(text == file.contents());
+  }
+  ::unlink(path);
+  ASSERT_THROW(kcalc::MappedFile file(path), std::system_error);
+
+  // pipes are read instead
+  int fds[2];
+  ASSERT_EQ(0, ::pipe(fds));
+  std::thread writer([&]() {
+      kcalc::OutputBuffer buffer(fds[1]);
+      std::ostream out(&buffer);
+      out << text;
+      out.flush();
+      ::close(fds[1]); });
+  kcalc::MappedFile file("/dev/fd/" + std::to_string(fds[0]));
+  writer.join();
+  ::close(fds[0]);
+  ASSERT_TRUE(text == file.contents());
+}
+
+// lines "vN = k" and "vN + k", evaluated by a map of their own; the 
+// reads print the value assigned last before them in the script
+TEST(ScriptTest, ParallelScriptOrder)
+{
+  std::string script = "# assignments and reads\n\n";
+  std::string expected;
+  std::map<std::string, unsigned int> values;
+  const unsigned int lines = 3000;
+  for (unsigned int k = 3; k < lines; ++k)
+  {
+    std::string name = "v" + std::to_string(k % 5);
+    if (k == lines / 2)
+      script += ":command\n";
+    else if (k % 4 == 0)
+    {
+      script += name + " = " + std::to_string(k) + "\n";
+      values[name] = k;
+    }
+    else if (k % 7 == 0)
+    {
+      script += std::to_string(k) + " * 2\n";
+      expected += std::to_string(2 * k) + "\n";
+    }
+    else
+    {
+      script += name + " + " + std::to_string(k) + "\n";
+      expected += std::to_string(values[name] + k) + "\n";
+    }
+  }
+  script += "v1 + fail\n";
+
+  std::mutex mutex;
+  std::map<std::string, unsigned int> assigned;
+  unsigned int lastEvaluated = 0;
+  auto evaluate = [&](kcalc::BatchLine& line) {
+    const std::string& text = line.text;
+    std::size_t space = text.find(' ');
+    std::string name = text.substr(0, space);
+    if (text.find("fail") != std::string::npos)
+    {
+      line.error = "failed";
+      return;
+    }
+    unsigned int k = std::stoul(text.substr(space + 3));
+    if (text[space + 1] == '=')
+    {
+      // late assignments catch reads that do not wait for them
+      std::this_thread::sleep_for(std::chrono::microseconds(k % 50));
+      std::lock_guard<std::mutex> lock(mutex);
+      assigned[name] = k;
+    }
+    else if (text[space + 1] == '*')
+      line.output = std::to_string(2 * std::stoul(name)) + "\n";
+    else
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      line.output = std::to_string(assigned[name] + k) + "\n";
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    lastEvaluated = std::max(lastEvaluated, line.number);
+  };
+  std::string output;
+  unsigned int commands = 0;
+  auto deliver = [&](kcalc::BatchLine& line) {
+    if (line.command)
+    {
+      ++commands;
+      // nothing after a command runs before it is delivered
+      std::lock_guard<std::mutex> lock(mutex);
+      EXPECT_LT(lastEvaluated, line.number);
+      return true;
+    }
+    output += line.output;
+    return line.error.empty(); };
+
+  kcalc::ThreadPool pool(3);
+  kcalc::ParallelScript parallel(pool, evaluate);
+  kcalc::LineReader reader(script);
+  ASSERT_FALSE(parallel.run(reader, deliver));
+  ASSERT_EQ(1u, commands);
+  ASSERT_TRUE(expected == output);
+}
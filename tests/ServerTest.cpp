@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Allocator.h"
+#include "PreparedExpression.h"
+#include "Server.h"
+
+namespace
+{
+
+// answers with the number of the request on its connection
+class CountingSession : public kcalc::Server::Session
+{
+public:
+  std::string handle(std::string_view request) override
+  {
+    if (request == "fail")
+      throw std::runtime_error("failed\nrequest");
+    return std::to_string(++m_count) + " " + std::string(request);
+  }
+
+private:
+  unsigned int m_count = 0;
+};
+
+// evaluates each request in an arena of its own, as kcalc --serve does
+class EvaluatingSession : public kcalc::Server::Session
+{
+public:
+  std::string handle(std::string_view request) override
+  {
+    kcalc::StatementArena arena;
+    kcalc::ComplexNumber value = 
+      kcalc::PreparedExpression::prepare(request).execute();
+    return value.to_string();
+  }
+};
+
+int connectTo(const std::string& path)
+{
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, path.c_str());
+  EXPECT_EQ(0, ::connect(fd, reinterpret_cast<sockaddr *>(&address),
+        sizeof(address)));
+  return fd;
+}
+
+// sends all of request, then reads until the server closes
+std::string roundTrip(const std::string& path, const std::string& request)
+{
+  int fd = connectTo(path);
+  std::thread writer([fd, &request]() {
+      std::size_t sent = 0;
+      while (sent < request.size())
+      {
+        ssize_t count = ::send(fd, request.data() + sent, 
+            request.size() - sent, MSG_NOSIGNAL);
+        if (count <= 0)
+          break;
+        sent += count;
+      }
+      ::shutdown(fd, SHUT_WR); });
+  std::string response;
+  char buffer[4096];
+  ssize_t count;
+  while ((count = ::recv(fd, buffer, sizeof(buffer), 0)) > 0)
+    response.append(buffer, count);
+  writer.join();
+  ::close(fd);
+  return response;
+}
+
+} /* anonymous namespace */
+
+TEST(ServerTest, OrderedResponses)
+{
+  std::string path = "/tmp/kcalc_server_test_" + std::to_string(::getpid());
+  for (unsigned int workers : { 0u, 2u })
+  {
+    kcalc::ThreadPool pool(workers);
+    kcalc::Server server(path, []() { 
+        return std::make_unique<CountingSession>(); }, pool);
+    std::thread loop([&server]() { server.run(); });
+    ASSERT_EQ("1 a\n2 b\n3\nerror failed request\n4 c\n", 
+        roundTrip(path, "a\nb\r\n\nfail\nc\n"));
+
+    // many more requests than the server queues before it stops 
+    // reading, from several connections at once
+    std::string requests, expected;
+    for (unsigned int i = 1; i <= 20000; ++i)
+    {
+      requests += "x\n";
+      expected += std::to_string(i) + " x\n";
+    }
+    std::vector<std::thread> clients;
+    std::vector<std::string> responses(3);
+    for (unsigned int i = 0; i < responses.size(); ++i)
+      clients.emplace_back([&, i]() { 
+          responses[i] = roundTrip(path, requests); });
+    for (std::thread& client : clients)
+      client.join();
+    for (const std::string& response : responses)
+      ASSERT_TRUE(expected == response);
+
+    std::string statistics = roundTrip(path, ":stats\n");
+    ASSERT_EQ(0u, statistics.find("requests 60005 "));
+    server.stop();
+    loop.join();
+    ASSERT_EQ(60005u, server.latency().count());
+  }
+}
+
+TEST(ServerTest, LatencyHistogram)
+{
+  kcalc::LatencyHistogram histogram;
+  for (unsigned int i = 1; i <= 1000; ++i)
+    histogram.record(i);
+  ASSERT_EQ(1000u, histogram.count());
+  ASSERT_DOUBLE_EQ(500.5, histogram.mean());
+  ASSERT_NEAR(500, histogram.percentile(0.5), 100);
+  ASSERT_NEAR(990, histogram.percentile(0.99), 10);
+  ASSERT_EQ(1000, histogram.max());
+}
+
+TEST(ServerTest, HeavyRequests)
+{
+  // the operands are evaluated in parallel on the pool that serves
+  // the requests, workers waiting for them run tasks of other requests
+  std::string path = "/tmp/kcalc_server_test_" + std::to_string(::getpid());
+  kcalc::ThreadPool& pool = kcalc::ThreadPool::instance();
+  unsigned int workers = pool.workers();
+  pool.resize(3);
+  {
+    kcalc::Server server(path, []() { 
+        return std::make_unique<EvaluatingSession>(); }, pool);
+    std::thread loop([&server]() { server.run(); });
+    std::string request = "(3^2000000 - 3^2000000) + 1\n"
+      "(3^2000000 + 5^1000000) - (5^1000000 + 3^2000000)\n"
+      "7^1000000 * 5^1000000 - 35^1000000\n";
+    std::vector<std::thread> clients;
+    std::vector<std::string> responses(4);
+    for (unsigned int i = 0; i < responses.size(); ++i)
+      clients.emplace_back([&, i]() { 
+          responses[i] = roundTrip(path, request); });
+    for (std::thread& client : clients)
+      client.join();
+    for (const std::string& response : responses)
+      ASSERT_EQ("1\n0\n0\n", response);
+    server.stop();
+    loop.join();
+  }
+  pool.resize(workers);
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+#include "Allocator.h"
+#include "RadixConversion.h"
+#include "ThreadPool.h"
+
+TEST(ThreadPoolTest, RunsAllTasks)
+{
+  for (unsigned int workers : { 0u, 1u, 3u })
+  {
+    kcalc::ThreadPool pool(workers);
+    std::atomic<unsigned int> count{0};
+    kcalc::TaskGroup group(pool);
+    for (unsigned int i = 0; i < 100; ++i)
+      group.run([&count]() { ++count; });
+    group.wait();
+    ASSERT_EQ(100u, count.load());
+  }
+}
+
+static unsigned long fibonacci(kcalc::ThreadPool& pool, unsigned int n)
+{
+  if (n < 2)
+    return n;
+  unsigned long left = 0;
+  kcalc::TaskGroup group(pool);
+  group.run([&]() { left = fibonacci(pool, n - 1); });
+  unsigned long right = fibonacci(pool, n - 2);
+  group.wait();
+  return left + right;
+}
+
+TEST(ThreadPoolTest, NestedGroups)
+{
+  kcalc::ThreadPool pool(2);
+  ASSERT_EQ(6765ul, fibonacci(pool, 20));
+}
+
+TEST(ThreadPoolTest, Exception)
+{
+  for (unsigned int workers : { 0u, 2u })
+  {
+    kcalc::ThreadPool pool(workers);
+    kcalc::TaskGroup group(pool);
+    std::atomic<unsigned int> count{0};
+    for (unsigned int i = 0; i < 10; ++i)
+      group.run([&count, i]() {
+          ++count;
+          if (i == 3)
+            throw std::runtime_error("task"); });
+    ASSERT_THROW(group.wait(), std::runtime_error);
+    ASSERT_EQ(10u, count.load());
+    group.wait();
+  }
+}
+
+TEST(ThreadPoolTest, ParallelRadixConversion)
+{
+  kcalc::ThreadPool pool(3);
+  for (unsigned long exponent : { 1ul, 1000ul, 300000ul, 700001ul })
+  {
+    mpz_class power;
+    mpz_ui_pow_ui(power.get_mpz_t(), 7, exponent);
+    ASSERT_EQ(power.get_str(),
+        kcalc::RadixConversion::toString(power.get_mpz_t(), pool));
+    power -= 1;
+    ASSERT_EQ(power.get_str(),
+        kcalc::RadixConversion::toString(power.get_mpz_t(), pool));
+  }
+  mpz_class round;
+  kcalc::RadixConversion::powerOfTen(round.get_mpz_t(), 400000);
+  ASSERT_EQ(round.get_str(),
+      kcalc::RadixConversion::toString(round.get_mpz_t(), pool));
+}
+
+TEST(ThreadPoolTest, StolenTaskOutsideArena)
+{
+  // a worker evaluating a statement in its arena runs a task of
+  // another statement while it waits, the result must not end up in
+  // the arena
+  kcalc::ThreadPool pool(1);
+  std::atomic<bool> started{false};
+  std::atomic<bool> done{false};
+  bool owned = true;
+  mpz_class power;
+  kcalc::TaskGroup statement(pool);
+  statement.run([&]() {
+      kcalc::StatementArena arena;
+      started = true;
+      while (!pool.runPending())
+        std::this_thread::yield();
+      owned = arena.owns(power.get_mpz_t()->_mp_d);
+      done = true; });
+  while (!started)
+    std::this_thread::yield();
+  kcalc::TaskGroup other(pool);
+  other.run([&power]() { mpz_ui_pow_ui(power.get_mpz_t(), 3, 100000); });
+  while (!done)
+    std::this_thread::yield();
+  statement.wait();
+  other.wait();
+  ASSERT_FALSE(owned);
+  power -= 1;
+  ASSERT_TRUE(mpz_even_p(power.get_mpz_t()));
+}